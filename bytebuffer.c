@@ -18,4 +18,203 @@
  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
- */
\ No newline at end of file
+ */
+
+
+#include "bytebuffer.h"
+#include "liblwgeom_internel.h"
+#include <string.h>
+
+/// @brief Growable buffer, the first BYTEBUFFER_STATICSIZE bytes live in
+/// the struct itself
+void
+bytebuffer_init(bytebuffer_t *b)
+{
+	memset(b, 0, offsetof(bytebuffer_t, buf_static));
+	b->buf_start = b->writecursor = b->buf_static;
+	b->buf_end = b->buf_static + BYTEBUFFER_STATICSIZE;
+}
+
+/// @brief Growable buffer of \a size bytes to begin with
+void
+bytebuffer_init_with_size(bytebuffer_t *b, size_t size)
+{
+	bytebuffer_init(b);
+	if (size > BYTEBUFFER_STATICSIZE)
+	{
+		uint8_t *mem = (uint8_t *)lwmalloc(size);
+		if (!mem)
+		{
+			b->error = LW_TRUE;
+			return;
+		}
+		b->buf_start = b->writecursor = mem;
+		b->buf_end = mem + size;
+	}
+}
+
+/// @brief Buffer over caller memory that never grows, what does not fit is
+/// dropped but still counted by bytebuffer_getlength()
+void
+bytebuffer_init_fixed(bytebuffer_t *b, void *mem, size_t size)
+{
+	memset(b, 0, offsetof(bytebuffer_t, buf_static));
+	b->buf_start = b->writecursor = (uint8_t *)mem;
+	// A NULL buffer only counts, it has no room at all
+	b->buf_end = mem ? b->buf_start + size : b->buf_start;
+	b->fixed = LW_TRUE;
+}
+
+/// @brief Buffer handing its content to \a sink each time it is full, and
+/// on bytebuffer_flush()
+void
+bytebuffer_init_sink(bytebuffer_t *b, int (*sink)(const char *, size_t, void *), void *arg)
+{
+	bytebuffer_init(b);
+	b->sink = sink;
+	b->sink_arg = arg;
+}
+
+/// @brief Buffer of \a size bytes handing its content to \a sink, see
+/// bytebuffer_init_sink()
+void
+bytebuffer_init_sink_with_size(bytebuffer_t *b, size_t size, int (*sink)(const char *, size_t, void *), void *arg)
+{
+	bytebuffer_init_with_size(b, size);
+	b->sink = sink;
+	b->sink_arg = arg;
+}
+
+void
+bytebuffer_destroy_buffer(bytebuffer_t *b)
+{
+	if (!b->fixed && b->buf_start != b->buf_static)
+		lwfree(b->buf_start);
+	b->buf_start = b->writecursor = b->buf_end = NULL;
+}
+
+/// @brief Hand the content to the sink
+/// @return LW_SUCCESS, LW_FAILURE when the sink failed or an earlier write did
+int
+bytebuffer_flush(bytebuffer_t *b)
+{
+	if (b->sink && !b->error && b->writecursor > b->buf_start)
+	{
+		size_t len = (size_t)(b->writecursor - b->buf_start);
+		if (!b->sink((const char *)b->buf_start, len, b->sink_arg))
+			b->error = LW_TRUE;
+		b->flushed += len;
+		b->writecursor = b->buf_start;
+	}
+	return b->error ? LW_FAILURE : LW_SUCCESS;
+}
+
+/// @brief Make room for \a size more contiguous bytes, doubling the capacity
+/// of a growable buffer
+/// @return LW_SUCCESS, LW_FAILURE when out of memory or when a fixed buffer
+/// is full
+int
+bytebuffer_reserve(bytebuffer_t *b, size_t size)
+{
+	if ((size_t)(b->buf_end - b->writecursor) >= size)
+		return LW_SUCCESS;
+	if (b->error || b->fixed)
+		return LW_FAILURE;
+	if (b->sink)
+	{
+		// A sink never grows the buffer, larger writes bypass it
+		bytebuffer_flush(b);
+		return !b->error && (size_t)(b->buf_end - b->writecursor) >= size ? LW_SUCCESS : LW_FAILURE;
+	}
+	size_t len = (size_t)(b->writecursor - b->buf_start);
+	size_t capacity = LWMAX((size_t)(b->buf_end - b->buf_start) * 2, len + size);
+	uint8_t *mem;
+	if (b->buf_start == b->buf_static)
+	{
+		mem = (uint8_t *)lwmalloc(capacity);
+		if (mem)
+			memcpy(mem, b->buf_static, len);
+	}
+	else
+		mem = (uint8_t *)lwrealloc(b->buf_start, capacity);
+	if (!mem)
+	{
+		b->error = LW_TRUE;
+		return LW_FAILURE;
+	}
+	b->buf_start = mem;
+	b->writecursor = mem + len;
+	b->buf_end = mem + capacity;
+	return LW_SUCCESS;
+}
+
+void
+bytebuffer_append(bytebuffer_t *b, const void *data, size_t size)
+{
+	if (bytebuffer_reserve(b, size))
+	{
+		if (size)
+		{
+			memcpy(b->writecursor, data, size);
+			b->writecursor += size;
+		}
+		return;
+	}
+	if (b->sink && !b->error)
+	{
+		// Larger than the whole buffer, straight to the sink
+		if (!b->sink((const char *)data, size, b->sink_arg))
+			b->error = LW_TRUE;
+		b->flushed += size;
+	}
+	else if (b->fixed)
+	{
+		// Fill what is left, count the rest
+		size_t room = (size_t)(b->buf_end - b->writecursor);
+		if (room)
+		{
+			memcpy(b->writecursor, data, room);
+			b->writecursor += room;
+		}
+		b->flushed += size - room;
+	}
+}
+
+void
+bytebuffer_append_string(bytebuffer_t *b, const char *s)
+{
+	bytebuffer_append(b, s, strlen(s));
+}
+
+/// @brief Bytes written so far, flushed ones and the ones that did not fit
+/// a fixed buffer included
+size_t
+bytebuffer_getlength(const bytebuffer_t *b)
+{
+	return b->flushed + (size_t)(b->writecursor - b->buf_start);
+}
+
+/// @brief Content of a growable buffer as a NUL terminated heap string owned
+/// by the caller, the buffer is left empty
+/// @param len receives the length without the NUL, may be NULL
+/// @return the string, NULL when out of memory
+uint8_t *
+bytebuffer_release_buffer(bytebuffer_t *b, size_t *len)
+{
+	bytebuffer_append_byte(b, '\0');
+	if (b->error || b->fixed)
+		return NULL;
+	size_t n = (size_t)(b->writecursor - b->buf_start);
+	uint8_t *mem = b->buf_start;
+	if (mem == b->buf_static)
+	{
+		mem = (uint8_t *)lwmalloc(n);
+		if (!mem)
+			return NULL;
+		memcpy(mem, b->buf_static, n);
+	}
+	if (len)
+		*len = n - 1;
+	bytebuffer_init(b);
+	return mem;
+}
@@ -23,4 +23,47 @@
 #ifndef BYTEBUFFER_H
 #define BYTEBUFFER_H
 
-#endif /* BYTEBUFFER_H */
\ No newline at end of file
+#include <stddef.h>
+#include <stdint.h>
+
+#define BYTEBUFFER_STATICSIZE 1024
+
+/// Output buffer of the writers. It either grows on the heap, fills caller
+/// memory without ever growing (the length past its end is still counted,
+/// like snprintf()), or hands its content to a sink each time it is full.
+typedef struct bytebuffer {
+	uint8_t *buf_start;
+	uint8_t *writecursor;
+	uint8_t *buf_end;
+	size_t flushed;  ///< bytes written before buf_start, sunk or past a fixed buffer
+	int (*sink)(const char *data, size_t len, void *arg);
+	void *sink_arg;
+	int fixed;       ///< caller memory, never grown
+	int error;       ///< out of memory, sink failure or unwritable value, later writes are dropped
+	uint8_t buf_static[BYTEBUFFER_STATICSIZE];
+} bytebuffer_t;
+
+void bytebuffer_init(bytebuffer_t *b);
+void bytebuffer_init_with_size(bytebuffer_t *b, size_t size);
+void bytebuffer_init_fixed(bytebuffer_t *b, void *mem, size_t size);
+void bytebuffer_init_sink(bytebuffer_t *b, int (*sink)(const char *, size_t, void *), void *arg);
+void bytebuffer_init_sink_with_size(bytebuffer_t *b, size_t size, int (*sink)(const char *, size_t, void *), void *arg);
+void bytebuffer_destroy_buffer(bytebuffer_t *b);
+int bytebuffer_reserve(bytebuffer_t *b, size_t size);
+void bytebuffer_append(bytebuffer_t *b, const void *data, size_t size);
+void bytebuffer_append_string(bytebuffer_t *b, const char *s);
+int bytebuffer_flush(bytebuffer_t *b);
+size_t bytebuffer_getlength(const bytebuffer_t *b);
+uint8_t *bytebuffer_release_buffer(bytebuffer_t *b, size_t *len);
+
+/// Append one byte
+static inline void
+bytebuffer_append_byte(bytebuffer_t *b, uint8_t val)
+{
+	if (b->writecursor < b->buf_end || bytebuffer_reserve(b, 1))
+		*b->writecursor++ = val;
+	else
+		bytebuffer_append(b, &val, 1);
+}
+
+#endif /* BYTEBUFFER_H */
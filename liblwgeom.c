@@ -20,17 +20,53 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
 #include <string.h>
 #include <assert.h>
 #include <math.h>
-
-void nv_segment_intersection(const POINT2D p1,
-			     const POINT2D p2,
-			     const POINT2D p3,
-			     const POINT2D p4,
-			     POINT2D *pin,
-			     int *intersection);
+#include <float.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/// Minimum and maximum of a unit-stride array
+static void
+lwgeom__minmax(const double *v, int n, double *vmin, double *vmax)
+{
+	double lo = v[0];
+	double hi = v[0];
+	int i = 0;
+#if defined(__SSE2__)
+	if (n >= 4)
+	{
+		__m128d lo0 = _mm_loadu_pd(v);
+		__m128d lo1 = _mm_loadu_pd(v + 2);
+		__m128d hi0 = lo0;
+		__m128d hi1 = lo1;
+		for (i = 4; i + 4 <= n; i += 4)
+		{
+			__m128d a = _mm_loadu_pd(v + i);
+			__m128d b = _mm_loadu_pd(v + i + 2);
+			lo0 = _mm_min_pd(lo0, a);
+			hi0 = _mm_max_pd(hi0, a);
+			lo1 = _mm_min_pd(lo1, b);
+			hi1 = _mm_max_pd(hi1, b);
+		}
+		double l[2], h[2];
+		_mm_storeu_pd(l, _mm_min_pd(lo0, lo1));
+		_mm_storeu_pd(h, _mm_max_pd(hi0, hi1));
+		lo = LWMIN(l[0], l[1]);
+		hi = LWMAX(h[0], h[1]);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		lo = v[i] < lo ? v[i] : lo;
+		hi = v[i] > hi ? v[i] : hi;
+	}
+	*vmin = lo;
+	*vmax = hi;
+}
 
 LWBOX
 lwgeom__query_envolpe(const double *pp, int npoints, int cdim)
@@ -40,19 +76,145 @@ lwgeom__query_envolpe(const double *pp, int npoints, int cdim)
 	double xmax = pp[0];
 	double ymin = pp[1];
 	double ymax = pp[1];
-
-	for (int i = 1; i < npoints; ++i)
+	int i = 1;
+
+#if defined(__SSE2__)
+	// One (x, y) pair per register, min/max of both ordinates at once. Two
+	// accumulators hide the latency of minpd/maxpd.
+	__m128d lo0 = _mm_loadu_pd(pp);
+	__m128d hi0 = lo0;
+	__m128d lo1 = lo0;
+	__m128d hi1 = lo0;
+	for (; i + 2 <= npoints; i += 2)
+	{
+		__m128d a = _mm_loadu_pd(pp + (ptrdiff_t)i * cdim);
+		__m128d b = _mm_loadu_pd(pp + (ptrdiff_t)(i + 1) * cdim);
+		lo0 = _mm_min_pd(lo0, a);
+		hi0 = _mm_max_pd(hi0, a);
+		lo1 = _mm_min_pd(lo1, b);
+		hi1 = _mm_max_pd(hi1, b);
+	}
+	double l[2], h[2];
+	_mm_storeu_pd(l, _mm_min_pd(lo0, lo1));
+	_mm_storeu_pd(h, _mm_max_pd(hi0, hi1));
+	xmin = l[0];
+	ymin = l[1];
+	xmax = h[0];
+	ymax = h[1];
+#endif
+	for (; i < npoints; ++i)
 	{
-		xmin = pp[i * cdim] > xmin ? xmin : pp[i * cdim];
-		xmax = pp[i * cdim] < xmax ? xmax : pp[i * cdim];
-		ymin = pp[i * cdim + 1] > ymin ? ymin : pp[i * cdim + 1];
-		xmax = pp[i * cdim + 1] < xmax ? xmax : pp[i * cdim + 1];
+		double x = pp[(ptrdiff_t)i * cdim];
+		double y = pp[(ptrdiff_t)i * cdim + 1];
+		xmin = x > xmin ? xmin : x;
+		xmax = x < xmax ? xmax : x;
+		ymin = y > ymin ? ymin : y;
+		ymax = y < ymax ? ymax : y;
 	}
 
 	LWBOX box = {.xmin = xmin, .ymin = ymin, .xmax = xmax, .ymax = ymax, .zmin = 0.0, .zmax = 0.0};
 	return box;
 }
 
+LWBOX
+lwgeom__query_envolpe_soa(const double *xs, const double *ys, int npoints)
+{
+	assert(xs && ys);
+	LWBOX box = {.zmin = 0.0, .zmax = 0.0};
+	lwgeom__minmax(xs, npoints, &box.xmin, &box.xmax);
+	lwgeom__minmax(ys, npoints, &box.ymin, &box.ymax);
+	return box;
+}
+
+/// Envelope of any geometry, an empty geometry gets the inverted
+/// (DBL_MAX, -DBL_MAX) null box. Children boxes are taken from, and left in,
+/// their cache.
+LWBOX
+lwgeom__compute_envelope(const LWGEOM *obj)
+{
+	assert(obj);
+	LWBOX box = {.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX, .zmin = 0.0, .zmax = 0.0};
+	if (obj->ngeoms == 0)
+	{
+		if (obj->npoints == 0)
+			return box;
+		if (LWFLAGS_GET_QUANT(obj->flags))
+			return lwgeom__quant_envelope(obj);
+		if (LWFLAGS_GET_SOA(obj->flags))
+			return lwgeom__query_envolpe_soa(LWGEOM_PP_XS(obj), LWGEOM_PP_YS(obj), (int)obj->npoints);
+		return lwgeom__query_envolpe(obj->pp, (int)obj->npoints, lwgeom_dim_coordinate(obj));
+	}
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		lwgeom__expand_envelope(&box, lwgeom_get_bbox(obj->geoms[i]));
+	return box;
+}
+
+/// @brief Envelope of every feature of a batch. The coordinates of a feature
+/// are contiguous, so each box is a single min/max pass over the column.
+/// Empty features get the inverted (DBL_MAX, -DBL_MAX) null box.
+void
+lwgeom_batch_envelope(const LWGEOM_BATCH *batch, LWBOX *out)
+{
+	assert(batch && out);
+	int cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	for (uint32_t g = 0; g < batch->ngeoms; ++g)
+	{
+		uint32_t start = batch->ring_offsets[batch->part_offsets[batch->geom_offsets[g]]];
+		uint32_t end = batch->ring_offsets[batch->part_offsets[batch->geom_offsets[g + 1]]];
+		if (end == start)
+		{
+			LWBOX null = {.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX};
+			out[g] = null;
+		}
+		else
+			out[g] = lwgeom__query_envolpe(batch->coords + (size_t)start * cdim, (int)(end - start), cdim);
+	}
+}
+
+void
+lwgeom__expand_envelope(LWBOX *box, const LWBOX *sub)
+{
+	box->xmin = LWMIN(box->xmin, sub->xmin);
+	box->ymin = LWMIN(box->ymin, sub->ymin);
+	box->xmax = LWMAX(box->xmax, sub->xmax);
+	box->ymax = LWMAX(box->ymax, sub->ymax);
+}
+
+/// @brief Envelope of \a obj, computed once and cached in obj->env
+/// The cache is filled lazily through a const geometry, so the first call
+/// on a geometry shared between threads has to happen before sharing it,
+/// or be preceded by lwgeom_add_bbox().
+/// @param obj geometry
+/// @return the cached envelope, owned by \a obj
+const LWBOX *
+lwgeom_get_bbox(const LWGEOM *obj)
+{
+	assert(obj);
+	if (!LWFLAGS_GET_BBOX(obj->flags))
+		lwgeom_add_bbox((LWGEOM *)obj);
+	return &obj->env;
+}
+
+/// @brief (Re)compute the cached envelope of \a obj
+void
+lwgeom_add_bbox(LWGEOM *obj)
+{
+	assert(obj);
+	obj->env = lwgeom__compute_envelope(obj);
+	LWFLAGS_SET_BBOX(obj->flags, LW_TRUE);
+}
+
+/// @brief Invalidate the cached envelope of \a obj and its children, to be
+/// called after their coordinates were modified in place
+void
+lwgeom_drop_bbox(LWGEOM *obj)
+{
+	assert(obj);
+	LWFLAGS_SET_BBOX(obj->flags, LW_FALSE);
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		lwgeom_drop_bbox(obj->geoms[i]);
+}
+
 int
 nv__check_single_ring(const double *pp, int npoints, int cdim)
 {
@@ -72,179 +234,591 @@ nv__check_single_ring(const double *pp, int npoints, int cdim)
 double
 lwgeom_get_x(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && obj->pp && i < obj->npoints);
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_get(obj, i, 0);
+	return obj->pp[LWGEOM_PP_INDEX(obj, lwgeom_dim_coordinate(obj), i, 0)];
 }
 
 double
 lwgeom_get_y(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && obj->pp && i < obj->npoints);
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_get(obj, i, 1);
+	return obj->pp[LWGEOM_PP_INDEX(obj, lwgeom_dim_coordinate(obj), i, 1)];
 }
 
 double
 lwgeom_get_z(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && obj->pp && i < obj->npoints);
+	if (!LWFLAGS_GET_Z(obj->flags))
+		return NO_Z_VALUE;
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_get(obj, i, 2);
+	return obj->pp[LWGEOM_PP_INDEX(obj, lwgeom_dim_coordinate(obj), i, 2)];
 }
 
 double
 lwgeom_get_m(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && obj->pp && i < obj->npoints);
+	if (!LWFLAGS_GET_M(obj->flags))
+		return NO_M_VALUE;
+	int cdim = lwgeom_dim_coordinate(obj);
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_get(obj, i, cdim - 1);
+	return obj->pp[LWGEOM_PP_INDEX(obj, cdim, i, cdim - 1)];
+}
+
+/* ---------------------------- coordinate layout --------------------------- */
+
+int
+lwgeom_is_soa(const LWGEOM *obj)
+{
+	assert(obj);
+	return LWFLAGS_GET_SOA(obj->flags) ? LW_TRUE : LW_FALSE;
+}
+
+/// Rewrite pp between the interleaved and the structure-of-arrays layout.
+/// Collections carry the flag of their children. Quantized coordinates are
+/// always interleaved.
+static int
+lwgeom__relayout(LWGEOM *obj, int soa)
+{
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return soa ? LW_FAILURE : LW_SUCCESS;
+
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (!lwgeom__relayout(obj->geoms[i], soa))
+			return LW_FAILURE;
+	}
+
+	if (!LWFLAGS_GET_SOA(obj->flags) == !soa)
+		return LW_SUCCESS;
+
+	// A single point is laid out the same either way
+	if (obj->npoints > 1)
+	{
+		size_t n = obj->npoints;
+		size_t cdim = lwgeom_dim_coordinate(obj);
+		size_t size = n * cdim * sizeof(double);
+		// Borrowed coordinates are never written, the geometry gets its own copy
+		int borrowed = LWFLAGS_GET_BORROWED(obj->flags);
+		double *dst = (double *)(borrowed ? lwgeom__malloc(obj->arena, size, LWGEOM_MEM_COORDS)
+						  : lwmalloc__cat(size, LWGEOM_MEM_COORDS));
+		if (!dst)
+			return LW_FAILURE;
+		for (size_t o = 0; o < cdim; ++o)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				if (soa)
+					dst[o * n + i] = obj->pp[i * cdim + o];
+				else
+					dst[i * cdim + o] = obj->pp[o * n + i];
+			}
+		}
+		if (borrowed)
+		{
+			obj->pp = dst;
+			LWFLAGS_SET_BORROWED(obj->flags, LW_FALSE);
+		}
+		else if (obj->arena)
+		{
+			memcpy(obj->pp, dst, size);
+			lwfree(dst);
+		}
+		else
+		{
+			lwfree(obj->pp);
+			obj->pp = dst;
+		}
+	}
+	LWFLAGS_SET_SOA(obj->flags, soa);
+	return LW_SUCCESS;
+}
+
+/// @brief Store the coordinates of \a obj as separate contiguous x[], y[],
+/// z[] and m[] arrays so that kernels can run over them with unit stride
+/// @param obj geometry, converted in place
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
+int
+lwgeom_to_soa(LWGEOM *obj)
+{
+	assert(obj);
+	return lwgeom__relayout(obj, LW_TRUE);
+}
+
+/// @brief Store the coordinates of \a obj interleaved (x,y[,z][,m])
+/// @param obj geometry, converted in place
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
+int
+lwgeom_to_aos(LWGEOM *obj)
+{
+	assert(obj);
+	return lwgeom__relayout(obj, LW_FALSE);
 }
 
 /* ---------------------------- geometry factory ---------------------------- */
 
 LWGEOM *
-lwgeom_point(const double *pp, int hasz, int hasm)
+lwgeom__new(lwgeom_arena *arena, uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	assert(pp);
-	LWGEOM *obj = (LWGEOM *)lwmalloc(sizeof(LWGEOM));
+	LWGEOM *obj = (LWGEOM *)lwgeom__malloc(arena, sizeof(LWGEOM), LWGEOM_MEM_GEOMETRY);
 	if (!obj)
 		return NULL;
 	memset(obj, 0, sizeof(LWGEOM));
-	obj->type = POINTTYPE;
+	obj->type = type;
+	obj->arena = arena;
+	LWFLAGS_SET_Z(obj->flags, hasz);
+	LWFLAGS_SET_M(obj->flags, hasm);
+	return obj;
+}
+
+/// Append a child to a collection. The capacity of geoms[] is not stored,
+/// it is always the nearest power of two of ngeoms.
+LWGEOM *
+lwgeom__add_child(LWGEOM *mobj, LWGEOM *obj)
+{
+	assert(mobj && obj);
+	// A child has to live as long as its parent
+	if (mobj->arena != obj->arena)
+		return NULL;
+	if (LWFLAGS_GET_Z(mobj->flags) != LWFLAGS_GET_Z(obj->flags) ||
+	    LWFLAGS_GET_M(mobj->flags) != LWFLAGS_GET_M(obj->flags))
+		return NULL;
+
+	uint32_t n = mobj->ngeoms;
+	if ((n & (n - 1)) == 0)
+	{
+		size_t capacity = n ? (size_t)n * 2 : 1;
+		LWGEOM **geoms = (LWGEOM **)lwgeom__realloc(
+		    mobj->arena, mobj->geoms, n * sizeof(LWGEOM *), capacity * sizeof(LWGEOM *), LWGEOM_MEM_GEOMETRY);
+		if (!geoms)
+			return NULL;
+		mobj->geoms = geoms;
+	}
+	mobj->geoms[mobj->ngeoms++] = obj;
+	// A valid parent box only needs to grow by the child box
+	if (LWFLAGS_GET_BBOX(mobj->flags))
+		lwgeom__expand_envelope(&mobj->env, lwgeom_get_bbox(obj));
+	return mobj;
+}
+
+LWGEOM *
+lwgeom_point(const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	return lwgeom_point_arena(NULL, pp, hasz, hasm);
+}
+
+LWGEOM *
+lwgeom_point_arena(lwgeom_arena *arena, const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	assert(pp);
+	LWGEOM *obj = lwgeom__new(arena, POINTTYPE, hasz, hasm);
+	if (!obj)
+		return NULL;
 	obj->npoints = 1;
 	size_t msize = LW_POINTBYTESIZE(hasz, hasm) * sizeof(double);
-	obj->pp = (double *)lwmalloc(msize);
+	obj->pp = (double *)lwgeom__malloc(arena, msize, LWGEOM_MEM_COORDS);
 	if (!obj->pp)
 	{
 		lwgeom_free(obj);
 		return NULL;
 	}
 	memcpy(obj->pp, pp, msize);
-	LWFLAGS_SET_Z(obj->flags, hasz);
-	LWFLAGS_SET_M(obj->flags, hasm);
-
-	obj->geoms = NULL;
 	return obj;
 }
 
 LWGEOM *
 lwgeom_line(uint32_t npoints, const double *points, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom_line_arena(NULL, npoints, points, hasz, hasm);
 }
+
+LWGEOM *
+lwgeom_line_arena(lwgeom_arena *arena, uint32_t npoints, const double *points, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	assert(points || npoints == 0);
+	LWGEOM *obj = lwgeom__new(arena, LINETYPE, hasz, hasm);
+	if (!obj)
+		return NULL;
+	if (npoints == 0)
+		return obj;
+
+	size_t msize = (size_t)npoints * LW_POINTBYTESIZE(hasz, hasm) * sizeof(double);
+	obj->pp = (double *)lwgeom__malloc(arena, msize, LWGEOM_MEM_COORDS);
+	if (!obj->pp)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	memcpy(obj->pp, points, msize);
+	obj->npoints = npoints;
+	return obj;
+}
+
+/// Point or line geometry borrowing \a pp, the header alone is allocated
+LWGEOM *
+lwgeom__wrap(lwgeom_arena *arena, uint8_t type, uint32_t npoints, const double *pp, int hasz, int hasm)
+{
+	assert(pp || npoints == 0);
+	LWGEOM *obj = lwgeom__new(arena, type, hasz, hasm);
+	if (!obj)
+		return NULL;
+	obj->npoints = npoints;
+	obj->pp = (double *)pp;
+	LWFLAGS_SET_BORROWED(obj->flags, LW_TRUE);
+	return obj;
+}
+
+/// @brief Create a point borrowing the caller's coordinate
+/// @param pp coordinate, must outlive the point
+/// @param hasz has z
+/// @param hasm has m
+/// @return the point, lwgeom_free() releases the header only
+LWGEOM *
+lwgeom_point_wrap(const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	assert(pp);
+	return lwgeom__wrap(NULL, POINTTYPE, 1, pp, hasz, hasm);
+}
+
+/// @brief Create a line borrowing the caller's interleaved coordinates, e.g.
+/// a column buffer or mmap'd data
+/// @param npoints number of points
+/// @param pp npoints * (2 + hasz + hasm) doubles, must outlive the line
+/// @param hasz has z
+/// @param hasm has m
+/// @return the line, lwgeom_free() releases the header only
+LWGEOM *
+lwgeom_line_wrap(uint32_t npoints, const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	return lwgeom__wrap(NULL, LINETYPE, npoints, pp, hasz, hasm);
+}
+
 LWGEOM *
 lwgeom_poly(const LWGEOM *shell, uint32_t nholes, const LWGEOM **holes)
 {
-	return NULL;
+	return lwgeom_poly_arena(NULL, shell, nholes, holes);
+}
+
+/// @brief Create a polygon, the rings are copied into the new geometry
+/// @param arena owning arena or NULL
+/// @param shell exterior ring, a line geometry
+/// @param nholes number of interior rings
+/// @param holes interior rings, line geometries
+/// @return polygon whose geoms[] are the rings, shell first
+LWGEOM *
+lwgeom_poly_arena(lwgeom_arena *arena, const LWGEOM *shell, uint32_t nholes, const LWGEOM **holes)
+{
+	assert(shell && shell->type == LINETYPE);
+	assert(holes || nholes == 0);
+	LWBOOLEAN hasz = LWFLAGS_GET_Z(shell->flags) ? LW_TRUE : LW_FALSE;
+	LWBOOLEAN hasm = LWFLAGS_GET_M(shell->flags) ? LW_TRUE : LW_FALSE;
+	LWGEOM *obj = lwgeom__new(arena, POLYTYPE, hasz, hasm);
+	if (!obj)
+		return NULL;
+
+	obj->geoms =
+	    (LWGEOM **)lwgeom__malloc(arena, lw_nearest_pow(nholes + 1) * sizeof(LWGEOM *), LWGEOM_MEM_GEOMETRY);
+	if (!obj->geoms)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	for (uint32_t i = 0; i <= nholes; ++i)
+	{
+		const LWGEOM *ring = i == 0 ? shell : holes[i - 1];
+		assert(ring && ring->type == LINETYPE);
+		LWGEOM *sub;
+		if (LWFLAGS_GET_QUANT(ring->flags))
+			sub = lwgeom__quant_line(
+			    arena, ring->quant, LINETYPE, ring->npoints, LWGEOM_PP_Q(ring), hasz, hasm);
+		else
+			sub = lwgeom_line_arena(arena, ring->npoints, ring->pp, hasz, hasm);
+		if (!sub)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		LWFLAGS_SET_SOA(sub->flags, LWFLAGS_GET_SOA(ring->flags));
+		if (i == 0)
+			LWFLAGS_SET_SHELL_RING(sub->flags, LW_TRUE);
+		else
+			LWFLAGS_SET_HOLE_RING(sub->flags, LW_TRUE);
+		obj->geoms[obj->ngeoms++] = sub;
+	}
+	return obj;
+}
+
+/// Polygon built from \a nrings line geometries whose ownership is taken over,
+/// the rings array itself stays with the caller. On failure nothing is freed.
+LWGEOM *
+lwgeom__poly_from_rings(lwgeom_arena *arena, uint32_t nrings, LWGEOM **rings)
+{
+	assert(rings && nrings > 0);
+	LWGEOM *obj = lwgeom__new(arena, POLYTYPE, lwgeom_has_z(rings[0]), lwgeom_has_m(rings[0]));
+	if (!obj)
+		return NULL;
+	obj->geoms = (LWGEOM **)lwgeom__malloc(arena, lw_nearest_pow(nrings) * sizeof(LWGEOM *), LWGEOM_MEM_GEOMETRY);
+	if (!obj->geoms)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < nrings; ++i)
+	{
+		assert(rings[i]->type == LINETYPE && rings[i]->arena == arena);
+		if (i == 0)
+			LWFLAGS_SET_SHELL_RING(rings[i]->flags, LW_TRUE);
+		else
+			LWFLAGS_SET_HOLE_RING(rings[i]->flags, LW_TRUE);
+		obj->geoms[i] = rings[i];
+	}
+	obj->ngeoms = nrings;
+	return obj;
 }
 
 LWGEOM *
 lwgeom_create_empty_mpoint(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom_create_empty_collection_arena(NULL, MPOINTTYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_mline(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom_create_empty_collection_arena(NULL, MLINETYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_mpoly(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom_create_empty_collection_arena(NULL, MPOLYTYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_collection(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom_create_empty_collection_arena(NULL, type, hasz, hasm);
 }
 
 LWGEOM *
-lwgeom_create_empty_collection2(uint8_t type, uint32_t ngeoms, LWGEOM *geoms)
+lwgeom_create_empty_collection_arena(lwgeom_arena *arena, uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	if (type < MPOINTTYPE || type > COLLECTIONTYPE)
+		return NULL;
+	return lwgeom__new(arena, type, hasz, hasm);
+}
+
+/// @brief Create a collection owning \a ngeoms existing geometries
+/// @param type collection type
+/// @param ngeoms number of geometries
+/// @param geoms geometries, the collection takes over their ownership
+/// @return the collection, NULL when the children do not fit the type
+LWGEOM *
+lwgeom_create_empty_collection2(uint8_t type, uint32_t ngeoms, LWGEOM **geoms)
+{
+	assert(geoms || ngeoms == 0);
+	LWBOOLEAN hasz = ngeoms && LWFLAGS_GET_Z(geoms[0]->flags) ? LW_TRUE : LW_FALSE;
+	LWBOOLEAN hasm = ngeoms && LWFLAGS_GET_M(geoms[0]->flags) ? LW_TRUE : LW_FALSE;
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(ngeoms ? geoms[0]->arena : NULL, type, hasz, hasm);
+	if (!mobj)
+		return NULL;
+	for (uint32_t i = 0; i < ngeoms; ++i)
+	{
+		if (type != COLLECTIONTYPE && geoms[i]->type != type - 3)
+			break;
+		if (!lwgeom__add_child(mobj, geoms[i]))
+			break;
+	}
+	if (mobj->ngeoms != ngeoms)
+	{
+		// Hand the children back to the caller
+		mobj->ngeoms = 0;
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
 }
 
 LWGEOM *
 lwgeom_mpoint_add_point(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (mobj->type != MPOINTTYPE || obj->type != POINTTYPE)
+		return NULL;
+	return lwgeom__add_child(mobj, obj);
 }
 
 LWGEOM *
 lwgeom_mline_add_line(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (mobj->type != MLINETYPE || obj->type != LINETYPE)
+		return NULL;
+	return lwgeom__add_child(mobj, obj);
 }
 
 LWGEOM *
 lwgeom_mpoly_add_poly(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (mobj->type != MPOLYTYPE || obj->type != POLYTYPE)
+		return NULL;
+	return lwgeom__add_child(mobj, obj);
 }
+
 LWGEOM *
 lwgeom_collection_add_geom(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (mobj->type != COLLECTIONTYPE)
+		return NULL;
+	return lwgeom__add_child(mobj, obj);
 }
 
 int
 lwgeom_has_z(const LWGEOM *obj)
 {
-	return 0;
+	assert(obj);
+	return LWFLAGS_GET_Z(obj->flags) ? LW_TRUE : LW_FALSE;
 }
 
 int
 lwgeom_has_m(const LWGEOM *obj)
 {
-	return 0;
+	assert(obj);
+	return LWFLAGS_GET_M(obj->flags) ? LW_TRUE : LW_FALSE;
 }
 
 int
 lwgeom_dim_coordinate(const LWGEOM *obj)
 {
-	return 0;
+	assert(obj);
+	return LW_POINTBYTESIZE(LWFLAGS_GET_Z(obj->flags), LWFLAGS_GET_M(obj->flags));
 }
 
 int
 lwgeom_dim_geometry(const LWGEOM *obj)
 {
+	assert(obj);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case MPOINTTYPE:
+		return 0;
+	case LINETYPE:
+	case MLINETYPE:
+		return 1;
+	case POLYTYPE:
+	case MPOLYTYPE:
+		return 2;
+	case COLLECTIONTYPE: {
+		int dim = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+			dim = LWMAX(dim, lwgeom_dim_geometry(obj->geoms[i]));
+		return dim;
+	}
+	}
 	return 0;
 }
 
 int
 lwgeom_children_count(const LWGEOM *obj)
 {
-	return 0;
+	assert(obj);
+	return (int)obj->ngeoms;
 }
+
 LWGEOM *
 lwgeom_child_at(const LWGEOM *obj, int i)
 {
-	return NULL;
+	assert(obj);
+	if (i < 0 || (uint32_t)i >= obj->ngeoms)
+		return NULL;
+	return obj->geoms[i];
 }
 
 int
 lwgeom_points_count(const LWGEOM *obj)
 {
-	return 0;
+	assert(obj);
+	if (obj->ngeoms == 0)
+		return (int)obj->npoints;
+	int n = 0;
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		n += lwgeom_points_count(obj->geoms[i]);
+	return n;
 }
 
+/// @brief Bytes held by \a obj and its children
+/// Headers, coordinate buffers and child arrays are counted at their
+/// allocated size, borrowed coordinates are not, since the geometry does
+/// not own them.
+/// @param obj geometry
+/// @return number of bytes
+size_t
+lwgeom_memsize(const LWGEOM *obj)
+{
+	assert(obj);
+	size_t size = sizeof(LWGEOM);
+	size_t osize = LWFLAGS_GET_QUANT(obj->flags) ? sizeof(int32_t) : sizeof(double);
+	if (obj->pp && !LWFLAGS_GET_BORROWED(obj->flags))
+		size += (size_t)obj->npoints * lwgeom_dim_coordinate(obj) * osize;
+	if (obj->ngeoms)
+		size += lw_nearest_pow(obj->ngeoms) * sizeof(LWGEOM *);
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		size += lwgeom_memsize(obj->geoms[i]);
+	return size;
+}
+
+/// @brief Copy the coordinate of the \a n th point of a point or line
+/// @param obj point or line geometry
+/// @param n point index
+/// @param point receives lwgeom_dim_coordinate() doubles
+/// @return LW_SUCCESS or LW_FAILURE when \a n is out of range
 int
 lwgeom_point_at(const LWGEOM *obj, int n, double *point)
 {
-	return 0;
+	assert(obj && point);
+	if (n < 0 || (uint32_t)n >= obj->npoints)
+		return LW_FAILURE;
+	int cdim = lwgeom_dim_coordinate(obj);
+	if (LWFLAGS_GET_QUANT(obj->flags))
+	{
+		for (int o = 0; o < cdim; ++o)
+			point[o] = lwgeom__quant_get(obj, (uint32_t)n, o);
+		return LW_SUCCESS;
+	}
+	if (!LWFLAGS_GET_SOA(obj->flags))
+	{
+		memcpy(point, obj->pp + (size_t)n * cdim, cdim * sizeof(double));
+		return LW_SUCCESS;
+	}
+	for (int o = 0; o < cdim; ++o)
+		point[o] = obj->pp[LWGEOM_PP_INDEX(obj, cdim, n, o)];
+	return LW_SUCCESS;
 }
 
+/// Coordinate buffer of a point or line, NULL when it is quantized
 double *
 lwgeom_points(const LWGEOM *obj)
 {
-	return NULL;
+	assert(obj);
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return NULL;
+	return obj->pp;
 }
 
 void
 lwgeom__free(LWGEOM *g)
 {
 	assert(g);
-	if (g->flags != 0)
-	{
+	if (g->pp && !LWFLAGS_GET_BORROWED(g->flags))
 		lwfree(g->pp);
-	}
+	if (g->geoms)
+		lwfree(g->geoms);
 	lwfree(g);
 }
 
@@ -253,41 +827,119 @@ lwgeom__free(LWGEOM *g)
 /// @return
 void
 lwgeom_free(LWGEOM *obj)
+{
+	if (obj == NULL)
+		return;
+	// Arena geometries are released together with their arena
+	if (obj->arena)
+		return;
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		lwgeom_free(obj->geoms[i]);
+	}
+	lwgeom__free(obj);
+}
+
+/// @brief Deep copy of a geometry, whatever its coordinate layout
+/// @param obj geometry to copy, may live in an arena or borrow its coordinates
+/// @return a copy owning its header, children and coordinates, lwgeom_free()
+/// releases it. The LWQUANT of a quantized geometry is shared, not copied.
+LWGEOM *
+lwgeom_clone(const LWGEOM *obj)
 {
 	assert(obj);
-	if (obj->ngeoms == 1)
+	LWGEOM *clone = lwgeom__new(NULL, obj->type, LW_FALSE, LW_FALSE);
+	if (!clone)
+		return NULL;
+	clone->env = obj->env;
+	clone->flags = obj->flags;
+	LWFLAGS_SET_BORROWED(clone->flags, LW_FALSE);
+	clone->quant = obj->quant;
+
+	if (obj->npoints)
 	{
-		lwgeom__free(obj);
+		size_t psize = LWFLAGS_GET_QUANT(obj->flags) ? sizeof(int32_t) : sizeof(double);
+		size_t msize = (size_t)obj->npoints *
+			       LW_POINTBYTESIZE(LWFLAGS_GET_Z(obj->flags), LWFLAGS_GET_M(obj->flags)) * psize;
+		clone->pp = (double *)lwmalloc__cat(msize, LWGEOM_MEM_COORDS);
+		if (!clone->pp)
+		{
+			lwgeom_free(clone);
+			return NULL;
+		}
+		memcpy(clone->pp, obj->pp, msize);
+		clone->npoints = obj->npoints;
 	}
-	else
+
+	if (obj->ngeoms)
 	{
-		for (int i = 0; i < obj->ngeoms; ++i)
+		clone->geoms = (LWGEOM **)lwmalloc__cat(lw_nearest_pow(obj->ngeoms) * sizeof(LWGEOM *),
+							 LWGEOM_MEM_GEOMETRY);
+		if (!clone->geoms)
+		{
+			lwgeom_free(clone);
+			return NULL;
+		}
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
 		{
-			LWGEOM *sub = obj->geoms[i];
-			if (sub == NULL)
-				continue;
-			lwgeom__free(sub);
+			LWGEOM *sub = lwgeom_clone(obj->geoms[i]);
+			if (!sub)
+			{
+				lwgeom_free(clone);
+				return NULL;
+			}
+			clone->geoms[clone->ngeoms++] = sub;
 		}
 	}
+	return clone;
 }
-/* -------------------------------- tolerance ------------------------------- */
 
-static double g_tolerance = 0.0001;
+/// Feature owning \a geom, with \a nspans ints of spans into a copy of \a text
+LW_SGO *
+lwgeom__sgo_new(LWGEOM *geom, const int *spans, size_t nspans, const char *text, size_t len)
+{
+	LW_SGO *sgo = (LW_SGO *)lwmalloc__cat(sizeof(LW_SGO) + nspans * sizeof(int) + len + 1, LWGEOM_MEM_GEOMETRY);
+	if (!sgo)
+		return NULL;
+	sgo->geom = geom;
+	sgo->prop_size = nspans;
+	if (nspans)
+		memcpy(sgo->properties, spans, nspans * sizeof(int));
+	char *copy = (char *)(sgo->properties + nspans);
+	if (len)
+		memcpy(copy, text, len);
+	copy[len] = '\0';
+	return sgo;
+}
 
-/// Set the tolerance used in geometric operations. This interface returns the
-/// tolerance currently in use.
-double
-nv_tolerance(double tol)
+/// @brief Properties text of \a sgo, stored after its spans, see LW_SGO
+const char *
+lwgeom_sgo_text(const LW_SGO *sgo)
 {
-	double tmp = g_tolerance;
-	g_tolerance = tol;
-	return tmp;
+	assert(sgo);
+	return (const char *)(sgo->properties + sgo->prop_size);
 }
 
-double
-tolerence()
+/// @brief free a feature and its geometry
+void
+lwgeom_sgo_free(LW_SGO *sgo)
+{
+	if (sgo == NULL)
+		return;
+	lwgeom_free(sgo->geom);
+	lwfree(sgo);
+}
+
+/// @brief free the features of \a reader and rewind it, keeping its array
+/// for the next features
+void
+lwgeom_reader2_reset(LWGEOMREADER2 *reader)
 {
-	return g_tolerance;
+	assert(reader);
+	for (size_t i = 0; i < reader->nsgo; ++i)
+		lwgeom_sgo_free(reader->sgos[i]);
+	reader->nsgo = 0;
+	reader->cur_index = 0;
 }
 
 /* --------------------------- geometry algorithm --------------------------- */
@@ -438,7 +1090,7 @@ nv__line_intersection(double p1x, double p1y, POINT2D v1, double p2x, double p2y
 /// @param p the point to compute the angle for
 /// @return the angle of the point
 double
-nv_angle(const POINT2D p0)
+lwpoint_angle(const POINT2D p0)
 {
 	return atan2(p0.y, p0.x);
 }
@@ -449,7 +1101,7 @@ nv_angle(const POINT2D p0)
 /// @param p1 the second point
 /// @return the angle of the vector from p0 to p1
 double
-nv_angle2(const POINT2D p0, const POINT2D p1)
+lwpoint_angle2(const POINT2D p0, const POINT2D p1)
 {
 	double dx = p1.x - p0.x;
 	double dy = p1.y - p0.y;
@@ -462,7 +1114,7 @@ nv_angle2(const POINT2D p0, const POINT2D p1)
 /// @param p2 the third point
 /// @return LW_TRUE if the angle is acute
 int
-nv_acute(const POINT2D p0, const POINT2D p1, const POINT2D p2)
+lwpoint_acute(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 {
 	double dx0 = p0.x - p1.x;
 	double dy0 = p0.y - p1.y;
@@ -478,7 +1130,7 @@ nv_acute(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 /// @param p2 the third point
 /// @return LW_TRUE if the angle is obtuse
 int
-nv_obtuse(const POINT2D p0, const POINT2D p1, const POINT2D p2)
+lwpoint_obtuse(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 {
 	double dx0 = p0.x - p1.x;
 	double dy0 = p0.y - p1.y;
@@ -494,10 +1146,10 @@ nv_obtuse(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 /// @param tip2 the second tip point
 /// @return the unoriented smallest angle between two vectors
 double
-nv_angle_between(const POINT2D tip1, const POINT2D tail, const POINT2D tip2)
+lwpoint_angle_between(const POINT2D tip1, const POINT2D tail, const POINT2D tip2)
 {
-	double a1 = nv_angle2(tail, tip1);
-	double a2 = nv_angle2(tail, tip2);
+	double a1 = lwpoint_angle2(tail, tip1);
+	double a2 = lwpoint_angle2(tail, tip2);
 
 	return nv__diff(a1, a2);
 }
@@ -508,10 +1160,10 @@ nv_angle_between(const POINT2D tip1, const POINT2D tail, const POINT2D tip2)
 /// @param p2 the third point
 /// @return the interior angle between two segments of a ring
 double
-nv_interior_angle(const POINT2D p0, const POINT2D p1, const POINT2D p2)
+lwpoint_interior_angle(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 {
-	double angle_prev = nv_angle2(p1, p0);
-	double angle_next = nv_angle2(p1, p2);
+	double angle_prev = lwpoint_angle2(p1, p0);
+	double angle_next = lwpoint_angle2(p1, p2);
 	return nv__normalize_positive(angle_next - angle_prev);
 }
 
@@ -525,13 +1177,13 @@ nv_interior_angle(const POINT2D p0, const POINT2D p1, const POINT2D p2)
 /// @param angle
 /// @return
 int
-nv_angle_bisector(const POINT2D A, const POINT2D B, const POINT2D C, const POINT2D D, POINT2D *p, double *angle)
+lwpoint_angle_bisector(const POINT2D A, const POINT2D B, const POINT2D C, const POINT2D D, POINT2D *p, double *angle)
 {
 
 	*angle = (nv__azimuth(A, B) + nv__azimuth(C, D)) / 2.0;
 
 	int intersection = LW_FALSE;
-	nv_segment_intersection(A, B, C, D, p, &intersection);
+	lwsegment_intersection(A, B, C, D, p, &intersection);
 	return intersection;
 }
 
@@ -541,7 +1193,7 @@ nv_angle_bisector(const POINT2D A, const POINT2D B, const POINT2D C, const POINT
 /// @param B another point of the line (must be different to A)
 /// @return the distance from p to line segment AB
 double
-nv_dis_point_to_segment(const POINT2D p, const POINT2D A, const POINT2D B)
+lwsegment_dis_point_to_segment(const POINT2D p, const POINT2D A, const POINT2D B)
 {
 	if (LW_DOUBLE_NEARES2(A.x, B.x) && LW_DOUBLE_NEARES2(A.y, B.y))
 	{
@@ -597,7 +1249,7 @@ nv_dis_point_to_segment(const POINT2D p, const POINT2D A, const POINT2D B)
 /// @param B another point of the line (must be different to A)
 /// @return the distance from p to line segment AB
 double
-nv_dis_point_to_perpendicular(const POINT2D p, const POINT2D A, const POINT2D B)
+lwsegment_dis_point_to_perpendicular(const POINT2D p, const POINT2D A, const POINT2D B)
 {
 	/*
 		    (Ay-Cy)(Bx-Ax)-(Ax-Cx)(By-Ay)
@@ -613,12 +1265,12 @@ nv_dis_point_to_perpendicular(const POINT2D p, const POINT2D A, const POINT2D B)
 }
 
 void
-nv_segment_intersection(const POINT2D p1,
-			const POINT2D p2,
-			const POINT2D p3,
-			const POINT2D p4,
-			POINT2D *pin,
-			int *intersection)
+lwsegment_intersection(const POINT2D p1,
+		       const POINT2D p2,
+		       const POINT2D p3,
+		       const POINT2D p4,
+		       POINT2D *pin,
+		       int *intersection)
 {
 	*intersection = LW_FALSE;
 	double vl = LW_POINTDISTANCE2(p1, p2);
@@ -31,6 +31,8 @@ extern "C" {
 #include <stddef.h>
 #include <stdarg.h>
 
+#include "mapsettings.h"
+
 /**
  * Return types for functions with status returns.
  */
@@ -81,6 +83,26 @@ extern void lwgeom_set_handlers(lwallocator allocator,
 
 extern void lwgeom_set_debuglogger(lwdebuglogger debuglogger);
 
+/******************************************************************
+ * lwgeom_ctx.
+ * Allocator, reporters and tolerance of the calling thread. A thread
+ * without a context, or a NULL member, falls back to the global handlers
+ * installed by lwgeom_set_handlers(). Memory has to be released under
+ * the context it was allocated with.
+ */
+typedef struct {
+	lwallocator allocator;
+	lwreallocator reallocator;
+	lwfreeor freeor;
+	lwreporter errorreporter;
+	lwreporter noticereporter;
+	double tolerance;
+} lwgeom_ctx;
+
+extern void lwgeom_ctx_init(lwgeom_ctx *ctx);
+extern lwgeom_ctx *lwgeom_ctx_set(lwgeom_ctx *ctx);
+extern lwgeom_ctx *lwgeom_ctx_get(void);
+
 /* Memory management */
 void *lwcalloc(size_t count, size_t size);
 void *lwmalloc0(size_t size);
@@ -89,7 +111,89 @@ void lwfree(void *mem);
 void *lwrealloc(void *mem, size_t size);
 
 /******************************************************************
- * LWGEOM Global tolerance
+ * LWGEOM arena.
+ * A bump allocator for batches of short-lived geometries. Every header,
+ * coordinate buffer and child array of a geometry built through an
+ * arena comes from the arena, lwgeom_free() on such a geometry does
+ * nothing, and lwgeom_arena_free() releases the whole batch at once.
+ */
+typedef struct lwgeom_arena lwgeom_arena;
+
+extern lwgeom_arena *lwgeom_arena_new(size_t block_size);
+extern void *lwgeom_arena_alloc(lwgeom_arena *arena, size_t size);
+extern void lwgeom_arena_reset(lwgeom_arena *arena);
+extern void lwgeom_arena_free(lwgeom_arena *arena);
+
+/******************************************************************
+ * LWGEOM pool allocator.
+ * Optional size-class allocator for the many small blocks the library
+ * makes (LWGEOM headers, point buffers, rtree nodes). Blocks come from
+ * per-thread caches backed by shared slabs, anything larger than the
+ * biggest class goes to malloc. Install it with lwgeom_pool_install()
+ * before the first allocation.
+ */
+#define LWGEOM_POOL_MAX_CLASSES 32
+
+typedef struct {
+	size_t size;          ///< block size, header included
+	uint64_t allocs;      ///< blocks handed out
+	uint64_t frees;       ///< blocks given back
+	uint64_t cache_hits;  ///< allocations served by a thread cache
+	uint64_t slab_blocks; ///< blocks carved from slabs
+} lwgeom_pool_class_stats;
+
+typedef struct {
+	uint32_t nclasses;
+	lwgeom_pool_class_stats classes[LWGEOM_POOL_MAX_CLASSES];
+	uint64_t large_allocs; ///< allocations passed to malloc
+	uint64_t large_frees;
+	size_t slab_bytes;     ///< bytes held by slabs
+} lwgeom_pool_stats;
+
+extern void *lwgeom_pool_malloc(size_t size);
+extern void *lwgeom_pool_realloc(void *mem, size_t size);
+extern void lwgeom_pool_free(void *mem);
+extern void lwgeom_pool_install(void);
+extern void lwgeom_pool_thread_flush(void);
+extern void lwgeom_pool_stats_get(lwgeom_pool_stats *stats);
+
+/******************************************************************
+ * LWGEOM memory accounting.
+ * When the library is built with LWGEOM_MEMORY_ACCOUNTING, every block
+ * allocated through lwmalloc is tagged with its size and category, and
+ * the counters below are maintained. Otherwise lwgeom_mem_stats_get()
+ * reports LW_FAILURE.
+ */
+typedef enum {
+	LWGEOM_MEM_OTHER = 0,
+	LWGEOM_MEM_GEOMETRY, ///< LWGEOM headers and child arrays
+	LWGEOM_MEM_COORDS,   ///< coordinate buffers
+	LWGEOM_MEM_INDEX,    ///< rtree nodes
+	LWGEOM_MEM_PARSER,   ///< parser scratch
+	LWGEOM_MEM_ARENA,    ///< arena blocks
+	LWGEOM_MEM_NCATEGORIES
+} lwgeom_mem_category;
+
+typedef struct {
+	size_t live_bytes; ///< bytes currently allocated
+	size_t live_count; ///< blocks currently allocated
+	uint64_t allocs;   ///< allocations since the last reset
+} lwgeom_mem_category_stats;
+
+typedef struct {
+	size_t live_bytes;
+	size_t peak_bytes; ///< highest live_bytes since the last reset
+	uint64_t allocs;
+	uint64_t frees;
+	lwgeom_mem_category_stats categories[LWGEOM_MEM_NCATEGORIES];
+} lwgeom_mem_stats;
+
+extern int lwgeom_mem_stats_get(lwgeom_mem_stats *stats);
+extern void lwgeom_mem_stats_reset(void);
+extern const char *lwgeom_mem_category_name(lwgeom_mem_category cat);
+
+/******************************************************************
+ * LWGEOM tolerance, per thread when a lwgeom_ctx is installed
  */
 extern double lwtolerance(double tol);
 extern double lwtolerance2();
@@ -133,19 +237,33 @@ typedef struct {
 	double zmax;
 } LWBOX;
 
+/******************************************************************
+ * LWQUANT structure.
+ * Scale and offset of quantized coordinates, ordinate o of a point is
+ * offset[o] + scale[o] * q with q the stored int32. One LWQUANT is
+ * usually shared by a whole batch, it is owned by the caller and has to
+ * outlive the geometries using it.
+ */
+typedef struct {
+	double scale[4];  ///< x, y, z, m
+	double offset[4]; ///< x, y, z, m
+} LWQUANT;
+
 /******************************************************************
  * LWGEOM structure.
  */
 typedef struct LWGEOM LWGEOM; /* forward declaration */
 
 struct LWGEOM {
-	LWBOX env;        ///< geometry envelope
-	uint8_t type;     ///< geometry type
-	uint32_t npoints; ///< number of points
-	double *pp;       ///< point pointer
-	uint16_t flags;   ///< flags
-	uint32_t ngeoms;  ///< number of geometries
-	LWGEOM **geoms;   ///< multi objects pointer
+	LWBOX env;            ///< geometry envelope, valid when LW_FLAG_BBOX is set
+	uint8_t type;         ///< geometry type
+	uint32_t npoints;     ///< number of points
+	double *pp;           ///< point pointer
+	uint16_t flags;       ///< flags
+	uint32_t ngeoms;      ///< number of geometries
+	LWGEOM **geoms;       ///< multi objects pointer
+	lwgeom_arena *arena;  ///< owning arena, NULL when allocated by lwmalloc
+	const LWQUANT *quant; ///< decoding of pp when LW_FLAG_QUANT is set
 };
 
 /******************************************************************
@@ -161,9 +279,16 @@ typedef struct {
 	double *sdo_ordinates;
 } LWGEOM_SDO;
 
+/******************************************************************
+ * LW_SGO structure.
+ * A feature, its geometry and its properties. Readers of text formats
+ * store the raw properties text after the properties array, see
+ * lwgeom_sgo_text(), and fill properties with 4 ints per member: offset
+ * and length of the key, without quotes, then of the raw value.
+ */
 typedef struct {
 	LWGEOM *geom;
-	size_t prop_size;
+	size_t prop_size; ///< number of ints in properties
 	int properties[];
 } LW_SGO;
 
@@ -217,18 +342,31 @@ typedef enum
 #define LW_FLAG_M          0x02
 #define LW_FLAG_SHELL_RING 0x04
 #define LW_FLAG_HOLE_RING  0x08
+#define LW_FLAG_SOA        0x10 ///< pp holds x[], y[], z[] and m[] one after the other
+#define LW_FLAG_BORROWED   0x20 ///< pp belongs to the caller and is never freed
+#define LW_FLAG_BBOX       0x40 ///< env holds the envelope of the geometry
+#define LW_FLAG_QUANT      0x80 ///< pp holds int32 ordinates decoded with LWGEOM.quant
 
 #define LWFLAGS_GET_Z(flags)          ((flags) & LW_FLAG_Z)
 #define LWFLAGS_GET_M(flags)          ((flags) & LW_FLAG_M)
 #define LWFLAGS_GET_SHELL_RING(flags) ((flags) & LW_FLAG_SHELL_RING)
 #define LWFLAGS_GET_HOLE_RING(flags)  ((flags) & LW_FLAG_HOLE_RING)
+#define LWFLAGS_GET_SOA(flags)        ((flags) & LW_FLAG_SOA)
+#define LWFLAGS_GET_BORROWED(flags)   ((flags) & LW_FLAG_BORROWED)
+#define LWFLAGS_GET_BBOX(flags)       ((flags) & LW_FLAG_BBOX)
+#define LWFLAGS_GET_QUANT(flags)      ((flags) & LW_FLAG_QUANT)
 
 #define LWFLAGS_SET_Z(flags, value) ((flags) = (value) ? ((flags) | LW_FLAG_Z) : ((flags) & ~LW_FLAG_Z))
 #define LWFLAGS_SET_M(flags, value) ((flags) = (value) ? ((flags) | LW_FLAG_M) : ((flags) & ~LW_FLAG_M))
-#define LWFLAGS_SET_SHELL_RING(flags) \
+#define LWFLAGS_SET_SHELL_RING(flags, value) \
 	((flags) = (value) ? ((flags) | LW_FLAG_SHELL_RING) : ((flags) & ~LW_FLAG_SHELL_RING))
-#define LWFLAGS_SET_HOLE_RING(flags) \
+#define LWFLAGS_SET_HOLE_RING(flags, value) \
 	((flags) = (value) ? ((flags) | LW_FLAG_HOLE_RING) : ((flags) & ~LW_FLAG_HOLE_RING))
+#define LWFLAGS_SET_SOA(flags, value) ((flags) = (value) ? ((flags) | LW_FLAG_SOA) : ((flags) & ~LW_FLAG_SOA))
+#define LWFLAGS_SET_BORROWED(flags, value) \
+	((flags) = (value) ? ((flags) | LW_FLAG_BORROWED) : ((flags) & ~LW_FLAG_BORROWED))
+#define LWFLAGS_SET_BBOX(flags, value) ((flags) = (value) ? ((flags) | LW_FLAG_BBOX) : ((flags) & ~LW_FLAG_BBOX))
+#define LWFLAGS_SET_QUANT(flags, value) ((flags) = (value) ? ((flags) | LW_FLAG_QUANT) : ((flags) & ~LW_FLAG_QUANT))
 
 #define LW_POINTBYTESIZE(hasz, hasm) (2 + ((hasz) ? 1 : 0) + ((hasm) ? 1 : 0))
 
@@ -239,13 +377,28 @@ extern LWGEOM *lwgeom_create_empty_mpoint(LWBOOLEAN hasz, LWBOOLEAN hasm);
 extern LWGEOM *lwgeom_create_empty_mline(LWBOOLEAN hasz, LWBOOLEAN hasm);
 extern LWGEOM *lwgeom_create_empty_mpoly(LWBOOLEAN hasz, LWBOOLEAN hasm);
 extern LWGEOM *lwgeom_create_empty_collection(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm);
-extern LWGEOM *lwgeom_create_empty_collection2(uint8_t type, uint32_t ngeoms, LWGEOM *geoms);
+extern LWGEOM *lwgeom_create_empty_collection2(uint8_t type, uint32_t ngeoms, LWGEOM **geoms);
 extern LWGEOM *lwgeom_mpoint_add_point(LWGEOM *mobj, LWGEOM *obj);
 extern LWGEOM *lwgeom_mline_add_line(LWGEOM *mobj, LWGEOM *obj);
 extern LWGEOM *lwgeom_mpoly_add_poly(LWGEOM *mobj, LWGEOM *obj);
 extern LWGEOM *lwgeom_collection_add_geom(LWGEOM *mobj, LWGEOM *obj);
 
 extern void lwgeom_free(LWGEOM *obj);
+extern const char *lwgeom_sgo_text(const LW_SGO *sgo);
+extern void lwgeom_sgo_free(LW_SGO *sgo);
+extern void lwgeom_reader2_reset(LWGEOMREADER2 *reader);
+
+/* Arena variants of the factories, a NULL arena falls back to lwmalloc */
+extern LWGEOM *lwgeom_point_arena(lwgeom_arena *arena, const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern LWGEOM *
+lwgeom_line_arena(lwgeom_arena *arena, uint32_t npoints, const double *points, LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern LWGEOM *lwgeom_poly_arena(lwgeom_arena *arena, const LWGEOM *shell, uint32_t nholes, const LWGEOM **holes);
+extern LWGEOM *lwgeom_create_empty_collection_arena(lwgeom_arena *arena, uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm);
+
+/* Wrap caller owned coordinates without copying them, the buffer has to
+ * outlive the geometry and is never written nor freed by the library */
+extern LWGEOM *lwgeom_point_wrap(const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern LWGEOM *lwgeom_line_wrap(uint32_t npoints, const double *pp, LWBOOLEAN hasz, LWBOOLEAN hasm);
 
 extern int lwgeom_has_z(const LWGEOM *obj);
 extern int lwgeom_has_m(const LWGEOM *obj);
@@ -255,6 +408,24 @@ extern int lwgeom_children_count(const LWGEOM *obj);
 extern LWGEOM *lwgeom_child_at(const LWGEOM *obj, int i);
 extern int lwgeom_points_count(const LWGEOM *obj);
 extern int lwgeom_point_at(const LWGEOM *obj, int n, double *point);
+extern size_t lwgeom_memsize(const LWGEOM *obj);
+
+/* Envelope cached in LWGEOM.env. It is computed on first use and kept up to date by the add functions, callers
+ * writing through lwgeom_points() have to drop it. An empty geometry has the inverted (DBL_MAX, -DBL_MAX) box. */
+extern const LWBOX *lwgeom_get_bbox(const LWGEOM *obj);
+extern void lwgeom_add_bbox(LWGEOM *obj);
+extern void lwgeom_drop_bbox(LWGEOM *obj);
+
+/* Quantized int32 coordinates, see LWQUANT */
+extern void lwquant_init(LWQUANT *quant, const LWBOX *extent, double precision);
+extern int lwgeom_quantize(LWGEOM *obj, const LWQUANT *quant);
+extern int lwgeom_dequantize(LWGEOM *obj);
+extern int lwgeom_is_quantized(const LWGEOM *obj);
+extern LWGEOM *
+lwgeom_point_quantized(const LWQUANT *quant, const int32_t *qpp, LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern LWGEOM *
+lwgeom_line_quantized(const LWQUANT *quant, uint32_t npoints, const int32_t *qpp, LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern int lwgeom_same(const LWGEOM *a, const LWGEOM *b);
 extern double *lwgeom_points(const LWGEOM *obj);
 
 extern double lwgeom_get_x(const LWGEOM *obj, uint32_t i);
@@ -262,17 +433,90 @@ extern double lwgeom_get_y(const LWGEOM *obj, uint32_t i);
 extern double lwgeom_get_z(const LWGEOM *obj, uint32_t i);
 extern double lwgeom_get_m(const LWGEOM *obj, uint32_t i);
 
+/* Coordinate layout, interleaved (x,y[,z][,m]) by default */
+extern int lwgeom_is_soa(const LWGEOM *obj);
+extern int lwgeom_to_soa(LWGEOM *obj);
+extern int lwgeom_to_aos(LWGEOM *obj);
+
 extern LWGEOM *lwgeom_read_wkt(const char *wkt, size_t len);
 extern LWGEOM *lwgeom_read_wkb(const char *wkb, size_t len, int hex);
 extern LWGEOM *lwgeom_read_ewkt(const char *ewkt, size_t len);
 extern LWGEOM *lwgeom_read_ewkb(const char *ewkb, size_t len);
 extern LWGEOM *lwgeom_read_geojson(const char *json, size_t len);
+extern LWGEOM *lwgeom_read_twkb(const char *twkb, size_t len);
 extern LWGEOM *lwgeom_read_kml(const char *kml, size_t len);
 extern LWGEOM *lwgeom_read_gml2(const char *gml, size_t len);
 extern LWGEOM *lwgeom_read_gml3(const char *gml, size_t len);
 
+extern LWGEOM *lwgeom_read_wkt_arena(lwgeom_arena *arena, const char *wkt, size_t len);
+extern LWGEOM *lwgeom_read_wkb_arena(lwgeom_arena *arena, const char *wkb, size_t len, int hex);
+extern LWGEOM *lwgeom_read_wkb_borrow(lwgeom_arena *arena, const char *wkb, size_t len);
+extern LWGEOM *
+lwgeom_read_twkb_arena(lwgeom_arena *arena, const char *twkb, size_t len, size_t *used, int64_t **ids);
+
+/******************************************************************
+ * Bulk WKT loading.
+ * Read a newline delimited file of WKT, or a CSV/TSV file with a WKT column,
+ * on several threads. The file is mapped and cut in chunks on line
+ * boundaries, each chunk parsed by a worker, and the records are handed to
+ * the callback on the calling thread in file order. One record per line:
+ * quoted fields may hold delimiters but not newlines.
+ */
+typedef struct {
+	char delimiter; ///< column separator, '\0' when a line holds nothing but the WKT
+	int column;     ///< 0-based index of the WKT column
+	int header;     ///< skip the first line
+	int nthreads;   ///< parsing threads, 0 for one per core
+} lwgeom_wkt_load_options;
+
+/// Receives each record, \a obj is NULL when it does not parse. The geometry
+/// is only valid during the call, lwgeom_clone() or lwgeom_batch_append()
+/// keep it. Returning LW_FAILURE stops the load.
+typedef int (*lwgeom_wkt_load_callback)(const LWGEOM *obj, size_t line, void *data);
+
+extern int lwgeom_load_wkt_file(const char *path,
+				const lwgeom_wkt_load_options *options,
+				lwgeom_wkt_load_callback callback,
+				void *data);
+
+/// Receives the output of the streaming writers in order, returns LW_FAILURE to stop
+typedef int (*lwgeom_sink)(const char *data, size_t len, void *arg);
+/// Fills \a buf with at most \a size bytes of input for the streaming readers, returns 0 at its end
+typedef size_t (*lwgeom_source)(char *buf, size_t size, void *arg);
+
 extern int lwgeom_write_wkt(const LWGEOM *obj, char **wkt, size_t *len);
+extern size_t lwgeom_write_wkt_buf(const LWGEOM *obj, int precision, char *buf, size_t size);
+extern int lwgeom_write_wkt_sink(const LWGEOM *obj, int precision, lwgeom_sink sink, void *arg);
 extern int lwgeom_write_wkb(const LWGEOM *obj, int hex, char **wkb, size_t *len);
+
+/* WKB variants, combined with | */
+#define LWGEOM_WKB_ISO 0x01      ///< ISO SQL/MM, Z and M as type + 1000, 2000 or 3000
+#define LWGEOM_WKB_EXTENDED 0x02 ///< PostGIS EWKB, Z and M as the high bits of the type
+#define LWGEOM_WKB_XDR 0x04      ///< big endian, little endian otherwise
+#define LWGEOM_WKB_HEX 0x08      ///< upper case hex instead of bytes
+
+extern size_t lwgeom_wkb_size(const LWGEOM *obj, uint8_t variant);
+extern size_t lwgeom_write_wkb_buf(const LWGEOM *obj, uint8_t variant, char *buf, size_t size);
+extern size_t lwgeom_write_wkb_batch(const LWGEOM *const *objs,
+				     uint32_t n,
+				     uint8_t variant,
+				     char *buf,
+				     size_t size,
+				     size_t *offsets);
+/* TWKB variants, combined with | */
+#define LWGEOM_TWKB_BBOX 0x01 ///< bounding box of each geometry
+#define LWGEOM_TWKB_SIZE 0x02 ///< byte size of each geometry, to skip it without decoding
+
+typedef struct {
+	int precision_xy;   ///< decimal digits of x and y, -8 to 7, negative ones round to tens, hundreds...
+	int precision_z;    ///< decimal digits of z, 0 to 7
+	int precision_m;    ///< decimal digits of m, 0 to 7
+	uint8_t variant;    ///< LWGEOM_TWKB_BBOX and LWGEOM_TWKB_SIZE
+	const int64_t *ids; ///< one id per member of a multi geometry or collection, or NULL
+} lwgeom_twkb_options;
+
+extern int lwgeom_write_twkb(const LWGEOM *obj, const lwgeom_twkb_options *options, char **twkb, size_t *len);
+extern size_t lwgeom_write_twkb_buf(const LWGEOM *obj, const lwgeom_twkb_options *options, char *buf, size_t size);
 extern int lwgeom_write_ewkt(const LWGEOM *obj, char **ewkt, size_t *len);
 extern int lwgeom_write_ewkb(const LWGEOM *obj, char **ewkb, size_t *len);
 extern int lwgeom_write_geojson(const LWGEOM *obj, char **json, size_t *len);
@@ -280,8 +524,199 @@ extern int lwgeom_write_kml(const LWGEOM *obj, char **kml, size_t *len);
 extern int lwgeom_write_gml2(const LWGEOM *obj, char **gml, size_t *len);
 extern int lwgeom_write_gml3(const LWGEOM *obj, char **gml, size_t *len);
 
+/******************************************************************
+ * Streaming GeoJSON writing.
+ * A FeatureCollection written feature by feature to a sink, through one
+ * chunk reused by every feature.
+ */
+#define LWGEOM_GEOJSON_BBOX 0x01  ///< "bbox" of the geometries, from their cached envelope
+#define LWGEOM_GEOJSON_FLUSH 0x02 ///< hand every feature to the sink once written
+
+typedef struct lwgeom_geojson_writer lwgeom_geojson_writer;
+
+extern int lwgeom_write_geojson_sink(const LWGEOM *obj, int precision, int flags, lwgeom_sink sink, void *arg);
+extern lwgeom_geojson_writer *
+lwgeom_geojson_writer_new(int precision, int flags, size_t chunk, lwgeom_sink sink, void *arg);
+extern int lwgeom_geojson_writer_feature(lwgeom_geojson_writer *writer,
+					 const LWGEOM *obj,
+					 const char *properties,
+					 size_t len);
+extern int lwgeom_geojson_writer_flush(lwgeom_geojson_writer *writer);
+extern int lwgeom_geojson_writer_finish(lwgeom_geojson_writer *writer);
+extern void lwgeom_geojson_writer_free(lwgeom_geojson_writer *writer);
+
+/******************************************************************
+ * Streaming GeoJSON reading.
+ * Pull the features of a FeatureCollection, or of a sequence of features
+ * or geometries, one at a time. The input is read in blocks and only the
+ * feature being parsed is kept, whatever the size of the document.
+ */
+typedef struct lwgeom_geojson_reader lwgeom_geojson_reader;
+
+extern lwgeom_geojson_reader *lwgeom_geojson_reader_new(lwgeom_source source, void *arg);
+extern lwgeom_geojson_reader *lwgeom_geojson_reader_open(const char *path);
+extern lwgeom_geojson_reader *lwgeom_geojson_reader_mem(const char *data, size_t len);
+extern int lwgeom_geojson_reader_next(lwgeom_geojson_reader *reader, LW_SGO **sgo);
+extern int lwgeom_geojson_reader_read(lwgeom_geojson_reader *reader, LWGEOMREADER2 *out, size_t max);
+extern void lwgeom_geojson_reader_free(lwgeom_geojson_reader *reader);
+
+/******************************************************************
+ * Streaming KML and GML reading.
+ * Pull the placemarks of KML or the feature members of GML one at a time,
+ * with a tokenizer that keeps only the current feature, whatever the size
+ * of the document. Positions are parsed straight from the coordinates,
+ * pos and posList text.
+ */
+typedef enum {
+	LWGEOM_XML_KML = 0,
+	LWGEOM_XML_GML ///< GML2 or GML3
+} lwgeom_xml_dialect;
+
+typedef struct lwgeom_xml_reader lwgeom_xml_reader;
+
+extern lwgeom_xml_reader *lwgeom_xml_reader_new(lwgeom_xml_dialect dialect, lwgeom_source source, void *arg);
+extern lwgeom_xml_reader *lwgeom_xml_reader_open(lwgeom_xml_dialect dialect, const char *path);
+extern lwgeom_xml_reader *lwgeom_xml_reader_mem(lwgeom_xml_dialect dialect, const char *data, size_t len);
+extern int lwgeom_xml_reader_next(lwgeom_xml_reader *reader, LW_SGO **sgo);
+extern int lwgeom_xml_reader_read(lwgeom_xml_reader *reader, LWGEOMREADER2 *out, size_t max);
+extern void lwgeom_xml_reader_free(lwgeom_xml_reader *reader);
+
+/******************************************************************
+ * Oracle SDO_GEOMETRY.
+ * Straight lines and polygons, optimized rectangles and point clusters;
+ * arcs and circles are not supported.
+ */
+#define LWGEOM_ORA_BORROW 0x01 ///< alias sdo_ordinates instead of copying them, when their layout allows
+
 extern LWGEOM *lwgeom_read_ora(const LWGEOM_SDO sdo, int flag);
+extern LWGEOM *lwgeom_read_ora_arena(lwgeom_arena *arena, const LWGEOM_SDO *sdo, int flag);
+extern size_t
+lwgeom_read_ora_batch(lwgeom_arena *arena, const LWGEOM_SDO *sdos, size_t n, int flag, LWGEOM **out);
+extern int lwgeom_ora_size(const LWGEOM *obj, size_t *elem_count, size_t *ord_count);
 extern int lwgeom_write_ora(const LWGEOM *obj, LWGEOM_SDO *sdo);
+extern int lwgeom_write_ora_batch(const LWGEOM *const *objs,
+				  uint32_t n,
+				  LWGEOM_SDO *sdos,
+				  int *elem_info,
+				  size_t elem_size,
+				  double *ordinates,
+				  size_t ord_size);
+extern void lwgeom_ora_free(LWGEOM_SDO *sdo);
+
+/******************************************************************
+ * FlatGeobuf.
+ * Files with a packed Hilbert R-tree over the feature boxes. The reader
+ * maps the file and decodes only the features found by a box query, the
+ * writer sorts the features along the Hilbert curve before writing them.
+ * Property values are exchanged as text, converted to the column types.
+ * Curves, surfaces and TINs are not supported.
+ */
+typedef enum {
+	LWGEOM_FGB_BYTE = 0,
+	LWGEOM_FGB_UBYTE,
+	LWGEOM_FGB_BOOL,
+	LWGEOM_FGB_SHORT,
+	LWGEOM_FGB_USHORT,
+	LWGEOM_FGB_INT,
+	LWGEOM_FGB_UINT,
+	LWGEOM_FGB_LONG,
+	LWGEOM_FGB_ULONG,
+	LWGEOM_FGB_FLOAT,
+	LWGEOM_FGB_DOUBLE,
+	LWGEOM_FGB_STRING,
+	LWGEOM_FGB_JSON,
+	LWGEOM_FGB_DATETIME, ///< ISO 8601 text
+	LWGEOM_FGB_BINARY
+} lwgeom_fgb_column_type;
+
+typedef struct lwgeom_fgb_writer lwgeom_fgb_writer;
+typedef struct lwgeom_fgb_reader lwgeom_fgb_reader;
+
+extern lwgeom_fgb_writer *lwgeom_fgb_writer_new(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm, uint16_t node_size);
+extern int lwgeom_fgb_writer_column(lwgeom_fgb_writer *writer, const char *name, lwgeom_fgb_column_type type);
+extern int lwgeom_fgb_writer_feature(lwgeom_fgb_writer *writer,
+				     const LWGEOM *obj,
+				     const char *const *values,
+				     const size_t *lens);
+extern int lwgeom_fgb_writer_finish(lwgeom_fgb_writer *writer, lwgeom_sink sink, void *arg);
+extern int lwgeom_fgb_writer_save(lwgeom_fgb_writer *writer, const char *path);
+extern void lwgeom_fgb_writer_free(lwgeom_fgb_writer *writer);
+
+extern lwgeom_fgb_reader *lwgeom_fgb_reader_open(const char *path);
+extern lwgeom_fgb_reader *lwgeom_fgb_reader_mem(const char *data, size_t len);
+extern uint64_t lwgeom_fgb_reader_count(const lwgeom_fgb_reader *reader);
+extern int lwgeom_fgb_reader_query(lwgeom_fgb_reader *reader, const LWBOX *box);
+extern int lwgeom_fgb_reader_next(lwgeom_fgb_reader *reader, LW_SGO **sgo);
+extern int lwgeom_fgb_reader_read(lwgeom_fgb_reader *reader, LWGEOMREADER2 *out, size_t max);
+extern void lwgeom_fgb_reader_free(lwgeom_fgb_reader *reader);
+
+/******************************************************************
+ * Shapefile.
+ * The reader maps the .shp and its .shx index, which gives any record in
+ * constant time. Record boxes are tested against the query box before the
+ * coordinates are decoded, and XY coordinates can be borrowed from the
+ * mapping. Multipatches are not supported.
+ */
+typedef struct lwgeom_shp_reader lwgeom_shp_reader;
+
+/// Borrow the coordinates of XY records from the mapping when they are
+/// aligned, the geometries must not outlive the reader
+#define LWGEOM_SHP_BORROW 0x01
+
+/// Receives a scanned record on one of the scanning threads, \a obj is only
+/// valid during the call
+/// @return LW_FAILURE to stop the scan
+typedef int (*lwgeom_shp_scan_callback)(const LWGEOM *obj, uint32_t index, void *data);
+
+extern lwgeom_shp_reader *lwgeom_shp_reader_open(const char *path);
+extern uint32_t lwgeom_shp_reader_count(const lwgeom_shp_reader *reader);
+extern void lwgeom_shp_reader_extent(const lwgeom_shp_reader *reader, LWBOX *box);
+extern int lwgeom_shp_reader_bbox(const lwgeom_shp_reader *reader, uint32_t i, LWBOX *box);
+extern int lwgeom_shp_reader_get(lwgeom_shp_reader *reader,
+				 lwgeom_arena *arena,
+				 uint32_t i,
+				 const LWBOX *filter,
+				 int flags,
+				 LWGEOM **out);
+extern int lwgeom_shp_reader_scan(lwgeom_shp_reader *reader,
+				  const LWBOX *filter,
+				  int flags,
+				  int nthreads,
+				  lwgeom_shp_scan_callback callback,
+				  void *data);
+extern void lwgeom_shp_reader_free(lwgeom_shp_reader *reader);
+
+/******************************************************************
+ * GeoPackage and SpatiaLite geometry blobs.
+ * Decoded without SQLite. The envelope functions read the box stored in
+ * the blob header, so filters can reject a blob before its coordinates are
+ * decoded.
+ */
+extern int lwgeom_gpkg_envelope(const char *blob, size_t len, int32_t *srid, LWBOX *box);
+extern LWGEOM *lwgeom_read_gpkg(lwgeom_arena *arena, const char *blob, size_t len, int borrow, int32_t *srid);
+extern int lwgeom_spatialite_envelope(const char *blob, size_t len, int32_t *srid, LWBOX *box);
+extern LWGEOM *lwgeom_read_spatialite(lwgeom_arena *arena, const char *blob, size_t len, int borrow, int32_t *srid);
+
+/******************************************************************
+ * Mapbox Vector Tiles.
+ * The encoder clips features to the buffered tile of a mapsettings_t
+ * grid, quantizes them to tile units and drops the parts that collapse,
+ * then writes their command streams in protobuf layers. Its buffers are
+ * reused from tile to tile. Property values are written as strings.
+ */
+typedef struct lwgeom_mvt_encoder lwgeom_mvt_encoder;
+
+extern lwgeom_mvt_encoder *lwgeom_mvt_encoder_new(const mapsettings_t *settings);
+extern int lwgeom_mvt_encoder_tile(lwgeom_mvt_encoder *enc, uint32_t z, uint32_t x, uint32_t y);
+extern int lwgeom_mvt_encoder_layer(lwgeom_mvt_encoder *enc, const char *name);
+extern int lwgeom_mvt_encoder_feature(lwgeom_mvt_encoder *enc,
+				      const LWGEOM *obj,
+				      uint64_t id,
+				      const char *const *keys,
+				      const char *const *values,
+				      uint32_t nprops);
+extern int lwgeom_mvt_encoder_finish(lwgeom_mvt_encoder *enc, const uint8_t **tile, size_t *len);
+extern void lwgeom_mvt_encoder_free(lwgeom_mvt_encoder *enc);
 
 extern double lwgeom_prop_width(const LWGEOM *obj);
 extern double lwgeom_prop_height(const LWGEOM *obj);
@@ -298,6 +733,125 @@ extern LWGEOM *lwellipse_stroke(LWELLIPSE e, uint32_t param, LWBOOLEAN hasz, LWB
 
 extern LWGEOM *lwgeom_clone(const LWGEOM *obj);
 
+/******************************************************************
+ * LWGEOM_BATCH.
+ * Many geometries in a few contiguous columns, laid out like the GeoArrow
+ * native encodings. Feature i spans parts [geom_offsets[i], geom_offsets[i+1]),
+ * part j spans rings [part_offsets[j], part_offsets[j+1]) and ring k spans
+ * points [ring_offsets[k], ring_offsets[k+1]) of the interleaved coords.
+ * A point or line is one part of one ring, a polygon one part with a ring
+ * per shell or hole, multi geometries and collections have a part per child.
+ */
+typedef struct {
+	uint32_t ngeoms;        ///< number of features
+	uint32_t nparts;        ///< number of parts
+	uint32_t nrings;        ///< number of rings
+	uint32_t npoints;       ///< number of points
+	lwflags_t flags;        ///< LW_FLAG_Z and LW_FLAG_M, shared by all features
+	uint8_t *types;         ///< feature types, ngeoms entries
+	uint8_t *part_types;    ///< POINTTYPE, LINETYPE or POLYTYPE, nparts entries
+	uint32_t *geom_offsets; ///< ngeoms + 1 entries
+	uint32_t *part_offsets; ///< nparts + 1 entries
+	uint32_t *ring_offsets; ///< nrings + 1 entries
+	double *coords;         ///< npoints * (2 + hasz + hasm) interleaved ordinates
+
+	/* capacities of the arrays above and reader scratch, internal */
+	uint32_t geoms_capacity;
+	uint32_t parts_capacity;
+	uint32_t rings_capacity;
+	uint32_t points_capacity;
+	lwgeom_arena *scratch;
+	/* set when the columns belong to someone else, e.g. an imported Arrow
+	 * array: the batch is read-only and lwgeom_batch_free() calls release */
+	void (*release)(void *data);
+	void *release_data;
+} LWGEOM_BATCH;
+
+extern LWGEOM_BATCH *lwgeom_batch_new(LWBOOLEAN hasz, LWBOOLEAN hasm);
+extern void lwgeom_batch_free(LWGEOM_BATCH *batch);
+extern void lwgeom_batch_reset(LWGEOM_BATCH *batch);
+extern int lwgeom_batch_append(LWGEOM_BATCH *batch, const LWGEOM *obj);
+extern int lwgeom_batch_append_wkt(LWGEOM_BATCH *batch, const char *wkt, size_t len);
+extern int lwgeom_batch_append_wkb(LWGEOM_BATCH *batch, const char *wkb, size_t len, int hex);
+extern LWGEOM *lwgeom_batch_get(const LWGEOM_BATCH *batch, uint32_t i);
+extern LWGEOM *lwgeom_batch_get_arena(lwgeom_arena *arena, const LWGEOM_BATCH *batch, uint32_t i);
+
+/******************************************************************
+ * Arrow C Data Interface.
+ * The ABI stable structs of https://arrow.apache.org/docs/format/CDataInterface.html,
+ * used to exchange batches in the GeoArrow native (interleaved) encodings
+ * without copying the coordinates.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+extern int lwgeom_batch_to_arrow(LWGEOM_BATCH *batch, struct ArrowSchema *schema, struct ArrowArray *array);
+extern LWGEOM_BATCH *lwgeom_batch_from_arrow(const struct ArrowSchema *schema, struct ArrowArray *array);
+
+/* Batch properties, \a out receives one value per feature */
+extern void lwgeom_batch_area(const LWGEOM_BATCH *batch, double *out);
+extern void lwgeom_batch_length(const LWGEOM_BATCH *batch, double *out);
+extern void lwgeom_batch_envelope(const LWGEOM_BATCH *batch, LWBOX *out);
+extern void lwgeom_batch_centroid(const LWGEOM_BATCH *batch, double *xy);
+
+/******************************************************************
+ * LWSERIALIZED.
+ * A geometry encoded in one contiguous, 8 byte aligned blob: a header,
+ * an optional cached box, child offsets and the coordinates. Blobs use
+ * the native byte order and can be read in place without rebuilding a
+ * LWGEOM tree. Child records share the same layout.
+ */
+typedef struct LWSERIALIZED LWSERIALIZED;
+
+extern size_t lwgeom_serialized_size(const LWGEOM *obj, LWBOOLEAN with_bbox);
+extern size_t lwgeom_serialize_into(const LWGEOM *obj, LWBOOLEAN with_bbox, void *buf, size_t len);
+extern LWSERIALIZED *lwgeom_serialize(const LWGEOM *obj, LWBOOLEAN with_bbox, size_t *size);
+extern LWGEOM *lwgeom_deserialize(const LWSERIALIZED *s);
+extern LWGEOM *lwgeom_deserialize_arena(lwgeom_arena *arena, const LWSERIALIZED *s);
+
+extern size_t lwserialized_size(const LWSERIALIZED *s);
+extern uint8_t lwserialized_type(const LWSERIALIZED *s);
+extern int lwserialized_has_z(const LWSERIALIZED *s);
+extern int lwserialized_has_m(const LWSERIALIZED *s);
+extern int lwserialized_has_bbox(const LWSERIALIZED *s);
+extern int lwserialized_get_bbox(const LWSERIALIZED *s, LWBOX *box);
+extern int lwserialized_children_count(const LWSERIALIZED *s);
+extern const LWSERIALIZED *lwserialized_child_at(const LWSERIALIZED *s, int i);
+extern int lwserialized_points_count(const LWSERIALIZED *s);
+extern int lwserialized_point_at(const LWSERIALIZED *s, int n, double *point);
+extern const double *lwserialized_points(const LWSERIALIZED *s);
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,6 +27,17 @@
 
 #include "lwgeom_log.h"
 
+#include <stdio.h>
+
+#if defined(_MSC_VER)
+#define LW_THREAD_LOCAL __declspec(thread)
+#else
+#define LW_THREAD_LOCAL __thread
+#endif
+
+/// Size of an rtree node, the pool allocator has a class for it
+extern size_t lwgeom__rtree_node_size(void);
+
 /**
  * Floating point comparators.
  */
@@ -61,6 +72,16 @@
 #define NO_Z_VALUE NO_VALUE
 #define NO_M_VALUE NO_VALUE
 
+/// Index of ordinate \a o of point \a i in LWGEOM.pp, for either coordinate layout
+#define LWGEOM_PP_INDEX(obj, cdim, i, o) \
+	(LWFLAGS_GET_SOA((obj)->flags) ? (size_t)(o) * (obj)->npoints + (i) : (size_t)(i) * (cdim) + (o))
+/// Distance between two consecutive points in the x[] or y[] view of LWGEOM.pp
+#define LWGEOM_PP_STRIDE(obj) ((size_t)(LWFLAGS_GET_SOA((obj)->flags) ? 1 : lwgeom_dim_coordinate(obj)))
+#define LWGEOM_PP_XS(obj)     ((obj)->pp)
+#define LWGEOM_PP_YS(obj)     ((obj)->pp + (LWFLAGS_GET_SOA((obj)->flags) ? (obj)->npoints : 1))
+/// Interleaved int32 ordinates of a quantized geometry
+#define LWGEOM_PP_Q(obj) ((int32_t *)(obj)->pp)
+
 // nv-util callback function
 typedef void (*DestoryFunc)(void *);
 typedef void (*EqualFunc)(const void *, const void *);
@@ -70,6 +91,81 @@ typedef void (*HashFunc)(const void *);
 size_t lw_str_hash(const void *str);
 
 size_t lw_nearest_pow(size_t v);
+// Grow *mem of *capacity elements of size bytes to hold need, doubling.
+int lwgeom__reserve(void **mem, size_t *capacity, size_t need, size_t size, lwgeom_mem_category cat);
+
+/// Input of the streaming readers, pulled from a source in blocks or held
+/// in memory. The bytes before begin are dropped when more is pulled, the
+/// buffer grows past a block only when the bytes in use fill it.
+typedef struct {
+	lwgeom_source source;
+	void *arg;
+	FILE *file;      ///< opened by lwgeom__input_open(), closed with the input
+	char *buf;
+	size_t begin;    ///< first byte in use
+	size_t len;      ///< end of the data in buf
+	size_t capacity;
+	int borrowed;    ///< buf is the caller memory of lwgeom__input_init_mem()
+	int eof;
+} lwgeom_input;
+
+int lwgeom__input_init(lwgeom_input *in, lwgeom_source source, void *arg, size_t block);
+void lwgeom__input_init_mem(lwgeom_input *in, const char *data, size_t len);
+int lwgeom__input_open(lwgeom_input *in, const char *path, size_t block);
+int lwgeom__input_fill(lwgeom_input *in);
+void lwgeom__input_destroy(lwgeom_input *in);
+// Locale independent decimal number parser, returns the end of the number or
+// NULL when [s, end) does not start with one.
+const char *lwgeom__parse_double(const char *s, const char *end, double *out);
+// Copy of n 8 bytes words with their bytes reversed, vectorized when possible.
+void lwgeom__bswap64_copy(void *dst, const void *src, size_t n);
+// Shortest round trip or fixed precision formatting of a double, see lwprint.c.
+#define LWPRINT_BUFSIZE 32
+int lwprint_double(double d, int precision, char *buf);
+struct bytebuffer;
+void lwprint_double_append(struct bytebuffer *b, double d, int precision, int finite);
+
+// lwmalloc/lwrealloc charging the block to \a cat for memory accounting.
+void *lwmalloc__cat(size_t size, lwgeom_mem_category cat);
+void *lwrealloc__cat(void *mem, size_t size, lwgeom_mem_category cat);
+
+// Allocate from the arena when one is given, from the lw handlers otherwise.
+// Arena memory is never released on its own, lwgeom__release() ignores it.
+void *lwgeom__malloc(lwgeom_arena *arena, size_t size, lwgeom_mem_category cat);
+void *lwgeom__realloc(lwgeom_arena *arena, void *mem, size_t oldsize, size_t size, lwgeom_mem_category cat);
+void lwgeom__release(lwgeom_arena *arena, void *mem);
+void *lwgeom_arena_realloc(lwgeom_arena *arena, void *mem, size_t oldsize, size_t size);
+
+// Empty geometry header of \a type.
+LWGEOM *lwgeom__new(lwgeom_arena *arena, uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm);
+// Point or line borrowing \a pp, used by readers aliasing their input.
+LWGEOM *lwgeom__wrap(lwgeom_arena *arena, uint8_t type, uint32_t npoints, const double *pp, int hasz, int hasm);
+// Append a child to a collection, taking over its ownership.
+LWGEOM *lwgeom__add_child(LWGEOM *mobj, LWGEOM *obj);
+// Polygon taking over the ownership of already built rings, used by readers.
+LWGEOM *lwgeom__poly_from_rings(lwgeom_arena *arena, uint32_t nrings, LWGEOM **rings);
+// Feature of the readers, see LW_SGO.
+LW_SGO *lwgeom__sgo_new(LWGEOM *geom, const int *spans, size_t nspans, const char *text, size_t len);
+
+LWBOX lwgeom__query_envolpe(const double *pp, int npoints, int cdim);
+LWBOX lwgeom__query_envolpe_soa(const double *xs, const double *ys, int npoints);
+LWBOX lwgeom__compute_envelope(const LWGEOM *obj);
+// Grow \a box so that it covers \a sub.
+void lwgeom__expand_envelope(LWBOX *box, const LWBOX *sub);
+
+// Quantized point and line geometries, see lwgeom_quant.c.
+double lwgeom__quant_get(const LWGEOM *obj, uint32_t i, int o);
+LWBOX lwgeom__quant_envelope(const LWGEOM *obj);
+double lwgeom__quant_ring_area(const LWGEOM *obj);
+double lwgeom__quant_length(const LWGEOM *obj);
+double *lwgeom__quant_decode(lwgeom_arena *arena, const LWGEOM *obj);
+LWGEOM *lwgeom__quant_line(lwgeom_arena *arena,
+			   const LWQUANT *quant,
+			   uint8_t type,
+			   uint32_t npoints,
+			   const int32_t *qpp,
+			   int hasz,
+			   int hasm);
 
 int lwbox_intersects(const LWBOX env1, const LWBOX env2);
 LWBOX lwbox_intersection(const LWBOX env1, const LWBOX env2);
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwfgb.h"
+
+const uint8_t lwfgb_magic[LWFGB_MAGIC_SIZE] = {0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62, 0x00};
+
+/* ----------------------------- packed R-tree ------------------------------ */
+
+/// Lay out the levels of a packed R-tree over \a nitems leaves, each node
+/// grouping \a node_size nodes of the level below
+/// @return LW_FAILURE when the tree would have more than UINT64_MAX nodes
+int
+lwfgb_levels_init(lwfgb_levels *levels, uint64_t nitems, uint16_t node_size)
+{
+	if (nitems == 0 || node_size < 2)
+		return LW_FAILURE;
+
+	uint64_t counts[65];
+	uint64_t n = nitems;
+	uint64_t nnodes = n;
+	int nlevels = 0;
+	counts[nlevels++] = n;
+	do
+	{
+		n = n / node_size + (n % node_size != 0);
+		// A count from a crafted header could wrap the total
+		if (n > UINT64_MAX - nnodes)
+			return LW_FAILURE;
+		nnodes += n;
+		counts[nlevels++] = n;
+	} while (n != 1);
+
+	uint64_t offset = nnodes;
+	for (int i = 0; i < nlevels; i++)
+	{
+		offset -= counts[i];
+		levels->start[i] = offset;
+		levels->end[i] = offset + counts[i];
+	}
+	levels->nlevels = nlevels;
+	levels->nnodes = nnodes;
+	return LW_SUCCESS;
+}
+
+/// Position of (x, y), two 16 bits values, along the Hilbert curve, branch free
+/// after "Fast Hilbert curve generation" by rawrunprotected
+uint32_t
+lwfgb_hilbert(uint32_t x, uint32_t y)
+{
+	uint32_t a = x ^ y;
+	uint32_t b = 0xFFFF ^ a;
+	uint32_t c = 0xFFFF ^ (x | y);
+	uint32_t d = x & (y ^ 0xFFFF);
+
+	uint32_t A = a | (b >> 1);
+	uint32_t B = (a >> 1) ^ a;
+	uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+	uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	A = (a & (a >> 2)) ^ (b & (b >> 2));
+	B = (a & (b >> 2)) ^ (b & ((a ^ b) >> 2));
+	C ^= (a & (c >> 2)) ^ (b & (d >> 2));
+	D ^= (b & (c >> 2)) ^ ((a ^ b) & (d >> 2));
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	A = (a & (a >> 4)) ^ (b & (b >> 4));
+	B = (a & (b >> 4)) ^ (b & ((a ^ b) >> 4));
+	C ^= (a & (c >> 4)) ^ (b & (d >> 4));
+	D ^= (b & (c >> 4)) ^ ((a ^ b) & (d >> 4));
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	C ^= (a & (c >> 8)) ^ (b & (d >> 8));
+	D ^= (b & (c >> 8)) ^ ((a ^ b) & (d >> 8));
+
+	a = C ^ (C >> 1);
+	b = D ^ (D >> 1);
+
+	uint32_t i0 = x ^ y;
+	uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+	i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+	i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+	i0 = (i0 | (i0 << 2)) & 0x33333333;
+	i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+	i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+	i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+	i1 = (i1 | (i1 << 2)) & 0x33333333;
+	i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+	return (i1 << 1) | i0;
+}
+
+/* --------------------------- flatbuffer reading --------------------------- */
+
+/// Table at \a pos of \a buf, with its vtable
+static int
+fgb_table_at(lwfgb_table *t, const uint8_t *buf, size_t len, size_t pos)
+{
+	if (len < 4 || pos > len - 4)
+		return LW_FAILURE;
+	int64_t vtable = (int64_t)pos - (int32_t)lwfgb_u32(buf + pos);
+	if (vtable < 0 || (uint64_t)vtable > len - 4)
+		return LW_FAILURE;
+	uint16_t vsize = lwfgb_u16(buf + vtable);
+	uint16_t tsize = lwfgb_u16(buf + vtable + 2);
+	if (vsize < 4 || (vsize & 1) || (size_t)vtable + vsize > len || tsize < 4 || tsize > len - pos)
+		return LW_FAILURE;
+
+	t->buf = buf;
+	t->len = len;
+	t->pos = pos;
+	t->vtable = (size_t)vtable;
+	t->vsize = vsize;
+	t->tsize = tsize;
+	return LW_SUCCESS;
+}
+
+/// Root table of a flatbuffer, \a buf past its size prefix
+int
+lwfgb_root(lwfgb_table *t, const uint8_t *buf, size_t len)
+{
+	if (len < 4)
+		return LW_FAILURE;
+	return fgb_table_at(t, buf, len, lwfgb_u32(buf));
+}
+
+/// Position of field \a id of \a size bytes, 0 when absent
+static size_t
+fgb_field(const lwfgb_table *t, int id, size_t size)
+{
+	size_t slot = 4 + 2 * (size_t)id;
+	if (slot + 2 > t->vsize)
+		return 0;
+	uint16_t offset = lwfgb_u16(t->buf + t->vtable + slot);
+	if (!offset || offset + size > t->tsize)
+		return 0;
+	return t->pos + offset;
+}
+
+/// Unsigned scalar field of 1, 2, 4 or 8 bytes, \a def when absent
+uint64_t
+lwfgb_scalar(const lwfgb_table *t, int id, size_t size, uint64_t def)
+{
+	size_t f = fgb_field(t, id, size);
+	if (!f)
+		return def;
+	switch (size)
+	{
+	case 1:
+		return t->buf[f];
+	case 2:
+		return lwfgb_u16(t->buf + f);
+	case 4:
+		return lwfgb_u32(t->buf + f);
+	default:
+		return lwfgb_u64(t->buf + f);
+	}
+}
+
+/// Vector field of \a elem bytes elements, \a data NULL and \a n 0 when absent
+int
+lwfgb_vector(const lwfgb_table *t, int id, size_t elem, const uint8_t **data, uint32_t *n)
+{
+	*data = NULL;
+	*n = 0;
+	size_t f = fgb_field(t, id, 4);
+	if (!f)
+		return LW_SUCCESS;
+	size_t v = f + lwfgb_u32(t->buf + f);
+	if (v > t->len - 4)
+		return LW_FAILURE;
+	uint32_t count = lwfgb_u32(t->buf + v);
+	if (count > (t->len - v - 4) / elem)
+		return LW_FAILURE;
+	*data = t->buf + v + 4;
+	*n = count;
+	return LW_SUCCESS;
+}
+
+/// Table field, \a out->buf NULL when absent
+int
+lwfgb_subtable(const lwfgb_table *t, int id, lwfgb_table *out)
+{
+	out->buf = NULL;
+	size_t f = fgb_field(t, id, 4);
+	if (!f)
+		return LW_SUCCESS;
+	return fgb_table_at(out, t->buf, t->len, f + lwfgb_u32(t->buf + f));
+}
+
+/// Element \a i of a vector of tables
+int
+lwfgb_element(const lwfgb_table *t, const uint8_t *data, uint32_t i, lwfgb_table *out)
+{
+	size_t f = (size_t)(data - t->buf) + 4 * (size_t)i;
+	return fgb_table_at(out, t->buf, t->len, f + lwfgb_u32(t->buf + f));
+}
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LWFGB_H
+#define LWFGB_H
+
+#include "liblwgeom_internel.h"
+
+#include <string.h>
+
+/* FlatGeobuf files start with "fgb", the major version 3, "fgb" and the patch version */
+#define LWFGB_MAGIC_SIZE 8
+extern const uint8_t lwfgb_magic[LWFGB_MAGIC_SIZE];
+
+/* Geometry types are those of LWGEOM, POINTTYPE to COLLECTIONTYPE, 0 for mixed */
+
+/* Field ids of the tables of header.fbs and feature.fbs */
+#define LWFGB_HEADER_NAME            0
+#define LWFGB_HEADER_ENVELOPE        1
+#define LWFGB_HEADER_GEOMETRY_TYPE   2
+#define LWFGB_HEADER_HAS_Z           3
+#define LWFGB_HEADER_HAS_M           4
+#define LWFGB_HEADER_COLUMNS         7
+#define LWFGB_HEADER_FEATURES_COUNT  8
+#define LWFGB_HEADER_INDEX_NODE_SIZE 9
+#define LWFGB_COLUMN_NAME            0
+#define LWFGB_COLUMN_TYPE            1
+#define LWFGB_FEATURE_GEOMETRY       0
+#define LWFGB_FEATURE_PROPERTIES     1
+#define LWFGB_GEOMETRY_ENDS          0
+#define LWFGB_GEOMETRY_XY            1
+#define LWFGB_GEOMETRY_Z             2
+#define LWFGB_GEOMETRY_M             3
+#define LWFGB_GEOMETRY_TYPE          6
+#define LWFGB_GEOMETRY_PARTS         7
+
+/* Index node size when the header has none */
+#define LWFGB_DEFAULT_NODE_SIZE 16
+
+/* A node of the packed R-tree: its box and, for a leaf, the offset of its
+ * feature from the first feature, else the index of its first child */
+#define LWFGB_NODE_BYTES 40
+
+typedef struct {
+	double minx;
+	double miny;
+	double maxx;
+	double maxy;
+	uint64_t offset;
+} lwfgb_node;
+
+/// Levels of a packed Hilbert R-tree of nnodes nodes, stored root first:
+/// level 0 holds the leaves, at the end, and the last level the root
+typedef struct {
+	int nlevels;
+	uint64_t nnodes;
+	uint64_t start[65];
+	uint64_t end[65];
+} lwfgb_levels;
+
+int lwfgb_levels_init(lwfgb_levels *levels, uint64_t nitems, uint16_t node_size);
+uint32_t lwfgb_hilbert(uint32_t x, uint32_t y);
+
+static inline uint16_t
+lwfgb_u16(const uint8_t *p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap16(v);
+#endif
+	return v;
+}
+
+static inline uint32_t
+lwfgb_u32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t
+lwfgb_u64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline double
+lwfgb_f64(const uint8_t *p)
+{
+	uint64_t v = lwfgb_u64(p);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+/// A flatbuffer table, every access checked against the buffer
+typedef struct {
+	const uint8_t *buf;
+	size_t len;
+	size_t pos;      ///< the table, its soffset to the vtable
+	size_t vtable;
+	uint16_t vsize;  ///< bytes of the vtable
+	uint16_t tsize;  ///< inline bytes of the table
+} lwfgb_table;
+
+int lwfgb_root(lwfgb_table *t, const uint8_t *buf, size_t len);
+uint64_t lwfgb_scalar(const lwfgb_table *t, int id, size_t size, uint64_t def);
+int lwfgb_vector(const lwfgb_table *t, int id, size_t elem, const uint8_t **data, uint32_t *n);
+int lwfgb_subtable(const lwfgb_table *t, int id, lwfgb_table *out);
+int lwfgb_element(const lwfgb_table *t, const uint8_t *data, uint32_t i, lwfgb_table *out);
+
+#endif /* LWFGB_H */
@@ -0,0 +1,218 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include <string.h>
+#include <assert.h>
+
+/// Every arena allocation is rounded to this alignment, which is enough for
+/// doubles, pointers and the LWGEOM header.
+#define LWARENA_ALIGN 16
+#define LWARENA_ROUND(n) (((n) + (LWARENA_ALIGN - 1)) & ~(size_t)(LWARENA_ALIGN - 1))
+
+#define LWARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct lwgeom_arena_block lwgeom_arena_block;
+
+struct lwgeom_arena_block {
+	lwgeom_arena_block *next; ///< next (older) block
+	size_t size;              ///< usable bytes in data
+	size_t used;              ///< bytes handed out
+	size_t last;              ///< offset of the latest allocation
+	char data[] __attribute__((aligned(LWARENA_ALIGN)));
+};
+
+struct lwgeom_arena {
+	lwgeom_arena_block *head; ///< block currently bumped
+	size_t block_size;        ///< usable size of a regular block
+};
+
+static lwgeom_arena_block *
+lwgeom_arena__block_new(size_t size)
+{
+	lwgeom_arena_block *block =
+	    (lwgeom_arena_block *)lwmalloc__cat(sizeof(lwgeom_arena_block) + size, LWGEOM_MEM_ARENA);
+	if (!block)
+		return NULL;
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	block->last = 0;
+	return block;
+}
+
+/// @brief Create an arena
+/// @param block_size usable size of each block, 0 selects the default 64KB
+/// @return the arena, NULL when out of memory
+lwgeom_arena *
+lwgeom_arena_new(size_t block_size)
+{
+	lwgeom_arena *arena = (lwgeom_arena *)lwmalloc(sizeof(lwgeom_arena));
+	if (!arena)
+		return NULL;
+	arena->block_size = LWARENA_ROUND(block_size ? block_size : LWARENA_DEFAULT_BLOCK_SIZE);
+	arena->head = lwgeom_arena__block_new(arena->block_size);
+	if (!arena->head)
+	{
+		lwfree(arena);
+		return NULL;
+	}
+	return arena;
+}
+
+/// @brief Bump allocate \a size bytes from the arena
+/// @param arena the arena
+/// @param size number of bytes
+/// @return 16 byte aligned memory, valid until the arena is reset or freed
+void *
+lwgeom_arena_alloc(lwgeom_arena *arena, size_t size)
+{
+	assert(arena);
+	size = LWARENA_ROUND(size ? size : 1);
+
+	lwgeom_arena_block *head = arena->head;
+	if (head && head->size - head->used >= size)
+	{
+		head->last = head->used;
+		head->used += size;
+		return head->data + head->last;
+	}
+
+	if (size > arena->block_size / 4 && head)
+	{
+		// Large requests get a block of their own, linked behind the head so
+		// the space left in the current block is not wasted
+		lwgeom_arena_block *block = lwgeom_arena__block_new(size);
+		if (!block)
+			return NULL;
+		block->used = size;
+		block->next = head->next;
+		head->next = block;
+		return block->data;
+	}
+
+	lwgeom_arena_block *block = lwgeom_arena__block_new(LWMAX(size, arena->block_size));
+	if (!block)
+		return NULL;
+	block->next = head;
+	block->used = size;
+	arena->head = block;
+	return block->data;
+}
+
+/// Grow or shrink an arena allocation. The latest allocation of the head
+/// block is resized in place when it fits, anything else is copied.
+void *
+lwgeom_arena_realloc(lwgeom_arena *arena, void *mem, size_t oldsize, size_t size)
+{
+	assert(arena);
+	if (!mem)
+		return lwgeom_arena_alloc(arena, size);
+
+	lwgeom_arena_block *head = arena->head;
+	if (head && (char *)mem == head->data + head->last)
+	{
+		size_t want = LWARENA_ROUND(size ? size : 1);
+		if (head->size - head->last >= want)
+		{
+			head->used = head->last + want;
+			return mem;
+		}
+	}
+
+	if (size <= oldsize)
+		return mem;
+
+	void *mem2 = lwgeom_arena_alloc(arena, size);
+	if (mem2)
+		memcpy(mem2, mem, oldsize);
+	return mem2;
+}
+
+/// @brief Release every allocation of the arena but keep one regular block
+/// around, so the arena can be reused for the next batch without hitting
+/// the allocator again.
+/// @param arena the arena
+void
+lwgeom_arena_reset(lwgeom_arena *arena)
+{
+	assert(arena);
+	lwgeom_arena_block *keep = NULL;
+	lwgeom_arena_block *block = arena->head;
+	while (block)
+	{
+		lwgeom_arena_block *next = block->next;
+		if (!keep && block->size == arena->block_size)
+			keep = block;
+		else
+			lwfree(block);
+		block = next;
+	}
+	if (keep)
+	{
+		keep->next = NULL;
+		keep->used = 0;
+		keep->last = 0;
+	}
+	arena->head = keep;
+}
+
+/// @brief Free the arena together with every geometry built in it
+/// @param arena the arena
+void
+lwgeom_arena_free(lwgeom_arena *arena)
+{
+	if (!arena)
+		return;
+	lwgeom_arena_block *block = arena->head;
+	while (block)
+	{
+		lwgeom_arena_block *next = block->next;
+		lwfree(block);
+		block = next;
+	}
+	lwfree(arena);
+}
+
+void *
+lwgeom__malloc(lwgeom_arena *arena, size_t size, lwgeom_mem_category cat)
+{
+	if (arena)
+		return lwgeom_arena_alloc(arena, size);
+	return lwmalloc__cat(size, cat);
+}
+
+void *
+lwgeom__realloc(lwgeom_arena *arena, void *mem, size_t oldsize, size_t size, lwgeom_mem_category cat)
+{
+	if (arena)
+		return lwgeom_arena_realloc(arena, mem, oldsize, size);
+	return lwrealloc__cat(mem, size, cat);
+}
+
+void
+lwgeom__release(lwgeom_arena *arena, void *mem)
+{
+	if (arena || !mem)
+		return;
+	lwfree(mem);
+}
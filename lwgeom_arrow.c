@@ -0,0 +1,481 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Deepest GeoArrow layout, a multipolygon: three lists, the vertices and
+ * their ordinates */
+#define LWARROW_MAX_DEPTH 5
+
+/* The offset columns of a batch, outermost first */
+#define LWARROW_GEOM_LEVEL 0
+#define LWARROW_PART_LEVEL 1
+#define LWARROW_RING_LEVEL 2
+
+static const struct {
+	uint8_t type;
+	uint8_t levels; ///< bit i set when offset column i is a GeoArrow list
+	const char *name;
+	const char *fields[3]; ///< names of the list children, outermost first
+} lwarrow__layouts[] = {
+	{POINTTYPE, 0x0, "geoarrow.point", {NULL, NULL, NULL}},
+	{LINETYPE, 0x4, "geoarrow.linestring", {"vertices", NULL, NULL}},
+	{POLYTYPE, 0x6, "geoarrow.polygon", {"rings", "vertices", NULL}},
+	{MPOINTTYPE, 0x1, "geoarrow.multipoint", {"points", NULL, NULL}},
+	{MLINETYPE, 0x5, "geoarrow.multilinestring", {"linestrings", "vertices", NULL}},
+	{MPOLYTYPE, 0x7, "geoarrow.multipolygon", {"polygons", "rings", "vertices"}},
+};
+
+#define LWARROW_NLAYOUTS (sizeof(lwarrow__layouts) / sizeof(lwarrow__layouts[0]))
+
+static const char *lwarrow__dim_names[] = {"xy", "xyz", "xym", "xyzm"};
+
+static int
+lwarrow__nlists(uint8_t levels)
+{
+	return (levels & 1) + ((levels >> 1) & 1) + ((levels >> 2) & 1);
+}
+
+static const char *
+lwarrow__dim_name(LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	return lwarrow__dim_names[(hasz ? 1 : 0) + (hasm ? 2 : 0)];
+}
+
+/******************************************************************
+ * Export
+ */
+
+typedef struct {
+	int refs;
+	struct ArrowSchema nodes[LWARROW_MAX_DEPTH];
+	struct ArrowSchema *children[LWARROW_MAX_DEPTH];
+	char format[8];
+	char metadata[128];
+} lwarrow__schema_private;
+
+typedef struct {
+	int refs;
+	LWGEOM_BATCH *batch;
+	struct ArrowArray nodes[LWARROW_MAX_DEPTH];
+	struct ArrowArray *children[LWARROW_MAX_DEPTH];
+	const void *buffers[LWARROW_MAX_DEPTH][2];
+} lwarrow__array_private;
+
+/// Every node of an exported schema or array shares one private block, the
+/// last node released frees it. Children may be moved out by the consumer
+/// and released on their own, hence the reference count.
+static void
+lwarrow__release_schema(struct ArrowSchema *schema)
+{
+	for (int64_t i = 0; i < schema->n_children; ++i)
+	{
+		if (schema->children[i]->release)
+			schema->children[i]->release(schema->children[i]);
+	}
+	lwarrow__schema_private *priv = (lwarrow__schema_private *)schema->private_data;
+	schema->release = NULL;
+	if (__atomic_sub_fetch(&priv->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		lwfree(priv);
+}
+
+static void
+lwarrow__release_array(struct ArrowArray *array)
+{
+	for (int64_t i = 0; i < array->n_children; ++i)
+	{
+		if (array->children[i]->release)
+			array->children[i]->release(array->children[i]);
+	}
+	lwarrow__array_private *priv = (lwarrow__array_private *)array->private_data;
+	array->release = NULL;
+	if (__atomic_sub_fetch(&priv->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		lwgeom_batch_free(priv->batch);
+		lwfree(priv);
+	}
+}
+
+/// Append a length prefixed string to Arrow metadata
+static char *
+lwarrow__put_string(char *p, const char *s)
+{
+	int32_t len = (int32_t)strlen(s);
+	memcpy(p, &len, sizeof(int32_t));
+	memcpy(p + sizeof(int32_t), s, (size_t)len);
+	return p + sizeof(int32_t) + len;
+}
+
+static lwarrow__schema_private *
+lwarrow__schema_new(int layout, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	lwarrow__schema_private *priv = (lwarrow__schema_private *)lwmalloc0(sizeof(lwarrow__schema_private));
+	if (!priv)
+		return NULL;
+	int nlists = lwarrow__nlists(lwarrow__layouts[layout].levels);
+	int depth = nlists + 2;
+	priv->refs = depth;
+	snprintf(priv->format, sizeof(priv->format), "+w:%d", (int)LW_POINTBYTESIZE(hasz, hasm));
+
+	// Extension name and empty extension metadata
+	int32_t npairs = 2;
+	memcpy(priv->metadata, &npairs, sizeof(int32_t));
+	char *p = priv->metadata + sizeof(int32_t);
+	p = lwarrow__put_string(p, "ARROW:extension:name");
+	p = lwarrow__put_string(p, lwarrow__layouts[layout].name);
+	p = lwarrow__put_string(p, "ARROW:extension:metadata");
+	lwarrow__put_string(p, "{}");
+
+	for (int i = 0; i < depth; ++i)
+	{
+		struct ArrowSchema *node = &priv->nodes[i];
+		if (i < nlists)
+			node->format = "+l";
+		else if (i == nlists)
+			node->format = priv->format;
+		else
+			node->format = "g";
+		if (i == 0)
+			node->name = "geometry";
+		else if (i <= nlists)
+			node->name = lwarrow__layouts[layout].fields[i - 1];
+		else
+			node->name = lwarrow__dim_name(hasz, hasm);
+		node->flags = i <= nlists ? ARROW_FLAG_NULLABLE : 0;
+		if (i + 1 < depth)
+		{
+			priv->children[i] = &priv->nodes[i + 1];
+			node->n_children = 1;
+			node->children = &priv->children[i];
+		}
+		node->release = lwarrow__release_schema;
+		node->private_data = priv;
+	}
+	priv->nodes[0].metadata = priv->metadata;
+	return priv;
+}
+
+/// Check that the offsets \a offs of \a n entries map entry i to child i,
+/// the layout of a column GeoArrow does not store
+static int
+lwarrow__is_identity(const uint32_t *offs, uint32_t n)
+{
+	for (uint32_t i = 0; i <= n; ++i)
+	{
+		if (offs[i] != i)
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+/// @brief Export a batch as a GeoArrow native array (interleaved coordinates)
+/// The batch is moved into \a array: its columns become the Arrow buffers
+/// without any copy and it is freed by the release callback of \a array.
+/// @param batch batch of features that all have the same point, line,
+/// polygon or multi type, non empty points only
+/// @param schema receives the field, a geoarrow.* extension type
+/// @param array receives the data
+/// @return LW_SUCCESS or LW_FAILURE when the batch has no GeoArrow layout or
+/// when out of memory. On failure the caller still owns the batch.
+int
+lwgeom_batch_to_arrow(LWGEOM_BATCH *batch, struct ArrowSchema *schema, struct ArrowArray *array)
+{
+	assert(batch && schema && array);
+	if (!batch->ngeoms)
+		return LW_FAILURE;
+	int layout = 0;
+	while (layout < (int)LWARROW_NLAYOUTS && lwarrow__layouts[layout].type != batch->types[0])
+		++layout;
+	if (layout == (int)LWARROW_NLAYOUTS)
+		return LW_FAILURE;
+	for (uint32_t i = 1; i < batch->ngeoms; ++i)
+	{
+		if (batch->types[i] != batch->types[0])
+			return LW_FAILURE;
+	}
+
+	// Keep the offset columns GeoArrow stores, the others must be one to one
+	uint8_t levels = lwarrow__layouts[layout].levels;
+	uint32_t *columns[3] = {batch->geom_offsets, batch->part_offsets, batch->ring_offsets};
+	uint32_t *offsets[3];
+	uint32_t lengths[LWARROW_MAX_DEPTH];
+	int nlists = 0;
+	uint32_t n = batch->ngeoms;
+	for (int level = 0; level < 3; ++level)
+	{
+		if (!(levels & (1 << level)))
+		{
+			if (!lwarrow__is_identity(columns[level], n))
+				return LW_FAILURE;
+			continue;
+		}
+		offsets[nlists] = columns[level];
+		lengths[nlists++] = n;
+		n = columns[level][n];
+	}
+	LWBOOLEAN hasz = LWFLAGS_GET_Z(batch->flags) ? LW_TRUE : LW_FALSE;
+	LWBOOLEAN hasm = LWFLAGS_GET_M(batch->flags) ? LW_TRUE : LW_FALSE;
+	size_t cdim = LW_POINTBYTESIZE(hasz, hasm);
+	// Arrow offsets are int32
+	if ((uint64_t)n * cdim > INT32_MAX)
+		return LW_FAILURE;
+
+	lwarrow__schema_private *spriv = lwarrow__schema_new(layout, hasz, hasm);
+	if (!spriv)
+		return LW_FAILURE;
+	lwarrow__array_private *apriv = (lwarrow__array_private *)lwmalloc0(sizeof(lwarrow__array_private));
+	if (!apriv)
+	{
+		lwfree(spriv);
+		return LW_FAILURE;
+	}
+	int depth = nlists + 2;
+	apriv->refs = depth;
+	apriv->batch = batch;
+	lengths[nlists] = n;
+	lengths[nlists + 1] = (uint32_t)(n * cdim);
+	for (int i = 0; i < depth; ++i)
+	{
+		struct ArrowArray *node = &apriv->nodes[i];
+		node->length = lengths[i];
+		node->buffers = apriv->buffers[i];
+		if (i < nlists)
+		{
+			// validity, int32 offsets
+			node->n_buffers = 2;
+			apriv->buffers[i][1] = offsets[i];
+		}
+		else if (i == nlists)
+			node->n_buffers = 1;
+		else
+		{
+			node->n_buffers = 2;
+			apriv->buffers[i][1] = batch->coords;
+		}
+		if (i + 1 < depth)
+		{
+			apriv->children[i] = &apriv->nodes[i + 1];
+			node->n_children = 1;
+			node->children = &apriv->children[i];
+		}
+		node->release = lwarrow__release_array;
+		node->private_data = apriv;
+	}
+	*schema = spriv->nodes[0];
+	*array = apriv->nodes[0];
+	return LW_SUCCESS;
+}
+
+/******************************************************************
+ * Import
+ */
+
+typedef struct {
+	struct ArrowArray array;
+	void *columns;
+} lwarrow__import;
+
+static void
+lwarrow__release_import(void *data)
+{
+	lwarrow__import *imp = (lwarrow__import *)data;
+	if (imp->array.release)
+		imp->array.release(&imp->array);
+	lwfree(imp->columns);
+	lwfree(imp);
+}
+
+/// Look \a key up in Arrow metadata, NULL when missing
+static const char *
+lwarrow__metadata_get(const char *metadata, const char *key, int32_t *len)
+{
+	if (!metadata)
+		return NULL;
+	int32_t npairs;
+	memcpy(&npairs, metadata, sizeof(int32_t));
+	const char *p = metadata + sizeof(int32_t);
+	size_t keylen = strlen(key);
+	for (int32_t i = 0; i < npairs; ++i)
+	{
+		int32_t klen, vlen;
+		memcpy(&klen, p, sizeof(int32_t));
+		const char *k = p + sizeof(int32_t);
+		memcpy(&vlen, k + klen, sizeof(int32_t));
+		const char *v = k + klen + sizeof(int32_t);
+		if ((size_t)klen == keylen && !memcmp(k, key, keylen))
+		{
+			*len = vlen;
+			return v;
+		}
+		p = v + vlen;
+	}
+	return NULL;
+}
+
+/// Match the schema with a GeoArrow interleaved layout
+/// @return the layout index, -1 when none fits
+static int
+lwarrow__parse_schema(const struct ArrowSchema *schema, LWBOOLEAN *hasz, LWBOOLEAN *hasm)
+{
+	int32_t len;
+	const char *name = lwarrow__metadata_get(schema->metadata, "ARROW:extension:name", &len);
+	if (!name)
+		return -1;
+	int layout = 0;
+	while (layout < (int)LWARROW_NLAYOUTS && ((size_t)len != strlen(lwarrow__layouts[layout].name) ||
+						  memcmp(name, lwarrow__layouts[layout].name, (size_t)len)))
+		++layout;
+	if (layout == (int)LWARROW_NLAYOUTS)
+		return -1;
+
+	int nlists = lwarrow__nlists(lwarrow__layouts[layout].levels);
+	const struct ArrowSchema *node = schema;
+	for (int i = 0; i < nlists; ++i)
+	{
+		if (strcmp(node->format, "+l") || node->n_children != 1)
+			return -1;
+		node = node->children[0];
+	}
+	// The vertices, a fixed size list of doubles named after the dimensions
+	if (strncmp(node->format, "+w:", 3) || node->n_children != 1)
+		return -1;
+	int cdim = atoi(node->format + 3);
+	const struct ArrowSchema *ordinates = node->children[0];
+	if (strcmp(ordinates->format, "g"))
+		return -1;
+	if (cdim == 3)
+	{
+		*hasm = ordinates->name && !strcmp(ordinates->name, "xym");
+		*hasz = !*hasm;
+	}
+	else if (cdim == 2 || cdim == 4)
+		*hasz = *hasm = cdim == 4;
+	else
+		return -1;
+	return layout;
+}
+
+/// @brief Import a GeoArrow native array (interleaved coordinates) as a batch
+/// borrowing its buffers, no coordinate or offset is copied.
+/// On success \a array is moved into the batch, the caller must not release
+/// it, and lwgeom_batch_free() releases it. The batch is read-only.
+/// @param schema a geoarrow.* extension field with interleaved coordinates
+/// @param array the data, null features read as what their offsets say,
+/// empty for the lists
+/// @return the batch, NULL when the layout is not supported or invalid or
+/// when out of memory. On failure the caller still owns \a array.
+LWGEOM_BATCH *
+lwgeom_batch_from_arrow(const struct ArrowSchema *schema, struct ArrowArray *array)
+{
+	assert(schema && array && array->release);
+	LWBOOLEAN hasz, hasm;
+	int layout = lwarrow__parse_schema(schema, &hasz, &hasm);
+	if (layout < 0 || array->length < 0 || array->length > INT32_MAX)
+		return NULL;
+	size_t cdim = LW_POINTBYTESIZE(hasz, hasm);
+
+	// Walk the lists down to the vertices, validating every offset
+	uint8_t levels = lwarrow__layouts[layout].levels;
+	const uint32_t *columns[3] = {NULL, NULL, NULL};
+	uint32_t counts[4];
+	uint32_t widest = 0;
+	uint32_t n = (uint32_t)array->length;
+	const struct ArrowArray *node = array;
+	for (int level = 0; level < 3; ++level)
+	{
+		counts[level] = n;
+		if (!(levels & (1 << level)))
+		{
+			widest = LWMAX(widest, n);
+			continue;
+		}
+		if (node->n_buffers != 2 || node->n_children != 1 || node->offset < 0 || !node->buffers[1])
+			return NULL;
+		const int32_t *offs = (const int32_t *)node->buffers[1] + node->offset;
+		const struct ArrowArray *child = node->children[0];
+		if (offs[0] < 0)
+			return NULL;
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			if (offs[i + 1] < offs[i])
+				return NULL;
+		}
+		if (offs[n] > child->length)
+			return NULL;
+		columns[level] = (const uint32_t *)offs;
+		n = (uint32_t)offs[n];
+		node = child;
+	}
+	counts[3] = n;
+	if (node->n_buffers != 1 || node->n_children != 1 || node->offset < 0)
+		return NULL;
+	const struct ArrowArray *ordinates = node->children[0];
+	if (ordinates->n_buffers != 2 || ordinates->offset < 0 ||
+	    (uint64_t)(node->offset + n) * cdim + (uint64_t)ordinates->offset > (uint64_t)ordinates->length ||
+	    (n && !ordinates->buffers[1]))
+		return NULL;
+
+	// Columns GeoArrow does not store: the types and a shared one to one map
+	LWGEOM_BATCH *batch = (LWGEOM_BATCH *)lwmalloc0(sizeof(LWGEOM_BATCH));
+	lwarrow__import *imp = (lwarrow__import *)lwmalloc0(sizeof(lwarrow__import));
+	size_t ntypes = (size_t)counts[0] + counts[1];
+	if (imp)
+		imp->columns = lwmalloc__cat(((size_t)widest + 1) * sizeof(uint32_t) + ntypes, LWGEOM_MEM_GEOMETRY);
+	if (!batch || !imp || !imp->columns)
+	{
+		if (imp)
+			lwfree(imp->columns);
+		lwfree(imp);
+		lwfree(batch);
+		return NULL;
+	}
+	uint32_t *identity = (uint32_t *)imp->columns;
+	for (uint32_t i = 0; i <= widest; ++i)
+		identity[i] = i;
+	batch->types = (uint8_t *)(identity + widest + 1);
+	batch->part_types = batch->types + counts[0];
+	uint8_t type = lwarrow__layouts[layout].type;
+	memset(batch->types, type, counts[0]);
+	memset(batch->part_types, type >= MPOINTTYPE ? type - (MPOINTTYPE - POINTTYPE) : type, counts[1]);
+
+	batch->geom_offsets = (uint32_t *)(columns[0] ? columns[0] : identity);
+	batch->part_offsets = (uint32_t *)(columns[1] ? columns[1] : identity);
+	batch->ring_offsets = (uint32_t *)(columns[2] ? columns[2] : identity);
+	batch->coords = (double *)ordinates->buffers[1] + ordinates->offset + node->offset * (int64_t)cdim;
+	batch->ngeoms = counts[0];
+	batch->nparts = counts[1];
+	batch->nrings = counts[2];
+	batch->npoints = counts[3];
+	LWFLAGS_SET_Z(batch->flags, hasz);
+	LWFLAGS_SET_M(batch->flags, hasm);
+
+	imp->array = *array;
+	array->release = NULL;
+	batch->release = lwarrow__release_import;
+	batch->release_data = imp;
+	return batch;
+}
@@ -0,0 +1,344 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include <string.h>
+#include <assert.h>
+
+/// @brief Create an empty batch
+/// @param hasz features have z
+/// @param hasm features have m
+/// @return the batch, NULL when out of memory
+LWGEOM_BATCH *
+lwgeom_batch_new(LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	LWGEOM_BATCH *batch = (LWGEOM_BATCH *)lwmalloc0(sizeof(LWGEOM_BATCH));
+	if (!batch)
+		return NULL;
+	LWFLAGS_SET_Z(batch->flags, hasz);
+	LWFLAGS_SET_M(batch->flags, hasm);
+	// The offset arrays always hold their leading 0
+	batch->geom_offsets = (uint32_t *)lwcalloc(1, sizeof(uint32_t));
+	batch->part_offsets = (uint32_t *)lwcalloc(1, sizeof(uint32_t));
+	batch->ring_offsets = (uint32_t *)lwcalloc(1, sizeof(uint32_t));
+	if (!batch->geom_offsets || !batch->part_offsets || !batch->ring_offsets)
+	{
+		lwgeom_batch_free(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+void
+lwgeom_batch_free(LWGEOM_BATCH *batch)
+{
+	if (!batch)
+		return;
+	if (batch->release)
+		batch->release(batch->release_data);
+	else
+	{
+		lwfree(batch->types);
+		lwfree(batch->part_types);
+		lwfree(batch->geom_offsets);
+		lwfree(batch->part_offsets);
+		lwfree(batch->ring_offsets);
+		lwfree(batch->coords);
+	}
+	if (batch->scratch)
+		lwgeom_arena_free(batch->scratch);
+	lwfree(batch);
+}
+
+/// @brief Drop every feature, the memory is kept for the next ones. A batch
+/// borrowing its columns is left as is.
+void
+lwgeom_batch_reset(LWGEOM_BATCH *batch)
+{
+	assert(batch);
+	if (batch->release)
+		return;
+	batch->ngeoms = 0;
+	batch->nparts = 0;
+	batch->nrings = 0;
+	batch->npoints = 0;
+}
+
+/// Make room for \a want entries of \a elem bytes plus the trailing offset
+static int
+lwgeom_batch__reserve(void **mem, uint32_t *capacity, uint32_t want, size_t elem, lwgeom_mem_category cat)
+{
+	size_t cap = *capacity ? (size_t)*capacity + 1 : 0;
+	if (want > UINT32_MAX - 2 || !lwgeom__reserve(mem, &cap, (size_t)want + 1, elem, cat))
+		return LW_FAILURE;
+	*capacity = (uint32_t)LWMIN(cap - 1, (size_t)UINT32_MAX - 1);
+	return LW_SUCCESS;
+}
+
+static int
+lwgeom_batch__reserve_geoms(LWGEOM_BATCH *batch, uint32_t want)
+{
+	uint32_t cap = batch->geoms_capacity;
+	if (!lwgeom_batch__reserve(
+		(void **)&batch->geom_offsets, &cap, want, sizeof(uint32_t), LWGEOM_MEM_GEOMETRY))
+		return LW_FAILURE;
+	uint32_t cap2 = batch->geoms_capacity;
+	if (!lwgeom_batch__reserve((void **)&batch->types, &cap2, want, sizeof(uint8_t), LWGEOM_MEM_GEOMETRY))
+		return LW_FAILURE;
+	batch->geoms_capacity = cap;
+	return LW_SUCCESS;
+}
+
+static int
+lwgeom_batch__reserve_parts(LWGEOM_BATCH *batch, uint32_t want)
+{
+	uint32_t cap = batch->parts_capacity;
+	if (!lwgeom_batch__reserve(
+		(void **)&batch->part_offsets, &cap, want, sizeof(uint32_t), LWGEOM_MEM_GEOMETRY))
+		return LW_FAILURE;
+	uint32_t cap2 = batch->parts_capacity;
+	if (!lwgeom_batch__reserve((void **)&batch->part_types, &cap2, want, sizeof(uint8_t), LWGEOM_MEM_GEOMETRY))
+		return LW_FAILURE;
+	batch->parts_capacity = cap;
+	return LW_SUCCESS;
+}
+
+/// Append one ring holding the points of a point or line geometry
+static int
+lwgeom_batch__add_ring(LWGEOM_BATCH *batch, const LWGEOM *ring)
+{
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	if ((uint64_t)batch->npoints + ring->npoints > UINT32_MAX - 1)
+		return LW_FAILURE;
+	uint32_t npoints = batch->npoints + ring->npoints;
+	if (!lwgeom_batch__reserve(
+		(void **)&batch->ring_offsets, &batch->rings_capacity, batch->nrings + 1, sizeof(uint32_t),
+		LWGEOM_MEM_GEOMETRY))
+		return LW_FAILURE;
+	uint32_t cap = batch->points_capacity;
+	if (!lwgeom_batch__reserve((void **)&batch->coords, &cap, npoints, cdim * sizeof(double), LWGEOM_MEM_COORDS))
+		return LW_FAILURE;
+	batch->points_capacity = cap;
+
+	double *dst = batch->coords + (size_t)batch->npoints * cdim;
+	if (ring->npoints && !LWFLAGS_GET_SOA(ring->flags) && !LWFLAGS_GET_QUANT(ring->flags))
+		memcpy(dst, ring->pp, (size_t)ring->npoints * cdim * sizeof(double));
+	else
+	{
+		for (uint32_t i = 0; i < ring->npoints; ++i)
+			lwgeom_point_at(ring, (int)i, dst + (size_t)i * cdim);
+	}
+	batch->npoints = npoints;
+	batch->ring_offsets[++batch->nrings] = npoints;
+	return LW_SUCCESS;
+}
+
+/// Append one part, a point, line or polygon
+static int
+lwgeom_batch__add_part(LWGEOM_BATCH *batch, const LWGEOM *part)
+{
+	if (!lwgeom_batch__reserve_parts(batch, batch->nparts + 1))
+		return LW_FAILURE;
+	if (part->type == POLYTYPE)
+	{
+		for (uint32_t r = 0; r < part->ngeoms; ++r)
+		{
+			if (!lwgeom_batch__add_ring(batch, part->geoms[r]))
+				return LW_FAILURE;
+		}
+	}
+	else if (part->type == POINTTYPE || part->type == LINETYPE)
+	{
+		if (!lwgeom_batch__add_ring(batch, part))
+			return LW_FAILURE;
+	}
+	else
+		return LW_FAILURE;
+	batch->part_types[batch->nparts] = part->type;
+	batch->part_offsets[++batch->nparts] = batch->nrings;
+	return LW_SUCCESS;
+}
+
+/// @brief Append a copy of \a obj to the batch
+/// Nested collections have no columnar form and are refused.
+/// @param batch the batch
+/// @param obj geometry with the dimensions of the batch
+/// @return LW_SUCCESS, LW_FAILURE when \a obj does not fit the batch or when
+/// out of memory. The batch is unchanged on failure.
+int
+lwgeom_batch_append(LWGEOM_BATCH *batch, const LWGEOM *obj)
+{
+	assert(batch && obj);
+	// Borrowed columns are read-only
+	if (batch->release)
+		return LW_FAILURE;
+	if (!LWFLAGS_GET_Z(obj->flags) != !LWFLAGS_GET_Z(batch->flags) ||
+	    !LWFLAGS_GET_M(obj->flags) != !LWFLAGS_GET_M(batch->flags))
+		return LW_FAILURE;
+	if (!lwgeom_batch__reserve_geoms(batch, batch->ngeoms + 1))
+		return LW_FAILURE;
+
+	uint32_t nparts = batch->nparts;
+	uint32_t nrings = batch->nrings;
+	uint32_t npoints = batch->npoints;
+	int ok = LW_SUCCESS;
+	if (obj->type == POINTTYPE || obj->type == LINETYPE || obj->type == POLYTYPE)
+		ok = lwgeom_batch__add_part(batch, obj);
+	else
+	{
+		for (uint32_t i = 0; i < obj->ngeoms && ok; ++i)
+			ok = lwgeom_batch__add_part(batch, obj->geoms[i]);
+	}
+	if (!ok)
+	{
+		batch->nparts = nparts;
+		batch->nrings = nrings;
+		batch->npoints = npoints;
+		return LW_FAILURE;
+	}
+	batch->types[batch->ngeoms] = obj->type;
+	batch->geom_offsets[++batch->ngeoms] = batch->nparts;
+	return LW_SUCCESS;
+}
+
+static lwgeom_arena *
+lwgeom_batch__scratch(LWGEOM_BATCH *batch)
+{
+	if (!batch->scratch)
+		batch->scratch = lwgeom_arena_new(0);
+	else
+		lwgeom_arena_reset(batch->scratch);
+	return batch->scratch;
+}
+
+/// @brief Parse \a wkt and append it, the intermediate geometry lives in an
+/// arena owned by the batch
+/// @return LW_SUCCESS or LW_FAILURE when the text does not parse or fit
+int
+lwgeom_batch_append_wkt(LWGEOM_BATCH *batch, const char *wkt, size_t len)
+{
+	assert(batch && wkt);
+	lwgeom_arena *arena = lwgeom_batch__scratch(batch);
+	if (!arena)
+		return LW_FAILURE;
+	LWGEOM *obj = lwgeom_read_wkt_arena(arena, wkt, len);
+	return obj ? lwgeom_batch_append(batch, obj) : LW_FAILURE;
+}
+
+/// @brief Parse \a wkb and append it, see lwgeom_batch_append_wkt()
+int
+lwgeom_batch_append_wkb(LWGEOM_BATCH *batch, const char *wkb, size_t len, int hex)
+{
+	assert(batch && wkb);
+	lwgeom_arena *arena = lwgeom_batch__scratch(batch);
+	if (!arena)
+		return LW_FAILURE;
+	// The coordinates are copied in the columns, they can alias the input meanwhile
+	LWGEOM *obj = hex ? lwgeom_read_wkb_arena(arena, wkb, len, hex) : lwgeom_read_wkb_borrow(arena, wkb, len);
+	return obj ? lwgeom_batch_append(batch, obj) : LW_FAILURE;
+}
+
+static LWGEOM *
+lwgeom_batch__ring(lwgeom_arena *arena, const LWGEOM_BATCH *batch, uint8_t type, uint32_t r)
+{
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	uint32_t start = batch->ring_offsets[r];
+	return lwgeom__wrap(arena,
+			    type,
+			    batch->ring_offsets[r + 1] - start,
+			    batch->coords + (size_t)start * cdim,
+			    LWFLAGS_GET_Z(batch->flags),
+			    LWFLAGS_GET_M(batch->flags));
+}
+
+static LWGEOM *
+lwgeom_batch__part(lwgeom_arena *arena, const LWGEOM_BATCH *batch, uint32_t p)
+{
+	uint32_t r0 = batch->part_offsets[p];
+	uint32_t r1 = batch->part_offsets[p + 1];
+	if (batch->part_types[p] != POLYTYPE)
+		return lwgeom_batch__ring(arena, batch, batch->part_types[p], r0);
+	if (r1 == r0)
+		return lwgeom__new(arena, POLYTYPE, LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	LWGEOM **rings = (LWGEOM **)lwmalloc((r1 - r0) * sizeof(LWGEOM *));
+	if (!rings)
+		return NULL;
+	uint32_t n = 0;
+	for (; n < r1 - r0; ++n)
+	{
+		rings[n] = lwgeom_batch__ring(arena, batch, LINETYPE, r0 + n);
+		if (!rings[n])
+			break;
+	}
+	LWGEOM *obj = n == r1 - r0 ? lwgeom__poly_from_rings(arena, n, rings) : NULL;
+	if (!obj)
+	{
+		for (uint32_t i = 0; i < n; ++i)
+			lwgeom_free(rings[i]);
+	}
+	lwfree(rings);
+	return obj;
+}
+
+/// @brief Feature \a i as a LWGEOM tree borrowing the coordinates of the
+/// batch, no coordinate is copied
+/// @param batch the batch, must outlive the result and not grow meanwhile
+/// @param i feature index
+/// @return the geometry, NULL when out of range or out of memory
+LWGEOM *
+lwgeom_batch_get(const LWGEOM_BATCH *batch, uint32_t i)
+{
+	return lwgeom_batch_get_arena(NULL, batch, i);
+}
+
+LWGEOM *
+lwgeom_batch_get_arena(lwgeom_arena *arena, const LWGEOM_BATCH *batch, uint32_t i)
+{
+	assert(batch);
+	if (i >= batch->ngeoms)
+		return NULL;
+	uint8_t type = batch->types[i];
+	uint32_t p0 = batch->geom_offsets[i];
+	uint32_t p1 = batch->geom_offsets[i + 1];
+	LWBOOLEAN hasz = LWFLAGS_GET_Z(batch->flags) ? LW_TRUE : LW_FALSE;
+	LWBOOLEAN hasm = LWFLAGS_GET_M(batch->flags) ? LW_TRUE : LW_FALSE;
+
+	// A simple geometry is always made of exactly one part
+	if (type == POINTTYPE || type == LINETYPE || type == POLYTYPE)
+		return lwgeom_batch__part(arena, batch, p0);
+
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(arena, type, hasz, hasm);
+	if (!mobj)
+		return NULL;
+	for (uint32_t p = p0; p < p1; ++p)
+	{
+		LWGEOM *sub = lwgeom_batch__part(arena, batch, p);
+		if (!sub || !lwgeom__add_child(mobj, sub))
+		{
+			if (sub)
+				lwgeom_free(sub);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	}
+	return mobj;
+}
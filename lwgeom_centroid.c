@@ -23,6 +23,10 @@
 #include "liblwgeom_internel.h"
 #include <math.h>
 #include <assert.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 struct nv__centriod {
 	POINT2D p_cent_sum;
@@ -36,90 +40,286 @@ struct nv__centriod {
 	double total_ay;
 };
 
+/// Length weighted segment midpoints of a line, \a stride is the distance
+/// between two consecutive points of \a xs and \a ys
+static inline double
+nv__centriod_line_kernel(const double *xs, const double *ys, size_t stride, size_t npts, POINT2D *sum)
+{
+	double line_len = 0.0;
+	double sx = 0.0;
+	double sy = 0.0;
+	size_t i = 0;
+#if defined(__SSE2__)
+	if (stride == 1)
+	{
+		// Two segments per step, one in each lane
+		__m128d vlen = _mm_setzero_pd();
+		__m128d vsx = _mm_setzero_pd();
+		__m128d vsy = _mm_setzero_pd();
+		for (; i + 3 <= npts; i += 2)
+		{
+			__m128d x1 = _mm_loadu_pd(xs + i);
+			__m128d y1 = _mm_loadu_pd(ys + i);
+			__m128d x2 = _mm_loadu_pd(xs + i + 1);
+			__m128d y2 = _mm_loadu_pd(ys + i + 1);
+			__m128d dx = _mm_sub_pd(x2, x1);
+			__m128d dy = _mm_sub_pd(y2, y1);
+			__m128d len = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+			vlen = _mm_add_pd(vlen, len);
+			vsx = _mm_add_pd(vsx, _mm_mul_pd(len, _mm_add_pd(x1, x2)));
+			vsy = _mm_add_pd(vsy, _mm_mul_pd(len, _mm_add_pd(y1, y2)));
+		}
+		double a[2];
+		_mm_storeu_pd(a, vlen);
+		line_len = a[0] + a[1];
+		_mm_storeu_pd(a, vsx);
+		sx = a[0] + a[1];
+		_mm_storeu_pd(a, vsy);
+		sy = a[0] + a[1];
+	}
+#endif
+	for (; i + 1 < npts; ++i)
+	{
+		double x1 = xs[i * stride];
+		double y1 = ys[i * stride];
+		double x2 = xs[(i + 1) * stride];
+		double y2 = ys[(i + 1) * stride];
+		double dx = x2 - x1;
+		double dy = y2 - y1;
+		double segment_len = sqrt(dx * dx + dy * dy);
+		line_len += segment_len;
+		sx += segment_len * (x1 + x2);
+		sy += segment_len * (y1 + y2);
+	}
+	sum->x += sx * 0.5;
+	sum->y += sy * 0.5;
+	return line_len;
+}
+
+/// Signed area and first moments of a ring, using the triangle fan around
+/// the first vertex
+static inline double
+nv__centriod_ring_kernel(const double *xs, const double *ys, size_t stride, size_t npts, POINT2D *moment)
+{
+	double x0 = xs[0];
+	double y0 = ys[0];
+	double area2 = 0.0;
+	double mx = 0.0;
+	double my = 0.0;
+	size_t i = 1;
+#if defined(__SSE2__)
+	if (stride == 1)
+	{
+		__m128d vx0 = _mm_set1_pd(x0);
+		__m128d vy0 = _mm_set1_pd(y0);
+		__m128d varea = _mm_setzero_pd();
+		__m128d vmx = _mm_setzero_pd();
+		__m128d vmy = _mm_setzero_pd();
+		for (; i + 3 <= npts; i += 2)
+		{
+			__m128d x1 = _mm_sub_pd(_mm_loadu_pd(xs + i), vx0);
+			__m128d y1 = _mm_sub_pd(_mm_loadu_pd(ys + i), vy0);
+			__m128d x2 = _mm_sub_pd(_mm_loadu_pd(xs + i + 1), vx0);
+			__m128d y2 = _mm_sub_pd(_mm_loadu_pd(ys + i + 1), vy0);
+			__m128d cross = _mm_sub_pd(_mm_mul_pd(x1, y2), _mm_mul_pd(x2, y1));
+			varea = _mm_add_pd(varea, cross);
+			vmx = _mm_add_pd(vmx, _mm_mul_pd(cross, _mm_add_pd(x1, x2)));
+			vmy = _mm_add_pd(vmy, _mm_mul_pd(cross, _mm_add_pd(y1, y2)));
+		}
+		double a[2];
+		_mm_storeu_pd(a, varea);
+		area2 = a[0] + a[1];
+		_mm_storeu_pd(a, vmx);
+		mx = a[0] + a[1];
+		_mm_storeu_pd(a, vmy);
+		my = a[0] + a[1];
+	}
+#endif
+	for (; i + 1 < npts; ++i)
+	{
+		double x1 = xs[i * stride] - x0;
+		double y1 = ys[i * stride] - y0;
+		double x2 = xs[(i + 1) * stride] - x0;
+		double y2 = ys[(i + 1) * stride] - y0;
+		double cross = x1 * y2 - x2 * y1;
+		area2 += cross;
+		mx += cross * (x1 + x2);
+		my += cross * (y1 + y2);
+	}
+	// Moments are relative to the first vertex
+	moment->x = mx / 3.0 + area2 * x0;
+	moment->y = my / 3.0 + area2 * y0;
+	return area2;
+}
+
+/// x[] and y[] views of a point or line with their stride. Quantized
+/// coordinates are decoded into \a tmp, which the caller releases.
+static int
+nv__centriod_view(const LWGEOM *obj, const double **xs, const double **ys, size_t *stride, double **tmp)
+{
+	*tmp = NULL;
+	if (LWFLAGS_GET_QUANT(obj->flags))
+	{
+		*tmp = lwgeom__quant_decode(NULL, obj);
+		if (!*tmp)
+			return LW_FAILURE;
+		*xs = *tmp;
+		*ys = *tmp + 1;
+		*stride = (size_t)lwgeom_dim_coordinate(obj);
+		return LW_SUCCESS;
+	}
+	*xs = LWGEOM_PP_XS(obj);
+	*ys = LWGEOM_PP_YS(obj);
+	*stride = LWGEOM_PP_STRIDE(obj);
+	return LW_SUCCESS;
+}
+
 void
 nv__centriod_single(const LWGEOM *obj, struct nv__centriod *centriod)
 {
 	assert(obj);
-	if (lwgeom_dim_geometry(obj) == 0)
+	if (obj->type == POINTTYPE)
 	{
-		centriod->p_cent_sum.x += obj->pp[0];
-		centriod->p_cent_sum.y += obj->pp[1];
+		centriod->p_cent_sum.x += lwgeom_get_x(obj, 0);
+		centriod->p_cent_sum.y += lwgeom_get_y(obj, 0);
 		centriod->pt_num += 1;
 	}
-	else if (lwgeom_dim_geometry(obj) == 1)
+	else if (obj->type == LINETYPE)
 	{
 		size_t npts = obj->npoints;
-		double line_len = 0.0;
-		for (size_t i = 0; i < npts - 1; ++i)
-		{
-			double x1 = lwgeom_get_x(obj, i);
-			double y1 = lwgeom_get_y(obj, i);
-			double x2 = lwgeom_get_x(obj, i + 1);
-			double y2 = lwgeom_get_y(obj, i + 1);
-			double segment_len = LW_POINTDISTANCE(x1, y1, x2, y2);
-			if (segment_len == 0.0)
-				continue;
-
-			line_len += segment_len;
-			double midx = (x1 + x2) * 0.5;
-			double midy = (y1 + y2) * 0.5;
-			centriod->l_cent_sum.x += segment_len * midx;
-			centriod->l_cent_sum.y += segment_len * midy;
-		}
+		if (npts == 0)
+			return;
+		const double *xs, *ys;
+		size_t stride;
+		double *tmp;
+		if (!nv__centriod_view(obj, &xs, &ys, &stride, &tmp))
+			return;
+		double line_len = nv__centriod_line_kernel(xs, ys, stride, npts, &centriod->l_cent_sum);
+		lwfree(tmp);
 		centriod->total_length += line_len;
-		if (line_len == 0.0 && npts > 0)
+		if (line_len == 0.0)
 		{
-			centriod->p_cent_sum.x += obj->pp[0];
-			centriod->p_cent_sum.y += obj->pp[1];
+			centriod->p_cent_sum.x += lwgeom_get_x(obj, 0);
+			centriod->p_cent_sum.y += lwgeom_get_y(obj, 0);
 			centriod->pt_num += 1;
 		}
 	}
-	else if (lwgeom_dim_geometry(obj) == 2)
+	else if (obj->type == POLYTYPE)
 	{
-		double area = lwgeom_prop_area(obj);
-		double tx = 0.0;
-		double ty = 0.0;
-		for (int i = 0; i < obj->npoints; ++i)
+		for (uint32_t r = 0; r < obj->ngeoms; ++r)
 		{
-			tx += lwgeom_get_x(obj, i);
-			ty += lwgeom_get_y(obj, i);
+			const LWGEOM *ring = obj->geoms[r];
+			if (ring->npoints < 3)
+				continue;
+			const double *xs, *ys;
+			size_t stride;
+			double *tmp;
+			if (!nv__centriod_view(ring, &xs, &ys, &stride, &tmp))
+				return;
+			POINT2D moment;
+			double area2 = nv__centriod_ring_kernel(xs, ys, stride, ring->npoints, &moment);
+			lwfree(tmp);
+			// Shell adds, holes subtract, whatever the ring orientation
+			double sign = ((r == 0) == (area2 > 0)) ? 1.0 : -1.0;
+			centriod->total_area += sign * area2 / 2.0;
+			centriod->total_ax += sign * moment.x / 2.0;
+			centriod->total_ay += sign * moment.y / 2.0;
 		}
-		centriod->total_area += area;
-		centriod->total_ax += (tx / obj->npoints);
-		centriod->total_ay += (ty / obj->npoints);
-	}
-}
-
-void
-nv_prop_geo_centriod(const LWGEOM *obj, double *xy)
-{
-	assert(obj);
-	struct nv__centriod centriod;
-	if (obj->ngeoms == 1)
-	{
-		nv__centriod_single(obj, &centriod);
 	}
 	else
 	{
-		for (int i = 0; i < obj->ngeoms; ++i)
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
 		{
-			nv__centriod_single(obj->geoms[i], &centriod);
+			nv__centriod_single(obj->geoms[i], centriod);
 		}
 	}
+}
 
-	if (lwgeom_dim_geometry(obj) == 0)
+/// Centroid from the sums, the highest dimension with a non zero weight wins
+static void
+nv__centriod_finish(const struct nv__centriod *centriod, int gdim, double *xy)
+{
+	if (gdim == 2 && centriod->total_area != 0.0)
 	{
-		xy[0] = centriod.p_cent_sum.x / centriod.pt_num;
-		xy[1] = centriod.p_cent_sum.y / centriod.pt_num;
+		xy[0] = centriod->total_ax / centriod->total_area;
+		xy[1] = centriod->total_ay / centriod->total_area;
 	}
-	else if (lwgeom_dim_geometry(obj) == 1)
+	else if (gdim >= 1 && centriod->total_length != 0.0)
 	{
-		xy[0] = centriod.l_cent_sum.x / centriod.total_length;
-		xy[1] = centriod.l_cent_sum.y / centriod.total_length;
+		xy[0] = centriod->l_cent_sum.x / centriod->total_length;
+		xy[1] = centriod->l_cent_sum.y / centriod->total_length;
 	}
-	else if (lwgeom_dim_geometry(obj) == 2)
+	else
+	{
+		xy[0] = centriod->p_cent_sum.x / centriod->pt_num;
+		xy[1] = centriod->p_cent_sum.y / centriod->pt_num;
+	}
+}
+
+void
+nv_prop_geo_centriod(const LWGEOM *obj, double *xy)
+{
+	assert(obj);
+	struct nv__centriod centriod;
+	memset(&centriod, 0, sizeof(centriod));
+	nv__centriod_single(obj, &centriod);
+
+	nv__centriod_finish(&centriod, lwgeom_dim_geometry(obj), xy);
+}
+
+/// @brief Centroid of every feature of a batch, with the rules of
+/// nv_prop_geo_centriod()
+/// @param batch the batch
+/// @param xy receives 2 * ngeoms doubles, x then y of each feature
+void
+lwgeom_batch_centroid(const LWGEOM_BATCH *batch, double *xy)
+{
+	assert(batch && xy);
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	for (uint32_t g = 0; g < batch->ngeoms; ++g)
 	{
-		xy[0] = centriod.total_area / centriod.total_ax;
-		xy[1] = centriod.total_area / centriod.total_ay;
+		struct nv__centriod centriod;
+		memset(&centriod, 0, sizeof(centriod));
+		int gdim = 0;
+		for (uint32_t p = batch->geom_offsets[g]; p < batch->geom_offsets[g + 1]; ++p)
+		{
+			uint8_t type = batch->part_types[p];
+			for (uint32_t r = batch->part_offsets[p]; r < batch->part_offsets[p + 1]; ++r)
+			{
+				uint32_t start = batch->ring_offsets[r];
+				size_t npts = batch->ring_offsets[r + 1] - start;
+				const double *pp = batch->coords + (size_t)start * cdim;
+				if (type == POLYTYPE)
+				{
+					gdim = 2;
+					if (npts < 3)
+						continue;
+					POINT2D moment;
+					double area2 = nv__centriod_ring_kernel(pp, pp + 1, cdim, npts, &moment);
+					double sign = ((r == batch->part_offsets[p]) == (area2 > 0)) ? 1.0 : -1.0;
+					centriod.total_area += sign * area2 / 2.0;
+					centriod.total_ax += sign * moment.x / 2.0;
+					centriod.total_ay += sign * moment.y / 2.0;
+					continue;
+				}
+				if (npts == 0)
+					continue;
+				double line_len = 0.0;
+				if (type == LINETYPE)
+				{
+					gdim = LWMAX(gdim, 1);
+					line_len =
+					    nv__centriod_line_kernel(pp, pp + 1, cdim, npts, &centriod.l_cent_sum);
+					centriod.total_length += line_len;
+				}
+				if (line_len == 0.0)
+				{
+					centriod.p_cent_sum.x += pp[0];
+					centriod.p_cent_sum.y += pp[1];
+					centriod.pt_num += 1;
+				}
+			}
+		}
+		nv__centriod_finish(&centriod, gdim, xy + 2 * (size_t)g);
 	}
-}
\ No newline at end of file
+}
@@ -74,29 +74,25 @@
 			lwdebug(level, "[%s:%s:%d] " msg, __FILE__, __func__, __LINE__, __VA_ARGS__); \
 	} while (0);
 
-/* Display a notice and an HEXWKB representation of a geometry
- * at the given debug level */
+/* Display a notice and a WKT representation of a geometry
+ * at the given debug level, truncated to fit a stack buffer */
 #define LWDEBUGG(level, geom, msg) \
 	if (LWGEOM_DEBUG_LEVEL >= level) \
 		do \
 		{ \
-			size_t sz; \
-			char *wkt; \
-			lwgeom_write_wkt(geom, &wkt, &sz); \
-			LWDEBUGF(level, msg ": %s", wkt); \
-			lwfree(wkt); \
+			char wkt[1024]; \
+			size_t sz = lwgeom_write_wkt_buf(geom, -1, wkt, sizeof(wkt)); \
+			LWDEBUGF(level, msg ": %s%s", wkt, sz >= sizeof(wkt) ? "..." : ""); \
 		} while (0);
 /* Display a formatted notice and a WKT representation of a geometry
- * at the given debug level */
+ * at the given debug level, truncated to fit a stack buffer */
 #define LWDEBUGGF(level, geom, fmt, ...) \
 	if (LWGEOM_DEBUG_LEVEL >= level) \
 		do \
 		{ \
-			size_t sz; \
-			char *wkt; \
-			lwgeom_write_wkt(geom, &wkt, &sz); \
-			LWDEBUGF(level, fmt ": %s", __VA_ARGS__, wkt); \
-			lwfree(wkt); \
+			char wkt[1024]; \
+			size_t sz = lwgeom_write_wkt_buf(geom, -1, wkt, sizeof(wkt)); \
+			LWDEBUGF(level, fmt ": %s%s", __VA_ARGS__, wkt, sz >= sizeof(wkt) ? "..." : ""); \
 		} while (0);
 
 #else /* LWGEOM_DEBUG_LEVEL <= 0 */
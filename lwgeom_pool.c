@@ -0,0 +1,450 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/// Every block starts with a header recording its size class, the payload
+/// that follows keeps the 16 byte alignment of malloc.
+#define LWPOOL_ALIGN 16
+#define LWPOOL_ROUND(n) (((n) + (LWPOOL_ALIGN - 1)) & ~(size_t)(LWPOOL_ALIGN - 1))
+
+/// Blocks larger than this are not pooled, they go straight to malloc
+#define LWPOOL_MAX_SMALL 8192
+#define LWPOOL_LARGE 0xffffffffu
+#define LWPOOL_MAGIC 0x4c57504fu
+
+/// Size of the chunks carved into blocks of a class
+#define LWPOOL_SLAB_SIZE (64 * 1024)
+
+/// Bytes a thread cache keeps per class before handing blocks back
+#define LWPOOL_CACHE_BYTES (32 * 1024)
+
+typedef struct {
+	uint32_t cls;   ///< size class, LWPOOL_LARGE for malloc blocks
+	uint32_t magic; ///< LWPOOL_MAGIC, catches foreign pointers
+	size_t size;    ///< requested size
+} lwpool_hdr;
+
+typedef struct lwpool_link lwpool_link;
+struct lwpool_link {
+	lwpool_link *next;
+};
+
+typedef struct {
+	pthread_mutex_t lock;
+	lwpool_link *free; ///< blocks handed back by the thread caches
+	size_t size;       ///< block size, header included
+	uint32_t batch;    ///< blocks moved at once between a cache and here
+	uint32_t cache;    ///< blocks a thread cache keeps at most
+	uint64_t slab_blocks;
+} lwpool_class;
+
+typedef struct {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t cache_hits;
+} lwpool_counters;
+
+typedef struct lwpool_cache lwpool_cache;
+struct lwpool_cache {
+	lwpool_cache *next; ///< next thread in the registry
+	lwpool_link *free[LWGEOM_POOL_MAX_CLASSES];
+	uint32_t count[LWGEOM_POOL_MAX_CLASSES];
+	lwpool_counters counters[LWGEOM_POOL_MAX_CLASSES];
+	uint64_t large_allocs;
+	uint64_t large_frees;
+};
+
+static pthread_once_t lwpool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t lwpool_key;
+
+static lwpool_class lwpool_classes[LWGEOM_POOL_MAX_CLASSES];
+static uint32_t lwpool_nclasses = 0;
+/// Size class of every LWPOOL_ALIGN step up to LWPOOL_MAX_SMALL
+static uint8_t lwpool_lookup[LWPOOL_MAX_SMALL / LWPOOL_ALIGN + 1];
+
+/// Registry of the live thread caches, and the counters of exited threads
+static pthread_mutex_t lwpool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static lwpool_cache *lwpool_registry = NULL;
+static lwpool_cache lwpool_retired;
+static size_t lwpool_slab_bytes = 0;
+
+static LW_THREAD_LOCAL lwpool_cache *lwpool_tcache = NULL;
+
+/// Counters have a single writer, the owning thread, and are read by
+/// lwgeom_pool_stats_get() from any thread.
+#define LWPOOL_BUMP(c) __atomic_store_n(&(c), (c) + 1, __ATOMIC_RELAXED)
+#define LWPOOL_LOAD(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+
+static int
+lwpool__cmp_size(const void *a, const void *b)
+{
+	size_t x = *(const size_t *)a;
+	size_t y = *(const size_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void lwpool__thread_exit(void *mem);
+
+/// Size class of a block of \a total bytes, UINT8_MAX when it is not pooled
+static inline uint32_t
+lwpool__class_of(size_t total)
+{
+	return total <= LWPOOL_MAX_SMALL ? lwpool_lookup[(total + LWPOOL_ALIGN - 1) / LWPOOL_ALIGN] : UINT8_MAX;
+}
+
+/// Build the class table. Beside a geometric progression it holds exact
+/// classes for the LWGEOM header, 2-4 double point buffers and the rtree
+/// node, which are by far the most frequent allocations.
+static void
+lwpool__init(void)
+{
+	size_t sizes[LWGEOM_POOL_MAX_CLASSES * 2];
+	uint32_t n = 0;
+	static const size_t base[] = {32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096};
+	for (size_t i = 0; i < sizeof(base) / sizeof(base[0]); i++)
+		sizes[n++] = base[i];
+	sizes[n++] = sizeof(lwpool_hdr) + LWPOOL_ROUND(sizeof(LWGEOM));
+	sizes[n++] = sizeof(lwpool_hdr) + LWPOOL_ROUND(3 * sizeof(double));
+	sizes[n++] = sizeof(lwpool_hdr) + LWPOOL_ROUND(4 * sizeof(double));
+	if (sizeof(lwpool_hdr) + LWPOOL_ROUND(lwgeom__rtree_node_size()) <= LWPOOL_MAX_SMALL)
+		sizes[n++] = sizeof(lwpool_hdr) + LWPOOL_ROUND(lwgeom__rtree_node_size());
+	qsort(sizes, n, sizeof(size_t), lwpool__cmp_size);
+
+	for (uint32_t i = 0; i < n && lwpool_nclasses < LWGEOM_POOL_MAX_CLASSES; i++)
+	{
+		if (lwpool_nclasses && lwpool_classes[lwpool_nclasses - 1].size == sizes[i])
+			continue;
+		lwpool_class *c = &lwpool_classes[lwpool_nclasses++];
+		pthread_mutex_init(&c->lock, NULL);
+		c->free = NULL;
+		c->size = sizes[i];
+		c->cache = (uint32_t)LWMAX(LWPOOL_CACHE_BYTES / c->size, 8);
+		c->batch = c->cache / 2;
+		c->slab_blocks = 0;
+	}
+
+	uint32_t cls = 0;
+	for (size_t i = 0; i <= LWPOOL_MAX_SMALL / LWPOOL_ALIGN; i++)
+	{
+		while (cls < lwpool_nclasses && lwpool_classes[cls].size < i * LWPOOL_ALIGN)
+			cls++;
+		lwpool_lookup[i] = cls < lwpool_nclasses ? (uint8_t)cls : UINT8_MAX;
+	}
+
+	pthread_key_create(&lwpool_key, lwpool__thread_exit);
+}
+
+static lwpool_cache *
+lwpool__cache(void)
+{
+	lwpool_cache *cache = lwpool_tcache;
+	if (cache)
+		return cache;
+
+	pthread_once(&lwpool_once, lwpool__init);
+	cache = (lwpool_cache *)calloc(1, sizeof(lwpool_cache));
+	if (!cache)
+		return NULL;
+	pthread_mutex_lock(&lwpool_registry_lock);
+	cache->next = lwpool_registry;
+	lwpool_registry = cache;
+	pthread_mutex_unlock(&lwpool_registry_lock);
+	pthread_setspecific(lwpool_key, cache);
+	lwpool_tcache = cache;
+	return cache;
+}
+
+/// Hand \a count blocks of the cache back to the class free list
+static void
+lwpool__flush(lwpool_cache *cache, uint32_t cls, uint32_t count)
+{
+	lwpool_link *head = cache->free[cls];
+	if (!head || !count)
+		return;
+	lwpool_link *tail = head;
+	uint32_t n = 1;
+	while (n < count && tail->next)
+	{
+		tail = tail->next;
+		n++;
+	}
+	cache->free[cls] = tail->next;
+	cache->count[cls] -= n;
+
+	lwpool_class *c = &lwpool_classes[cls];
+	pthread_mutex_lock(&c->lock);
+	tail->next = c->free;
+	c->free = head;
+	pthread_mutex_unlock(&c->lock);
+}
+
+/// Move a batch of blocks from the class into the empty cache, carving a
+/// new slab when the class has none left.
+static int
+lwpool__refill(lwpool_cache *cache, uint32_t cls)
+{
+	lwpool_class *c = &lwpool_classes[cls];
+	pthread_mutex_lock(&c->lock);
+	if (!c->free)
+	{
+		size_t nblocks = LWMAX(LWPOOL_SLAB_SIZE / c->size, 8);
+		char *slab = (char *)malloc(nblocks * c->size);
+		if (!slab)
+		{
+			pthread_mutex_unlock(&c->lock);
+			return LW_FAILURE;
+		}
+		for (size_t i = nblocks; i-- > 0;)
+		{
+			lwpool_link *link = (lwpool_link *)(slab + i * c->size);
+			link->next = c->free;
+			c->free = link;
+		}
+		c->slab_blocks += nblocks;
+		__atomic_add_fetch(&lwpool_slab_bytes, nblocks * c->size, __ATOMIC_RELAXED);
+	}
+
+	lwpool_link *head = c->free;
+	lwpool_link *tail = head;
+	uint32_t n = 1;
+	while (n < c->batch && tail->next)
+	{
+		tail = tail->next;
+		n++;
+	}
+	c->free = tail->next;
+	pthread_mutex_unlock(&c->lock);
+
+	tail->next = cache->free[cls];
+	cache->free[cls] = head;
+	cache->count[cls] += n;
+	return LW_SUCCESS;
+}
+
+static void
+lwpool__thread_exit(void *mem)
+{
+	lwpool_cache *cache = (lwpool_cache *)mem;
+	for (uint32_t i = 0; i < lwpool_nclasses; i++)
+		lwpool__flush(cache, i, cache->count[i]);
+
+	pthread_mutex_lock(&lwpool_registry_lock);
+	lwpool_cache **pp = &lwpool_registry;
+	while (*pp && *pp != cache)
+		pp = &(*pp)->next;
+	if (*pp)
+		*pp = cache->next;
+	for (uint32_t i = 0; i < lwpool_nclasses; i++)
+	{
+		lwpool_retired.counters[i].allocs += cache->counters[i].allocs;
+		lwpool_retired.counters[i].frees += cache->counters[i].frees;
+		lwpool_retired.counters[i].cache_hits += cache->counters[i].cache_hits;
+	}
+	lwpool_retired.large_allocs += cache->large_allocs;
+	lwpool_retired.large_frees += cache->large_frees;
+	pthread_mutex_unlock(&lwpool_registry_lock);
+
+	if (lwpool_tcache == cache)
+		lwpool_tcache = NULL;
+	free(cache);
+}
+
+/// @brief Allocate \a size bytes from the pool
+/// @param size number of bytes
+/// @return 16 byte aligned memory, NULL when out of memory
+void *
+lwgeom_pool_malloc(size_t size)
+{
+	lwpool_cache *cache = lwpool__cache();
+	if (!cache)
+		return NULL;
+
+	size_t total = sizeof(lwpool_hdr) + LWPOOL_ROUND(size ? size : 1);
+	uint32_t cls = lwpool__class_of(total);
+	lwpool_hdr *hdr;
+	if (cls == UINT8_MAX)
+	{
+		hdr = (lwpool_hdr *)malloc(total);
+		if (!hdr)
+			return NULL;
+		LWPOOL_BUMP(cache->large_allocs);
+		hdr->cls = LWPOOL_LARGE;
+	}
+	else
+	{
+		if (cache->free[cls])
+			LWPOOL_BUMP(cache->counters[cls].cache_hits);
+		else if (lwpool__refill(cache, cls) != LW_SUCCESS)
+			return NULL;
+		hdr = (lwpool_hdr *)cache->free[cls];
+		cache->free[cls] = ((lwpool_link *)hdr)->next;
+		cache->count[cls]--;
+		LWPOOL_BUMP(cache->counters[cls].allocs);
+		hdr->cls = cls;
+	}
+	hdr->magic = LWPOOL_MAGIC;
+	hdr->size = size;
+	return hdr + 1;
+}
+
+/// Return a block to the calling thread cache. Blocks may be released by
+/// another thread than the one that allocated them.
+void
+lwgeom_pool_free(void *mem)
+{
+	if (!mem)
+		return;
+	lwpool_hdr *hdr = (lwpool_hdr *)mem - 1;
+	if (hdr->magic != LWPOOL_MAGIC)
+	{
+		lwerror("%s: pointer %p was not allocated by the pool", __func__, mem);
+		return;
+	}
+	hdr->magic = 0;
+
+	lwpool_cache *cache = lwpool__cache();
+	if (hdr->cls == LWPOOL_LARGE)
+	{
+		if (cache)
+			LWPOOL_BUMP(cache->large_frees);
+		free(hdr);
+		return;
+	}
+
+	uint32_t cls = hdr->cls;
+	lwpool_link *link = (lwpool_link *)hdr;
+	if (!cache)
+	{
+		lwpool_class *c = &lwpool_classes[cls];
+		pthread_mutex_lock(&c->lock);
+		link->next = c->free;
+		c->free = link;
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+	link->next = cache->free[cls];
+	cache->free[cls] = link;
+	cache->count[cls]++;
+	LWPOOL_BUMP(cache->counters[cls].frees);
+	if (cache->count[cls] > lwpool_classes[cls].cache)
+		lwpool__flush(cache, cls, lwpool_classes[cls].batch);
+}
+
+/// Resize a pool block, in place when the new size still fits its class
+void *
+lwgeom_pool_realloc(void *mem, size_t size)
+{
+	if (!mem)
+		return lwgeom_pool_malloc(size);
+
+	lwpool_hdr *hdr = (lwpool_hdr *)mem - 1;
+	if (hdr->magic != LWPOOL_MAGIC)
+	{
+		lwerror("%s: pointer %p was not allocated by the pool", __func__, mem);
+		return NULL;
+	}
+
+	size_t total = sizeof(lwpool_hdr) + LWPOOL_ROUND(size ? size : 1);
+	if (hdr->cls != LWPOOL_LARGE && total <= lwpool_classes[hdr->cls].size)
+	{
+		hdr->size = size;
+		return mem;
+	}
+	if (hdr->cls == LWPOOL_LARGE && lwpool__class_of(total) == UINT8_MAX)
+	{
+		hdr = (lwpool_hdr *)realloc(hdr, total);
+		if (!hdr)
+			return NULL;
+		hdr->size = size;
+		return hdr + 1;
+	}
+
+	void *mem2 = lwgeom_pool_malloc(size);
+	if (!mem2)
+		return NULL;
+	memcpy(mem2, mem, LWMIN(hdr->size, size));
+	lwgeom_pool_free(mem);
+	return mem2;
+}
+
+/// @brief Install the pool as the global allocator
+/// The pool must be installed before the library allocates anything, since
+/// lwgeom_pool_free() only accepts memory that came from the pool.
+void
+lwgeom_pool_install(void)
+{
+	lwgeom_set_handlers(lwgeom_pool_malloc, lwgeom_pool_realloc, lwgeom_pool_free, NULL, NULL);
+}
+
+/// Hand the blocks cached by the calling thread back to the shared free
+/// lists, e.g. before a worker goes idle for a long time.
+void
+lwgeom_pool_thread_flush(void)
+{
+	lwpool_cache *cache = lwpool_tcache;
+	if (!cache)
+		return;
+	for (uint32_t i = 0; i < lwpool_nclasses; i++)
+		lwpool__flush(cache, i, cache->count[i]);
+}
+
+/// @brief Collect the pool statistics of all threads
+/// @param stats filled with the counters, summed over live and exited threads
+void
+lwgeom_pool_stats_get(lwgeom_pool_stats *stats)
+{
+	pthread_once(&lwpool_once, lwpool__init);
+	memset(stats, 0, sizeof(lwgeom_pool_stats));
+	stats->nclasses = lwpool_nclasses;
+
+	pthread_mutex_lock(&lwpool_registry_lock);
+	for (uint32_t i = 0; i < lwpool_nclasses; i++)
+	{
+		lwgeom_pool_class_stats *s = &stats->classes[i];
+		s->size = lwpool_classes[i].size;
+		s->allocs = lwpool_retired.counters[i].allocs;
+		s->frees = lwpool_retired.counters[i].frees;
+		s->cache_hits = lwpool_retired.counters[i].cache_hits;
+		for (lwpool_cache *cache = lwpool_registry; cache; cache = cache->next)
+		{
+			s->allocs += LWPOOL_LOAD(cache->counters[i].allocs);
+			s->frees += LWPOOL_LOAD(cache->counters[i].frees);
+			s->cache_hits += LWPOOL_LOAD(cache->counters[i].cache_hits);
+		}
+		pthread_mutex_lock(&lwpool_classes[i].lock);
+		s->slab_blocks = lwpool_classes[i].slab_blocks;
+		pthread_mutex_unlock(&lwpool_classes[i].lock);
+	}
+	stats->large_allocs = lwpool_retired.large_allocs;
+	stats->large_frees = lwpool_retired.large_frees;
+	for (lwpool_cache *cache = lwpool_registry; cache; cache = cache->next)
+	{
+		stats->large_allocs += LWPOOL_LOAD(cache->large_allocs);
+		stats->large_frees += LWPOOL_LOAD(cache->large_frees);
+	}
+	pthread_mutex_unlock(&lwpool_registry_lock);
+	stats->slab_bytes = __atomic_load_n(&lwpool_slab_bytes, __ATOMIC_RELAXED);
+}
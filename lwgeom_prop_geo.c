@@ -136,20 +136,4 @@ nv__arc_center(POINT2D c0, POINT2D c1, POINT2D c2, POINT2D *center)
 	center->x = 0.5 * (G3.x - H.x);
 	center->y = 0.5 * (G3.y - H.y);
 	return 1;
-}
-
-LWGEOM *
-lwgeom_clone(const LWGEOM *obj)
-{
-	assert(obj);
-
-	LWGEOM *clone = (LWGEOM *)lwmalloc(sizeof(LWGEOM));
-	if (clone == NULL)
-	{
-		return NULL;
-	}
-
-	clone->ngeoms = obj->ngeoms;
-	if (obj->ngeoms == 1) {}
-	return NULL;
 }
\ No newline at end of file
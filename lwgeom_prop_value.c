@@ -20,9 +20,83 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
 #include <assert.h>
 #include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/// Shoelace sum of a ring, positive for clockwise rings. \a stride is the
+/// distance between two consecutive points of \a xs and \a ys.
+static inline double
+lwgeom__ring_area_kernel(const double *xs, const double *ys, size_t stride, size_t rlen)
+{
+	double sum = 0.0;
+	double x0 = xs[0];
+	size_t i = 1;
+#if defined(__SSE2__)
+	if (stride == 1)
+	{
+		__m128d vx0 = _mm_set1_pd(x0);
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		for (; i + 4 <= rlen - 1; i += 4)
+		{
+			__m128d x = _mm_sub_pd(_mm_loadu_pd(xs + i), vx0);
+			__m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i - 1), _mm_loadu_pd(ys + i + 1));
+			acc0 = _mm_add_pd(acc0, _mm_mul_pd(x, dy));
+			x = _mm_sub_pd(_mm_loadu_pd(xs + i + 2), vx0);
+			dy = _mm_sub_pd(_mm_loadu_pd(ys + i + 1), _mm_loadu_pd(ys + i + 3));
+			acc1 = _mm_add_pd(acc1, _mm_mul_pd(x, dy));
+		}
+		double a[2];
+		_mm_storeu_pd(a, _mm_add_pd(acc0, acc1));
+		sum = a[0] + a[1];
+	}
+#endif
+	for (; i < rlen - 1; i++)
+	{
+		double x = xs[i * stride] - x0;
+		double y1 = ys[(i + 1) * stride];
+		double y2 = ys[(i - 1) * stride];
+		sum += x * (y2 - y1);
+	}
+	return sum;
+}
+
+static inline double
+lwgeom__length_kernel(const double *xs, const double *ys, size_t stride, size_t n)
+{
+	double len = 0.0;
+	size_t i = 1;
+#if defined(__SSE2__)
+	if (stride == 1)
+	{
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), _mm_loadu_pd(xs + i - 1));
+			__m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), _mm_loadu_pd(ys + i - 1));
+			acc0 = _mm_add_pd(acc0, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+			dx = _mm_sub_pd(_mm_loadu_pd(xs + i + 2), _mm_loadu_pd(xs + i + 1));
+			dy = _mm_sub_pd(_mm_loadu_pd(ys + i + 2), _mm_loadu_pd(ys + i + 1));
+			acc1 = _mm_add_pd(acc1, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+		}
+		double a[2];
+		_mm_storeu_pd(a, _mm_add_pd(acc0, acc1));
+		len = a[0] + a[1];
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		double dx = xs[i * stride] - xs[(i - 1) * stride];
+		double dy = ys[i * stride] - ys[(i - 1) * stride];
+		len += sqrt(dx * dx + dy * dy);
+	}
+	return len;
+}
 
 static double
 lwgeom__prop_area(const LWGEOM *obj)
@@ -30,17 +104,12 @@ lwgeom__prop_area(const LWGEOM *obj)
 	uint32_t rlen = obj->npoints;
 	if (rlen < 3)
 		return 0.0;
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_ring_area(obj) / 2.0;
 
-	double sum = 0.0;
-	double x0 = obj->pp[0];
-	for (size_t i = 1; i < rlen - 1; i++)
-	{
-		double x = lwgeom_get_x(obj, i) - x0;
-		double y1 = lwgeom_get_y(obj, i + 1);
-		double y2 = lwgeom_get_y(obj, i - 1);
-		sum += x * (y2 - y1);
-	}
-	return (sum / 2.0);
+	if (LWFLAGS_GET_SOA(obj->flags))
+		return lwgeom__ring_area_kernel(LWGEOM_PP_XS(obj), LWGEOM_PP_YS(obj), 1, rlen) / 2.0;
+	return lwgeom__ring_area_kernel(LWGEOM_PP_XS(obj), LWGEOM_PP_YS(obj), LWGEOM_PP_STRIDE(obj), rlen) / 2.0;
 }
 
 static double
@@ -51,23 +120,15 @@ lwgeom__prop_length(const LWGEOM *obj)
 	{
 		return 0.0;
 	}
-	double len = 0.0;
-	double x0 = obj->pp[0];
-	double y0 = obj->pp[1];
-	for (int i = 1; i < n; ++i)
-	{
-		double x1 = lwgeom_get_x(obj, i);
-		double y1 = lwgeom_get_y(obj, i);
-		double dx = x1 - x0;
-		double dy = y1 - y0;
-
-		len += sqrt(dx * dx + dy * dy);
-		x0 = x1;
-		y0 = y1;
-	}
-	return len;
+	if (LWFLAGS_GET_QUANT(obj->flags))
+		return lwgeom__quant_length(obj);
+	if (LWFLAGS_GET_SOA(obj->flags))
+		return lwgeom__length_kernel(LWGEOM_PP_XS(obj), LWGEOM_PP_YS(obj), 1, n);
+	return lwgeom__length_kernel(LWGEOM_PP_XS(obj), LWGEOM_PP_YS(obj), LWGEOM_PP_STRIDE(obj), n);
 }
 
+/// @brief Area of a geometry. Polygons count their shell minus their holes,
+/// a single ring keeps its signed shoelace area (positive when clockwise).
 double
 lwgeom_prop_area(const LWGEOM *obj)
 {
@@ -78,11 +139,19 @@ lwgeom_prop_area(const LWGEOM *obj)
 	{
 		sum = lwgeom__prop_area(obj);
 	}
+	else if (obj->type == POLYTYPE)
+	{
+		sum = fabs(lwgeom__prop_area(obj->geoms[0]));
+		for (uint32_t i = 1; i < obj->ngeoms; ++i)
+		{
+			sum -= fabs(lwgeom__prop_area(obj->geoms[i]));
+		}
+	}
 	else
 	{
-		for (int i = 0; i < obj->ngeoms; ++i)
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
 		{
-			sum += lwgeom__prop_area(obj->geoms[i]);
+			sum += lwgeom_prop_area(obj->geoms[i]);
 		}
 	}
 	return sum;
@@ -100,9 +169,9 @@ lwgeom_prop_length(const LWGEOM *obj)
 	}
 	else
 	{
-		for (int i = 0; i < obj->ngeoms; ++i)
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
 		{
-			sum += lwgeom__prop_length(obj->geoms[i]);
+			sum += lwgeom_prop_length(obj->geoms[i]);
 		}
 	}
 	return sum;
@@ -112,70 +181,71 @@ double
 lwgeom_prop_width(const LWGEOM *obj)
 {
 	assert(obj);
-	double xmin = 0.0;
-	double xmax = 0.0;
-	if (obj->ngeoms == 1)
-	{
-		xmin = lwgeom_get_x(obj, 0);
-		xmax = lwgeom_get_x(obj, 0);
-		for (int i = 1; i < obj->npoints; ++i)
-		{
-			xmin = lwgeom_get_x(obj, i) > xmin ? xmin : lwgeom_get_x(obj, i);
-			xmax = lwgeom_get_x(obj, i) < xmax ? xmax : lwgeom_get_x(obj, i);
-		}
-		return (xmax - xmin);
-	}
-	else
-	{
-		xmin = obj->geoms[0]->pp[0];
-		xmax = obj->geoms[0]->pp[0];
-		for (int i = 0; i < obj->ngeoms; ++i)
-		{
-			LWGEOM *sub = obj->geoms[i];
-			if (sub == NULL)
-				continue;
-			for (int j = 0; j < sub->npoints; ++j)
-			{
-				xmin = lwgeom_get_x(sub, i) > xmin ? xmin : lwgeom_get_x(sub, i);
-				xmax = lwgeom_get_x(sub, i) < xmax ? xmax : lwgeom_get_x(sub, i);
-			}
-		}
-		return (xmax - xmin);
-	}
+	const LWBOX *box = lwgeom_get_bbox(obj);
+	return box->xmax < box->xmin ? 0.0 : (box->xmax - box->xmin);
 }
 
 double
 lwgeom_prop_height(const LWGEOM *obj)
 {
 	assert(obj);
-	double ymin = 0.0;
-	double ymax = 0.0;
-	if (obj->ngeoms == 1)
+	const LWBOX *box = lwgeom_get_bbox(obj);
+	return box->ymax < box->ymin ? 0.0 : (box->ymax - box->ymin);
+}
+
+/// @brief Area of every feature of a batch, with the rules of
+/// lwgeom_prop_area(). The rings are read in place from the coordinate column.
+void
+lwgeom_batch_area(const LWGEOM_BATCH *batch, double *out)
+{
+	assert(batch && out);
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	for (uint32_t g = 0; g < batch->ngeoms; ++g)
 	{
-		ymin = lwgeom_get_y(obj, 0);
-		ymax = lwgeom_get_y(obj, 0);
-		for (int i = 1; i < obj->npoints; ++i)
+		double sum = 0.0;
+		for (uint32_t p = batch->geom_offsets[g]; p < batch->geom_offsets[g + 1]; ++p)
 		{
-			ymin = lwgeom_get_y(obj, i) > ymin ? ymin : lwgeom_get_y(obj, i);
-			ymax = lwgeom_get_y(obj, i) < ymax ? ymax : lwgeom_get_y(obj, i);
+			for (uint32_t r = batch->part_offsets[p]; r < batch->part_offsets[p + 1]; ++r)
+			{
+				uint32_t start = batch->ring_offsets[r];
+				uint32_t rlen = batch->ring_offsets[r + 1] - start;
+				if (rlen < 3)
+					continue;
+				const double *pp = batch->coords + (size_t)start * cdim;
+				double area = lwgeom__ring_area_kernel(pp, pp + 1, cdim, rlen) / 2.0;
+				if (batch->part_types[p] != POLYTYPE)
+					sum += area;
+				else if (r == batch->part_offsets[p])
+					sum += fabs(area);
+				else
+					sum -= fabs(area);
+			}
 		}
-		return (ymax - ymin);
+		out[g] = sum;
 	}
-	else
+}
+
+/// @brief Length of every feature of a batch, with the rules of
+/// lwgeom_prop_length()
+void
+lwgeom_batch_length(const LWGEOM_BATCH *batch, double *out)
+{
+	assert(batch && out);
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(batch->flags), LWFLAGS_GET_M(batch->flags));
+	for (uint32_t g = 0; g < batch->ngeoms; ++g)
 	{
-		ymin = obj->geoms[0]->pp[1];
-		ymax = obj->geoms[0]->pp[1];
-		for (int i = 0; i < obj->ngeoms; ++i)
+		double sum = 0.0;
+		uint32_t r0 = batch->part_offsets[batch->geom_offsets[g]];
+		uint32_t r1 = batch->part_offsets[batch->geom_offsets[g + 1]];
+		for (uint32_t r = r0; r < r1; ++r)
 		{
-			LWGEOM *sub = obj->geoms[i];
-			if (sub == NULL)
+			uint32_t start = batch->ring_offsets[r];
+			uint32_t n = batch->ring_offsets[r + 1] - start;
+			if (n <= 1)
 				continue;
-			for (int j = 0; j < sub->npoints; ++j)
-			{
-				ymin = lwgeom_get_y(obj, i) > ymin ? ymin : lwgeom_get_y(obj, i);
-				ymax = lwgeom_get_y(obj, i) < ymax ? ymax : lwgeom_get_y(obj, i);
-			}
+			const double *pp = batch->coords + (size_t)start * cdim;
+			sum += lwgeom__length_kernel(pp, pp + 1, cdim, n);
 		}
-		return (ymax - ymin);
+		out[g] = sum;
 	}
-}
\ No newline at end of file
+}
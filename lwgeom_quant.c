@@ -0,0 +1,390 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+/// Slot of LWQUANT.scale/offset for stored ordinate \a o, the 3rd ordinate
+/// of a XYM point is m.
+static inline int
+lwquant__slot(lwflags_t flags, int o)
+{
+	return (o == 2 && !LWFLAGS_GET_Z(flags)) ? 3 : o;
+}
+
+static inline double
+lwquant__decode(const LWQUANT *quant, int slot, int32_t q)
+{
+	return quant->offset[slot] + quant->scale[slot] * (double)q;
+}
+
+/// @brief Fill \a quant so that \a extent is stored with \a precision
+/// Ordinates are centered on the extent, which leaves 2^31 steps of
+/// \a precision on each side of it. z and m keep the same precision around 0.
+/// @param quant receives the scale and offset
+/// @param extent area the coordinates lie in
+/// @param precision size of one integer step, e.g. 0.001 for millimetres
+void
+lwquant_init(LWQUANT *quant, const LWBOX *extent, double precision)
+{
+	assert(quant && extent && precision > 0.0);
+	for (int o = 0; o < 4; ++o)
+	{
+		quant->scale[o] = precision;
+		quant->offset[o] = 0.0;
+	}
+	quant->offset[0] = extent->xmin + (extent->xmax - extent->xmin) / 2.0;
+	quant->offset[1] = extent->ymin + (extent->ymax - extent->ymin) / 2.0;
+}
+
+double
+lwgeom__quant_get(const LWGEOM *obj, uint32_t i, int o)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	return lwquant__decode(obj->quant, lwquant__slot(obj->flags, o), LWGEOM_PP_Q(obj)[(size_t)i * cdim + o]);
+}
+
+/// Whether every ordinate of \a obj rounds to an int32 under \a quant
+static int
+lwgeom__quant_check(const LWGEOM *obj, const LWQUANT *quant)
+{
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (!lwgeom__quant_check(obj->geoms[i], quant))
+			return LW_FALSE;
+	}
+	int cdim = lwgeom_dim_coordinate(obj);
+	double c[4];
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		lwgeom_point_at(obj, (int)i, c);
+		for (int o = 0; o < cdim; ++o)
+		{
+			int slot = lwquant__slot(obj->flags, o);
+			double q = round((c[o] - quant->offset[slot]) / quant->scale[slot]);
+			if (!(q >= (double)INT32_MIN && q <= (double)INT32_MAX))
+				return LW_FALSE;
+		}
+	}
+	return LW_TRUE;
+}
+
+/// Replace the coordinate buffer of a point or line, the old one is released
+/// unless it is borrowed or lives in an arena.
+static void
+lwgeom__quant_swap(LWGEOM *obj, double *pp)
+{
+	if (obj->pp && !LWFLAGS_GET_BORROWED(obj->flags))
+		lwgeom__release(obj->arena, obj->pp);
+	obj->pp = pp;
+	LWFLAGS_SET_BORROWED(obj->flags, LW_FALSE);
+	LWFLAGS_SET_SOA(obj->flags, LW_FALSE);
+}
+
+static int
+lwgeom__quantize(LWGEOM *obj, const LWQUANT *quant)
+{
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (!lwgeom__quantize(obj->geoms[i], quant))
+			return LW_FAILURE;
+	}
+
+	if (obj->npoints)
+	{
+		int cdim = lwgeom_dim_coordinate(obj);
+		int32_t *q = (int32_t *)lwgeom__malloc(
+		    obj->arena, (size_t)obj->npoints * cdim * sizeof(int32_t), LWGEOM_MEM_COORDS);
+		if (!q)
+			return LW_FAILURE;
+		double c[4];
+		for (uint32_t i = 0; i < obj->npoints; ++i)
+		{
+			lwgeom_point_at(obj, (int)i, c);
+			for (int o = 0; o < cdim; ++o)
+			{
+				int slot = lwquant__slot(obj->flags, o);
+				double v = (c[o] - quant->offset[slot]) / quant->scale[slot];
+				q[(size_t)i * cdim + o] = (int32_t)lround(v);
+			}
+		}
+		lwgeom__quant_swap(obj, (double *)q);
+	}
+	obj->quant = quant;
+	LWFLAGS_SET_QUANT(obj->flags, LW_TRUE);
+	// Rounding may move the envelope by half a step
+	LWFLAGS_SET_BBOX(obj->flags, LW_FALSE);
+	return LW_SUCCESS;
+}
+
+/// @brief Store the coordinates of \a obj as int32 steps of \a quant
+/// About half the memory of doubles for XY data. Coordinates are rounded
+/// to the nearest step.
+/// @param obj geometry, converted in place with its children
+/// @param quant scale and offset, must outlive \a obj
+/// @return LW_SUCCESS, LW_FAILURE when a coordinate does not fit in int32 or
+/// when out of memory. \a obj is left untouched when out of range.
+int
+lwgeom_quantize(LWGEOM *obj, const LWQUANT *quant)
+{
+	assert(obj && quant);
+	if (LWFLAGS_GET_QUANT(obj->flags) && obj->quant == quant)
+		return LW_SUCCESS;
+	if (!lwgeom__quant_check(obj, quant))
+		return LW_FAILURE;
+	if (!lwgeom_dequantize(obj))
+		return LW_FAILURE;
+	return lwgeom__quantize(obj, quant);
+}
+
+/// @brief Store the coordinates of \a obj as interleaved doubles again
+/// @param obj geometry, converted in place with its children
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
+int
+lwgeom_dequantize(LWGEOM *obj)
+{
+	assert(obj);
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (!lwgeom_dequantize(obj->geoms[i]))
+			return LW_FAILURE;
+	}
+	if (!LWFLAGS_GET_QUANT(obj->flags))
+		return LW_SUCCESS;
+
+	if (obj->npoints)
+	{
+		double *pp = lwgeom__quant_decode(obj->arena, obj);
+		if (!pp)
+			return LW_FAILURE;
+		lwgeom__quant_swap(obj, pp);
+	}
+	obj->quant = NULL;
+	LWFLAGS_SET_QUANT(obj->flags, LW_FALSE);
+	return LW_SUCCESS;
+}
+
+int
+lwgeom_is_quantized(const LWGEOM *obj)
+{
+	assert(obj);
+	return LWFLAGS_GET_QUANT(obj->flags) ? LW_TRUE : LW_FALSE;
+}
+
+/// Interleaved doubles of a quantized point or line, allocated from \a arena
+/// or with lwmalloc
+double *
+lwgeom__quant_decode(lwgeom_arena *arena, const LWGEOM *obj)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	size_t n = (size_t)obj->npoints * cdim;
+	double *pp = (double *)lwgeom__malloc(arena, n * sizeof(double), LWGEOM_MEM_COORDS);
+	if (!pp)
+		return NULL;
+	const int32_t *q = LWGEOM_PP_Q(obj);
+	for (int o = 0; o < cdim; ++o)
+	{
+		int slot = lwquant__slot(obj->flags, o);
+		double scale = obj->quant->scale[slot];
+		double offset = obj->quant->offset[slot];
+		for (size_t i = o; i < n; i += cdim)
+			pp[i] = offset + scale * (double)q[i];
+	}
+	return pp;
+}
+
+LWGEOM *
+lwgeom__quant_line(lwgeom_arena *arena,
+		   const LWQUANT *quant,
+		   uint8_t type,
+		   uint32_t npoints,
+		   const int32_t *qpp,
+		   int hasz,
+		   int hasm)
+{
+	assert(quant && (qpp || npoints == 0));
+	LWGEOM *obj = lwgeom_line_arena(arena, 0, NULL, hasz, hasm);
+	if (!obj)
+		return NULL;
+	obj->type = type;
+	obj->quant = quant;
+	LWFLAGS_SET_QUANT(obj->flags, LW_TRUE);
+	if (npoints == 0)
+		return obj;
+
+	size_t msize = (size_t)npoints * LW_POINTBYTESIZE(hasz, hasm) * sizeof(int32_t);
+	obj->pp = (double *)lwgeom__malloc(arena, msize, LWGEOM_MEM_COORDS);
+	if (!obj->pp)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	memcpy(obj->pp, qpp, msize);
+	obj->npoints = npoints;
+	return obj;
+}
+
+/// @brief Create a point from an already quantized coordinate
+/// @param quant scale and offset, must outlive the point
+/// @param qpp 2 + hasz + hasm int32 steps
+LWGEOM *
+lwgeom_point_quantized(const LWQUANT *quant, const int32_t *qpp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	return lwgeom__quant_line(NULL, quant, POINTTYPE, 1, qpp, hasz, hasm);
+}
+
+/// @brief Create a line from already quantized coordinates, e.g. decoded
+/// from an integer format, without going through doubles
+/// @param quant scale and offset, must outlive the line
+/// @param npoints number of points
+/// @param qpp npoints * (2 + hasz + hasm) int32 steps, interleaved
+LWGEOM *
+lwgeom_line_quantized(const LWQUANT *quant, uint32_t npoints, const int32_t *qpp, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	return lwgeom__quant_line(NULL, quant, LINETYPE, npoints, qpp, hasz, hasm);
+}
+
+/* --------------------------- integer fast paths --------------------------- */
+
+/// Envelope from the integer min/max, decoded once
+LWBOX
+lwgeom__quant_envelope(const LWGEOM *obj)
+{
+	LWBOX box = {.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX, .zmin = 0.0, .zmax = 0.0};
+	if (obj->npoints == 0)
+		return box;
+	size_t cdim = lwgeom_dim_coordinate(obj);
+	const int32_t *q = LWGEOM_PP_Q(obj);
+	int32_t xmin = q[0], xmax = q[0], ymin = q[1], ymax = q[1];
+	for (size_t i = 1; i < obj->npoints; ++i)
+	{
+		int32_t x = q[i * cdim];
+		int32_t y = q[i * cdim + 1];
+		xmin = x < xmin ? x : xmin;
+		xmax = x > xmax ? x : xmax;
+		ymin = y < ymin ? y : ymin;
+		ymax = y > ymax ? y : ymax;
+	}
+	double x0 = lwquant__decode(obj->quant, 0, xmin);
+	double x1 = lwquant__decode(obj->quant, 0, xmax);
+	double y0 = lwquant__decode(obj->quant, 1, ymin);
+	double y1 = lwquant__decode(obj->quant, 1, ymax);
+	box.xmin = LWMIN(x0, x1);
+	box.xmax = LWMAX(x0, x1);
+	box.ymin = LWMIN(y0, y1);
+	box.ymax = LWMAX(y0, y1);
+	return box;
+}
+
+/// Shoelace sum of a quantized ring with the convention of the double
+/// kernel (positive for clockwise rings). The cross products are exact
+/// integers, only the final scaling rounds.
+double
+lwgeom__quant_ring_area(const LWGEOM *obj)
+{
+	size_t n = obj->npoints;
+	if (n < 3)
+		return 0.0;
+	size_t cdim = lwgeom_dim_coordinate(obj);
+	const int32_t *q = LWGEOM_PP_Q(obj);
+	int64_t x0 = q[0];
+	// Both factors take 33 bits, their product does not fit 64
+#if defined(__SIZEOF_INT128__)
+	typedef __int128 quant_sum;
+#else
+	typedef long double quant_sum;
+#endif
+	quant_sum sum = 0;
+	for (size_t i = 1; i + 1 < n; ++i)
+	{
+		int64_t x = q[i * cdim] - x0;
+		int64_t dy = (int64_t)q[(i - 1) * cdim + 1] - q[(i + 1) * cdim + 1];
+		sum += (quant_sum)x * dy;
+	}
+	return (double)sum * obj->quant->scale[0] * obj->quant->scale[1];
+}
+
+double
+lwgeom__quant_length(const LWGEOM *obj)
+{
+	size_t cdim = lwgeom_dim_coordinate(obj);
+	const int32_t *q = LWGEOM_PP_Q(obj);
+	double sx = obj->quant->scale[0];
+	double sy = obj->quant->scale[1];
+	double len = 0.0;
+	for (size_t i = 1; i < obj->npoints; ++i)
+	{
+		double dx = (double)((int64_t)q[i * cdim] - q[(i - 1) * cdim]) * sx;
+		double dy = (double)((int64_t)q[i * cdim + 1] - q[(i - 1) * cdim + 1]) * sy;
+		len += sqrt(dx * dx + dy * dy);
+	}
+	return len;
+}
+
+/* -------------------------------- equality -------------------------------- */
+
+static int
+lwquant__equals(const LWQUANT *a, const LWQUANT *b)
+{
+	return a == b || memcmp(a, b, sizeof(LWQUANT)) == 0;
+}
+
+/// @brief Whether \a a and \a b have the same structure and coordinates
+/// Quantized geometries sharing their LWQUANT compare their integers,
+/// anything else compares the decoded doubles exactly.
+/// @return LW_TRUE or LW_FALSE
+int
+lwgeom_same(const LWGEOM *a, const LWGEOM *b)
+{
+	assert(a && b);
+	if (a->type != b->type || a->npoints != b->npoints || a->ngeoms != b->ngeoms ||
+	    LWFLAGS_GET_Z(a->flags) != LWFLAGS_GET_Z(b->flags) || LWFLAGS_GET_M(a->flags) != LWFLAGS_GET_M(b->flags))
+		return LW_FALSE;
+
+	for (uint32_t i = 0; i < a->ngeoms; ++i)
+	{
+		if (!lwgeom_same(a->geoms[i], b->geoms[i]))
+			return LW_FALSE;
+	}
+	if (a->npoints == 0)
+		return LW_TRUE;
+
+	int cdim = lwgeom_dim_coordinate(a);
+	if (LWFLAGS_GET_QUANT(a->flags) && LWFLAGS_GET_QUANT(b->flags) && lwquant__equals(a->quant, b->quant))
+		return memcmp(a->pp, b->pp, (size_t)a->npoints * cdim * sizeof(int32_t)) == 0 ? LW_TRUE : LW_FALSE;
+
+	double ca[4], cb[4];
+	for (uint32_t i = 0; i < a->npoints; ++i)
+	{
+		lwgeom_point_at(a, (int)i, ca);
+		lwgeom_point_at(b, (int)i, cb);
+		for (int o = 0; o < cdim; ++o)
+		{
+			if (ca[o] != cb[o])
+				return LW_FALSE;
+		}
+	}
+	return LW_TRUE;
+}
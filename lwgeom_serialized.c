@@ -0,0 +1,424 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+
+#define LWSERIALIZED_VERSION 1
+
+/// Serialization only flag, a LWBOX (xmin, xmax, ymin, ymax) follows the header
+#define LWS_FLAG_BBOX 0x8000
+
+#define LWS_ALIGN8(n) (((n) + 7) & ~(size_t)7)
+#define LWS_BBOX_SIZE (4 * sizeof(double))
+
+/// Record layout, every field is naturally aligned:
+///
+///     header
+///     [double xmin, xmax, ymin, ymax]      when LWS_FLAG_BBOX is set
+///     uint32_t offsets[ngeoms], padded     collections and polygons
+///     child records                        at the offsets above
+///     double pp[npoints * cdim]            points and lines
+///
+/// For records with children npoints is the total number of points below.
+struct LWSERIALIZED {
+	uint32_t size;    ///< record size in bytes, children included
+	uint8_t type;     ///< geometry type
+	uint8_t version;  ///< LWSERIALIZED_VERSION
+	uint16_t flags;   ///< LWGEOM flags plus LWS_FLAG_BBOX
+	uint32_t npoints; ///< number of points
+	uint32_t ngeoms;  ///< number of children
+};
+
+static const uint8_t *
+lws__body(const LWSERIALIZED *s)
+{
+	const uint8_t *p = (const uint8_t *)s + sizeof(LWSERIALIZED);
+	return (s->flags & LWS_FLAG_BBOX) ? p + LWS_BBOX_SIZE : p;
+}
+
+static size_t
+lws__record_size(const LWGEOM *obj, int bbox)
+{
+	size_t size = sizeof(LWSERIALIZED) + (bbox ? LWS_BBOX_SIZE : 0);
+	if (obj->ngeoms == 0)
+		return size + (size_t)obj->npoints * lwgeom_dim_coordinate(obj) * sizeof(double);
+
+	size += LWS_ALIGN8(obj->ngeoms * sizeof(uint32_t));
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		size += lws__record_size(obj->geoms[i], LW_FALSE);
+	return size;
+}
+
+static uint8_t *
+lws__write(const LWGEOM *obj, int bbox, uint8_t *buf)
+{
+	LWSERIALIZED *s = (LWSERIALIZED *)buf;
+	s->type = obj->type;
+	s->version = LWSERIALIZED_VERSION;
+	// Quantized coordinates are stored decoded, blobs always hold doubles
+	s->flags = (obj->flags & ~(LW_FLAG_BORROWED | LW_FLAG_BBOX | LW_FLAG_QUANT)) | (bbox ? LWS_FLAG_BBOX : 0);
+	s->ngeoms = obj->ngeoms;
+
+	uint8_t *p = buf + sizeof(LWSERIALIZED);
+	if (bbox)
+	{
+		const LWBOX *box = lwgeom_get_bbox(obj);
+		double b[4] = {box->xmin, box->xmax, box->ymin, box->ymax};
+		memcpy(p, b, LWS_BBOX_SIZE);
+		p += LWS_BBOX_SIZE;
+	}
+
+	if (obj->ngeoms == 0)
+	{
+		size_t csize = (size_t)obj->npoints * lwgeom_dim_coordinate(obj) * sizeof(double);
+		s->npoints = obj->npoints;
+		if (LWFLAGS_GET_QUANT(obj->flags))
+		{
+			int cdim = lwgeom_dim_coordinate(obj);
+			for (uint32_t i = 0; i < obj->npoints; ++i)
+			{
+				double c[4];
+				lwgeom_point_at(obj, (int)i, c);
+				memcpy(p + (size_t)i * cdim * sizeof(double), c, cdim * sizeof(double));
+			}
+		}
+		else if (csize)
+			memcpy(p, obj->pp, csize);
+		p += csize;
+	}
+	else
+	{
+		uint32_t *offsets = (uint32_t *)p;
+		size_t olen = obj->ngeoms * sizeof(uint32_t);
+		memset(p + olen, 0, LWS_ALIGN8(olen) - olen);
+		p += LWS_ALIGN8(olen);
+		s->npoints = (uint32_t)lwgeom_points_count(obj);
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		{
+			offsets[i] = (uint32_t)(p - buf);
+			p = lws__write(obj->geoms[i], LW_FALSE, p);
+		}
+	}
+	s->size = (uint32_t)(p - buf);
+	return p;
+}
+
+/// @brief Exact size of the serialized form of \a obj
+/// @param obj geometry
+/// @param with_bbox cache the envelope in the blob
+/// @return size in bytes
+size_t
+lwgeom_serialized_size(const LWGEOM *obj, LWBOOLEAN with_bbox)
+{
+	assert(obj);
+	return lws__record_size(obj, with_bbox);
+}
+
+/// @brief Serialize \a obj into caller memory
+/// @param obj geometry
+/// @param with_bbox cache the envelope in the blob
+/// @param buf 8 byte aligned destination
+/// @param len size of \a buf
+/// @return bytes written, 0 when \a buf is too small
+size_t
+lwgeom_serialize_into(const LWGEOM *obj, LWBOOLEAN with_bbox, void *buf, size_t len)
+{
+	assert(obj && buf);
+	assert(((uintptr_t)buf & 7) == 0);
+	size_t size = lws__record_size(obj, with_bbox);
+	if (size > len || size > UINT32_MAX)
+		return 0;
+	lws__write(obj, with_bbox, (uint8_t *)buf);
+	return size;
+}
+
+/// @brief Serialize \a obj into a single lwmalloc'd blob
+/// @param obj geometry
+/// @param with_bbox cache the envelope in the blob
+/// @param size receives the blob size, may be NULL
+/// @return the blob, release it with lwfree()
+LWSERIALIZED *
+lwgeom_serialize(const LWGEOM *obj, LWBOOLEAN with_bbox, size_t *size)
+{
+	assert(obj);
+	size_t len = lws__record_size(obj, with_bbox);
+	if (len > UINT32_MAX)
+		return NULL;
+	LWSERIALIZED *s = (LWSERIALIZED *)lwmalloc(len);
+	if (!s)
+		return NULL;
+	lws__write(obj, with_bbox, (uint8_t *)s);
+	if (size)
+		*size = len;
+	return s;
+}
+
+static LWGEOM *
+lws__read(lwgeom_arena *arena, const LWSERIALIZED *s)
+{
+	int hasz = LWFLAGS_GET_Z(s->flags) ? LW_TRUE : LW_FALSE;
+	int hasm = LWFLAGS_GET_M(s->flags) ? LW_TRUE : LW_FALSE;
+	const uint8_t *body = lws__body(s);
+
+	if (s->type == POINTTYPE || s->type == LINETYPE)
+	{
+		LWGEOM *obj = s->type == POINTTYPE && s->npoints == 1
+				  ? lwgeom_point_arena(arena, (const double *)body, hasz, hasm)
+				  : lwgeom_line_arena(arena, s->npoints, (const double *)body, hasz, hasm);
+		if (obj)
+		{
+			obj->type = s->type;
+			obj->flags = s->flags & ~LWS_FLAG_BBOX;
+		}
+		return obj;
+	}
+
+	if (s->type == POLYTYPE)
+	{
+		if (s->ngeoms == 0)
+		{
+			LWGEOM *obj = lwgeom__new(arena, POLYTYPE, hasz, hasm);
+			if (obj)
+				obj->flags = s->flags & ~LWS_FLAG_BBOX;
+			return obj;
+		}
+		LWGEOM **rings = (LWGEOM **)lwmalloc(s->ngeoms * sizeof(LWGEOM *));
+		if (!rings)
+			return NULL;
+		LWGEOM *obj = NULL;
+		uint32_t n = 0;
+		for (; n < s->ngeoms; ++n)
+		{
+			rings[n] = lws__read(arena, lwserialized_child_at(s, n));
+			if (!rings[n])
+				break;
+		}
+		if (n == s->ngeoms)
+			obj = lwgeom__poly_from_rings(arena, n, rings);
+		if (obj)
+			obj->flags = s->flags & ~LWS_FLAG_BBOX;
+		else
+		{
+			for (uint32_t i = 0; i < n; ++i)
+				lwgeom_free(rings[i]);
+		}
+		lwfree(rings);
+		return obj;
+	}
+
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(arena, s->type, hasz, hasm);
+	if (!mobj)
+		return NULL;
+	for (uint32_t i = 0; i < s->ngeoms; ++i)
+	{
+		LWGEOM *sub = lws__read(arena, lwserialized_child_at(s, i));
+		if (!sub || !lwgeom__add_child(mobj, sub))
+		{
+			lwgeom_free(sub);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	}
+	mobj->flags = s->flags & ~LWS_FLAG_BBOX;
+	return mobj;
+}
+
+/// @brief Rebuild a LWGEOM tree from a blob
+/// @param s blob
+/// @return the geometry, NULL for an unknown blob version
+LWGEOM *
+lwgeom_deserialize(const LWSERIALIZED *s)
+{
+	return lwgeom_deserialize_arena(NULL, s);
+}
+
+LWGEOM *
+lwgeom_deserialize_arena(lwgeom_arena *arena, const LWSERIALIZED *s)
+{
+	assert(s);
+	if (s->version != LWSERIALIZED_VERSION)
+		return NULL;
+	LWGEOM *obj = lws__read(arena, s);
+	// A box stored in the blob seeds the envelope cache
+	if (obj && (s->flags & LWS_FLAG_BBOX) && s->npoints)
+	{
+		LWBOX box;
+		lwserialized_get_bbox(s, &box);
+		obj->env = box;
+		LWFLAGS_SET_BBOX(obj->flags, LW_TRUE);
+	}
+	return obj;
+}
+
+/* ------------------------------- in place view ------------------------------- */
+
+size_t
+lwserialized_size(const LWSERIALIZED *s)
+{
+	assert(s);
+	return s->size;
+}
+
+uint8_t
+lwserialized_type(const LWSERIALIZED *s)
+{
+	assert(s);
+	return s->type;
+}
+
+int
+lwserialized_has_z(const LWSERIALIZED *s)
+{
+	assert(s);
+	return LWFLAGS_GET_Z(s->flags) ? LW_TRUE : LW_FALSE;
+}
+
+int
+lwserialized_has_m(const LWSERIALIZED *s)
+{
+	assert(s);
+	return LWFLAGS_GET_M(s->flags) ? LW_TRUE : LW_FALSE;
+}
+
+int
+lwserialized_has_bbox(const LWSERIALIZED *s)
+{
+	assert(s);
+	return (s->flags & LWS_FLAG_BBOX) ? LW_TRUE : LW_FALSE;
+}
+
+/// @brief Envelope of a blob, read from the cached box when there is one
+/// and computed from the coordinates in place otherwise
+/// @param s blob
+/// @param box receives the envelope
+/// @return LW_SUCCESS, LW_FAILURE for an empty geometry
+int
+lwserialized_get_bbox(const LWSERIALIZED *s, LWBOX *box)
+{
+	assert(s && box);
+	memset(box, 0, sizeof(LWBOX));
+	if (s->flags & LWS_FLAG_BBOX)
+	{
+		double b[4];
+		memcpy(b, (const uint8_t *)s + sizeof(LWSERIALIZED), LWS_BBOX_SIZE);
+		box->xmin = b[0];
+		box->xmax = b[1];
+		box->ymin = b[2];
+		box->ymax = b[3];
+		return s->npoints ? LW_SUCCESS : LW_FAILURE;
+	}
+
+	if (s->npoints == 0)
+		return LW_FAILURE;
+	if (s->ngeoms == 0)
+	{
+		const double *pp = (const double *)lws__body(s);
+		if (LWFLAGS_GET_SOA(s->flags))
+			*box = lwgeom__query_envolpe_soa(pp, pp + s->npoints, (int)s->npoints);
+		else
+			*box = lwgeom__query_envolpe(
+			    pp, (int)s->npoints, LW_POINTBYTESIZE(LWFLAGS_GET_Z(s->flags), LWFLAGS_GET_M(s->flags)));
+		return LW_SUCCESS;
+	}
+
+	box->xmin = box->ymin = DBL_MAX;
+	box->xmax = box->ymax = -DBL_MAX;
+	for (uint32_t i = 0; i < s->ngeoms; ++i)
+	{
+		LWBOX sub;
+		if (!lwserialized_get_bbox(lwserialized_child_at(s, i), &sub))
+			continue;
+		box->xmin = LWMIN(box->xmin, sub.xmin);
+		box->ymin = LWMIN(box->ymin, sub.ymin);
+		box->xmax = LWMAX(box->xmax, sub.xmax);
+		box->ymax = LWMAX(box->ymax, sub.ymax);
+	}
+	return LW_SUCCESS;
+}
+
+int
+lwserialized_children_count(const LWSERIALIZED *s)
+{
+	assert(s);
+	return (int)s->ngeoms;
+}
+
+/// @brief Child record of a collection or ring of a polygon, in place
+/// @param s blob
+/// @param i child index
+/// @return the child record, NULL when \a i is out of range
+const LWSERIALIZED *
+lwserialized_child_at(const LWSERIALIZED *s, int i)
+{
+	assert(s);
+	if (i < 0 || (uint32_t)i >= s->ngeoms)
+		return NULL;
+	const uint32_t *offsets = (const uint32_t *)lws__body(s);
+	return (const LWSERIALIZED *)((const uint8_t *)s + offsets[i]);
+}
+
+/// Number of points, for a collection or polygon the total of its children
+int
+lwserialized_points_count(const LWSERIALIZED *s)
+{
+	assert(s);
+	return (int)s->npoints;
+}
+
+/// @brief Copy the coordinate of the \a n th point of a point or line blob
+/// @param s blob
+/// @param n point index
+/// @param point receives 2 + hasz + hasm doubles
+/// @return LW_SUCCESS or LW_FAILURE when \a n is out of range
+int
+lwserialized_point_at(const LWSERIALIZED *s, int n, double *point)
+{
+	assert(s && point);
+	if (s->ngeoms != 0 || n < 0 || (uint32_t)n >= s->npoints)
+		return LW_FAILURE;
+	const double *pp = (const double *)lws__body(s);
+	size_t cdim = LW_POINTBYTESIZE(LWFLAGS_GET_Z(s->flags), LWFLAGS_GET_M(s->flags));
+	if (!LWFLAGS_GET_SOA(s->flags))
+	{
+		memcpy(point, pp + (size_t)n * cdim, cdim * sizeof(double));
+		return LW_SUCCESS;
+	}
+	for (size_t o = 0; o < cdim; ++o)
+		point[o] = pp[o * s->npoints + n];
+	return LW_SUCCESS;
+}
+
+/// @brief Coordinates of a point or line blob, suitable for lwgeom_line_wrap()
+/// when the blob is not in the structure-of-arrays layout
+/// @param s blob
+/// @return the coordinates, NULL for collections and polygons
+const double *
+lwserialized_points(const LWSERIALIZED *s)
+{
+	assert(s);
+	if (s->ngeoms != 0 || s->npoints == 0)
+		return NULL;
+	return (const double *)lws__body(s);
+}
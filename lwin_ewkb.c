@@ -22,8 +22,16 @@
 
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+
+/// @brief Read binary PostGIS EWKB, the SRID is skipped. The WKB reader
+/// takes the dimensions from the high bits of the type as well.
+/// @param data binary EWKB
+/// @param len bytes of \a data
+/// @return the geometry, NULL when the input is invalid
 LWGEOM *
 lwgeom_read_ewkb(const char *data, size_t len)
 {
-	return NULL;
+	assert(data);
+	return lwgeom_read_wkb(data, len, LW_FALSE);
 }
@@ -0,0 +1,659 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "bytebuffer.h"
+#include "lwfgb.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Nesting of geometries in collections */
+#define FGB_MAX_DEPTH 32
+
+typedef struct {
+	const uint8_t *name;
+	uint32_t len;
+	uint8_t type;
+} fgb_column;
+
+struct lwgeom_fgb_reader {
+	const uint8_t *data;
+	size_t len;
+	int mapped;      ///< data is a mapping of the file
+	uint8_t type;    ///< geometry type of every feature, 0 when mixed
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	uint16_t node_size;
+	uint64_t count;  ///< features, 0 when unknown and the file has no index
+	fgb_column *columns;
+	uint32_t ncolumns;
+	size_t index;    ///< offset of the packed R-tree
+	size_t features; ///< offset of the first feature
+	lwfgb_levels levels;
+
+	/* sequential scan, filtered on the geometry boxes when a query cannot use an index */
+	size_t cursor;
+	uint64_t scanned;
+	int filter;
+	LWBOX box;
+	/* features of an index query, offsets from the first one in file order */
+	int query;
+	uint64_t *hits;
+	size_t nhits;
+	size_t hit;
+	size_t hits_capacity;
+	/* scratch of the search and of the properties */
+	uint64_t *queue;
+	size_t queue_capacity;
+	bytebuffer_t text;
+	int *spans;
+	size_t spans_capacity;
+};
+
+/* -------------------------------- geometry -------------------------------- */
+
+/// Coordinate vectors of a Geometry table
+typedef struct {
+	const uint8_t *xy;
+	const uint8_t *z;
+	const uint8_t *m;
+	uint32_t npoints;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+} fgb_coords;
+
+/// Point or line of the points [from, to), copied out of the file
+static LWGEOM *
+fgb_points(const fgb_coords *c, uint8_t type, uint32_t from, uint32_t to)
+{
+	LWGEOM *obj = lwgeom__new(NULL, type, c->hasz, c->hasm);
+	uint32_t n = to - from;
+	if (!obj || n == 0)
+		return obj;
+	int cdim = LW_POINTBYTESIZE(c->hasz, c->hasm);
+	double *pp = (double *)lwgeom__malloc(NULL, (size_t)n * cdim * sizeof(double), LWGEOM_MEM_COORDS);
+	if (!pp)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	obj->pp = pp;
+	obj->npoints = n;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (cdim == 2)
+	{
+		memcpy(pp, c->xy + (size_t)from * 16, (size_t)n * 16);
+		return obj;
+	}
+#endif
+	for (uint32_t i = from; i < to; i++, pp += cdim)
+	{
+		pp[0] = lwfgb_f64(c->xy + (size_t)i * 16);
+		pp[1] = lwfgb_f64(c->xy + (size_t)i * 16 + 8);
+		if (c->hasz)
+			pp[2] = lwfgb_f64(c->z + (size_t)i * 8);
+		if (c->hasm)
+			pp[cdim - 1] = lwfgb_f64(c->m + (size_t)i * 8);
+	}
+	return obj;
+}
+
+/// Lines of the runs of points delimited by \a ends, or of all the points
+/// without ends, added to \a obj as rings of a polygon or lines of a multi line
+static LWGEOM *
+fgb_runs(LWGEOM *obj, const fgb_coords *c, const uint8_t *ends, uint32_t nends)
+{
+	uint32_t from = 0;
+	uint32_t n = ends ? nends : (c->npoints ? 1 : 0);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint32_t to = ends ? lwfgb_u32(ends + 4 * (size_t)i) : c->npoints;
+		if (to < from || to > c->npoints)
+			return NULL;
+		LWGEOM *line = fgb_points(c, LINETYPE, from, to);
+		if (!line)
+			return NULL;
+		if (obj->type == POLYTYPE)
+		{
+			if (i == 0)
+				LWFLAGS_SET_SHELL_RING(line->flags, LW_TRUE);
+			else
+				LWFLAGS_SET_HOLE_RING(line->flags, LW_TRUE);
+		}
+		if (!lwgeom__add_child(obj, line))
+		{
+			lwgeom_free(line);
+			return NULL;
+		}
+		from = to;
+	}
+	return obj;
+}
+
+/// Geometry table \a g of \a type, 0 to take the type of the table
+static LWGEOM *
+fgb_geometry(const lwgeom_fgb_reader *r, const lwfgb_table *g, uint8_t type, int depth)
+{
+	if (depth > FGB_MAX_DEPTH)
+		return NULL;
+	if (!type)
+		type = (uint8_t)lwfgb_scalar(g, LWFGB_GEOMETRY_TYPE, 1, 0);
+	if (type < POINTTYPE || type > COLLECTIONTYPE)
+		return NULL;
+
+	fgb_coords c = {NULL, NULL, NULL, 0, r->hasz, r->hasm};
+	const uint8_t *ends;
+	const uint8_t *parts;
+	uint32_t nxy, nz, nm, nends, nparts;
+	if (!lwfgb_vector(g, LWFGB_GEOMETRY_XY, 8, &c.xy, &nxy) || !lwfgb_vector(g, LWFGB_GEOMETRY_Z, 8, &c.z, &nz) ||
+	    !lwfgb_vector(g, LWFGB_GEOMETRY_M, 8, &c.m, &nm) ||
+	    !lwfgb_vector(g, LWFGB_GEOMETRY_ENDS, 4, &ends, &nends) ||
+	    !lwfgb_vector(g, LWFGB_GEOMETRY_PARTS, 4, &parts, &nparts))
+		return NULL;
+	c.npoints = nxy / 2;
+	if ((nxy & 1) || (c.hasz && nz != c.npoints) || (c.hasm && nm != c.npoints))
+		return NULL;
+
+	LWGEOM *obj;
+	switch (type)
+	{
+	case POINTTYPE:
+		return fgb_points(&c, POINTTYPE, 0, c.npoints ? 1 : 0);
+	case LINETYPE:
+		return fgb_points(&c, LINETYPE, 0, c.npoints);
+	case MPOINTTYPE:
+		obj = lwgeom__new(NULL, type, c.hasz, c.hasm);
+		for (uint32_t i = 0; obj && i < c.npoints; i++)
+		{
+			LWGEOM *point = fgb_points(&c, POINTTYPE, i, i + 1);
+			if (!point || !lwgeom__add_child(obj, point))
+			{
+				lwgeom_free(point);
+				lwgeom_free(obj);
+				return NULL;
+			}
+		}
+		return obj;
+	case POLYTYPE:
+	case MLINETYPE:
+		obj = lwgeom__new(NULL, type, c.hasz, c.hasm);
+		if (obj && !fgb_runs(obj, &c, nends ? ends : NULL, nends))
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		return obj;
+	}
+
+	obj = lwgeom__new(NULL, type, c.hasz, c.hasm);
+	for (uint32_t i = 0; obj && i < nparts; i++)
+	{
+		lwfgb_table part;
+		LWGEOM *child = NULL;
+		if (lwfgb_element(g, parts, i, &part))
+			child = fgb_geometry(r, &part, type == MPOLYTYPE ? POLYTYPE : 0, depth + 1);
+		if (!child || !lwgeom__add_child(obj, child))
+		{
+			lwgeom_free(child);
+			lwgeom_free(obj);
+			return NULL;
+		}
+	}
+	return obj;
+}
+
+/* ------------------------------- properties ------------------------------- */
+
+/// Bytes of a property value of \a type at \a p, 0 when it overruns \a end
+static size_t
+fgb_value_size(uint8_t type, const uint8_t *p, const uint8_t *end)
+{
+	static const uint8_t sizes[] = {1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+	size_t avail = (size_t)(end - p);
+	size_t size;
+	if (type < sizeof(sizes))
+		size = sizes[type];
+	else if (avail < 4 || lwfgb_u32(p) > avail - 4)
+		return 0;
+	else
+		size = 4 + (size_t)lwfgb_u32(p);
+	return size <= avail ? size : 0;
+}
+
+/// Append the text of a property value of \a type at \a p
+static void
+fgb_value_text(bytebuffer_t *b, uint8_t type, const uint8_t *p)
+{
+	char buf[LWPRINT_BUFSIZE];
+	int n = 0;
+	switch (type)
+	{
+	case LWGEOM_FGB_BYTE:
+		n = snprintf(buf, sizeof(buf), "%d", (int8_t)p[0]);
+		break;
+	case LWGEOM_FGB_UBYTE:
+		n = snprintf(buf, sizeof(buf), "%u", p[0]);
+		break;
+	case LWGEOM_FGB_BOOL:
+		bytebuffer_append_string(b, p[0] ? "true" : "false");
+		return;
+	case LWGEOM_FGB_SHORT:
+		n = snprintf(buf, sizeof(buf), "%d", (int16_t)lwfgb_u16(p));
+		break;
+	case LWGEOM_FGB_USHORT:
+		n = snprintf(buf, sizeof(buf), "%u", lwfgb_u16(p));
+		break;
+	case LWGEOM_FGB_INT:
+		n = snprintf(buf, sizeof(buf), "%" PRId32, (int32_t)lwfgb_u32(p));
+		break;
+	case LWGEOM_FGB_UINT:
+		n = snprintf(buf, sizeof(buf), "%" PRIu32, lwfgb_u32(p));
+		break;
+	case LWGEOM_FGB_LONG:
+		n = snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)lwfgb_u64(p));
+		break;
+	case LWGEOM_FGB_ULONG:
+		n = snprintf(buf, sizeof(buf), "%" PRIu64, lwfgb_u64(p));
+		break;
+	case LWGEOM_FGB_FLOAT: {
+		uint32_t v = lwfgb_u32(p);
+		float f;
+		memcpy(&f, &v, sizeof(f));
+		n = lwprint_double(f, -1, buf);
+		break;
+	}
+	case LWGEOM_FGB_DOUBLE:
+		n = lwprint_double(lwfgb_f64(p), -1, buf);
+		break;
+	default:
+		bytebuffer_append(b, p + 4, lwfgb_u32(p));
+		return;
+	}
+	bytebuffer_append(b, buf, (size_t)n);
+}
+
+/// Feature of the Feature table \a f, properties rendered as text
+static int
+fgb_feature(lwgeom_fgb_reader *r, const lwfgb_table *f, LWGEOM *geom, LW_SGO **sgo)
+{
+	const uint8_t *props;
+	uint32_t len;
+	if (!lwfgb_vector(f, LWFGB_FEATURE_PROPERTIES, 1, &props, &len) || len > INT_MAX / 2)
+		return LW_FAILURE;
+
+	bytebuffer_t *text = &r->text;
+	text->writecursor = text->buf_start;
+	size_t nspans = 0;
+	const uint8_t *end = props + len;
+	for (const uint8_t *p = props; p < end;)
+	{
+		if (end - p < 2)
+			return LW_FAILURE;
+		uint16_t i = lwfgb_u16(p);
+		p += 2;
+		size_t size;
+		if (i >= r->ncolumns || !(size = fgb_value_size(r->columns[i].type, p, end)))
+			return LW_FAILURE;
+		if (!lwgeom__reserve(
+			(void **)&r->spans, &r->spans_capacity, nspans + 4, sizeof(int), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		r->spans[nspans++] = (int)bytebuffer_getlength(text);
+		r->spans[nspans++] = (int)r->columns[i].len;
+		bytebuffer_append(text, r->columns[i].name, r->columns[i].len);
+		r->spans[nspans++] = (int)bytebuffer_getlength(text);
+		fgb_value_text(text, r->columns[i].type, p);
+		r->spans[nspans] = (int)bytebuffer_getlength(text) - r->spans[nspans - 1];
+		nspans++;
+		p += size;
+	}
+	if (text->error || bytebuffer_getlength(text) > INT_MAX)
+		return LW_FAILURE;
+	*sgo = lwgeom__sgo_new(geom, r->spans, nspans, (const char *)text->buf_start, bytebuffer_getlength(text));
+	return *sgo ? LW_SUCCESS : LW_FAILURE;
+}
+
+/* --------------------------------- search --------------------------------- */
+
+static inline int
+fgb_node_intersects(const uint8_t *node, const LWBOX *box)
+{
+	return lwfgb_f64(node) <= box->xmax && lwfgb_f64(node + 8) <= box->ymax && lwfgb_f64(node + 16) >= box->xmin &&
+	       lwfgb_f64(node + 24) >= box->ymin;
+}
+
+/// Collect the features of the leaves intersecting \a box. The tree is
+/// walked breadth first from the root, each queued entry being the first
+/// node of a run of siblings, so leaves come out in file order.
+static int
+fgb_search(lwgeom_fgb_reader *r, const LWBOX *box)
+{
+	const lwfgb_levels *levels = &r->levels;
+	const uint8_t *index = r->data + r->index;
+	size_t head = 0;
+	size_t tail = 0;
+	r->nhits = 0;
+	if (!lwgeom__reserve((void **)&r->queue, &r->queue_capacity, 2, sizeof(uint64_t), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	r->queue[tail++] = 0;
+	r->queue[tail++] = (uint64_t)levels->nlevels - 1;
+	while (head < tail)
+	{
+		uint64_t first = r->queue[head++];
+		int level = (int)r->queue[head++];
+		uint64_t end = LWMIN(first + r->node_size, levels->end[level]);
+		for (uint64_t pos = first; pos < end; pos++)
+		{
+			const uint8_t *node = index + pos * LWFGB_NODE_BYTES;
+			if (!fgb_node_intersects(node, box))
+				continue;
+			uint64_t offset = lwfgb_u64(node + 32);
+			if (level == 0)
+			{
+				if (!lwgeom__reserve((void **)&r->hits,
+						     &r->hits_capacity,
+						     r->nhits + 1,
+						     sizeof(uint64_t),
+						     LWGEOM_MEM_PARSER))
+					return LW_FAILURE;
+				r->hits[r->nhits++] = offset;
+				continue;
+			}
+			// Children are on the level below, which also rules out cycles
+			if (offset < levels->start[level - 1] || offset >= levels->end[level - 1])
+				return LW_FAILURE;
+			if (head > 0 && tail == r->queue_capacity)
+			{
+				memmove(r->queue, r->queue + head, (tail - head) * sizeof(uint64_t));
+				tail -= head;
+				head = 0;
+			}
+			if (!lwgeom__reserve(
+				(void **)&r->queue, &r->queue_capacity, tail + 2, sizeof(uint64_t), LWGEOM_MEM_PARSER))
+				return LW_FAILURE;
+			r->queue[tail++] = offset;
+			r->queue[tail++] = (uint64_t)level - 1;
+		}
+	}
+	return LW_SUCCESS;
+}
+
+/* ---------------------------------- reader -------------------------------- */
+
+/// Parse the magic bytes, the header and locate the index and the features
+static int
+fgb_open(lwgeom_fgb_reader *r)
+{
+	const uint8_t *data = r->data;
+	if (r->len < LWFGB_MAGIC_SIZE + 4 || memcmp(data, lwfgb_magic, 4) || memcmp(data + 4, lwfgb_magic + 4, 3))
+		return LW_FAILURE;
+	size_t size = lwfgb_u32(data + LWFGB_MAGIC_SIZE);
+	size_t hpos = LWFGB_MAGIC_SIZE + 4;
+	lwfgb_table h;
+	if (size > r->len - hpos || !lwfgb_root(&h, data + hpos, size))
+		return LW_FAILURE;
+
+	r->type = (uint8_t)lwfgb_scalar(&h, LWFGB_HEADER_GEOMETRY_TYPE, 1, 0);
+	r->hasz = lwfgb_scalar(&h, LWFGB_HEADER_HAS_Z, 1, 0) ? LW_TRUE : LW_FALSE;
+	r->hasm = lwfgb_scalar(&h, LWFGB_HEADER_HAS_M, 1, 0) ? LW_TRUE : LW_FALSE;
+	r->count = lwfgb_scalar(&h, LWFGB_HEADER_FEATURES_COUNT, 8, 0);
+	r->node_size = (uint16_t)lwfgb_scalar(&h, LWFGB_HEADER_INDEX_NODE_SIZE, 2, LWFGB_DEFAULT_NODE_SIZE);
+	// Curves, surfaces and TINs are not supported
+	if (r->type > COLLECTIONTYPE || r->node_size == 1)
+		return LW_FAILURE;
+
+	const uint8_t *columns;
+	if (!lwfgb_vector(&h, LWFGB_HEADER_COLUMNS, 4, &columns, &r->ncolumns))
+		return LW_FAILURE;
+	if (r->ncolumns)
+	{
+		r->columns = (fgb_column *)lwmalloc__cat(r->ncolumns * sizeof(fgb_column), LWGEOM_MEM_PARSER);
+		if (!r->columns)
+			return LW_FAILURE;
+	}
+	for (uint32_t i = 0; i < r->ncolumns; i++)
+	{
+		lwfgb_table c;
+		if (!lwfgb_element(&h, columns, i, &c) ||
+		    !lwfgb_vector(&c, LWFGB_COLUMN_NAME, 1, &r->columns[i].name, &r->columns[i].len) ||
+		    !r->columns[i].name || r->columns[i].len > INT_MAX / 2)
+			return LW_FAILURE;
+		r->columns[i].type = (uint8_t)lwfgb_scalar(&c, LWFGB_COLUMN_TYPE, 1, LWGEOM_FGB_BYTE);
+		if (r->columns[i].type > LWGEOM_FGB_BINARY)
+			return LW_FAILURE;
+	}
+
+	r->index = hpos + size;
+	r->features = r->index;
+	if (r->node_size && r->count)
+	{
+		// Every feature has a leaf, rule out counts the file cannot hold
+		// before laying out the levels
+		if (r->count > (r->len - r->index) / LWFGB_NODE_BYTES ||
+		    !lwfgb_levels_init(&r->levels, r->count, r->node_size) ||
+		    r->levels.nnodes > (r->len - r->index) / LWFGB_NODE_BYTES)
+			return LW_FAILURE;
+		r->features += r->levels.nnodes * LWFGB_NODE_BYTES;
+	}
+	else
+		r->node_size = 0;
+	r->cursor = r->features;
+	return LW_SUCCESS;
+}
+
+static lwgeom_fgb_reader *
+fgb_reader_new(const uint8_t *data, size_t len, int mapped)
+{
+	lwgeom_fgb_reader *r = (lwgeom_fgb_reader *)lwmalloc__cat(sizeof(lwgeom_fgb_reader), LWGEOM_MEM_PARSER);
+	if (!r)
+		return NULL;
+	memset(r, 0, sizeof(lwgeom_fgb_reader));
+	bytebuffer_init(&r->text);
+	r->data = data;
+	r->len = len;
+	r->mapped = mapped;
+	if (!fgb_open(r))
+	{
+		// The mapping stays with the caller
+		r->mapped = LW_FALSE;
+		lwgeom_fgb_reader_free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/// @brief Map the FlatGeobuf file at \a path, only the pages of the header,
+/// of the index nodes visited and of the features read are touched
+/// @return the reader to release with lwgeom_fgb_reader_free(), NULL when
+/// the file cannot be mapped or its header is malformed
+lwgeom_fgb_reader *
+lwgeom_fgb_reader_open(const char *path)
+{
+	assert(path);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	// Queries read scattered features
+	madvise(map, (size_t)st.st_size, MADV_RANDOM);
+	lwgeom_fgb_reader *r = fgb_reader_new((const uint8_t *)map, (size_t)st.st_size, LW_TRUE);
+	if (!r)
+		munmap(map, (size_t)st.st_size);
+	return r;
+}
+
+/// @brief Read the FlatGeobuf file in \a data, which has to outlive the reader
+lwgeom_fgb_reader *
+lwgeom_fgb_reader_mem(const char *data, size_t len)
+{
+	assert(data || len == 0);
+	return fgb_reader_new((const uint8_t *)data, len, LW_FALSE);
+}
+
+/// @brief Number of features from the header, 0 when the writer left it unknown
+uint64_t
+lwgeom_fgb_reader_count(const lwgeom_fgb_reader *reader)
+{
+	assert(reader);
+	return reader->count;
+}
+
+/// @brief Restrict the next features to those whose box intersects \a box,
+/// found through the index when the file has one, by decoding every
+/// feature otherwise. Restarts the iteration.
+/// @param reader reader
+/// @param box query box, NULL for every feature
+/// @return LW_FAILURE when the index is malformed
+int
+lwgeom_fgb_reader_query(lwgeom_fgb_reader *reader, const LWBOX *box)
+{
+	assert(reader);
+	reader->cursor = reader->features;
+	reader->scanned = 0;
+	reader->filter = LW_FALSE;
+	reader->query = LW_FALSE;
+	reader->nhits = reader->hit = 0;
+	if (!box)
+		return LW_SUCCESS;
+	if (!reader->node_size)
+	{
+		reader->filter = LW_TRUE;
+		reader->box = *box;
+		return LW_SUCCESS;
+	}
+	reader->query = LW_TRUE;
+	return fgb_search(reader, box);
+}
+
+/// @brief Next feature of \a reader, decoded on demand and owned by the caller
+/// @param[out] sgo the feature, NULL at the end
+/// @return LW_FAILURE for a malformed feature
+int
+lwgeom_fgb_reader_next(lwgeom_fgb_reader *reader, LW_SGO **sgo)
+{
+	assert(reader && sgo);
+	*sgo = NULL;
+	for (;;)
+	{
+		size_t pos;
+		if (reader->query)
+		{
+			if (reader->hit == reader->nhits)
+				return LW_SUCCESS;
+			uint64_t offset = reader->hits[reader->hit++];
+			if (offset > reader->len - reader->features)
+				return LW_FAILURE;
+			pos = reader->features + (size_t)offset;
+		}
+		else
+		{
+			if (reader->cursor == reader->len || (reader->count && reader->scanned == reader->count))
+				return LW_SUCCESS;
+			pos = reader->cursor;
+		}
+
+		if (reader->len - pos < 4)
+			return LW_FAILURE;
+		size_t size = lwfgb_u32(reader->data + pos);
+		lwfgb_table f, g;
+		if (size > reader->len - pos - 4 || !lwfgb_root(&f, reader->data + pos + 4, size) ||
+		    !lwfgb_subtable(&f, LWFGB_FEATURE_GEOMETRY, &g))
+			return LW_FAILURE;
+		if (!reader->query)
+		{
+			reader->cursor = pos + 4 + size;
+			reader->scanned++;
+		}
+
+		LWGEOM *geom = NULL;
+		if (g.buf && !(geom = fgb_geometry(reader, &g, reader->type, 0)))
+			return LW_FAILURE;
+		if (reader->filter)
+		{
+			const LWBOX *b = geom ? lwgeom_get_bbox(geom) : NULL;
+			const LWBOX *q = &reader->box;
+			if (!b || b->xmin > q->xmax || b->ymin > q->ymax || b->xmax < q->xmin || b->ymax < q->ymin)
+			{
+				lwgeom_free(geom);
+				continue;
+			}
+		}
+		if (!fgb_feature(reader, &f, geom, sgo))
+		{
+			lwgeom_free(geom);
+			return LW_FAILURE;
+		}
+		return LW_SUCCESS;
+	}
+}
+
+/// @brief Append at most \a max features of \a reader to \a out
+/// @return LW_FAILURE for a malformed feature, the features read before are kept
+int
+lwgeom_fgb_reader_read(lwgeom_fgb_reader *reader, LWGEOMREADER2 *out, size_t max)
+{
+	assert(reader && out);
+	for (size_t i = 0; i < max; ++i)
+	{
+		if (!lwgeom__reserve(
+			(void **)&out->sgos, &out->nsgo_max, out->nsgo + 1, sizeof(LW_SGO *), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		LW_SGO *sgo;
+		if (!lwgeom_fgb_reader_next(reader, &sgo))
+			return LW_FAILURE;
+		if (!sgo)
+			break;
+		out->sgos[out->nsgo++] = sgo;
+	}
+	return LW_SUCCESS;
+}
+
+void
+lwgeom_fgb_reader_free(lwgeom_fgb_reader *reader)
+{
+	if (reader == NULL)
+		return;
+	if (reader->mapped)
+		munmap((void *)reader->data, reader->len);
+	lwfree(reader->columns);
+	lwfree(reader->hits);
+	lwfree(reader->queue);
+	lwfree(reader->spans);
+	bytebuffer_destroy_buffer(&reader->text);
+	lwfree(reader);
+}
@@ -20,10 +20,885 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+#include <string.h>
+
+/* Input is pulled in blocks of this size, the buffer grows past it only for larger features */
+#define GEOJSON_BLOCK_SIZE (64 * 1024)
+/* Nesting of coordinate arrays, a MultiPolygon has 4 */
+#define GEOJSON_MAX_LEVELS 4
+/* Nesting of GeometryCollections */
+#define GEOJSON_MAX_DEPTH 32
+
+typedef struct {
+	uint32_t *v;
+	uint32_t n;
+	uint32_t capacity;
+} geojson_counts;
+
+/// Parser over a feature or a geometry held in memory. The scratch is kept
+/// from one feature to the next, it is as large as the largest feature.
+typedef struct {
+	const char *pos;
+	const char *end;
+
+	double *coords;  ///< positions of the last "coordinates"
+	size_t ncoords;
+	size_t capacity;
+	int cdim;        ///< ordinates per position, 0 before the first one
+	int pos_level;   ///< nesting of the positions, -1 before the first one
+	geojson_counts counts[GEOJSON_MAX_LEVELS]; ///< children of the arrays at each level
+
+	int *spans;      ///< key and value spans of the properties
+	size_t nspans;
+	size_t spans_capacity;
+} geojson_parser;
+
+typedef enum {
+	GEOJSON_TOP = 0, ///< between top level values
+	GEOJSON_FEATURES, ///< in the "features" array of a FeatureCollection
+	GEOJSON_TAIL,     ///< after "features", up to the end of the FeatureCollection
+	GEOJSON_END,
+	GEOJSON_ERROR
+} geojson_state;
+
+struct lwgeom_geojson_reader {
+	lwgeom_input in; ///< in.begin is the first unconsumed byte
+	geojson_state state;
+
+	geojson_parser parser;
+};
+
+/* --------------------------- in memory parsing ---------------------------- */
+
+static inline int
+geojson_is_blank(char c)
+{
+	// RS separates the texts of a GeoJSON sequence (RFC 8142)
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\x1e';
+}
+
+static inline char
+geojson_peek(geojson_parser *ps)
+{
+	while (ps->pos < ps->end && geojson_is_blank(*ps->pos))
+		ps->pos++;
+	return ps->pos < ps->end ? *ps->pos : '\0';
+}
+
+static inline int
+geojson_accept(geojson_parser *ps, char c)
+{
+	if (geojson_peek(ps) != c)
+		return LW_FALSE;
+	ps->pos++;
+	return LW_TRUE;
+}
+
+/// Read a string, \a s and \a n receive its raw content without the quotes
+static int
+geojson_read_string(geojson_parser *ps, const char **s, size_t *n)
+{
+	if (!geojson_accept(ps, '"'))
+		return LW_FAILURE;
+	const char *p = ps->pos;
+	while (p < ps->end && *p != '"')
+		p += *p == '\\' ? 2 : 1;
+	if (p >= ps->end)
+		return LW_FAILURE;
+	*s = ps->pos;
+	*n = (size_t)(p - ps->pos);
+	ps->pos = p + 1;
+	return LW_SUCCESS;
+}
+
+static inline int
+geojson_is(const char *s, size_t n, const char *word)
+{
+	return strlen(word) == n && memcmp(s, word, n) == 0;
+}
+
+/// Read a member name and its ':'
+static inline int
+geojson_read_key(geojson_parser *ps, const char **s, size_t *n)
+{
+	return geojson_read_string(ps, s, n) && geojson_accept(ps, ':');
+}
+
+/// Skip any value, checking no more than its nesting
+static int
+geojson_skip_value(geojson_parser *ps)
+{
+	const char *s;
+	size_t n;
+	char c = geojson_peek(ps);
+	if (c == '"')
+		return geojson_read_string(ps, &s, &n);
+	if (c != '{' && c != '[')
+	{
+		// Number or literal
+		const char *start = ps->pos;
+		while (ps->pos < ps->end && !geojson_is_blank(*ps->pos) && *ps->pos != ',' && *ps->pos != ']' &&
+		       *ps->pos != '}')
+			ps->pos++;
+		return ps->pos > start;
+	}
+
+	int depth = 0;
+	while (ps->pos < ps->end)
+	{
+		c = *ps->pos;
+		if (c == '"')
+		{
+			if (!geojson_read_string(ps, &s, &n))
+				return LW_FAILURE;
+			continue;
+		}
+		ps->pos++;
+		if (c == '{' || c == '[')
+			depth++;
+		else if ((c == '}' || c == ']') && --depth == 0)
+			return LW_SUCCESS;
+	}
+	return LW_FAILURE;
+}
+
+static int
+geojson_push_count(geojson_parser *ps, int level, uint32_t n)
+{
+	geojson_counts *c = &ps->counts[level];
+	if (c->n == c->capacity)
+	{
+		size_t capacity = c->capacity;
+		if (!lwgeom__reserve((void **)&c->v, &capacity, (size_t)c->n + 1, sizeof(uint32_t), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		c->capacity = (uint32_t)capacity;
+	}
+	c->v[c->n++] = n;
+	return LW_SUCCESS;
+}
+
+/// Position of 2 to 4 numbers parsed in place, more ordinates are ignored
+static int
+geojson_read_position(geojson_parser *ps, int level)
+{
+	if (ps->pos_level >= 0 && ps->pos_level != level)
+		return LW_FAILURE;
+	ps->pos_level = level;
+	if (!lwgeom__reserve((void **)&ps->coords, &ps->capacity, ps->ncoords + 4, sizeof(double), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+
+	double *pp = ps->coords + ps->ncoords;
+	int n = 0;
+	do
+	{
+		double v;
+		geojson_peek(ps);
+		const char *next = lwgeom__parse_double(ps->pos, ps->end, &v);
+		if (!next)
+			return LW_FAILURE;
+		ps->pos = next;
+		if (n < 4)
+			pp[n] = v;
+		n++;
+	} while (geojson_accept(ps, ','));
+	if (!geojson_accept(ps, ']') || n < 2)
+		return LW_FAILURE;
+
+	n = n > 4 ? 4 : n;
+	if (ps->cdim && ps->cdim != n)
+		return LW_FAILURE;
+	ps->cdim = n;
+	ps->ncoords += (size_t)n;
+	return LW_SUCCESS;
+}
+
+/// Nested arrays of positions, whatever the geometry type: the positions go
+/// to coords and the children count of every other array to counts[level]
+static int
+geojson_read_array(geojson_parser *ps, int level)
+{
+	if (level >= GEOJSON_MAX_LEVELS || !geojson_accept(ps, '['))
+		return LW_FAILURE;
+	char c = geojson_peek(ps);
+	if (c == ']')
+	{
+		ps->pos++;
+		return geojson_push_count(ps, level, 0);
+	}
+	if (c != '[')
+		return geojson_read_position(ps, level);
+
+	uint32_t n = 0;
+	do
+	{
+		if (!geojson_read_array(ps, level + 1))
+			return LW_FAILURE;
+		n++;
+	} while (geojson_accept(ps, ','));
+	return geojson_accept(ps, ']') && geojson_push_count(ps, level, n);
+}
+
+static int
+geojson_read_coordinates(geojson_parser *ps)
+{
+	ps->ncoords = 0;
+	ps->cdim = 0;
+	ps->pos_level = -1;
+	for (int l = 0; l < GEOJSON_MAX_LEVELS; ++l)
+		ps->counts[l].n = 0;
+	return geojson_read_array(ps, 0);
+}
+
+static uint8_t
+geojson_type(const char *s, size_t n)
+{
+	static const char *names[] = {"",
+				       "Point",
+				       "LineString",
+				       "Polygon",
+				       "MultiPoint",
+				       "MultiLineString",
+				       "MultiPolygon",
+				       "GeometryCollection"};
+	for (uint8_t t = POINTTYPE; t <= COLLECTIONTYPE; ++t)
+	{
+		if (geojson_is(s, n, names[t]))
+			return t;
+	}
+	return 0;
+}
+
+/* Nesting of the positions in the coordinates of each type */
+static const int geojson_levels[] = {-1, 0, 1, 2, 1, 2, 3, -1};
+
+/// Check the shape of the coordinates read against the level of the
+/// positions of the type: one array at the top, each level holding as
+/// many arrays as its parents count, no empty array as a position
+static int
+geojson_check_coordinates(const geojson_parser *ps, int level)
+{
+	if (ps->pos_level >= 0 && ps->pos_level != level)
+		return LW_FAILURE;
+	if (level == 0)
+		return ps->counts[0].n + (ps->ncoords ? 1 : 0) == 1;
+	if (ps->counts[0].n != 1 || ps->counts[level].n != 0)
+		return LW_FAILURE;
+	for (int l = level + 1; l < GEOJSON_MAX_LEVELS; ++l)
+	{
+		if (ps->counts[l].n)
+			return LW_FAILURE;
+	}
+	for (int l = 1; l <= level; ++l)
+	{
+		size_t sum = 0;
+		for (uint32_t i = 0; i < ps->counts[l - 1].n; ++i)
+			sum += ps->counts[l - 1].v[i];
+		size_t have = l < level ? ps->counts[l].n : (ps->cdim ? ps->ncoords / (size_t)ps->cdim : 0);
+		if (sum != have)
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+typedef struct {
+	uint32_t next[GEOJSON_MAX_LEVELS]; ///< next count to use at each level
+	size_t coord;                      ///< next position
+} geojson_cursor;
+
+#define GEOJSON_HASZ(ps) ((ps)->cdim >= 3)
+#define GEOJSON_HASM(ps) ((ps)->cdim == 4)
+
+static LWGEOM *
+geojson_build_line(const geojson_parser *ps, geojson_cursor *c, int level, uint32_t min)
+{
+	uint32_t n = ps->counts[level].v[c->next[level]++];
+	if (n && n < min)
+		return NULL;
+	const double *pp = ps->coords + c->coord * (size_t)ps->cdim;
+	c->coord += n;
+	return lwgeom_line_arena(NULL, n, pp, GEOJSON_HASZ(ps), GEOJSON_HASM(ps));
+}
+
+static LWGEOM *
+geojson_build_polygon(const geojson_parser *ps, geojson_cursor *c, int level)
+{
+	uint32_t nrings = ps->counts[level].v[c->next[level]++];
+	if (nrings == 0)
+		return lwgeom__new(NULL, POLYTYPE, GEOJSON_HASZ(ps), GEOJSON_HASM(ps));
+
+	LWGEOM **rings = (LWGEOM **)lwmalloc__cat(nrings * sizeof(LWGEOM *), LWGEOM_MEM_PARSER);
+	if (!rings)
+		return NULL;
+	LWGEOM *obj = NULL;
+	uint32_t i = 0;
+	for (; i < nrings; ++i)
+	{
+		rings[i] = geojson_build_line(ps, c, level + 1, 4);
+		if (!rings[i] || rings[i]->npoints == 0)
+			break;
+	}
+	if (i == nrings)
+		obj = lwgeom__poly_from_rings(NULL, nrings, rings);
+	if (!obj)
+	{
+		for (uint32_t r = 0; r <= i && r < nrings; ++r)
+			lwgeom_free(rings[r]);
+	}
+	lwfree(rings);
+	return obj;
+}
+
+/// Geometry of \a type from the coordinates read
+static LWGEOM *
+geojson_build(const geojson_parser *ps, uint8_t type)
+{
+	int level = geojson_levels[type];
+	if (level < 0 || !geojson_check_coordinates(ps, level))
+		return NULL;
+
+	geojson_cursor c;
+	memset(&c, 0, sizeof(c));
+	switch (type)
+	{
+	case POINTTYPE:
+		if (ps->ncoords == 0)
+			return lwgeom__new(NULL, POINTTYPE, LW_FALSE, LW_FALSE);
+		return lwgeom_point_arena(NULL, ps->coords, GEOJSON_HASZ(ps), GEOJSON_HASM(ps));
+	case LINETYPE:
+		return geojson_build_line(ps, &c, 0, 2);
+	case POLYTYPE:
+		return geojson_build_polygon(ps, &c, 0);
+	default:
+		break;
+	}
+
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(NULL, type, GEOJSON_HASZ(ps), GEOJSON_HASM(ps));
+	uint32_t n = ps->counts[0].v[0];
+	c.next[0] = 1;
+	for (uint32_t i = 0; mobj && i < n; ++i)
+	{
+		LWGEOM *sub;
+		if (type == MPOINTTYPE)
+		{
+			const double *pp = ps->coords + c.coord++ * (size_t)ps->cdim;
+			sub = lwgeom_point_arena(NULL, pp, GEOJSON_HASZ(ps), GEOJSON_HASM(ps));
+		}
+		else if (type == MLINETYPE)
+			sub = geojson_build_line(ps, &c, 1, 2);
+		else
+			sub = geojson_build_polygon(ps, &c, 1);
+		if (!sub || !lwgeom__add_child(mobj, sub))
+		{
+			lwgeom_free(sub);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	}
+	return mobj;
+}
+
+static LWGEOM *geojson_read_geometry(geojson_parser *ps, int depth);
+
+/// "geometries" of a GeometryCollection, the dimensions of its first child
+static LWGEOM *
+geojson_read_geometries(geojson_parser *ps, int depth)
+{
+	if (!geojson_accept(ps, '['))
+		return NULL;
+	if (geojson_accept(ps, ']'))
+		return lwgeom_create_empty_collection_arena(NULL, COLLECTIONTYPE, LW_FALSE, LW_FALSE);
+	LWGEOM *mobj = NULL;
+	do
+	{
+		LWGEOM *sub = geojson_read_geometry(ps, depth + 1);
+		if (sub && !mobj)
+			mobj = lwgeom_create_empty_collection_arena(
+			    NULL, COLLECTIONTYPE, lwgeom_has_z(sub), lwgeom_has_m(sub));
+		if (!sub || !mobj || !lwgeom__add_child(mobj, sub))
+		{
+			lwgeom_free(sub);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	} while (geojson_accept(ps, ','));
+	if (!geojson_accept(ps, ']'))
+	{
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+/// Geometry object, its members in any order
+static LWGEOM *
+geojson_read_geometry(geojson_parser *ps, int depth)
+{
+	if (depth > GEOJSON_MAX_DEPTH || !geojson_accept(ps, '{'))
+		return NULL;
+	uint8_t type = 0;
+	int coordinates = LW_FALSE;
+	LWGEOM *collection = NULL;
+	if (!geojson_accept(ps, '}'))
+	{
+		do
+		{
+			const char *key;
+			size_t n;
+			if (!geojson_read_key(ps, &key, &n))
+				goto fail;
+			if (geojson_is(key, n, "type"))
+			{
+				const char *s;
+				size_t len;
+				if (!geojson_read_string(ps, &s, &len) || !(type = geojson_type(s, len)))
+					goto fail;
+			}
+			else if (geojson_is(key, n, "coordinates"))
+			{
+				if (!geojson_read_coordinates(ps))
+					goto fail;
+				coordinates = LW_TRUE;
+			}
+			else if (geojson_is(key, n, "geometries") && !collection)
+			{
+				if (!(collection = geojson_read_geometries(ps, depth)))
+					goto fail;
+			}
+			else if (!geojson_skip_value(ps))
+				goto fail;
+		} while (geojson_accept(ps, ','));
+		if (!geojson_accept(ps, '}'))
+			goto fail;
+	}
+
+	if (type == COLLECTIONTYPE)
+		return collection;
+	lwgeom_free(collection);
+	return type && coordinates ? geojson_build(ps, type) : NULL;
+
+fail:
+	lwgeom_free(collection);
+	return NULL;
+}
+
+/// Spans of the members of a "properties" object, relative to \a text
+static int
+geojson_read_properties(geojson_parser *ps, const char *text)
+{
+	ps->nspans = 0;
+	if (!geojson_accept(ps, '{'))
+		return LW_FAILURE;
+	if (geojson_accept(ps, '}'))
+		return LW_SUCCESS;
+	do
+	{
+		const char *key;
+		size_t n;
+		if (!geojson_read_key(ps, &key, &n))
+			return LW_FAILURE;
+		geojson_peek(ps);
+		const char *value = ps->pos;
+		if (!geojson_skip_value(ps))
+			return LW_FAILURE;
+		if (!lwgeom__reserve(
+			(void **)&ps->spans, &ps->spans_capacity, ps->nspans + 4, sizeof(int), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		int *span = ps->spans + ps->nspans;
+		span[0] = (int)(key - text);
+		span[1] = (int)n;
+		span[2] = (int)(value - text);
+		span[3] = (int)(ps->pos - value);
+		ps->nspans += 4;
+	} while (geojson_accept(ps, ','));
+	return geojson_accept(ps, '}');
+}
+
+/// Feature object, a bare geometry is read as a feature without properties
+static LW_SGO *
+geojson_read_feature(geojson_parser *ps)
+{
+	const char *start = ps->pos;
+	const char *text = NULL;
+	const char *text_end = NULL;
+	int feature = LW_FALSE;
+	int bare = LW_FALSE;
+	LWGEOM *geom = NULL;
+	if (!geojson_accept(ps, '{'))
+		return NULL;
+	if (!geojson_accept(ps, '}'))
+	{
+		do
+		{
+			const char *key;
+			size_t n;
+			if (!geojson_read_key(ps, &key, &n))
+				goto fail;
+			if (geojson_is(key, n, "type"))
+			{
+				const char *s;
+				size_t len;
+				if (!geojson_read_string(ps, &s, &len))
+					goto fail;
+				feature = geojson_is(s, len, "Feature");
+				bare = !feature && geojson_type(s, len);
+			}
+			else if (geojson_is(key, n, "geometry") && !geom)
+			{
+				if (geojson_peek(ps) == 'n')
+				{
+					if (!geojson_skip_value(ps))
+						goto fail;
+				}
+				else if (!(geom = geojson_read_geometry(ps, 0)))
+					goto fail;
+			}
+			else if (geojson_is(key, n, "properties") && geojson_peek(ps) == '{')
+			{
+				text = ps->pos;
+				if (!geojson_read_properties(ps, text))
+					goto fail;
+				text_end = ps->pos;
+			}
+			else if (!geojson_skip_value(ps))
+				goto fail;
+		} while (geojson_accept(ps, ','));
+		if (!geojson_accept(ps, '}'))
+			goto fail;
+	}
+
+	if (bare)
+	{
+		lwgeom_free(geom);
+		ps->pos = start;
+		if (!(geom = geojson_read_geometry(ps, 0)))
+			return NULL;
+		text = NULL;
+	}
+	else if (!feature)
+		goto fail;
+	size_t len = text ? (size_t)(text_end - text) : 0;
+	LW_SGO *sgo = lwgeom__sgo_new(geom, ps->spans, text ? ps->nspans : 0, text, len);
+	if (sgo)
+		return sgo;
+
+fail:
+	lwgeom_free(geom);
+	return NULL;
+}
+
+static void
+geojson_parser_free(geojson_parser *ps)
+{
+	lwfree(ps->coords);
+	for (int l = 0; l < GEOJSON_MAX_LEVELS; ++l)
+		lwfree(ps->counts[l].v);
+	lwfree(ps->spans);
+}
+
+/* -------------------------------- streaming ------------------------------- */
+
+/// Next non blank character of the input, '\0' at its end
+static char
+geojson_next(lwgeom_geojson_reader *r)
+{
+	for (;;)
+	{
+		while (r->in.begin < r->in.len && geojson_is_blank(r->in.buf[r->in.begin]))
+			r->in.begin++;
+		if (r->in.begin < r->in.len)
+			return r->in.buf[r->in.begin];
+		if (!lwgeom__input_fill(&r->in))
+			return '\0';
+	}
+}
+
+typedef enum {
+	GEOJSON_SCAN_ERROR = 0,
+	GEOJSON_SCAN_CLOSED,  ///< the value ended
+	GEOJSON_SCAN_FEATURES ///< a "features" member starts
+} geojson_scan_result;
+
+/// Find the end of the object or array at begin, or of the one it is in
+/// when \a depth is 1, pulling input as needed. The structure alone is
+/// followed, the content is left to the parser. With \a features the scan
+/// stops after a "features": of the outer object.
+/// @param r reader
+/// @param depth nesting at begin
+/// @param features look for the features of a FeatureCollection
+/// @param end receives the offset from begin after the value or after ':'
+static geojson_scan_result
+geojson_scan(lwgeom_geojson_reader *r, int depth, int features, size_t *end)
+{
+	size_t i = 0;
+	int in_string = LW_FALSE;
+	size_t key = 0; // start of the last string of the outer object
+	for (;;)
+	{
+		const char *buf = r->in.buf + r->in.begin;
+		size_t len = r->in.len - r->in.begin;
+		for (; i < len; ++i)
+		{
+			char c = buf[i];
+			if (in_string)
+			{
+				if (c == '\\')
+					i++;
+				else if (c == '"')
+					in_string = LW_FALSE;
+				continue;
+			}
+			switch (c)
+			{
+			case '"':
+				in_string = LW_TRUE;
+				key = i + 1;
+				break;
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0)
+				{
+					*end = i + 1;
+					return GEOJSON_SCAN_CLOSED;
+				}
+				if (depth < 0)
+					return GEOJSON_SCAN_ERROR;
+				break;
+			case ':':
+				if (features && depth == 1 && i >= key + 9 && memcmp(buf + key, "features\"", 9) == 0)
+				{
+					*end = i + 1;
+					return GEOJSON_SCAN_FEATURES;
+				}
+				break;
+			default:
+				break;
+			}
+		}
+		if (!lwgeom__input_fill(&r->in))
+			return GEOJSON_SCAN_ERROR;
+	}
+}
+
+/// Parse the feature of \a size bytes at begin and consume it
+static LW_SGO *
+geojson_take_feature(lwgeom_geojson_reader *r, size_t size)
+{
+	geojson_parser *ps = &r->parser;
+	ps->pos = r->in.buf + r->in.begin;
+	ps->end = ps->pos + size;
+	LW_SGO *sgo = geojson_read_feature(ps);
+	if (sgo && geojson_peek(ps) != '\0')
+	{
+		lwgeom_sgo_free(sgo);
+		sgo = NULL;
+	}
+	r->in.begin += size;
+	return sgo;
+}
+
+/// @brief Next feature of the input
+/// @param reader reader
+/// @param sgo receives the feature, to release with lwgeom_sgo_free(), or
+/// NULL at the end of the input
+/// @return LW_SUCCESS or LW_FAILURE when the input is not valid GeoJSON
+int
+lwgeom_geojson_reader_next(lwgeom_geojson_reader *reader, LW_SGO **sgo)
+{
+	assert(reader && sgo);
+	lwgeom_geojson_reader *r = reader;
+	*sgo = NULL;
+	size_t size;
+	while (r->state != GEOJSON_END && r->state != GEOJSON_ERROR)
+	{
+		char c = geojson_next(r);
+		switch (r->state)
+		{
+		case GEOJSON_TOP:
+			// A FeatureCollection, a feature or a geometry of a sequence
+			if (c == '\0')
+			{
+				r->state = GEOJSON_END;
+				continue;
+			}
+			if (c != '{')
+				break;
+			switch (geojson_scan(r, 0, LW_TRUE, &size))
+			{
+			case GEOJSON_SCAN_FEATURES:
+				r->in.begin += size;
+				if (geojson_next(r) != '[')
+					break;
+				r->in.begin++;
+				r->state = GEOJSON_FEATURES;
+				continue;
+			case GEOJSON_SCAN_CLOSED:
+				if (!(*sgo = geojson_take_feature(r, size)))
+					break;
+				return LW_SUCCESS;
+			default:
+				break;
+			}
+			break;
+		case GEOJSON_FEATURES:
+			if (c == ',')
+			{
+				r->in.begin++;
+				continue;
+			}
+			if (c == ']')
+			{
+				r->in.begin++;
+				r->state = GEOJSON_TAIL;
+				continue;
+			}
+			if (c != '{' || geojson_scan(r, 0, LW_FALSE, &size) != GEOJSON_SCAN_CLOSED)
+				break;
+			if (!(*sgo = geojson_take_feature(r, size)))
+				break;
+			return LW_SUCCESS;
+		case GEOJSON_TAIL:
+			// Members after the features, such as a "bbox", are skipped
+			if (geojson_scan(r, 1, LW_FALSE, &size) != GEOJSON_SCAN_CLOSED)
+				break;
+			r->in.begin += size;
+			r->state = GEOJSON_TOP;
+			continue;
+		default:
+			break;
+		}
+		r->state = GEOJSON_ERROR;
+	}
+	return r->state == GEOJSON_END ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief Append up to \a max features to \a out, which the pipeline
+/// consumes and resets with lwgeom_reader2_reset() before the next call
+/// @param reader reader
+/// @param out receives the features after its current ones
+/// @param max maximum number of features to read
+/// @return LW_SUCCESS, nothing is appended at the end of the input, or
+/// LW_FAILURE when the input is not valid GeoJSON or out of memory
+int
+lwgeom_geojson_reader_read(lwgeom_geojson_reader *reader, LWGEOMREADER2 *out, size_t max)
+{
+	assert(reader && out);
+	for (size_t i = 0; i < max; ++i)
+	{
+		if (out->nsgo == out->nsgo_max &&
+		    !lwgeom__reserve(
+			(void **)&out->sgos, &out->nsgo_max, out->nsgo + 1, sizeof(LW_SGO *), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		LW_SGO *sgo;
+		if (!lwgeom_geojson_reader_next(reader, &sgo))
+			return LW_FAILURE;
+		if (!sgo)
+			break;
+		out->sgos[out->nsgo++] = sgo;
+	}
+	return LW_SUCCESS;
+}
+
+static lwgeom_geojson_reader *
+geojson_reader_alloc(void)
+{
+	lwgeom_geojson_reader *r =
+	    (lwgeom_geojson_reader *)lwmalloc__cat(sizeof(lwgeom_geojson_reader), LWGEOM_MEM_PARSER);
+	if (r)
+		memset(r, 0, sizeof(*r));
+	return r;
+}
+
+/// @brief Read GeoJSON pulled from \a source: the features of a
+/// FeatureCollection, or a sequence of features or geometries. Memory is
+/// bounded by the largest feature, not by the document.
+/// @param source fills a buffer with the next input, returns 0 at its end
+/// @param arg passed to \a source
+/// @return the reader to release with lwgeom_geojson_reader_free()
+lwgeom_geojson_reader *
+lwgeom_geojson_reader_new(lwgeom_source source, void *arg)
+{
+	assert(source);
+	lwgeom_geojson_reader *r = geojson_reader_alloc();
+	if (r && !lwgeom__input_init(&r->in, source, arg, GEOJSON_BLOCK_SIZE))
+	{
+		lwgeom__input_destroy(&r->in);
+		lwfree(r);
+		return NULL;
+	}
+	return r;
+}
+
+/// @brief Stream the GeoJSON file at \a path, see lwgeom_geojson_reader_new()
+/// @param path file path
+/// @return the reader, NULL when the file can not be opened
+lwgeom_geojson_reader *
+lwgeom_geojson_reader_open(const char *path)
+{
+	assert(path);
+	lwgeom_geojson_reader *r = geojson_reader_alloc();
+	if (r && !lwgeom__input_open(&r->in, path, GEOJSON_BLOCK_SIZE))
+	{
+		lwfree(r);
+		return NULL;
+	}
+	return r;
+}
+
+/// @brief Read the GeoJSON in \a data, which must outlive the reader and
+/// is parsed in place, see lwgeom_geojson_reader_new()
+/// @param data GeoJSON text
+/// @param len length of \a data
+/// @return the reader to release with lwgeom_geojson_reader_free()
+lwgeom_geojson_reader *
+lwgeom_geojson_reader_mem(const char *data, size_t len)
+{
+	assert(data || len == 0);
+	lwgeom_geojson_reader *r = geojson_reader_alloc();
+	if (r)
+		lwgeom__input_init_mem(&r->in, data, len);
+	return r;
+}
+
+void
+lwgeom_geojson_reader_free(lwgeom_geojson_reader *reader)
+{
+	if (!reader)
+		return;
+	lwgeom__input_destroy(&reader->in);
+	geojson_parser_free(&reader->parser);
+	lwfree(reader);
+}
+
+/* ------------------------------ single value ------------------------------ */
+
+/// @brief Read a GeoJSON geometry, or the geometry of a feature
+/// @param data GeoJSON text
+/// @param len length of \a data
+/// @return the geometry, NULL when it can not be parsed or is null
 LWGEOM *
 lwgeom_read_geojson(const char *data, size_t len)
 {
-	return NULL;
+	assert(data);
+	geojson_parser ps;
+	memset(&ps, 0, sizeof(ps));
+	ps.pos = data;
+	ps.end = data + len;
+	LWGEOM *obj = NULL;
+	LW_SGO *sgo = geojson_read_feature(&ps);
+	if (sgo && geojson_peek(&ps) == '\0')
+	{
+		obj = sgo->geom;
+		sgo->geom = NULL;
+	}
+	lwgeom_sgo_free(sgo);
+	geojson_parser_free(&ps);
+	return obj;
 }
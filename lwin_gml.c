@@ -19,16 +19,87 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
-#include "liblwgeom_internel.h"
 
+
+#include "lwxml.h"
+
+/// Feature of a GML collection: its child elements are its properties, the
+/// first one holding a geometry gives the geometry
+static int
+gml_read_feature(lwxml_reader *x, LW_SGO **sgo)
+{
+	LWGEOM *geom = NULL;
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			goto fail;
+		if (t != LWXML_START)
+			continue;
+		int ok;
+		if (lwxml_is(x, "boundedBy"))
+			ok = lwxml_skip(x);
+		else
+			ok = lwxml_property_key(x, x->name, x->name_len) && lwxml_property_value(x, &geom);
+		if (!ok)
+			goto fail;
+	}
+	*sgo = lwxml_take_feature(x, geom);
+	return *sgo != NULL;
+
+fail:
+	lwgeom_free(geom);
+	x->nspans = 0;
+	x->nprops = 0;
+	return LW_FAILURE;
+}
+
+/// @brief Next feature of a GML feature collection, the children of
+/// featureMember, featureMembers and member elements, or geometry outside
+/// of one
+/// @param[out] sgo the feature, NULL at the end of the input
+int
+lwgml_next_feature(lwxml_reader *x, LW_SGO **sgo)
+{
+	*sgo = NULL;
+	for (;;)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF)
+			return LW_SUCCESS;
+		if (t == LWXML_ERROR)
+			return LW_FAILURE;
+		// Out of the member element
+		if (t == LWXML_END && x->depth < x->feature_depth - 1)
+			x->feature_depth = 0;
+		if (t != LWXML_START)
+			continue;
+		if (x->feature_depth && x->depth == x->feature_depth)
+			return gml_read_feature(x, sgo);
+		if (lwxml_is(x, "featureMember") || lwxml_is(x, "featureMembers") || lwxml_is(x, "member"))
+			x->feature_depth = x->depth + 1;
+		else if (lwxml_is_geometry(x))
+		{
+			LWGEOM *geom = lwxml_read_geometry(x, 0);
+			if (!geom)
+				return LW_FAILURE;
+			*sgo = lwxml_take_feature(x, geom);
+			return *sgo != NULL;
+		}
+	}
+}
+
+/// @brief First geometry of a GML2 document, coordinates or coord positions
 LWGEOM *
 lwgeom_read_gml2(const char *data, size_t len)
 {
-	return NULL;
+	return lwxml_read_first_geometry(data, len);
 }
 
+/// @brief First geometry of a GML3 document, pos or posList positions
 LWGEOM *
 lwgeom_read_gml3(const char *data, size_t len)
 {
-	return NULL;
+	return lwxml_read_first_geometry(data, len);
 }
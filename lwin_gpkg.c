@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/* Flags byte of the header */
+#define GPKG_FLAG_NDR 0x01      /* header in little endian */
+#define GPKG_FLAG_ENVELOPE 0x0E /* envelope contents indicator */
+#define GPKG_FLAG_EMPTY 0x10
+
+typedef struct {
+	int32_t srid;
+	int envelope; ///< 0 none, 1 xy, 2 xyz, 3 xym, 4 xyzm
+	int empty;
+	int swap;     ///< header in foreign byte order
+	size_t size;  ///< of the header, where the WKB starts
+} gpkg_header;
+
+static inline double
+gpkg_double(const uint8_t *p, int swap)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	if (swap)
+		v = __builtin_bswap64(v);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+static inline int
+gpkg_native_ndr(void)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return LW_FALSE;
+#else
+	return LW_TRUE;
+#endif
+}
+
+static int
+gpkg_read_header(const uint8_t *blob, size_t len, gpkg_header *h)
+{
+	if (len < 8 || blob[0] != 'G' || blob[1] != 'P' || blob[2] != 0)
+		return LW_FAILURE;
+	uint8_t flags = blob[3];
+	h->swap = ((flags & GPKG_FLAG_NDR) != 0) != gpkg_native_ndr();
+	h->envelope = (flags & GPKG_FLAG_ENVELOPE) >> 1;
+	h->empty = (flags & GPKG_FLAG_EMPTY) != 0;
+	if (h->envelope > 4)
+		return LW_FAILURE;
+	uint32_t srid;
+	memcpy(&srid, blob + 4, sizeof(srid));
+	h->srid = (int32_t)(h->swap ? __builtin_bswap32(srid) : srid);
+	static const size_t envelope_size[] = {0, 32, 48, 48, 64};
+	h->size = 8 + envelope_size[h->envelope];
+	return len >= h->size ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief Envelope of a GeoPackage geometry blob, read from its header
+/// without decoding the WKB. Points usually come without an envelope, theirs
+/// is read from their coordinates.
+/// @param blob GeoPackage binary geometry
+/// @param len bytes of \a blob
+/// @param[out] srid srs_id of the blob, may be NULL
+/// @param[out] box envelope, z as well when the blob has it, the inverted
+/// (DBL_MAX, -DBL_MAX) box for empty geometries
+/// @return LW_FAILURE for an invalid header, or when the blob of a non point
+/// geometry has no envelope: only a full decode gives its extent then
+int
+lwgeom_gpkg_envelope(const char *blob, size_t len, int32_t *srid, LWBOX *box)
+{
+	assert(blob && box);
+	const uint8_t *p = (const uint8_t *)blob;
+	gpkg_header h;
+	if (!gpkg_read_header(p, len, &h))
+		return LW_FAILURE;
+	if (srid)
+		*srid = h.srid;
+	memset(box, 0, sizeof(*box));
+	if (h.empty)
+	{
+		box->xmin = box->ymin = DBL_MAX;
+		box->xmax = box->ymax = -DBL_MAX;
+		return LW_SUCCESS;
+	}
+	if (h.envelope)
+	{
+		box->xmin = gpkg_double(p + 8, h.swap);
+		box->xmax = gpkg_double(p + 16, h.swap);
+		box->ymin = gpkg_double(p + 24, h.swap);
+		box->ymax = gpkg_double(p + 32, h.swap);
+		if (h.envelope == 2 || h.envelope == 4)
+		{
+			box->zmin = gpkg_double(p + 40, h.swap);
+			box->zmax = gpkg_double(p + 48, h.swap);
+		}
+		return LW_SUCCESS;
+	}
+
+	/* A point has its envelope right after the WKB header */
+	const uint8_t *wkb = p + h.size;
+	if (len - h.size < 5 + 16 || wkb[0] > 1)
+		return LW_FAILURE;
+	int swap = (wkb[0] != 0) != gpkg_native_ndr();
+	uint32_t type;
+	memcpy(&type, wkb + 1, sizeof(type));
+	if (swap)
+		type = __builtin_bswap32(type);
+	if ((type & 0x0FFFFFFFu) % 1000 != POINTTYPE || (type & 0x20000000u))
+		return LW_FAILURE;
+	double x = gpkg_double(wkb + 5, swap);
+	double y = gpkg_double(wkb + 13, swap);
+	if (isnan(x) && isnan(y))
+	{
+		// POINT EMPTY
+		box->xmin = box->ymin = DBL_MAX;
+		box->xmax = box->ymax = -DBL_MAX;
+		return LW_SUCCESS;
+	}
+	box->xmin = box->xmax = x;
+	box->ymin = box->ymax = y;
+	return LW_SUCCESS;
+}
+
+/// @brief Read a GeoPackage geometry blob: its header, then the WKB read
+/// with lwgeom_read_wkb_arena(), or lwgeom_read_wkb_borrow() when borrowing
+/// @param arena arena owning the result, NULL to allocate with lwmalloc
+/// @param blob GeoPackage binary geometry
+/// @param len bytes of \a blob
+/// @param borrow alias native, aligned coordinates in \a blob, which must
+/// then outlive the result
+/// @param[out] srid srs_id of the blob, may be NULL
+/// @return the geometry, NULL when the blob is invalid
+LWGEOM *
+lwgeom_read_gpkg(lwgeom_arena *arena, const char *blob, size_t len, int borrow, int32_t *srid)
+{
+	assert(blob);
+	gpkg_header h;
+	if (!gpkg_read_header((const uint8_t *)blob, len, &h))
+		return NULL;
+	if (srid)
+		*srid = h.srid;
+	if (borrow)
+		return lwgeom_read_wkb_borrow(arena, blob + h.size, len - h.size);
+	return lwgeom_read_wkb_arena(arena, blob + h.size, len - h.size, LW_FALSE);
+}
@@ -20,10 +20,110 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+
+#include "lwxml.h"
+
+/// ExtendedData <Data name="key"><value>...</value></Data>
+static int
+kml_read_data(lwxml_reader *x)
+{
+	const char *key;
+	size_t len;
+	if (!lwxml_attr(x, "name", &key, &len))
+		return lwxml_skip(x);
+	if (!lwxml_property_key(x, key, len))
+		return LW_FAILURE;
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			return LW_FAILURE;
+		if (t == LWXML_START && lwxml_is(x, "value") && !lwxml_property_value(x, NULL))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+/// Placemark of its geometry, its name and description and its extended data
+static int
+kml_read_placemark(lwxml_reader *x, LW_SGO **sgo)
+{
+	LWGEOM *geom = NULL;
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			goto fail;
+		if (t != LWXML_START)
+			continue;
+		int ok = LW_TRUE;
+		if (lwxml_is_geometry(x))
+		{
+			// A placemark has a single geometry, MultiGeometry for more
+			if (geom)
+				goto fail;
+			ok = (geom = lwxml_read_geometry(x, 0)) != NULL;
+		}
+		else if (x->depth == depth + 1 && (lwxml_is(x, "name") || lwxml_is(x, "description")))
+			ok = lwxml_property_key(x, x->name, x->name_len) && lwxml_property_value(x, NULL);
+		else if (lwxml_is(x, "Data"))
+			ok = kml_read_data(x);
+		else if (lwxml_is(x, "SimpleData"))
+		{
+			const char *key;
+			size_t len;
+			if (lwxml_attr(x, "name", &key, &len))
+				ok = lwxml_property_key(x, key, len) && lwxml_property_value(x, NULL);
+			else
+				ok = lwxml_skip(x);
+		}
+		// ExtendedData, SchemaData and the other elements are walked through
+		if (!ok)
+			goto fail;
+	}
+	*sgo = lwxml_take_feature(x, geom);
+	return *sgo != NULL;
+
+fail:
+	lwgeom_free(geom);
+	x->nspans = 0;
+	x->nprops = 0;
+	return LW_FAILURE;
+}
+
+/// @brief Next Placemark of a KML document, or geometry outside of one,
+/// Documents and Folders being walked through
+/// @param[out] sgo the feature, NULL at the end of the input
+int
+lwkml_next_feature(lwxml_reader *x, LW_SGO **sgo)
+{
+	*sgo = NULL;
+	for (;;)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF)
+			return LW_SUCCESS;
+		if (t == LWXML_ERROR)
+			return LW_FAILURE;
+		if (t != LWXML_START)
+			continue;
+		if (lwxml_is(x, "Placemark"))
+			return kml_read_placemark(x, sgo);
+		if (lwxml_is_geometry(x))
+		{
+			LWGEOM *geom = lwxml_read_geometry(x, 0);
+			if (!geom)
+				return LW_FAILURE;
+			*sgo = lwxml_take_feature(x, geom);
+			return *sgo != NULL;
+		}
+	}
+}
 
 LWGEOM *
 lwgeom_read_kml(const char *data, size_t len)
 {
-	return NULL;
+	return lwxml_read_first_geometry(data, len);
 }
@@ -20,28 +20,349 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/// An element of sdo_elem_info, with the range of ordinates it spans
 typedef struct {
-	int sdo_starting_offset;
+	size_t start; ///< first ordinate, sdo_starting_offset - 1
+	size_t end;   ///< past the last ordinate, the start of the next element
 	int sdo_etype;
 	int sdo_interpretation;
 } GEOM_SDO_ELEM_INFO;
 
-LWGEOM *
-lwgeom_read_ora(const LWGEOM_SDO sdo, int flag)
+/// Decoding state, the element array is kept across the rows of a batch
+typedef struct {
+	lwgeom_arena *arena;
+	const LWGEOM_SDO *sdo;
+	int borrow;
+	int dims;    ///< ordinates per point
+	int lrs;     ///< position of the measure from 1, 0 without measure
+	int hasz;
+	int hasm;
+	GEOM_SDO_ELEM_INFO *elems;
+	size_t nelems;
+	size_t capacity;
+} ora_reader;
+
+/// Decode the gtype and the element triplets of \a sdo, once per geometry
+static int
+ora_decode(ora_reader *r, const LWGEOM_SDO *sdo)
+{
+	r->sdo = sdo;
+	r->dims = sdo->sdo_gtype / 1000;
+	r->lrs = sdo->sdo_gtype / 100 % 10;
+	if (r->dims < 2 || r->dims > 4 || (r->lrs && (r->lrs < 3 || r->lrs > r->dims)))
+		return LW_FAILURE;
+	r->hasm = r->lrs != 0;
+	r->hasz = r->dims - r->hasm > 2;
+	if (sdo->sdo_elem_count % 3 || (sdo->sdo_elem_count && !sdo->sdo_elem_info) ||
+	    (sdo->sdo_ord_count && !sdo->sdo_ordinates) || sdo->sdo_ord_count % (size_t)r->dims)
+		return LW_FAILURE;
+
+	size_t n = sdo->sdo_elem_count / 3;
+	if (!lwgeom__reserve((void **)&r->elems, &r->capacity, n, sizeof(GEOM_SDO_ELEM_INFO), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	const int *info = sdo->sdo_elem_info;
+	for (size_t i = 0; i < n; ++i)
+	{
+		// Offsets are 1 based, non decreasing and at a point boundary
+		size_t start = (size_t)info[3 * i] - 1;
+		if (info[3 * i] < 1 || start > sdo->sdo_ord_count || start % (size_t)r->dims ||
+		    (i && start < r->elems[i - 1].start))
+			return LW_FAILURE;
+		r->elems[i].start = start;
+		r->elems[i].sdo_etype = info[3 * i + 1];
+		r->elems[i].sdo_interpretation = info[3 * i + 2];
+		if (i)
+			r->elems[i - 1].end = start;
+	}
+	if (n)
+		r->elems[n - 1].end = sdo->sdo_ord_count;
+	r->nelems = n;
+	return LW_SUCCESS;
+}
+
+/// Point or line of \a n points from ordinate \a start, aliasing the
+/// ordinates when asked to and their layout is the one of LWGEOM
+static LWGEOM *
+ora_points(ora_reader *r, uint8_t type, size_t start, uint32_t n)
 {
-	int dimension = 2 > (sdo.sdo_gtype / 1000) ? 2 : (sdo.sdo_gtype / 1000);
+	const double *pp = r->sdo->sdo_ordinates + start;
+	if (r->lrs == 0 || r->lrs == r->dims)
+	{
+		if (r->borrow)
+			return lwgeom__wrap(r->arena, type, n, pp, r->hasz, r->hasm);
+		if (type == POINTTYPE)
+			return lwgeom_point_arena(r->arena, pp, r->hasz, r->hasm);
+		return lwgeom_line_arena(r->arena, n, pp, r->hasz, r->hasm);
+	}
+
+	// The measure third and z fourth, swapped into XYZM
+	double *copy = (double *)lwmalloc__cat((size_t)n * 4 * sizeof(double), LWGEOM_MEM_COORDS);
+	if (!copy)
+		return NULL;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		copy[4 * i] = pp[4 * i];
+		copy[4 * i + 1] = pp[4 * i + 1];
+		copy[4 * i + 2] = pp[4 * i + 3];
+		copy[4 * i + 3] = pp[4 * i + 2];
+	}
+	LWGEOM *obj = type == POINTTYPE ? lwgeom_point_arena(r->arena, copy, LW_TRUE, LW_TRUE)
+					: lwgeom_line_arena(r->arena, n, copy, LW_TRUE, LW_TRUE);
+	lwfree(copy);
+	return obj;
+}
+
+/// Closed ring of the lower left and upper right corners of an optimized rectangle
+static LWGEOM *
+ora_rectangle(ora_reader *r, size_t start)
+{
+	const double *pp = r->sdo->sdo_ordinates + start;
+	size_t dims = (size_t)r->dims;
+	double ring[5 * 4];
+	static const int corners[5][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}, {0, 0}};
+	for (size_t i = 0; i < 5; ++i)
+	{
+		memcpy(ring + i * dims, pp, dims * sizeof(double));
+		ring[i * dims] = pp[corners[i][0] * dims];
+		ring[i * dims + 1] = pp[corners[i][1] * dims + 1];
+	}
+	LWGEOM_SDO sdo = *r->sdo;
+	sdo.sdo_ordinates = ring;
+	const LWGEOM_SDO *saved = r->sdo;
+	int borrow = r->borrow;
+	r->sdo = &sdo;
+	r->borrow = LW_FALSE;
+	LWGEOM *obj = ora_points(r, LINETYPE, 0, 5);
+	r->sdo = saved;
+	r->borrow = borrow;
+	return obj;
+}
+
+/// Geometry of the element at \a *i, which moves past it and its
+/// subelements: a point, a multi point for a point cluster, a line or a ring
+static LWGEOM *
+ora_element(ora_reader *r, size_t *i, int *etype)
+{
+	const GEOM_SDO_ELEM_INFO *e = &r->elems[(*i)++];
+	size_t end = e->end;
+	int interpretation = e->sdo_interpretation;
+	*etype = e->sdo_etype;
+	if (*etype == 4 || *etype == 1005 || *etype == 2005)
+	{
+		// Compound of subelements sharing their end points, supported
+		// when they all are straight lines
+		if (interpretation < 1 || (size_t)interpretation > r->nelems - *i)
+			return NULL;
+		for (size_t k = *i; k < *i + (size_t)interpretation; ++k)
+		{
+			if (r->elems[k].sdo_etype != 2 || r->elems[k].sdo_interpretation != 1)
+				return NULL;
+		}
+		*i += (size_t)interpretation;
+		end = r->elems[*i - 1].end;
+		interpretation = 1;
+		*etype = *etype == 4 ? 2 : *etype - 2;
+	}
+	size_t n = (end - e->start) / (size_t)r->dims;
+	if (n > UINT32_MAX)
+		return NULL;
 
-	int tt = sdo.sdo_gtype % 100;
-	if (tt > 0 && tt < 4)
+	switch (*etype)
 	{
-		GEOM_SDO_ELEM_INFO *pElemInfo = (GEOM_SDO_ELEM_INFO *)sdo.sdo_elem_info;
-		for (int i = 0; i < sdo.sdo_elem_count / 3; i++) {}
+	case 1:
+		if (interpretation == 1)
+			return n ? ora_points(r, POINTTYPE, e->start, 1) : NULL;
+		if (interpretation < 1 || n < (size_t)interpretation)
+			return NULL;
+		{
+			LWGEOM *mobj = lwgeom_create_empty_collection_arena(r->arena, MPOINTTYPE, r->hasz, r->hasm);
+			for (size_t k = 0; mobj && k < (size_t)interpretation; ++k)
+			{
+				LWGEOM *obj = ora_points(r, POINTTYPE, e->start + k * (size_t)r->dims, 1);
+				if (!obj || !lwgeom__add_child(mobj, obj))
+				{
+					lwgeom_free(obj);
+					lwgeom_free(mobj);
+					return NULL;
+				}
+			}
+			return mobj;
+		}
+	case 2:
+		return interpretation == 1 && n >= 2 ? ora_points(r, LINETYPE, e->start, (uint32_t)n) : NULL;
+	case 1003:
+	case 2003:
+		if (interpretation == 1 && n >= 4)
+			return ora_points(r, LINETYPE, e->start, (uint32_t)n);
+		if (interpretation == 3 && n == 2)
+			return ora_rectangle(r, e->start);
+		return NULL;
+	default:
+		// Circular arcs and circles are not supported
+		return NULL;
 	}
-	else if (tt > 4 && tt < 8)
+}
+
+static const uint8_t ora_types[8] = {
+    0, POINTTYPE, LINETYPE, POLYTYPE, COLLECTIONTYPE, MPOINTTYPE, MLINETYPE, MPOLYTYPE};
+
+/// Geometry of the decoded elements, assembled as sdo_gtype tells
+static LWGEOM *
+ora_build(ora_reader *r)
+{
+	int tt = r->sdo->sdo_gtype % 100;
+	uint8_t type = tt >= 1 && tt <= 7 ? ora_types[tt] : 0;
+	if (!type)
+		return NULL;
+	if (type == POINTTYPE || type == LINETYPE || type == POLYTYPE)
+	{
+		if (r->nelems == 0)
+			return lwgeom__new(r->arena, type, r->hasz, r->hasm);
+	}
+
+	LWGEOM *root = type > POLYTYPE ? lwgeom_create_empty_collection_arena(r->arena, type, r->hasz, r->hasm) : NULL;
+	if (type > POLYTYPE && !root)
+		return NULL;
+	LWGEOM *poly = NULL; // polygon taking the interior rings
+	size_t i = 0;
+	while (i < r->nelems)
 	{
-		// multi LWGEOM
+		if (r->elems[i].sdo_etype == 0 || (r->elems[i].sdo_etype == 1 && r->elems[i].sdo_interpretation == 0))
+		{
+			// Unknown elements are skipped, as Oracle does, and so is the
+			// orientation following an oriented point, with its ordinates
+			i++;
+			continue;
+		}
+		int etype;
+		LWGEOM *obj = ora_element(r, &i, &etype);
+		if (!obj)
+			goto fail;
+		// Interior rings follow their exterior ring
+		if (etype != 1003 && etype != 2003)
+			poly = NULL;
+		LWGEOM *parent = NULL;
+		if (etype == 1003)
+		{
+			LWGEOM *shell = obj;
+			if (type != POLYTYPE && type != MPOLYTYPE && type != COLLECTIONTYPE)
+				goto fail_obj;
+			if (type == POLYTYPE && root)
+				goto fail_obj;
+			if (!(poly = lwgeom__new(r->arena, POLYTYPE, r->hasz, r->hasm)))
+				goto fail_obj;
+			if (type == POLYTYPE)
+				root = poly;
+			else if (!lwgeom__add_child(root, poly))
+			{
+				lwgeom_free(poly);
+				goto fail_obj;
+			}
+			LWFLAGS_SET_SHELL_RING(shell->flags, LW_TRUE);
+			parent = poly;
+		}
+		else if (etype == 2003)
+		{
+			LWFLAGS_SET_HOLE_RING(obj->flags, LW_TRUE);
+			parent = poly;
+		}
+		else if (type == POINTTYPE || type == LINETYPE)
+		{
+			if (root || obj->type != type)
+				goto fail_obj;
+			root = obj;
+			continue;
+		}
+		else if (type == MPOINTTYPE && obj->type == MPOINTTYPE)
+		{
+			// The points of a cluster go to the multi point
+			for (uint32_t k = 0; k < obj->ngeoms; ++k)
+			{
+				if (!lwgeom__add_child(root, obj->geoms[k]))
+					goto fail_obj;
+				obj->geoms[k] = NULL;
+			}
+			obj->ngeoms = 0;
+			lwgeom_free(obj);
+			continue;
+		}
+		else if (type == COLLECTIONTYPE || obj->type + (MPOINTTYPE - POINTTYPE) == type)
+			parent = root;
+
+		if (!parent || !lwgeom__add_child(parent, obj))
+			goto fail_obj;
+		continue;
+
+	fail_obj:
+		lwgeom_free(obj);
+		goto fail;
 	}
+	if (!root && (type == POINTTYPE || type == LINETYPE || type == POLYTYPE))
+		return lwgeom__new(r->arena, type, r->hasz, r->hasm);
+	return root;
+
+fail:
+	lwgeom_free(root);
 	return NULL;
 }
+
+static LWGEOM *
+ora_read(ora_reader *r, const LWGEOM_SDO *sdo)
+{
+	return ora_decode(r, sdo) ? ora_build(r) : NULL;
+}
+
+/// @brief Read an Oracle SDO_GEOMETRY into an arena
+/// @param arena owning arena or NULL
+/// @param sdo gtype, element info and ordinates, the SRID is left out
+/// @param flag LWGEOM_ORA_BORROW to alias the ordinates of XY, XYZ, XYM and
+/// XYZM geometries, which then have to outlive the geometry
+/// @return NULL for malformed geometries and arcs or circles
+LWGEOM *
+lwgeom_read_ora_arena(lwgeom_arena *arena, const LWGEOM_SDO *sdo, int flag)
+{
+	assert(sdo);
+	ora_reader r;
+	memset(&r, 0, sizeof(r));
+	r.arena = arena;
+	r.borrow = (flag & LWGEOM_ORA_BORROW) != 0;
+	LWGEOM *obj = ora_read(&r, sdo);
+	lwfree(r.elems);
+	return obj;
+}
+
+LWGEOM *
+lwgeom_read_ora(const LWGEOM_SDO sdo, int flag)
+{
+	return lwgeom_read_ora_arena(NULL, &sdo, flag);
+}
+
+/// @brief Read \a n SDO_GEOMETRY rows, reusing the decoding state from row to row
+/// @param arena owning arena or NULL
+/// @param flag see lwgeom_read_ora_arena()
+/// @param[out] out the \a n geometries, NULL for the rows that can not be read
+/// @return the number of rows read
+size_t
+lwgeom_read_ora_batch(lwgeom_arena *arena, const LWGEOM_SDO *sdos, size_t n, int flag, LWGEOM **out)
+{
+	assert((sdos && out) || n == 0);
+	ora_reader r;
+	memset(&r, 0, sizeof(r));
+	r.arena = arena;
+	r.borrow = (flag & LWGEOM_ORA_BORROW) != 0;
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = ora_read(&r, &sdos[i]);
+		count += out[i] != NULL;
+	}
+	lwfree(r.elems);
+	return count;
+}
@@ -0,0 +1,763 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Both files start with a 100 bytes header, records have an 8 bytes header */
+#define SHP_HEADER_SIZE 100
+#define SHP_RECORD_HEADER_SIZE 8
+/* Records handed to a scanning thread at once */
+#define SHP_SCAN_CHUNK 4096
+
+/* Shape types, the Z variants add 10 and the M variants 20 */
+#define SHP_NULL 0
+#define SHP_POINT 1
+#define SHP_ARC 3
+#define SHP_POLYGON 5
+#define SHP_MULTIPOINT 8
+#define SHP_MULTIPATCH 31
+
+struct lwgeom_shp_reader {
+	const uint8_t *shp;
+	size_t shp_len;
+	const uint8_t *shx; ///< NULL when the offsets were found by walking the records
+	size_t shx_len;
+	uint32_t *offsets;  ///< of each record header, without .shx
+	uint32_t count;
+	int type;           ///< shape type of the file
+	LWBOX extent;
+};
+
+/// Rings of the polygon being assembled, reused from record to record
+typedef struct {
+	LWGEOM **rings;
+	double *areas;
+	int32_t *owners;
+	LWGEOM **group;
+	uint32_t *next;
+	size_t capacity;
+} shp_scratch;
+
+/// Coordinates of the record being decoded
+typedef struct {
+	lwgeom_arena *arena;
+	const uint8_t *xy;
+	const uint8_t *z;     ///< NULL without Z
+	const uint8_t *m;     ///< NULL without M
+	double *block;        ///< arena block receiving the copied points
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	int borrow;
+} shp_decoder;
+
+static inline uint32_t
+shp_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint32_t
+shp_le32(const uint8_t *p)
+{
+	return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static inline double
+shp_double(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+/* --------------------------------- records -------------------------------- */
+
+/// Content of record \a i, after its record header
+static const uint8_t *
+shp_record(const lwgeom_shp_reader *r, uint32_t i, size_t *len)
+{
+	size_t offset;
+	if (r->shx)
+		offset = (size_t)shp_be32(r->shx + SHP_HEADER_SIZE + 8 * (size_t)i) * 2;
+	else
+		offset = r->offsets[i];
+	if (offset < SHP_HEADER_SIZE || offset > r->shp_len - SHP_RECORD_HEADER_SIZE)
+		return NULL;
+	*len = (size_t)shp_be32(r->shp + offset + 4) * 2;
+	if (*len > r->shp_len - offset - SHP_RECORD_HEADER_SIZE)
+		return NULL;
+	return r->shp + offset + SHP_RECORD_HEADER_SIZE;
+}
+
+/// Box of the record at \a rec, its header for multi point, line and
+/// polygon records, the point itself for points
+/// @return LW_FAILURE for null shapes and malformed records
+static int
+shp_record_bbox(const uint8_t *rec, size_t len, LWBOX *box)
+{
+	if (len < 4)
+		return LW_FAILURE;
+	int type = (int)shp_le32(rec);
+	if (type == SHP_NULL || type == SHP_MULTIPATCH || len < 20)
+		return LW_FAILURE;
+	if (type % 10 == SHP_POINT)
+	{
+		box->xmin = box->xmax = shp_double(rec + 4);
+		box->ymin = box->ymax = shp_double(rec + 12);
+		return LW_SUCCESS;
+	}
+	if (len < 36)
+		return LW_FAILURE;
+	box->xmin = shp_double(rec + 4);
+	box->ymin = shp_double(rec + 12);
+	box->xmax = shp_double(rec + 20);
+	box->ymax = shp_double(rec + 28);
+	return LW_SUCCESS;
+}
+
+/* -------------------------------- geometry -------------------------------- */
+
+/// Point or line of the points [from, to): borrowed from the mapping when
+/// the layout allows, else copied into an arena block or a buffer of its own
+static LWGEOM *
+shp_points(shp_decoder *d, uint8_t type, uint32_t from, uint32_t to)
+{
+	uint32_t n = to - from;
+	if (n == 0)
+		return lwgeom__new(d->arena, type, d->hasz, d->hasm);
+	const uint8_t *xy = d->xy + (size_t)from * 16;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (d->borrow && !d->hasz && !d->hasm && ((uintptr_t)xy & (sizeof(double) - 1)) == 0)
+		return lwgeom__wrap(d->arena, type, n, (const double *)xy, LW_FALSE, LW_FALSE);
+#endif
+
+	int cdim = LW_POINTBYTESIZE(d->hasz, d->hasm);
+	LWGEOM *obj;
+	double *pp;
+	if (d->block)
+	{
+		pp = d->block;
+		d->block += (size_t)n * cdim;
+		obj = lwgeom__wrap(d->arena, type, n, pp, d->hasz, d->hasm);
+		if (!obj)
+			return NULL;
+	}
+	else
+	{
+		obj = lwgeom__new(d->arena, type, d->hasz, d->hasm);
+		size_t size = (size_t)n * cdim * sizeof(double);
+		pp = obj ? (double *)lwgeom__malloc(d->arena, size, LWGEOM_MEM_COORDS) : NULL;
+		if (!pp)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		obj->pp = pp;
+		obj->npoints = n;
+	}
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (cdim == 2)
+	{
+		memcpy(pp, xy, (size_t)n * 16);
+		return obj;
+	}
+#endif
+	for (uint32_t i = from; i < to; i++, pp += cdim)
+	{
+		pp[0] = shp_double(d->xy + (size_t)i * 16);
+		pp[1] = shp_double(d->xy + (size_t)i * 16 + 8);
+		if (d->hasz)
+			pp[2] = shp_double(d->z + (size_t)i * 8);
+		if (d->hasm)
+			pp[cdim - 1] = shp_double(d->m + (size_t)i * 8);
+	}
+	return obj;
+}
+
+/// Twice the signed area of a ring, negative when clockwise
+static double
+shp_ring_area(const LWGEOM *ring)
+{
+	int cdim = lwgeom_dim_coordinate(ring);
+	const double *pp = ring->pp;
+	double area = 0.0;
+	for (uint32_t i = 1; i < ring->npoints; i++, pp += cdim)
+		area += pp[0] * pp[cdim + 1] - pp[cdim] * pp[1];
+	return area;
+}
+
+/// Crossing number test of (x, y) against \a ring
+static int
+shp_ring_contains(const LWGEOM *ring, double x, double y)
+{
+	int cdim = lwgeom_dim_coordinate(ring);
+	const double *pp = ring->pp;
+	int inside = LW_FALSE;
+	for (uint32_t i = 1; i < ring->npoints; i++, pp += cdim)
+	{
+		double x0 = pp[0], y0 = pp[1], x1 = pp[cdim], y1 = pp[cdim + 1];
+		if ((y0 > y) != (y1 > y) && x < x0 + (y - y0) * (x1 - x0) / (y1 - y0))
+			inside = !inside;
+	}
+	return inside;
+}
+
+static int
+shp_scratch_reserve(shp_scratch *s, size_t n)
+{
+	// The arrays share a capacity, they all grow from it the same way
+	size_t c[5] = {s->capacity, s->capacity, s->capacity, s->capacity, s->capacity};
+	if (!lwgeom__reserve((void **)&s->rings, &c[0], n, sizeof(LWGEOM *), LWGEOM_MEM_PARSER) ||
+	    !lwgeom__reserve((void **)&s->areas, &c[1], n, sizeof(double), LWGEOM_MEM_PARSER) ||
+	    !lwgeom__reserve((void **)&s->owners, &c[2], n, sizeof(int32_t), LWGEOM_MEM_PARSER) ||
+	    !lwgeom__reserve((void **)&s->group, &c[3], n, sizeof(LWGEOM *), LWGEOM_MEM_PARSER) ||
+	    !lwgeom__reserve((void **)&s->next, &c[4], n, sizeof(uint32_t), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	s->capacity = c[0];
+	return LW_SUCCESS;
+}
+
+static void
+shp_scratch_free(shp_scratch *s)
+{
+	lwfree(s->rings);
+	lwfree(s->areas);
+	lwfree(s->owners);
+	lwfree(s->group);
+	lwfree(s->next);
+}
+
+/// Polygon or multi polygon of the rings in \a s. Shapefile shells are
+/// clockwise and holes counterclockwise, each hole belongs to the smallest
+/// shell around it; holes outside of every shell, or rings of files that
+/// ignore the orientation rule, become shells.
+static LWGEOM *
+shp_polygons(shp_decoder *d, shp_scratch *s, uint32_t nrings)
+{
+	LWGEOM **rings = s->rings;
+	uint32_t nshells = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		s->areas[i] = shp_ring_area(rings[i]);
+		s->owners[i] = s->areas[i] <= 0.0 ? (int32_t)i : -1;
+		nshells += s->owners[i] >= 0;
+	}
+	if (nshells == 0)
+	{
+		for (uint32_t i = 0; i < nrings; i++)
+			s->owners[i] = (int32_t)i;
+	}
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		if (s->owners[i] >= 0 || rings[i]->npoints == 0)
+			continue;
+		double x = rings[i]->pp[0];
+		double y = rings[i]->pp[1];
+		double best = 0.0;
+		for (uint32_t j = 0; j < nrings; j++)
+		{
+			if (s->owners[j] != (int32_t)j || (s->owners[i] >= 0 && -s->areas[j] >= best))
+				continue;
+			const LWBOX *box = lwgeom_get_bbox(rings[j]);
+			if (x < box->xmin || x > box->xmax || y < box->ymin || y > box->ymax ||
+			    !shp_ring_contains(rings[j], x, y))
+				continue;
+			s->owners[i] = (int32_t)j;
+			best = -s->areas[j];
+		}
+	}
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		if (s->owners[i] < 0)
+			s->owners[i] = (int32_t)i;
+	}
+
+	/* Group each shell with its holes, in file order */
+	uint32_t *next = s->next;
+	for (uint32_t i = 0; i < nrings; i++)
+		next[i] = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+		next[s->owners[i]]++;
+	uint32_t pos = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		if (s->owners[i] != (int32_t)i)
+			continue;
+		uint32_t n = next[i];
+		s->group[pos] = rings[i];
+		next[i] = pos + 1;
+		pos += n;
+	}
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		if (s->owners[i] != (int32_t)i)
+			s->group[next[s->owners[i]]++] = rings[i];
+	}
+
+	LWGEOM *mobj = NULL;
+	LWGEOM *poly = NULL;
+	pos = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		if (s->owners[i] != (int32_t)i)
+			continue;
+		uint32_t n = next[i] - pos;
+		if (!(poly = lwgeom__poly_from_rings(d->arena, n, s->group + pos)))
+			break;
+		pos += n;
+		if (pos == nrings && !mobj)
+			return poly;
+		if (!mobj && !(mobj = lwgeom__new(d->arena, MPOLYTYPE, d->hasz, d->hasm)))
+			break;
+		if (!lwgeom__add_child(mobj, poly))
+			break;
+		poly = NULL;
+	}
+	if (pos == nrings)
+		return mobj;
+	lwgeom_free(poly);
+	lwgeom_free(mobj);
+	for (uint32_t i = pos; i < nrings; i++)
+		lwgeom_free(s->group[i]);
+	return NULL;
+}
+
+/// Decode the record at \a rec
+/// @param[out] out the geometry, NULL for a null shape or a record whose
+/// box misses \a filter
+/// @return LW_FAILURE for malformed records, multipatches and out of memory
+static int
+shp_decode(lwgeom_arena *arena,
+	   shp_scratch *s,
+	   const uint8_t *rec,
+	   size_t len,
+	   const LWBOX *filter,
+	   int flags,
+	   LWGEOM **out)
+{
+	*out = NULL;
+	LWBOX box;
+	if (len >= 4 && shp_le32(rec) == SHP_NULL)
+		return LW_SUCCESS;
+	if (!shp_record_bbox(rec, len, &box))
+		return LW_FAILURE;
+	if (filter && (box.xmin > filter->xmax || box.ymin > filter->ymax || box.xmax < filter->xmin ||
+		       box.ymax < filter->ymin))
+		return LW_SUCCESS;
+
+	int type = (int)shp_le32(rec);
+	int base = type % 10;
+	shp_decoder d = {arena, NULL, NULL, NULL, NULL, type > 10 && type < 20, type > 20, flags & LWGEOM_SHP_BORROW};
+	if (type > 28 || (base != SHP_POINT && base != SHP_ARC && base != SHP_POLYGON && base != SHP_MULTIPOINT))
+		return LW_FAILURE;
+
+	if (base == SHP_POINT)
+	{
+		double pp[4] = {box.xmin, box.ymin, 0.0, 0.0};
+		size_t need = 20 + 8 * (size_t)d.hasz;
+		if (len < need)
+			return LW_FAILURE;
+		if (d.hasz)
+			pp[2] = shp_double(rec + 20);
+		// M is optional after Z
+		d.hasm = type > 10 && len >= need + 8;
+		if (type > 20 && !d.hasm)
+			return LW_FAILURE;
+		if (d.hasm)
+			pp[2 + d.hasz] = shp_double(rec + need);
+		*out = lwgeom_point_arena(arena, pp, d.hasz, d.hasm);
+		return *out ? LW_SUCCESS : LW_FAILURE;
+	}
+
+	/* Counts, then the parts, the points and the Z then M ranges and values */
+	size_t head = base == SHP_MULTIPOINT ? 40 : 44;
+	if (len < head)
+		return LW_FAILURE;
+	uint32_t nparts = base == SHP_MULTIPOINT ? 0 : shp_le32(rec + 36);
+	uint32_t npoints = shp_le32(rec + head - 4);
+	if (nparts > (len - head) / 4 || npoints > (len - head - 4 * (size_t)nparts) / 16)
+		return LW_FAILURE;
+	const uint8_t *parts = rec + head;
+	d.xy = parts + 4 * (size_t)nparts;
+	size_t rest = len - head - 4 * (size_t)nparts - 16 * (size_t)npoints;
+	const uint8_t *next = d.xy + 16 * (size_t)npoints;
+	if (d.hasz && npoints)
+	{
+		if (rest < 16 + 8 * (size_t)npoints)
+			return LW_FAILURE;
+		d.z = next + 16;
+		next += 16 + 8 * (size_t)npoints;
+		rest -= 16 + 8 * (size_t)npoints;
+	}
+	// M is optional after Z, empty M shapes may leave out the range
+	d.hasm = type > 10 && (rest >= 16 + 8 * (size_t)npoints || (type > 20 && !npoints));
+	if (type > 20 && !d.hasm)
+		return LW_FAILURE;
+	d.m = next + 16;
+	if (!d.borrow || d.hasz || d.hasm)
+	{
+		// One block for every point of the record
+		size_t size = (size_t)npoints * LW_POINTBYTESIZE(d.hasz, d.hasm) * sizeof(double);
+		if (arena && npoints && !(d.block = (double *)lwgeom__malloc(arena, size, LWGEOM_MEM_COORDS)))
+			return LW_FAILURE;
+	}
+
+	if (base == SHP_MULTIPOINT)
+	{
+		LWGEOM *mobj = lwgeom__new(arena, MPOINTTYPE, d.hasz, d.hasm);
+		for (uint32_t i = 0; mobj && i < npoints; i++)
+		{
+			LWGEOM *point = shp_points(&d, POINTTYPE, i, i + 1);
+			if (!point || !lwgeom__add_child(mobj, point))
+			{
+				lwgeom_free(point);
+				lwgeom_free(mobj);
+				return LW_FAILURE;
+			}
+		}
+		*out = mobj;
+		return mobj ? LW_SUCCESS : LW_FAILURE;
+	}
+
+	if (nparts == 0 || !shp_scratch_reserve(s, nparts))
+		return LW_FAILURE;
+	for (uint32_t i = 0; i < nparts; i++)
+	{
+		uint32_t from = shp_le32(parts + 4 * (size_t)i);
+		uint32_t to = i + 1 < nparts ? shp_le32(parts + 4 * (size_t)i + 4) : npoints;
+		LWGEOM *line = from <= to && to <= npoints ? shp_points(&d, LINETYPE, from, to) : NULL;
+		if (!line)
+		{
+			while (i)
+				lwgeom_free(s->rings[--i]);
+			return LW_FAILURE;
+		}
+		s->rings[i] = line;
+	}
+	if (base == SHP_POLYGON)
+	{
+		*out = shp_polygons(&d, s, nparts);
+		return *out ? LW_SUCCESS : LW_FAILURE;
+	}
+	if (nparts == 1)
+	{
+		*out = s->rings[0];
+		return LW_SUCCESS;
+	}
+	LWGEOM *mobj = lwgeom__new(arena, MLINETYPE, d.hasz, d.hasm);
+	uint32_t i = 0;
+	for (; mobj && i < nparts && lwgeom__add_child(mobj, s->rings[i]); i++)
+		;
+	if (i == nparts)
+	{
+		*out = mobj;
+		return LW_SUCCESS;
+	}
+	for (; i < nparts; i++)
+		lwgeom_free(s->rings[i]);
+	lwgeom_free(mobj);
+	return LW_FAILURE;
+}
+
+/* ---------------------------------- reader -------------------------------- */
+
+static const uint8_t *
+shp_map(const char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < SHP_HEADER_SIZE)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	*len = (size_t)st.st_size;
+	return (const uint8_t *)map;
+}
+
+/// Offsets of the records found by walking them, for a missing .shx
+static int
+shp_walk(lwgeom_shp_reader *r)
+{
+	size_t capacity = 0;
+	for (size_t offset = SHP_HEADER_SIZE; offset + SHP_RECORD_HEADER_SIZE <= r->shp_len;)
+	{
+		size_t len = (size_t)shp_be32(r->shp + offset + 4) * 2;
+		if (len > r->shp_len - offset - SHP_RECORD_HEADER_SIZE || offset > UINT32_MAX || r->count == UINT32_MAX)
+			return LW_FAILURE;
+		if (r->count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 1024;
+			uint32_t *offsets =
+			    (uint32_t *)lwrealloc__cat(r->offsets, capacity * sizeof(uint32_t), LWGEOM_MEM_INDEX);
+			if (!offsets)
+				return LW_FAILURE;
+			r->offsets = offsets;
+		}
+		r->offsets[r->count++] = (uint32_t)offset;
+		offset += SHP_RECORD_HEADER_SIZE + len;
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief Map the shapefile at \a path and its .shx index, found next to
+/// it. Records are located through the index, by walking the .shp once
+/// when there is none.
+/// @param path the .shp file
+/// @return the reader to release with lwgeom_shp_reader_free(), NULL when
+/// the file cannot be mapped or is no shapefile
+lwgeom_shp_reader *
+lwgeom_shp_reader_open(const char *path)
+{
+	assert(path);
+	lwgeom_shp_reader *r = (lwgeom_shp_reader *)lwmalloc0(sizeof(lwgeom_shp_reader));
+	if (!r)
+		return NULL;
+	r->shp = shp_map(path, &r->shp_len);
+	if (!r->shp || shp_be32(r->shp) != 9994 || shp_le32(r->shp + 28) != 1000)
+	{
+		lwgeom_shp_reader_free(r);
+		return NULL;
+	}
+	r->type = (int)shp_le32(r->shp + 32);
+	r->extent.xmin = shp_double(r->shp + 36);
+	r->extent.ymin = shp_double(r->shp + 44);
+	r->extent.xmax = shp_double(r->shp + 52);
+	r->extent.ymax = shp_double(r->shp + 60);
+	r->extent.zmin = shp_double(r->shp + 68);
+	r->extent.zmax = shp_double(r->shp + 76);
+
+	/* x.shp pairs with x.shx, X.SHP with X.SHX */
+	size_t n = strlen(path);
+	char *shx = (char *)lwmalloc__cat(n + 5, LWGEOM_MEM_OTHER);
+	if (!shx)
+	{
+		lwgeom_shp_reader_free(r);
+		return NULL;
+	}
+	memcpy(shx, path, n + 1);
+	if (n >= 4 && shx[n - 4] == '.')
+		shx[n - 1] = shx[n - 1] == 'P' ? 'X' : 'x';
+	else
+		memcpy(shx + n, ".shx", 5);
+	r->shx = shp_map(shx, &r->shx_len);
+	lwfree(shx);
+
+	if (r->shx && shp_be32(r->shx) == 9994)
+	{
+		size_t count = (r->shx_len - SHP_HEADER_SIZE) / 8;
+		r->count = (uint32_t)LWMIN(count, UINT32_MAX);
+	}
+	else
+	{
+		if (r->shx)
+			munmap((void *)r->shx, r->shx_len);
+		r->shx = NULL;
+		if (!shp_walk(r))
+		{
+			lwgeom_shp_reader_free(r);
+			return NULL;
+		}
+	}
+	return r;
+}
+
+/// @brief Number of records, null shapes included
+uint32_t
+lwgeom_shp_reader_count(const lwgeom_shp_reader *reader)
+{
+	assert(reader);
+	return reader->count;
+}
+
+/// @brief Extent of the file from its header, z as well for Z shapefiles
+void
+lwgeom_shp_reader_extent(const lwgeom_shp_reader *reader, LWBOX *box)
+{
+	assert(reader && box);
+	*box = reader->extent;
+}
+
+/// @brief Box of record \a i from its header, without decoding it
+/// @return LW_FAILURE for null shapes and malformed records
+int
+lwgeom_shp_reader_bbox(const lwgeom_shp_reader *reader, uint32_t i, LWBOX *box)
+{
+	assert(reader && box);
+	size_t len;
+	const uint8_t *rec = i < reader->count ? shp_record(reader, i, &len) : NULL;
+	return rec ? shp_record_bbox(rec, len, box) : LW_FAILURE;
+}
+
+/// @brief Decode record \a i. Polygons with several shells come out as multi
+/// polygons, lines with several parts as multi lines.
+/// @param reader reader
+/// @param arena arena of the geometry, NULL to allocate it with lwmalloc
+/// @param i record index
+/// @param filter box the record box has to intersect, NULL for none
+/// @param flags LWGEOM_SHP_BORROW
+/// @param[out] out the geometry, NULL for a null shape or a record outside \a filter
+/// @return LW_FAILURE for malformed records, multipatches and out of memory
+int
+lwgeom_shp_reader_get(lwgeom_shp_reader *reader,
+		      lwgeom_arena *arena,
+		      uint32_t i,
+		      const LWBOX *filter,
+		      int flags,
+		      LWGEOM **out)
+{
+	assert(reader && out);
+	*out = NULL;
+	size_t len;
+	const uint8_t *rec = i < reader->count ? shp_record(reader, i, &len) : NULL;
+	if (!rec)
+		return LW_FAILURE;
+	shp_scratch s = {NULL, NULL, NULL, NULL, NULL, 0};
+	int ok = shp_decode(arena, &s, rec, len, filter, flags, out);
+	shp_scratch_free(&s);
+	return ok;
+}
+
+/* ---------------------------------- scan ---------------------------------- */
+
+typedef struct {
+	const lwgeom_shp_reader *reader;
+	const LWBOX *filter;
+	int flags;
+	lwgeom_shp_scan_callback callback;
+	void *data;
+	lwgeom_ctx *ctx;
+	uint64_t next; ///< first record of the next chunk
+	int stop;
+	int failed;
+} shp_scan;
+
+/// Decode chunks of records until there are none left, each record in an
+/// arena of the thread reset after the callback
+static void *
+shp_scan_worker(void *arg)
+{
+	shp_scan *scan = (shp_scan *)arg;
+	const lwgeom_shp_reader *r = scan->reader;
+	lwgeom_ctx_set(scan->ctx);
+	lwgeom_arena *arena = lwgeom_arena_new(0);
+	shp_scratch s = {NULL, NULL, NULL, NULL, NULL, 0};
+	int ok = arena != NULL;
+	while (ok && !__atomic_load_n(&scan->stop, __ATOMIC_RELAXED))
+	{
+		uint64_t begin = __atomic_fetch_add(&scan->next, SHP_SCAN_CHUNK, __ATOMIC_RELAXED);
+		if (begin >= r->count)
+			break;
+		uint32_t end = (uint32_t)LWMIN(begin + SHP_SCAN_CHUNK, r->count);
+		for (uint32_t i = (uint32_t)begin; ok && i < end; i++)
+		{
+			size_t len;
+			LWGEOM *obj;
+			const uint8_t *rec = shp_record(r, i, &len);
+			ok = rec && shp_decode(arena, &s, rec, len, scan->filter, scan->flags, &obj);
+			if (ok && obj)
+				ok = scan->callback(obj, i, scan->data);
+			lwgeom_arena_reset(arena);
+		}
+	}
+	if (!ok)
+	{
+		__atomic_store_n(&scan->failed, LW_TRUE, __ATOMIC_RELAXED);
+		__atomic_store_n(&scan->stop, LW_TRUE, __ATOMIC_RELAXED);
+	}
+	if (arena)
+		lwgeom_arena_free(arena);
+	shp_scratch_free(&s);
+	return NULL;
+}
+
+/// @brief Decode every record on several threads, which take chunks of
+/// consecutive records in turn
+/// @param reader reader
+/// @param filter box the record boxes have to intersect, NULL for none
+/// @param flags LWGEOM_SHP_BORROW
+/// @param nthreads decoding threads, the caller included, 0 for one per core
+/// @param callback receives the records, concurrently and out of order
+/// @param data passed to \a callback
+/// @return LW_SUCCESS, LW_FAILURE for a malformed record, out of memory or
+/// when \a callback stopped the scan
+int
+lwgeom_shp_reader_scan(lwgeom_shp_reader *reader,
+		       const LWBOX *filter,
+		       int flags,
+		       int nthreads,
+		       lwgeom_shp_scan_callback callback,
+		       void *data)
+{
+	assert(reader && callback);
+	shp_scan scan = {reader, filter, flags, callback, data, lwgeom_ctx_get(), 0, LW_FALSE, LW_FALSE};
+	long n = nthreads > 0 ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+	n = LWMAX(1, LWMIN(n, (long)(reader->count / SHP_SCAN_CHUNK) + 1));
+	madvise((void *)reader->shp, reader->shp_len, MADV_SEQUENTIAL);
+
+	pthread_t *threads = n > 1 ? (pthread_t *)lwmalloc((size_t)(n - 1) * sizeof(pthread_t)) : NULL;
+	long started = 0;
+	for (; threads && started < n - 1; ++started)
+	{
+		if (pthread_create(&threads[started], NULL, shp_scan_worker, &scan) != 0)
+			break;
+	}
+	shp_scan_worker(&scan);
+	for (long i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+	lwfree(threads);
+	madvise((void *)reader->shp, reader->shp_len, MADV_NORMAL);
+	return scan.failed ? LW_FAILURE : LW_SUCCESS;
+}
+
+void
+lwgeom_shp_reader_free(lwgeom_shp_reader *reader)
+{
+	if (reader == NULL)
+		return;
+	if (reader->shp)
+		munmap((void *)reader->shp, reader->shp_len);
+	if (reader->shx)
+		munmap((void *)reader->shx, reader->shx_len);
+	lwfree(reader->offsets);
+	lwfree(reader);
+}
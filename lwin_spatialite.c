@@ -0,0 +1,418 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* Nesting allowed in collections, deeper input is refused */
+#define SPL_MAX_DEPTH 32
+
+/* Markers of the blob */
+#define SPL_START 0x00
+#define SPL_XDR 0x00 /* big endian */
+#define SPL_NDR 0x01 /* little endian */
+#define SPL_TINY_XDR 0x80
+#define SPL_TINY_NDR 0x81
+#define SPL_MBR 0x7C
+#define SPL_ENTITY 0x69
+#define SPL_END 0xFE
+
+/* Start, endianness, SRID, MBR, MBR marker and class of a blob */
+#define SPL_HEADER_SIZE 43
+/* Classes of lines and polygons with float deltas between their end points */
+#define SPL_COMPRESSED 1000000u
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SPL_NATIVE SPL_XDR
+#else
+#define SPL_NATIVE SPL_NDR
+#endif
+
+typedef struct {
+	const uint8_t *pos;
+	const uint8_t *end;
+	lwgeom_arena *arena;
+	int swap;
+	int borrow;    ///< alias native, aligned coordinates in the input
+	double *block; ///< arena coordinates sized by the check pass
+} spl_reader;
+
+/// Geometry class: the WKB type and dimensions, plus compression
+typedef struct {
+	uint8_t type;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	int compressed;
+} spl_class;
+
+static inline uint32_t
+spl_uint32(const uint8_t *p, int swap)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap32(v) : v;
+}
+
+static inline double
+spl_double(const uint8_t *p, int swap)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	if (swap)
+		v = __builtin_bswap64(v);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+static inline float
+spl_float(const uint8_t *p, int swap)
+{
+	uint32_t v = spl_uint32(p, swap);
+	float f;
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+static int
+spl_read_class(uint32_t code, spl_class *c)
+{
+	if (code >= 2 * SPL_COMPRESSED)
+		return LW_FAILURE;
+	c->compressed = code >= SPL_COMPRESSED;
+	code %= SPL_COMPRESSED;
+	if (code / 1000 > 3 || code % 1000 < POINTTYPE || code % 1000 > COLLECTIONTYPE)
+		return LW_FAILURE;
+	c->type = (uint8_t)(code % 1000);
+	c->hasz = code / 1000 == 1 || code / 1000 == 3;
+	c->hasm = code / 1000 >= 2;
+	if (c->compressed && c->type != LINETYPE && c->type != POLYTYPE)
+		return LW_FAILURE;
+	return LW_SUCCESS;
+}
+
+/// Bytes of \a n points, compressed ones keep their first and last points
+/// whole and store float deltas for x, y and z in between, m as is
+static size_t
+spl_points_size(const spl_class *c, size_t n)
+{
+	size_t full = LW_POINTBYTESIZE(c->hasz, c->hasm) * sizeof(double);
+	if (!c->compressed || n <= 2)
+		return n * full;
+	size_t delta = (c->hasz ? 12 : 8) + (c->hasm ? 8 : 0);
+	return 2 * full + (n - 2) * delta;
+}
+
+/// Skip a counted sequence of points
+static int
+spl_check_points(spl_reader *r, const spl_class *c, size_t *npoints)
+{
+	if (r->end - r->pos < 4)
+		return LW_FAILURE;
+	uint32_t n = spl_uint32(r->pos, r->swap);
+	r->pos += 4;
+	// The smallest point takes 8 bytes
+	if (n > (size_t)(r->end - r->pos) / 8 || spl_points_size(c, n) > (size_t)(r->end - r->pos))
+		return LW_FAILURE;
+	r->pos += spl_points_size(c, n);
+	*npoints += n;
+	return LW_SUCCESS;
+}
+
+/// First pass: validate the body of a \a c geometry and count its points,
+/// nothing is allocated and every count is checked against the bytes left
+static int
+spl_check(spl_reader *r, const spl_class *c, int depth, size_t *npoints)
+{
+	if (depth > SPL_MAX_DEPTH)
+		return LW_FAILURE;
+	switch (c->type)
+	{
+	case POINTTYPE:
+		if ((size_t)(r->end - r->pos) < spl_points_size(c, 1))
+			return LW_FAILURE;
+		r->pos += spl_points_size(c, 1);
+		*npoints += 1;
+		return LW_SUCCESS;
+	case LINETYPE:
+		return spl_check_points(r, c, npoints);
+	default:
+		break;
+	}
+
+	if (r->end - r->pos < 4)
+		return LW_FAILURE;
+	uint32_t n = spl_uint32(r->pos, r->swap);
+	r->pos += 4;
+	// A ring takes 4 bytes at least, a collection item 5
+	if (n > (size_t)(r->end - r->pos) / (c->type == POLYTYPE ? 4 : 5))
+		return LW_FAILURE;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (c->type == POLYTYPE)
+		{
+			if (!spl_check_points(r, c, npoints))
+				return LW_FAILURE;
+			continue;
+		}
+		spl_class item;
+		if (r->end - r->pos < 5 || r->pos[0] != SPL_ENTITY)
+			return LW_FAILURE;
+		if (!spl_read_class(spl_uint32(r->pos + 1, r->swap), &item))
+			return LW_FAILURE;
+		r->pos += 5;
+		if (item.hasz != c->hasz || item.hasm != c->hasm)
+			return LW_FAILURE;
+		if (c->type != COLLECTIONTYPE && item.type != c->type - (MPOINTTYPE - POINTTYPE))
+			return LW_FAILURE;
+		if (!spl_check(r, &item, depth + 1, npoints))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+/// Point or line over \a n validated points, aliasing the input when allowed
+static LWGEOM *
+spl_build_points(spl_reader *r, const spl_class *c, uint8_t type, uint32_t n)
+{
+	size_t cdim = LW_POINTBYTESIZE(c->hasz, c->hasm);
+	const uint8_t *src = r->pos;
+	r->pos += spl_points_size(c, n);
+	if (n == 0)
+		return lwgeom__new(r->arena, type, c->hasz, c->hasm);
+	if (r->borrow && !r->swap && !c->compressed && ((uintptr_t)src & (sizeof(double) - 1)) == 0)
+		return lwgeom__wrap(r->arena, type, n, (const double *)src, c->hasz, c->hasm);
+
+	LWGEOM *obj;
+	double *dst;
+	if (r->block)
+	{
+		// Slice of the coordinates allocated up front in the arena
+		dst = r->block;
+		r->block += n * cdim;
+		obj = lwgeom__wrap(r->arena, type, n, dst, c->hasz, c->hasm);
+	}
+	else
+	{
+		obj = lwgeom__new(r->arena, type, c->hasz, c->hasm);
+		dst = obj ? (double *)lwgeom__malloc(r->arena, n * cdim * sizeof(double), LWGEOM_MEM_COORDS) : NULL;
+		if (obj && !dst)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		if (obj)
+		{
+			obj->pp = dst;
+			obj->npoints = n;
+		}
+	}
+	if (!obj)
+		return NULL;
+	if (!c->compressed || n <= 2)
+	{
+		if (r->swap)
+			lwgeom__bswap64_copy(dst, src, n * cdim);
+		else
+			memcpy(dst, src, n * cdim * sizeof(double));
+		return obj;
+	}
+
+	for (uint32_t i = 0; i < n; ++i, dst += cdim)
+	{
+		if (i == 0 || i == n - 1)
+		{
+			for (size_t o = 0; o < cdim; ++o, src += 8)
+				dst[o] = spl_double(src, r->swap);
+			continue;
+		}
+		dst[0] = dst[-(ptrdiff_t)cdim] + spl_float(src, r->swap);
+		dst[1] = dst[1 - (ptrdiff_t)cdim] + spl_float(src + 4, r->swap);
+		src += 8;
+		if (c->hasz)
+		{
+			dst[2] = dst[2 - (ptrdiff_t)cdim] + spl_float(src, r->swap);
+			src += 4;
+		}
+		if (c->hasm)
+		{
+			dst[cdim - 1] = spl_double(src, r->swap);
+			src += 8;
+		}
+	}
+	return obj;
+}
+
+/// Second pass over the body of a \a c geometry validated by spl_check()
+static LWGEOM *
+spl_build(spl_reader *r, const spl_class *c)
+{
+	if (c->type == POINTTYPE)
+		return spl_build_points(r, c, POINTTYPE, 1);
+	uint32_t n = spl_uint32(r->pos, r->swap);
+	r->pos += 4;
+	if (c->type == LINETYPE)
+		return spl_build_points(r, c, LINETYPE, n);
+
+	// Polygons and collections get their child array at its final size
+	LWGEOM *obj = lwgeom__new(r->arena, c->type, c->hasz, c->hasm);
+	if (!obj || n == 0)
+		return obj;
+	obj->geoms = (LWGEOM **)lwgeom__malloc(r->arena, lw_nearest_pow(n) * sizeof(LWGEOM *), LWGEOM_MEM_GEOMETRY);
+	if (!obj->geoms)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		LWGEOM *sub;
+		if (c->type == POLYTYPE)
+		{
+			uint32_t npoints = spl_uint32(r->pos, r->swap);
+			r->pos += 4;
+			sub = spl_build_points(r, c, LINETYPE, npoints);
+			if (sub && i == 0)
+				LWFLAGS_SET_SHELL_RING(sub->flags, LW_TRUE);
+			else if (sub)
+				LWFLAGS_SET_HOLE_RING(sub->flags, LW_TRUE);
+		}
+		else
+		{
+			spl_class item;
+			spl_read_class(spl_uint32(r->pos + 1, r->swap), &item);
+			r->pos += 5;
+			sub = spl_build(r, &item);
+		}
+		if (!sub)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		obj->geoms[obj->ngeoms++] = sub;
+	}
+	return obj;
+}
+
+/// Locate the body of a blob and read its class
+/// @return LW_FAILURE when the blob is no SpatiaLite geometry
+static int
+spl_open(const uint8_t *blob, size_t len, spl_reader *r, spl_class *c, int32_t *srid)
+{
+	if (len < 8 || blob[0] != SPL_START || blob[len - 1] != SPL_END)
+		return LW_FAILURE;
+	if (blob[1] == SPL_TINY_XDR || blob[1] == SPL_TINY_NDR)
+	{
+		// TinyPoint: SRID, one byte dimensions then the point
+		r->swap = (blob[1] == SPL_TINY_NDR) != (SPL_NATIVE == SPL_NDR);
+		if (blob[6] < 1 || blob[6] > 4)
+			return LW_FAILURE;
+		c->type = POINTTYPE;
+		c->hasz = blob[6] == 2 || blob[6] == 4;
+		c->hasm = blob[6] >= 3;
+		c->compressed = LW_FALSE;
+		r->pos = blob + 7;
+	}
+	else
+	{
+		if (blob[1] > SPL_NDR || len < SPL_HEADER_SIZE + 1 || blob[38] != SPL_MBR)
+			return LW_FAILURE;
+		r->swap = blob[1] != SPL_NATIVE;
+		if (!spl_read_class(spl_uint32(blob + 39, r->swap), c))
+			return LW_FAILURE;
+		r->pos = blob + SPL_HEADER_SIZE;
+	}
+	r->end = blob + len - 1;
+	if (srid)
+		*srid = (int32_t)spl_uint32(blob + 2, r->swap);
+	return LW_SUCCESS;
+}
+
+/// @brief Envelope of a SpatiaLite geometry blob, its MBR read without
+/// decoding the coordinates, or the point of a TinyPoint blob
+/// @param blob SpatiaLite geometry
+/// @param len bytes of \a blob
+/// @param[out] srid SRID of the blob, may be NULL
+/// @param[out] box envelope
+/// @return LW_FAILURE when \a blob is no SpatiaLite geometry
+int
+lwgeom_spatialite_envelope(const char *blob, size_t len, int32_t *srid, LWBOX *box)
+{
+	assert(blob && box);
+	const uint8_t *p = (const uint8_t *)blob;
+	spl_reader r;
+	spl_class c;
+	if (!spl_open(p, len, &r, &c, srid))
+		return LW_FAILURE;
+	memset(box, 0, sizeof(*box));
+	if (r.pos == p + 7)
+	{
+		if (r.end - r.pos < 16)
+			return LW_FAILURE;
+		box->xmin = box->xmax = spl_double(r.pos, r.swap);
+		box->ymin = box->ymax = spl_double(r.pos + 8, r.swap);
+		return LW_SUCCESS;
+	}
+	box->xmin = spl_double(p + 6, r.swap);
+	box->ymin = spl_double(p + 14, r.swap);
+	box->xmax = spl_double(p + 22, r.swap);
+	box->ymax = spl_double(p + 30, r.swap);
+	return LW_SUCCESS;
+}
+
+/// @brief Read a SpatiaLite geometry blob, TinyPoint and compressed lines
+/// and polygons included, validated in one pass before anything is allocated
+/// @param arena arena owning the result, NULL to allocate with lwmalloc
+/// @param blob SpatiaLite geometry
+/// @param len bytes of \a blob
+/// @param borrow alias native, aligned and uncompressed coordinates in
+/// \a blob, which must then outlive the result
+/// @param[out] srid SRID of the blob, may be NULL
+/// @return the geometry, NULL when the blob is invalid
+LWGEOM *
+lwgeom_read_spatialite(lwgeom_arena *arena, const char *blob, size_t len, int borrow, int32_t *srid)
+{
+	assert(blob);
+	const uint8_t *p = (const uint8_t *)blob;
+	spl_reader r = {NULL, NULL, arena, 0, borrow, NULL};
+	spl_class c;
+	if (!spl_open(p, len, &r, &c, srid))
+		return NULL;
+	const uint8_t *body = r.pos;
+	size_t npoints = 0;
+	if (!spl_check(&r, &c, 0, &npoints) || r.pos != r.end)
+		return NULL;
+
+	r.pos = body;
+	if (arena && npoints)
+	{
+		// Children share the dimensions of the root
+		size_t cdim = LW_POINTBYTESIZE(c.hasz, c.hasm);
+		r.block = (double *)lwgeom__malloc(arena, npoints * cdim * sizeof(double), LWGEOM_MEM_COORDS);
+		if (!r.block)
+			return NULL;
+	}
+	return spl_build(&r, &c);
+}
@@ -0,0 +1,424 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* With pext, the varints ending in an 8 byte word are all decoded from
+ * one load of it, elsewhere a byte loop is faster than packing their 7 bit
+ * groups with shifts */
+#if defined(__BMI2__)
+#include <immintrin.h>
+#define TWKB_WORD_DECODE 1
+#endif
+
+/* Nesting allowed in collections, deeper input is refused */
+#define TWKB_MAX_DEPTH 32
+
+/* Metadata header bits */
+#define TWKB_BBOX     0x01
+#define TWKB_SIZE     0x02
+#define TWKB_IDLIST   0x04
+#define TWKB_EXTENDED 0x08
+#define TWKB_EMPTY    0x10
+
+typedef struct {
+	const uint8_t *pos;
+	const uint8_t *end;
+	lwgeom_arena *arena;
+	int ndims;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	double mul[4];   ///< 10^-precision of the negative precisions, 1 otherwise
+	double div[4];   ///< 10^precision of the positive precisions, 1 otherwise
+	int64_t last[4]; ///< previous point, the next one is a delta from it
+} twkb_reader;
+
+/* Precisions go from -8 to 7 */
+static const double twkb_pow10[9] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8};
+
+/// Unsigned varint at \a p
+/// @return the position past it, NULL when truncated or over 10 bytes
+static const uint8_t *
+twkb_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t value = 0;
+	for (int shift = 0; shift < 70 && p < end; shift += 7)
+	{
+		uint8_t byte = *p++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			*v = value;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline int
+twkb_uvarint(twkb_reader *r, uint64_t *v)
+{
+	const uint8_t *p = twkb_varint(r->pos, r->end, v);
+	if (!p)
+		return LW_FAILURE;
+	r->pos = p;
+	return LW_SUCCESS;
+}
+
+static inline int64_t
+twkb_unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/// Count at the read position, each of its items taking at least \a min bytes
+static int
+twkb_count(twkb_reader *r, size_t min, uint32_t *n)
+{
+	uint64_t v;
+	if (!twkb_uvarint(r, &v) || v > UINT32_MAX || v > (uint64_t)(r->end - r->pos) / min)
+		return LW_FAILURE;
+	*n = (uint32_t)v;
+	return LW_SUCCESS;
+}
+
+/// Decode the \a n points at the read position into \a dst. With
+/// TWKB_WORD_DECODE, the bytes without continuation bit of an 8 byte word
+/// delimit the varints ending in it, which are decoded without a branch per
+/// byte, and the read position moves once per word.
+static int
+twkb_read_points(twkb_reader *r, double *dst, uint32_t n)
+{
+	// Kept in locals, the stores to dst would otherwise reload them
+	const uint8_t *pos = r->pos;
+	const uint8_t *end = r->end;
+	int ndims = r->ndims;
+	int64_t last[4] = {r->last[0], r->last[1], r->last[2], r->last[3]};
+	size_t todo = (size_t)n * (size_t)ndims;
+	int o = 0;
+	while (todo)
+	{
+		uint64_t values[8];
+		int nvalues = 0;
+#ifdef TWKB_WORD_DECODE
+		uint64_t w, stop = 0;
+		if (end - pos >= 8)
+		{
+			memcpy(&w, pos, sizeof(w));
+			stop = ~w & 0x8080808080808080ULL;
+		}
+		if (stop)
+		{
+			int used = 0;
+			do
+			{
+				int last_byte = __builtin_ctzll(stop) >> 3;
+				uint64_t s = stop >> (8 * used);
+				values[nvalues++] = _pext_u64((w >> (8 * used)) & (s ^ (s - 1)), 0x7f7f7f7f7f7f7f7fULL);
+				used = last_byte + 1;
+				stop &= stop - 1;
+			} while (stop && (size_t)nvalues < todo);
+			pos += used;
+		}
+		else
+#endif
+		{
+			if (!(pos = twkb_varint(pos, end, &values[0])))
+				return LW_FAILURE;
+			nvalues = 1;
+		}
+		todo -= (size_t)nvalues;
+		for (int i = 0; i < nvalues; ++i)
+		{
+			// Wrapping add, a hostile delta must not be undefined behavior
+			last[o] = (int64_t)((uint64_t)last[o] + (uint64_t)twkb_unzigzag(values[i]));
+			*dst++ = (double)last[o] * r->mul[o] / r->div[o];
+			if (++o == ndims)
+				o = 0;
+		}
+	}
+	memcpy(r->last, last, sizeof(last));
+	r->pos = pos;
+	return LW_SUCCESS;
+}
+
+/// Point or line of \a n points at the read position
+static LWGEOM *
+twkb_build_points(twkb_reader *r, uint8_t type, uint32_t n)
+{
+	LWGEOM *obj = lwgeom__new(r->arena, type, r->hasz, r->hasm);
+	if (!obj || n == 0)
+		return obj;
+	size_t size = (size_t)n * (size_t)r->ndims * sizeof(double);
+	double *dst = (double *)lwgeom__malloc(r->arena, size, LWGEOM_MEM_COORDS);
+	if (!dst)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	obj->pp = dst;
+	obj->npoints = n;
+	if (!twkb_read_points(r, dst, n))
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/// Line with its point count at the read position
+static LWGEOM *
+twkb_read_line(twkb_reader *r)
+{
+	uint32_t n;
+	if (!twkb_count(r, (size_t)r->ndims, &n))
+		return NULL;
+	return twkb_build_points(r, LINETYPE, n);
+}
+
+static LWGEOM *
+twkb_read_poly(twkb_reader *r)
+{
+	uint32_t n;
+	if (!twkb_count(r, 1, &n))
+		return NULL;
+	LWGEOM *obj = lwgeom__new(r->arena, POLYTYPE, r->hasz, r->hasm);
+	for (uint32_t i = 0; obj && i < n; ++i)
+	{
+		LWGEOM *ring = twkb_read_line(r);
+		if (ring)
+		{
+			if (i == 0)
+				LWFLAGS_SET_SHELL_RING(ring->flags, LW_TRUE);
+			else
+				LWFLAGS_SET_HOLE_RING(ring->flags, LW_TRUE);
+		}
+		if (!ring || !lwgeom__add_child(obj, ring))
+		{
+			lwgeom_free(ring);
+			lwgeom_free(obj);
+			return NULL;
+		}
+	}
+	return obj;
+}
+
+static LWGEOM *twkb_read_geom(twkb_reader *r, int depth, int64_t **ids);
+
+/// Members of a multi geometry or collection of \a n members
+static LWGEOM *
+twkb_read_members(twkb_reader *r, uint8_t type, uint8_t meta, int depth, int64_t **ids)
+{
+	uint32_t n;
+	if (!twkb_count(r, 1, &n))
+		return NULL;
+	if (meta & TWKB_IDLIST)
+	{
+		// Kept for the top level only
+		int64_t *list = NULL;
+		if (ids && depth == 0 && n)
+		{
+			list = (int64_t *)lwmalloc__cat((size_t)n * sizeof(int64_t), LWGEOM_MEM_OTHER);
+			if (!list)
+				return NULL;
+		}
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			uint64_t v;
+			if (!twkb_uvarint(r, &v))
+			{
+				lwfree(list);
+				return NULL;
+			}
+			if (list)
+				list[i] = twkb_unzigzag(v);
+		}
+		if (ids && depth == 0)
+			*ids = list;
+	}
+
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(r->arena, type, r->hasz, r->hasm);
+	for (uint32_t i = 0; mobj && i < n; ++i)
+	{
+		LWGEOM *obj;
+		switch (type)
+		{
+		case MPOINTTYPE:
+			obj = twkb_build_points(r, POINTTYPE, 1);
+			break;
+		case MLINETYPE:
+			obj = twkb_read_line(r);
+			break;
+		case MPOLYTYPE:
+			obj = twkb_read_poly(r);
+			break;
+		default:
+			obj = twkb_read_geom(r, depth + 1, NULL);
+			break;
+		}
+		if (!obj || !lwgeom__add_child(mobj, obj))
+		{
+			lwgeom_free(obj);
+			lwgeom_free(mobj);
+			mobj = NULL;
+		}
+	}
+	if (!mobj && ids && depth == 0 && *ids)
+	{
+		lwfree(*ids);
+		*ids = NULL;
+	}
+	return mobj;
+}
+
+static LWGEOM *
+twkb_read_geom(twkb_reader *r, int depth, int64_t **ids)
+{
+	if (depth > TWKB_MAX_DEPTH || r->end - r->pos < 2)
+		return NULL;
+	uint8_t type = r->pos[0] & 0x0f;
+	int precision = (int)twkb_unzigzag(r->pos[0] >> 4);
+	uint8_t meta = r->pos[1];
+	r->pos += 2;
+	if (type < POINTTYPE || type > COLLECTIONTYPE)
+		return NULL;
+
+	int pz = 0, pm = 0;
+	r->hasz = r->hasm = LW_FALSE;
+	if (meta & TWKB_EXTENDED)
+	{
+		if (r->pos == r->end)
+			return NULL;
+		uint8_t e = *r->pos++;
+		r->hasz = (e & 0x01) != 0;
+		r->hasm = (e & 0x02) != 0;
+		pz = (e >> 2) & 0x07;
+		pm = (e >> 5) & 0x07;
+	}
+	r->ndims = 2 + r->hasz + r->hasm;
+	int precisions[4] = {precision, precision, r->hasz ? pz : pm, pm};
+	for (int o = 0; o < r->ndims; ++o)
+	{
+		r->mul[o] = precisions[o] < 0 ? twkb_pow10[-precisions[o]] : 1.0;
+		r->div[o] = precisions[o] > 0 ? twkb_pow10[precisions[o]] : 1.0;
+		r->last[o] = 0;
+	}
+
+	const uint8_t *end = NULL;
+	if (meta & TWKB_SIZE)
+	{
+		uint64_t size;
+		if (!twkb_uvarint(r, &size) || size > (uint64_t)(r->end - r->pos))
+			return NULL;
+		end = r->pos + size;
+	}
+	if (meta & TWKB_EMPTY)
+	{
+		if (end && r->pos != end)
+			return NULL;
+		if (type <= POLYTYPE)
+			return lwgeom__new(r->arena, type, r->hasz, r->hasm);
+		return lwgeom_create_empty_collection_arena(r->arena, type, r->hasz, r->hasm);
+	}
+	if (meta & TWKB_BBOX)
+	{
+		// Minimum and extent of each ordinate, of no use to the reader
+		for (int o = 0; o < 2 * r->ndims; ++o)
+		{
+			uint64_t v;
+			if (!twkb_uvarint(r, &v))
+				return NULL;
+		}
+	}
+
+	LWGEOM *obj;
+	switch (type)
+	{
+	case POINTTYPE:
+		obj = twkb_build_points(r, POINTTYPE, 1);
+		break;
+	case LINETYPE:
+		obj = twkb_read_line(r);
+		break;
+	case POLYTYPE:
+		obj = twkb_read_poly(r);
+		break;
+	default:
+		obj = twkb_read_members(r, type, meta, depth, ids);
+		break;
+	}
+	if (obj && end && r->pos != end)
+	{
+		lwgeom_free(obj);
+		if (ids && depth == 0 && *ids)
+		{
+			lwfree(*ids);
+			*ids = NULL;
+		}
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief Read a TWKB geometry into an arena
+/// @param arena owning arena or NULL
+/// @param[out] used bytes of the geometry, to read the next one of a stream,
+/// may be NULL when \a twkb holds the geometry alone
+/// @param[out] ids when not NULL, the id list of a multi geometry or
+/// collection, one id per member released with lwfree(), NULL without list
+/// @return NULL for malformed input
+LWGEOM *
+lwgeom_read_twkb_arena(lwgeom_arena *arena, const char *twkb, size_t len, size_t *used, int64_t **ids)
+{
+	assert(twkb || len == 0);
+	twkb_reader r;
+	memset(&r, 0, sizeof(r));
+	r.pos = (const uint8_t *)twkb;
+	r.end = r.pos + len;
+	r.arena = arena;
+	if (ids)
+		*ids = NULL;
+	LWGEOM *obj = twkb_read_geom(&r, 0, ids);
+	if (obj && !used && r.pos != r.end)
+	{
+		lwgeom_free(obj);
+		obj = NULL;
+		if (ids)
+		{
+			lwfree(*ids);
+			*ids = NULL;
+		}
+	}
+	if (obj && used)
+		*used = (size_t)(r.pos - (const uint8_t *)twkb);
+	return obj;
+}
+
+LWGEOM *
+lwgeom_read_twkb(const char *twkb, size_t len)
+{
+	return lwgeom_read_twkb_arena(NULL, twkb, len, NULL, NULL);
+}
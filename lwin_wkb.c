@@ -22,8 +22,378 @@
 
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Nesting allowed in collections, deeper input is refused */
+#define WKB_MAX_DEPTH 32
+
+#define WKB_XDR 0 /* big endian */
+#define WKB_NDR 1 /* little endian */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WKB_NATIVE WKB_XDR
+#else
+#define WKB_NATIVE WKB_NDR
+#endif
+
+/* EWKB flags, the ISO dimensions are type / 1000 */
+#define WKBZOFFSET    0x80000000u
+#define WKBMOFFSET    0x40000000u
+#define WKBSRIDFLAG   0x20000000u
+
+typedef struct {
+	const uint8_t *pos;
+	const uint8_t *end;
+	lwgeom_arena *arena;
+	int borrow;    ///< alias native, aligned coordinates in the input
+	double *block; ///< arena coordinates sized by the check pass
+} wkb_reader;
+
+typedef struct {
+	uint8_t type;
+	int swap;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+} wkb_header;
+
+static inline uint32_t
+wkb_uint32(const uint8_t *p, int swap)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap32(v) : v;
+}
+
+static inline void
+wkb_copy_doubles(double *dst, const uint8_t *src, size_t n, int swap)
+{
+	if (swap)
+		lwgeom__bswap64_copy(dst, src, n);
+	else
+		memcpy(dst, src, n * sizeof(double));
+}
+
+static int
+wkb_read_header(wkb_reader *r, wkb_header *h)
+{
+	if (r->end - r->pos < 5 || r->pos[0] > WKB_NDR)
+		return LW_FAILURE;
+	h->swap = r->pos[0] != WKB_NATIVE;
+	uint32_t type = wkb_uint32(r->pos + 1, h->swap);
+	r->pos += 5;
+	h->hasz = (type & WKBZOFFSET) ? LW_TRUE : LW_FALSE;
+	h->hasm = (type & WKBMOFFSET) ? LW_TRUE : LW_FALSE;
+	if (type & WKBSRIDFLAG)
+	{
+		if (r->end - r->pos < 4)
+			return LW_FAILURE;
+		r->pos += 4;
+	}
+	type &= 0x0FFFFFFFu;
+	switch (type / 1000)
+	{
+	case 0:
+		break;
+	case 1:
+		h->hasz = LW_TRUE;
+		break;
+	case 2:
+		h->hasm = LW_TRUE;
+		break;
+	case 3:
+		h->hasz = h->hasm = LW_TRUE;
+		break;
+	default:
+		return LW_FAILURE;
+	}
+	type %= 1000;
+	if (type < POINTTYPE || type > COLLECTIONTYPE)
+		return LW_FAILURE;
+	h->type = (uint8_t)type;
+	return LW_SUCCESS;
+}
+
+/// Skip a counted sequence of points
+static int
+wkb_check_points(wkb_reader *r, const wkb_header *h, size_t *npoints)
+{
+	if (r->end - r->pos < 4)
+		return LW_FAILURE;
+	uint32_t n = wkb_uint32(r->pos, h->swap);
+	size_t psize = LW_POINTBYTESIZE(h->hasz, h->hasm) * sizeof(double);
+	r->pos += 4;
+	if (n > (size_t)(r->end - r->pos) / psize)
+		return LW_FAILURE;
+	r->pos += n * psize;
+	*npoints += n;
+	return LW_SUCCESS;
+}
+
+/// First pass: validate the whole structure and count the points, nothing
+/// is allocated and every count is checked against the bytes left
+static int
+wkb_check(wkb_reader *r, const wkb_header *parent, int depth, size_t *npoints)
+{
+	wkb_header h;
+	if (depth > WKB_MAX_DEPTH || !wkb_read_header(r, &h))
+		return LW_FAILURE;
+	if (parent)
+	{
+		if (h.hasz != parent->hasz || h.hasm != parent->hasm)
+			return LW_FAILURE;
+		if (parent->type != COLLECTIONTYPE && h.type != parent->type - (MPOINTTYPE - POINTTYPE))
+			return LW_FAILURE;
+	}
+	size_t psize = LW_POINTBYTESIZE(h.hasz, h.hasm) * sizeof(double);
+	switch (h.type)
+	{
+	case POINTTYPE:
+		if ((size_t)(r->end - r->pos) < psize)
+			return LW_FAILURE;
+		r->pos += psize;
+		*npoints += 1;
+		return LW_SUCCESS;
+	case LINETYPE:
+		return wkb_check_points(r, &h, npoints);
+	default:
+		break;
+	}
+
+	if (r->end - r->pos < 4)
+		return LW_FAILURE;
+	uint32_t n = wkb_uint32(r->pos, h.swap);
+	r->pos += 4;
+	// A ring takes 4 bytes at least, a child geometry 9
+	if (n > (size_t)(r->end - r->pos) / (h.type == POLYTYPE ? 4 : 9))
+		return LW_FAILURE;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (!(h.type == POLYTYPE ? wkb_check_points(r, &h, npoints) : wkb_check(r, &h, depth + 1, npoints)))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+/// Point or line over \a n validated points, aliasing the input when allowed
+static LWGEOM *
+wkb_build_points(wkb_reader *r, const wkb_header *h, uint8_t type, uint32_t n)
+{
+	size_t cdim = LW_POINTBYTESIZE(h->hasz, h->hasm);
+	const uint8_t *src = r->pos;
+	r->pos += n * cdim * sizeof(double);
+	if (type == POINTTYPE)
+	{
+		// POINT EMPTY is written with NaN ordinates
+		double pp[4];
+		wkb_copy_doubles(pp, src, cdim, h->swap);
+		int empty = LW_TRUE;
+		for (size_t o = 0; o < cdim; ++o)
+			empty &= isnan(pp[o]) != 0;
+		if (empty)
+			n = 0;
+	}
+	if (n == 0)
+		return lwgeom__new(r->arena, type, h->hasz, h->hasm);
+	if (r->borrow && !h->swap && ((uintptr_t)src & (sizeof(double) - 1)) == 0)
+		return lwgeom__wrap(r->arena, type, n, (const double *)src, h->hasz, h->hasm);
+
+	LWGEOM *obj;
+	double *dst;
+	if (r->block)
+	{
+		// Slice of the coordinates allocated up front in the arena
+		dst = r->block;
+		r->block += n * cdim;
+		obj = lwgeom__wrap(r->arena, type, n, dst, h->hasz, h->hasm);
+	}
+	else
+	{
+		obj = lwgeom__new(r->arena, type, h->hasz, h->hasm);
+		dst = obj ? (double *)lwgeom__malloc(r->arena, n * cdim * sizeof(double), LWGEOM_MEM_COORDS) : NULL;
+		if (obj && !dst)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		if (obj)
+		{
+			obj->pp = dst;
+			obj->npoints = n;
+		}
+	}
+	if (obj)
+		wkb_copy_doubles(dst, src, n * cdim, h->swap);
+	return obj;
+}
+
+/// Second pass over input validated by wkb_check()
+static LWGEOM *
+wkb_build(wkb_reader *r)
+{
+	wkb_header h;
+	wkb_read_header(r, &h);
+	if (h.type == POINTTYPE)
+		return wkb_build_points(r, &h, POINTTYPE, 1);
+	uint32_t n = wkb_uint32(r->pos, h.swap);
+	r->pos += 4;
+	if (h.type == LINETYPE)
+		return wkb_build_points(r, &h, LINETYPE, n);
+
+	// Polygons and collections get their child array at its final size
+	LWGEOM *obj = lwgeom__new(r->arena, h.type, h.hasz, h.hasm);
+	if (!obj || n == 0)
+		return obj;
+	obj->geoms = (LWGEOM **)lwgeom__malloc(r->arena, lw_nearest_pow(n) * sizeof(LWGEOM *), LWGEOM_MEM_GEOMETRY);
+	if (!obj->geoms)
+	{
+		lwgeom_free(obj);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		LWGEOM *sub;
+		if (h.type == POLYTYPE)
+		{
+			uint32_t npoints = wkb_uint32(r->pos, h.swap);
+			r->pos += 4;
+			sub = wkb_build_points(r, &h, LINETYPE, npoints);
+			if (sub && i == 0)
+				LWFLAGS_SET_SHELL_RING(sub->flags, LW_TRUE);
+			else if (sub)
+				LWFLAGS_SET_HOLE_RING(sub->flags, LW_TRUE);
+		}
+		else
+			sub = wkb_build(r);
+		if (!sub)
+		{
+			lwgeom_free(obj);
+			return NULL;
+		}
+		obj->geoms[obj->ngeoms++] = sub;
+	}
+	return obj;
+}
+
+static LWGEOM *
+wkb_read(lwgeom_arena *arena, const uint8_t *wkb, size_t len, int borrow)
+{
+	wkb_reader r = {wkb, wkb + len, arena, borrow, NULL};
+	size_t npoints = 0;
+	if (!wkb_check(&r, NULL, 0, &npoints) || r.pos != r.end)
+		return NULL;
+
+	r.pos = wkb;
+	if (arena && npoints)
+	{
+		// Children share the dimensions of the root
+		wkb_header h;
+		wkb_read_header(&r, &h);
+		r.pos = wkb;
+		size_t cdim = LW_POINTBYTESIZE(h.hasz, h.hasm);
+		r.block = (double *)lwgeom__malloc(arena, npoints * cdim * sizeof(double), LWGEOM_MEM_COORDS);
+		if (!r.block)
+			return NULL;
+	}
+	return wkb_build(&r);
+}
+
+static inline int
+wkb_hex_nibble(uint8_t c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/// Decode \a len hex characters, 16 at a time with SSE2
+static int
+wkb_hex_decode(const char *hex, size_t len, uint8_t *out)
+{
+	if (len % 2)
+		return LW_FAILURE;
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i lower = _mm_set1_epi8(0x20);
+	const __m128i c0 = _mm_set1_epi8('0');
+	const __m128i ca = _mm_set1_epi8('a');
+	const __m128i minus1 = _mm_set1_epi8(-1);
+	const __m128i ten = _mm_set1_epi8(10);
+	const __m128i six = _mm_set1_epi8(6);
+	const __m128i low = _mm_set1_epi16(0x00FF);
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(hex + i));
+		__m128i d = _mm_sub_epi8(v, c0);
+		__m128i l = _mm_sub_epi8(_mm_or_si128(v, lower), ca);
+		__m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(d, minus1), _mm_cmplt_epi8(d, ten));
+		__m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(l, minus1), _mm_cmplt_epi8(l, six));
+		if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xFFFF)
+			return LW_FAILURE;
+		__m128i nib = _mm_or_si128(_mm_and_si128(is_digit, d), _mm_and_si128(is_alpha, _mm_add_epi8(l, ten)));
+		// Even characters are the high nibbles
+		__m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, low), 4), _mm_srli_epi16(nib, 8));
+		_mm_storel_epi64((__m128i *)(out + i / 2), _mm_packus_epi16(bytes, bytes));
+	}
+#endif
+	for (; i < len; i += 2)
+	{
+		int hi = wkb_hex_nibble((uint8_t)hex[i]);
+		int lo = wkb_hex_nibble((uint8_t)hex[i + 1]);
+		if (hi < 0 || lo < 0)
+			return LW_FAILURE;
+		out[i / 2] = (uint8_t)(hi << 4 | lo);
+	}
+	return LW_SUCCESS;
+}
+
 LWGEOM *
 lwgeom_read_wkb(const char *wkb, size_t len, int hex)
 {
-	return NULL;
+	return lwgeom_read_wkb_arena(NULL, wkb, len, hex);
+}
+
+/// @brief Read WKB, ISO or extended (the SRID is skipped), validated in one
+/// pass before anything is allocated. POINT EMPTY is read from NaN ordinates.
+/// @param arena arena owning the result, NULL to allocate with lwmalloc
+/// @param wkb binary or hex encoded WKB
+/// @param len bytes of \a wkb
+/// @param hex \a wkb is hex encoded
+/// @return the geometry, a copy of the input, NULL when it is invalid
+LWGEOM *
+lwgeom_read_wkb_arena(lwgeom_arena *arena, const char *wkb, size_t len, int hex)
+{
+	assert(wkb);
+	if (!hex)
+		return wkb_read(arena, (const uint8_t *)wkb, len, LW_FALSE);
+
+	// An arena keeps the decoded bytes, which can then be aliased
+	uint8_t *bin = (uint8_t *)lwgeom__malloc(arena, len / 2 + 1, LWGEOM_MEM_PARSER);
+	if (!bin)
+		return NULL;
+	LWGEOM *obj = NULL;
+	if (wkb_hex_decode(wkb, len, bin))
+		obj = wkb_read(arena, bin, len / 2, arena != NULL);
+	lwgeom__release(arena, bin);
+	return obj;
+}
+
+/// @brief Read binary WKB like lwgeom_read_wkb_arena(), with coordinates in
+/// native byte order and 8 bytes aligned aliased in \a wkb instead of copied
+/// @param arena arena owning the result, NULL to allocate with lwmalloc
+/// @param wkb binary WKB, must outlive the result
+/// @param len bytes of \a wkb
+/// @return the geometry, NULL when the input is invalid
+LWGEOM *
+lwgeom_read_wkb_borrow(lwgeom_arena *arena, const char *wkb, size_t len)
+{
+	assert(wkb);
+	return wkb_read(arena, (const uint8_t *)wkb, len, LW_TRUE);
 }
@@ -20,335 +20,419 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
 
 #include "lwgeom_ordinate.h"
-#include "stok.h"
 #include <assert.h>
-#include <ctype.h>
 #include <string.h>
-#include <locale.h>
-
-/* ----------------------------- static read wkt ---------------------------- */
-
-static char *wkt_next_word(stok_t *token);
-static double wkt_get_next_number(stok_t *token);
-static void wkt_get_coordinates(stok_t *token, lwgeom_ordinate *flag, double **coordinates, int *num);
-static void wkt_get_precise_coordinates(stok_t *token, lwgeom_ordinate *flag, double *coordinates);
-static char *wkt_get_next_empty_or_opener(stok_t *token, lwgeom_ordinate *flag);
-static char *wkt_get_next_closer_comma(stok_t *token);
-static LWGEOM *wkt_read_point(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_linestring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_linearring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_polygon(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multipoint(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multilinestring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multipolygon(stok_t *token, lwgeom_ordinate *flag);
 
-/* -------------------------------- input wkt ------------------------------- */
-
-LWGEOM *
-lwgeom_read_wkt(const char *data, size_t len)
+/* -------------------------------- scanner --------------------------------- */
+
+/// Single pass WKT scanner. Words are compared in place, numbers are parsed
+/// straight from the input and the ordinates of the sequence being read are
+/// gathered in one buffer that only grows, reused for every sequence.
+typedef struct {
+	const char *pos;      ///< current character
+	const char *end;      ///< end of the input
+	lwgeom_ordinate flag; ///< dimensions, open until the first coordinate
+	double *coords;       ///< ordinates of the current sequence
+	size_t ncoords;       ///< ordinates in use
+	size_t capacity;      ///< ordinates allocated
+} wkt_scanner;
+
+static LWGEOM *wkt_read_point(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_linestring(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_linearring(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_polygon(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_multipoint(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_multilinestring(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_multipolygon(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_geometrycollection(lwgeom_arena *arena, wkt_scanner *s);
+static LWGEOM *wkt_read_tagged(lwgeom_arena *arena, wkt_scanner *s);
+
+#define WKT_HASZ(s) (((s)->flag.value & LWORDINATE_VALUE_Z) ? LW_TRUE : LW_FALSE)
+#define WKT_HASM(s) (((s)->flag.value & LWORDINATE_VALUE_M) ? LW_TRUE : LW_FALSE)
+
+/// Skip blanks and return the next character, '\0' at the end of the input
+static inline char
+wkt_peek(wkt_scanner *s)
 {
-	char *p = setlocale(LC_NUMERIC, NULL);
-	setlocale(LC_NUMERIC, "C");
+	while (s->pos < s->end && (*s->pos == ' ' || *s->pos == '\t' || *s->pos == '\n' || *s->pos == '\r'))
+		s->pos++;
+	return s->pos < s->end ? *s->pos : '\0';
+}
 
-	stok_t token;
-	stok_init(&token, (char *)data);
+/// Consume \a c when it is the next character
+static inline int
+wkt_accept(wkt_scanner *s, char c)
+{
+	if (wkt_peek(s) != c)
+		return LW_FALSE;
+	s->pos++;
+	return LW_TRUE;
+}
 
-	lwgeom_ordinate flags = lwgeom_ordinate_XY();
-	lwgeom_ordinate new_flags = lwgeom_ordinate_XY();
-	char *type = wkt_next_word(&token);
-	if (strcmp(type, "EMPTY") == 0)
-	{
-		memcpy(&new_flags, &flags, sizeof(lwgeom_ordinate));
-	}
-	else
-	{
-		if (strlen(type) >= 2 && 0 == strncmp(type + strlen(type) - 2, "ZM", 2))
-		{
-			lwgeom_ordinate_setZ(&new_flags, LW_TRUE);
-			lwgeom_ordinate_setM(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
-		else if (strlen(type) >= 1 && 0 == strncmp(type + strlen(type) - 1, "M", 1))
-		{
-			lwgeom_ordinate_setM(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
-		else if (strlen(type) >= 1 && 0 == strncmp(type + strlen(type) - 1, "Z", 1))
-		{
-			lwgeom_ordinate_setZ(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
-	}
+/// Consume the next word, its characters stay in the input
+static size_t
+wkt_word(wkt_scanner *s, const char **word)
+{
+	wkt_peek(s);
+	const char *p = s->pos;
+	while (p < s->end && (unsigned char)((*p | 0x20) - 'a') < 26)
+		p++;
+	*word = s->pos;
+	size_t n = (size_t)(p - s->pos);
+	s->pos = p;
+	return n;
+}
 
-	if (strncmp(type, "POINT", 5) == 0)
-	{
-		return wkt_read_point(&token, &new_flags);
-	}
-	else if (strncmp(type, "LINESTRING", 10) == 0)
-	{
-		return wkt_read_linestring(&token, &new_flags);
-	}
-	else if (strncmp(type, "LINEARRING ", 10) == 0)
-	{
-		return wkt_read_linearring(&token, &new_flags);
-	}
-	else if (strncmp(type, "POLYGON", 7) == 0)
-	{
-		return wkt_read_polygon(&token, &new_flags);
-	}
-	else if (strncmp(type, "MULTIPOINT", 10) == 0)
-	{
-		return wkt_read_multipoint(&token, &new_flags);
-	}
-	else if (strncmp(type, "MULTILINESTRING", 15) == 0)
-	{
-		return wkt_read_multilinestring(&token, &new_flags);
-	}
-	else if (strncmp(type, "MULTIPOLYGON", 12) == 0)
+/// Case insensitive comparison of a word with the upper case \a keyword
+static int
+wkt_word_is(const char *word, size_t n, const char *keyword)
+{
+	for (size_t i = 0; i < n; ++i)
 	{
-		return wkt_read_multipolygon(&token, &new_flags);
+		if (!keyword[i] || (word[i] & ~0x20) != keyword[i])
+			return LW_FALSE;
 	}
-	// else if (strncmp(type, "CIRCULARSTRING", 14) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "COMPOUNDCURVE", 13) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "CURVEPOLYGON", 12) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "MULTICURVE", 10) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "MULTISURFACE", 12) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "GEOMETRYCOLLECTION", 18) == 0) {
-	//     return NULL;
-	// }
-
-	setlocale(LC_NUMERIC, p);
-	return NULL;
+	return keyword[n] == '\0';
 }
 
-/* ----------------------------- static read wkt ---------------------------- */
-
-char *
-wkt_next_word(stok_t *token)
+/// Apply a Z, M or ZM dimension word
+static int
+wkt_set_dims(wkt_scanner *s, const char *word, size_t n)
 {
-	int type = stok_next_token(token);
-	switch (type)
+	if (wkt_word_is(word, n, "ZM"))
 	{
-	case STOK_EOF:
-	case STOK_EOL:
-	case STOK_NUM:
-		return "";
-	case STOK_WORD: {
-		char *word = token->stok;
-		char *str = word;
-		while (*str)
-		{
-			*str = (char)toupper((unsigned char)*str);
-			str++;
-		}
-		return word;
+		lwgeom_ordinate_setZ(&s->flag, LW_TRUE);
+		lwgeom_ordinate_setM(&s->flag, LW_TRUE);
 	}
-	case '(':
-		return "(";
-	case ')':
-		return ")";
-	case ',':
-		return ",";
-	};
-	return "";
+	else if (wkt_word_is(word, n, "Z"))
+		lwgeom_ordinate_setZ(&s->flag, LW_TRUE);
+	else if (wkt_word_is(word, n, "M"))
+		lwgeom_ordinate_setM(&s->flag, LW_TRUE);
+	else
+		return LW_FALSE;
+	s->flag.changeAllowed = LW_FALSE;
+	return LW_TRUE;
 }
 
-double
-wkt_get_next_number(stok_t *token)
+/// Consume '(' or EMPTY
+/// @return 1 for '(', 0 for EMPTY, -1 for anything else
+static int
+wkt_opener_or_empty(wkt_scanner *s)
 {
-	int type = stok_next_token(token);
-	switch (type)
-	{
-	case STOK_NUM:
-		return token->ntok;
-	default:
-		return 0.0;
-	}
-	return 0;
+	if (wkt_accept(s, '('))
+		return 1;
+	const char *word;
+	size_t n = wkt_word(s, &word);
+	return wkt_word_is(word, n, "EMPTY") ? 0 : -1;
 }
 
-void
-wkt_get_coordinates(stok_t *token, lwgeom_ordinate *flag, double **coordinates, int *num)
+static int
+wkt_read_number(wkt_scanner *s, double *v)
 {
-	char *nexttok = wkt_get_next_empty_or_opener(token, flag);
-	if (strcmp(nexttok, "EMPTY") == 0)
-	{
-		return;
-	}
-	double c[4] = {0.0};
-	wkt_get_precise_coordinates(token, flag, c);
+	wkt_peek(s);
+	const char *next = lwgeom__parse_double(s->pos, s->end, v);
+	if (!next)
+		return LW_FAILURE;
+	s->pos = next;
+	return LW_SUCCESS;
+}
 
-	// calloc coordinates with cdim
-	int cdim = (flag->value & LWORDINATE_VALUE_Z) ? 3 : 2;
-	*coordinates = (double *)lwcalloc(cdim, sizeof(double));
-	if (*coordinates == NULL)
+/// Read one coordinate at the end of the ordinate buffer. The first one of
+/// an input without dimension word decides between XY, XYZ and XYZM.
+static int
+wkt_read_coordinate(wkt_scanner *s)
+{
+	if (s->ncoords + 4 > s->capacity)
 	{
-		return;
+		size_t capacity = LWMAX(s->capacity * 2, 64);
+		double *grow = (double *)lwrealloc__cat(s->coords, capacity * sizeof(double), LWGEOM_MEM_PARSER);
+		if (!grow)
+			return LW_FAILURE;
+		s->coords = grow;
+		s->capacity = capacity;
 	}
-	*num = 1;
-	memcpy(*coordinates, c, cdim * sizeof(double));
-
-	nexttok = wkt_get_next_closer_comma(token);
-	while (strcmp(nexttok, ")") != 0)
+	double *c = s->coords + s->ncoords;
+	if (!wkt_read_number(s, &c[0]) || !wkt_read_number(s, &c[1]))
+		return LW_FAILURE;
+	int n = 2;
+	if (s->flag.changeAllowed)
 	{
-		memset(c, 0, sizeof(c));
-		wkt_get_precise_coordinates(token, flag, c);
-		*coordinates = (double *)lwrealloc(*coordinates, (*num + 1) * sizeof(double) * (cdim));
-		if (*coordinates == NULL)
+		// Undeclared Z then M
+		for (; n < 4; ++n)
 		{
-			lwfree(*coordinates);
-			*num = 0;
-			// log error
-			return;
+			char next = wkt_peek(s);
+			if (next == ',' || next == ')' || next == '\0' || !wkt_read_number(s, &c[n]))
+				break;
 		}
-		memcpy((*coordinates) + ((*num) * cdim), c, cdim * sizeof(double));
-		(*num)++;
-		nexttok = wkt_get_next_closer_comma(token);
-	}
-}
-
-char *
-wkt_get_next_empty_or_opener(stok_t *token, lwgeom_ordinate *flag)
-{
-	char *nextword = wkt_next_word(token);
-	if (strcmp(nextword, "ZM") == 0)
-	{
-		nextword = wkt_next_word(token);
+		lwgeom_ordinate_setZ(&s->flag, n > 2);
+		lwgeom_ordinate_setM(&s->flag, n > 3);
+		s->flag.changeAllowed = LW_FALSE;
 	}
 	else
 	{
-		if (strcmp(nextword, "Z") == 0)
+		int cdim = LW_POINTBYTESIZE(WKT_HASZ(s), WKT_HASM(s));
+		for (; n < cdim; ++n)
 		{
-			nextword = wkt_next_word(token);
-		}
-		if (strcmp(nextword, "M") == 0)
-		{
-			nextword = wkt_next_word(token);
+			if (!wkt_read_number(s, &c[n]))
+				return LW_FAILURE;
 		}
 	}
+	s->ncoords += (size_t)n;
+	return LW_SUCCESS;
+}
 
-	if (strcmp(nextword, "(") == 0 || strcmp(nextword, "EMPTY") == 0)
+/// Read '(' coordinate, ... ')' or EMPTY into the ordinate buffer
+/// @return the number of points, -1 on syntax error
+static int
+wkt_read_sequence(wkt_scanner *s)
+{
+	s->ncoords = 0;
+	int opener = wkt_opener_or_empty(s);
+	if (opener <= 0)
+		return opener;
+	int n = 0;
+	do
 	{
-		return nextword;
-	}
-	return "";
+		if (!wkt_read_coordinate(s))
+			return -1;
+		n++;
+	} while (wkt_accept(s, ','));
+	return wkt_accept(s, ')') ? n : -1;
+}
+
+/* -------------------------------- input wkt ------------------------------- */
+
+LWGEOM *
+lwgeom_read_wkt(const char *data, size_t len)
+{
+	return lwgeom_read_wkt_arena(NULL, data, len);
 }
 
-char *
-wkt_get_next_closer_comma(stok_t *token)
+static const struct {
+	const char *name;
+	LWGEOM *(*read)(lwgeom_arena *arena, wkt_scanner *s);
+} wkt_readers[] = {
+	{"POINT", wkt_read_point},
+	{"LINESTRING", wkt_read_linestring},
+	{"LINEARRING", wkt_read_linearring},
+	{"POLYGON", wkt_read_polygon},
+	{"MULTIPOINT", wkt_read_multipoint},
+	{"MULTILINESTRING", wkt_read_multilinestring},
+	{"MULTIPOLYGON", wkt_read_multipolygon},
+	{"GEOMETRYCOLLECTION", wkt_read_geometrycollection},
+};
+
+/// @brief Read a WKT string
+/// The text is scanned once, without copy, and numbers are read with a '.'
+/// decimal point whatever the locale.
+/// @param arena arena owning the result, NULL to allocate with lwmalloc
+/// @param data WKT string
+/// @param len length of \a data
+/// @return the geometry, NULL when the text can not be parsed
+LWGEOM *
+lwgeom_read_wkt_arena(lwgeom_arena *arena, const char *data, size_t len)
 {
-	char *nextWord = wkt_next_word(token);
-	if (strcmp(nextWord, ",") == 0 || strcmp(nextWord, ")") == 0)
+	assert(data);
+	wkt_scanner s;
+	memset(&s, 0, sizeof(s));
+	s.pos = data;
+	s.end = data + len;
+	s.flag = lwgeom_ordinate_XY();
+
+	LWGEOM *obj = wkt_read_tagged(arena, &s);
+	lwfree(s.coords);
+	// Only blanks may follow, up to the end or a '\0'
+	if (obj && wkt_peek(&s) != '\0')
 	{
-		return nextWord;
+		lwgeom_free(obj);
+		return NULL;
 	}
-	return NULL;
+	return obj;
 }
 
-static void
-wkt_get_precise_coordinates(stok_t *token, lwgeom_ordinate *flag, double *coordinates)
+/// Read a geometry with its type, its dimensions either as a suffix or as a
+/// word of their own
+static LWGEOM *
+wkt_read_tagged(lwgeom_arena *arena, wkt_scanner *s)
 {
-	coordinates[0] = wkt_get_next_number(token);
-	coordinates[1] = wkt_get_next_number(token);
-
-	// Check for undeclared Z dimension
-	if (flag->changeAllowed && (stok_peek_next_token(token) == STOK_NUM))
-		lwgeom_ordinate_setZ(flag, LW_TRUE);
-
-	if (flag->value & LWORDINATE_VALUE_Z)
-		coordinates[2] = wkt_get_next_number(token);
-
-	// Check for undeclared M dimension
-	if (flag->changeAllowed && (flag->value & LWORDINATE_VALUE_Z) && (stok_peek_next_token(token) == STOK_NUM))
-		lwgeom_ordinate_setM(flag, LW_TRUE);
+	const char *type;
+	size_t n = wkt_word(s, &type);
+	size_t r = 0;
+	size_t tlen = 0;
+	for (; r < sizeof(wkt_readers) / sizeof(wkt_readers[0]); ++r)
+	{
+		tlen = strlen(wkt_readers[r].name);
+		if (n >= tlen && wkt_word_is(type, tlen, wkt_readers[r].name) &&
+		    (n == tlen || wkt_set_dims(s, type + tlen, n - tlen)))
+			break;
+	}
+	if (r == sizeof(wkt_readers) / sizeof(wkt_readers[0]))
+		return NULL;
+	if (n == tlen)
+	{
+		const char *pos = s->pos;
+		const char *dims;
+		size_t ndims = wkt_word(s, &dims);
+		if (!wkt_set_dims(s, dims, ndims))
+			s->pos = pos;
+	}
+	return wkt_readers[r].read(arena, s);
+}
 
-	if (flag->value & LWORDINATE_VALUE_M)
-		coordinates[3] = wkt_get_next_number(token);
+/* ----------------------------- static read wkt ---------------------------- */
 
-	flag->changeAllowed = LW_FALSE;
+LWGEOM *
+wkt_read_point(lwgeom_arena *arena, wkt_scanner *s)
+{
+	int n = wkt_read_sequence(s);
+	if (n == 0)
+		return lwgeom__new(arena, POINTTYPE, WKT_HASZ(s), WKT_HASM(s));
+	if (n != 1)
+		return NULL;
+	return lwgeom_point_arena(arena, s->coords, WKT_HASZ(s), WKT_HASM(s));
 }
 
 LWGEOM *
-wkt_read_point(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_linestring(lwgeom_arena *arena, wkt_scanner *s)
 {
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n == 1)
-	{
-	}
-	return NULL;
+	int n = wkt_read_sequence(s);
+	if (n == 0)
+		return lwgeom__new(arena, LINETYPE, WKT_HASZ(s), WKT_HASM(s));
+	if (n < 2)
+		return NULL;
+	return lwgeom_line_arena(arena, (uint32_t)n, s->coords, WKT_HASZ(s), WKT_HASM(s));
 }
 
 LWGEOM *
-wkt_read_linestring(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_linearring(lwgeom_arena *arena, wkt_scanner *s)
 {
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n > 1)
-	{
-	}
-	return NULL;
+	int n = wkt_read_sequence(s);
+	if (n <= 3)
+		return NULL;
+	return lwgeom_line_arena(arena, (uint32_t)n, s->coords, WKT_HASZ(s), WKT_HASM(s));
 }
 
 LWGEOM *
-wkt_read_linearring(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_polygon(lwgeom_arena *arena, wkt_scanner *s)
 {
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n > 1)
+	int opener = wkt_opener_or_empty(s);
+	if (opener == 0)
+		return lwgeom__new(arena, POLYTYPE, WKT_HASZ(s), WKT_HASM(s));
+	if (opener != 1)
+		return NULL;
+
+	uint32_t nrings = 0;
+	uint32_t capacity = 0;
+	LWGEOM **rings = NULL;
+	LWGEOM *obj = NULL;
+	do
 	{
+		LWGEOM *ring = wkt_read_linearring(arena, s);
+		if (ring == NULL)
+			goto cleanup;
+		if (nrings == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 4;
+			LWGEOM **grow =
+			    (LWGEOM **)lwrealloc__cat(rings, capacity * sizeof(LWGEOM *), LWGEOM_MEM_PARSER);
+			if (grow == NULL)
+			{
+				lwgeom_free(ring);
+				goto cleanup;
+			}
+			rings = grow;
+		}
+		rings[nrings++] = ring;
+	} while (wkt_accept(s, ','));
+
+	if (wkt_accept(s, ')'))
+		obj = lwgeom__poly_from_rings(arena, nrings, rings);
+
+cleanup:
+	if (obj == NULL)
+	{
+		for (uint32_t i = 0; i < nrings; ++i)
+			lwgeom_free(rings[i]);
 	}
-	return NULL;
+	lwfree(rings);
+	return obj;
 }
 
-LWGEOM *
-wkt_read_polygon(stok_t *token, lwgeom_ordinate *flag)
+static LWGEOM *
+wkt_read_multipoint_item(lwgeom_arena *arena, wkt_scanner *s)
 {
-	char *nextToken = wkt_get_next_empty_or_opener(token, flag);
-	if (strncmp(nextToken, "EMPTY", 5) == 0)
+	// Both MULTIPOINT((1 2),(3 4)) and MULTIPOINT(1 2,3 4) are accepted,
+	// EMPTY children as well
+	char next = wkt_peek(s);
+	if (next == '(' || (next | 0x20) == 'e')
+		return wkt_read_point(arena, s);
+
+	s->ncoords = 0;
+	if (!wkt_read_coordinate(s))
 		return NULL;
+	return lwgeom_point_arena(arena, s->coords, WKT_HASZ(s), WKT_HASM(s));
+}
+
+/// Read the children of a multi geometry with \a read_item
+static LWGEOM *
+wkt_read_collection(lwgeom_arena *arena,
+		    wkt_scanner *s,
+		    uint8_t type,
+		    LWGEOM *(*read_item)(lwgeom_arena *arena, wkt_scanner *s))
+{
+	int opener = wkt_opener_or_empty(s);
+	if (opener < 0)
+		return NULL;
+	LWGEOM *mobj = NULL;
+	if (opener == 0)
+		return lwgeom_create_empty_collection_arena(arena, type, WKT_HASZ(s), WKT_HASM(s));
+
+	do
+	{
+		LWGEOM *sub = read_item(arena, s);
+		// The dimensions are known once the first child is read
+		if (sub && mobj == NULL)
+			mobj = lwgeom_create_empty_collection_arena(arena, type, WKT_HASZ(s), WKT_HASM(s));
+		if (sub == NULL || mobj == NULL || !lwgeom__add_child(mobj, sub))
+		{
+			lwgeom_free(sub);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	} while (wkt_accept(s, ','));
 
-	LWGEOM **subs = (LWGEOM **)lwcalloc(1, sizeof(LWGEOM *));
-	if (subs == NULL)
+	if (!wkt_accept(s, ')'))
+	{
+		lwgeom_free(mobj);
 		return NULL;
-	LWGEOM *shell = wkt_read_linearring(token, flag);
-	subs[0] = shell;
-	nextToken = wkt_get_next_closer_comma(token);
-	while (strcmp(nextToken, ",") == 0) {}
+	}
+	return mobj;
+}
 
-	return NULL;
+LWGEOM *
+wkt_read_multipoint(lwgeom_arena *arena, wkt_scanner *s)
+{
+	return wkt_read_collection(arena, s, MPOINTTYPE, wkt_read_multipoint_item);
 }
 
 LWGEOM *
-wkt_read_multipoint(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_multilinestring(lwgeom_arena *arena, wkt_scanner *s)
 {
-	return NULL;
+	return wkt_read_collection(arena, s, MLINETYPE, wkt_read_linestring);
 }
 
 LWGEOM *
-wkt_read_multilinestring(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_multipolygon(lwgeom_arena *arena, wkt_scanner *s)
 {
-	return NULL;
+	return wkt_read_collection(arena, s, MPOLYTYPE, wkt_read_polygon);
 }
 
 LWGEOM *
-wkt_read_multipolygon(stok_t *token, lwgeom_ordinate *flag)
+wkt_read_geometrycollection(lwgeom_arena *arena, wkt_scanner *s)
 {
-	return NULL;
-}
\ No newline at end of file
+	return wkt_read_collection(arena, s, COLLECTIONTYPE, wkt_read_tagged);
+}
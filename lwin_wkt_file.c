@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bytes of input per chunk, cut on the next line boundary */
+#define LWBULK_CHUNK_SIZE (4 << 20)
+
+/// Parsed records of one chunk, slots are reused round robin so that only
+/// a window of chunks lives at once
+typedef struct {
+	size_t chunk;         ///< chunk held, valid when done
+	int done;             ///< parsed and waiting to be emitted
+	lwgeom_arena *arena;  ///< owns the geometries
+	const LWGEOM **geoms; ///< one per record, NULL when it does not parse
+	uint32_t *lines;      ///< line of each record within the chunk
+	uint32_t nrecords;
+	uint32_t capacity;
+	uint32_t nlines;      ///< lines of the chunk, blank ones included
+} lwbulk_slot;
+
+typedef struct {
+	const char *data;
+	size_t size;
+	size_t nchunks;
+	const lwgeom_wkt_load_options *options;
+	lwgeom_ctx *ctx;
+
+	pthread_mutex_t lock;
+	pthread_cond_t parsed;   ///< a slot is done
+	pthread_cond_t released; ///< a slot was emitted
+	size_t next_chunk;       ///< next chunk to parse
+	size_t emitted;          ///< chunks already handed to the callback
+	int stop;
+	size_t nslots;
+	lwbulk_slot *slots;
+} lwbulk_load;
+
+/// Start of the line holding \a pos, the first line boundary at or after it
+static size_t
+lwbulk__line_start(const lwbulk_load *load, size_t pos)
+{
+	if (pos == 0)
+		return 0;
+	if (pos >= load->size)
+		return load->size;
+	const char *nl = memchr(load->data + pos - 1, '\n', load->size - pos + 1);
+	return nl ? (size_t)(nl - load->data) + 1 : load->size;
+}
+
+/// Bounds of field \a column of the record [p, end)
+/// @return LW_FAILURE when the record has fewer fields
+static int
+lwbulk__field(const char *p, const char *end, char delimiter, int column, const char **start, const char **stop)
+{
+	for (int c = 0;; ++c)
+	{
+		const char *fs = p;
+		const char *fe;
+		if (p < end && *p == '"')
+		{
+			// Quoted, "" stands for a quote
+			fs = ++p;
+			for (; p < end; ++p)
+			{
+				if (*p != '"')
+					continue;
+				if (p + 1 == end || p[1] != '"')
+					break;
+				++p;
+			}
+			fe = p;
+			p = memchr(p, delimiter, (size_t)(end - p));
+		}
+		else
+		{
+			p = memchr(p, delimiter, (size_t)(end - p));
+			fe = p ? p : end;
+		}
+		if (c == column)
+		{
+			*start = fs;
+			*stop = fe;
+			return LW_SUCCESS;
+		}
+		if (!p)
+			return LW_FAILURE;
+		++p;
+	}
+}
+
+static int
+lwbulk__push(lwbulk_slot *slot, const LWGEOM *obj, uint32_t line)
+{
+	if (slot->nrecords == slot->capacity)
+	{
+		uint32_t capacity = slot->capacity ? slot->capacity * 2 : 1024;
+		const LWGEOM **geoms =
+		    (const LWGEOM **)lwrealloc__cat(slot->geoms, capacity * sizeof(LWGEOM *), LWGEOM_MEM_PARSER);
+		if (!geoms)
+			return LW_FAILURE;
+		slot->geoms = geoms;
+		uint32_t *lines =
+		    (uint32_t *)lwrealloc__cat(slot->lines, capacity * sizeof(uint32_t), LWGEOM_MEM_PARSER);
+		if (!lines)
+			return LW_FAILURE;
+		slot->lines = lines;
+		slot->capacity = capacity;
+	}
+	slot->geoms[slot->nrecords] = obj;
+	slot->lines[slot->nrecords++] = line;
+	return LW_SUCCESS;
+}
+
+/// Parse chunk \a k into \a slot
+static int
+lwbulk__parse_chunk(const lwbulk_load *load, size_t k, lwbulk_slot *slot)
+{
+	const lwgeom_wkt_load_options *options = load->options;
+	size_t begin = lwbulk__line_start(load, k * LWBULK_CHUNK_SIZE);
+	size_t end = lwbulk__line_start(load, (k + 1) * LWBULK_CHUNK_SIZE);
+	lwgeom_arena_reset(slot->arena);
+	slot->nrecords = 0;
+	slot->nlines = 0;
+
+	const char *p = load->data + begin;
+	const char *stop = load->data + end;
+	for (; p < stop; ++slot->nlines)
+	{
+		const char *nl = memchr(p, '\n', (size_t)(stop - p));
+		const char *eol = nl ? nl : stop;
+		const char *line = p;
+		p = nl ? nl + 1 : stop;
+		if (k == 0 && slot->nlines == 0 && options->header)
+			continue;
+		// Blank lines hold no record
+		const char *q = line;
+		while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r'))
+			++q;
+		if (q == eol)
+			continue;
+
+		const char *fs = line;
+		const char *fe = eol;
+		const LWGEOM *obj = NULL;
+		if (!options->delimiter || lwbulk__field(line, eol, options->delimiter, options->column, &fs, &fe))
+			obj = lwgeom_read_wkt_arena(slot->arena, fs, (size_t)(fe - fs));
+		if (!lwbulk__push(slot, obj, slot->nlines))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+static void *
+lwbulk__worker(void *arg)
+{
+	lwbulk_load *load = (lwbulk_load *)arg;
+	// Allocate with the handlers of the caller
+	lwgeom_ctx_set(load->ctx);
+	pthread_mutex_lock(&load->lock);
+	for (;;)
+	{
+		while (!load->stop && load->next_chunk < load->nchunks &&
+		       load->next_chunk >= load->emitted + load->nslots)
+			pthread_cond_wait(&load->released, &load->lock);
+		if (load->stop || load->next_chunk == load->nchunks)
+			break;
+		size_t k = load->next_chunk++;
+		lwbulk_slot *slot = &load->slots[k % load->nslots];
+		pthread_mutex_unlock(&load->lock);
+
+		int ok = lwbulk__parse_chunk(load, k, slot);
+
+		pthread_mutex_lock(&load->lock);
+		if (!ok)
+			load->stop = LW_TRUE;
+		slot->chunk = k;
+		slot->done = LW_TRUE;
+		pthread_cond_broadcast(&load->parsed);
+	}
+	pthread_mutex_unlock(&load->lock);
+	return NULL;
+}
+
+/// Hand the chunks to the callback in order, on the calling thread
+static int
+lwbulk__emit(lwbulk_load *load, lwgeom_wkt_load_callback callback, void *data)
+{
+	size_t line = 0;
+	for (size_t k = 0; k < load->nchunks; ++k)
+	{
+		lwbulk_slot *slot = &load->slots[k % load->nslots];
+		pthread_mutex_lock(&load->lock);
+		while (!load->stop && !(slot->done && slot->chunk == k))
+			pthread_cond_wait(&load->parsed, &load->lock);
+		int stop = load->stop;
+		pthread_mutex_unlock(&load->lock);
+		if (stop)
+			return LW_FAILURE;
+
+		for (uint32_t i = 0; i < slot->nrecords; ++i)
+		{
+			if (!callback(slot->geoms[i], line + slot->lines[i], data))
+				return LW_FAILURE;
+		}
+		line += slot->nlines;
+
+		pthread_mutex_lock(&load->lock);
+		slot->done = LW_FALSE;
+		load->emitted++;
+		pthread_cond_broadcast(&load->released);
+		pthread_mutex_unlock(&load->lock);
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief Load a WKT file on several threads, see lwgeom_wkt_load_options
+/// @param path file to read
+/// @param options delimiter, column, header and threads, NULL for a WKT per
+/// line on every core
+/// @param callback receives the records in file order
+/// @param data passed to \a callback
+/// @return LW_SUCCESS, LW_FAILURE when the file can not be read, when out of
+/// memory or when \a callback stopped the load
+int
+lwgeom_load_wkt_file(const char *path,
+		     const lwgeom_wkt_load_options *options,
+		     lwgeom_wkt_load_callback callback,
+		     void *data)
+{
+	assert(path && callback);
+	lwgeom_wkt_load_options defaults = {'\0', 0, LW_FALSE, 0};
+	if (!options)
+		options = &defaults;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return LW_FAILURE;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return LW_FAILURE;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return LW_SUCCESS;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return LW_FAILURE;
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	lwbulk_load load;
+	memset(&load, 0, sizeof(load));
+	load.data = (const char *)map;
+	load.size = (size_t)st.st_size;
+	load.nchunks = (load.size + LWBULK_CHUNK_SIZE - 1) / LWBULK_CHUNK_SIZE;
+	load.options = options;
+	load.ctx = lwgeom_ctx_get();
+	long nthreads = options->nthreads > 0 ? options->nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = LWMAX(1, LWMIN(nthreads, (long)load.nchunks));
+	load.nslots = (size_t)nthreads * 2;
+	pthread_mutex_init(&load.lock, NULL);
+	pthread_cond_init(&load.parsed, NULL);
+	pthread_cond_init(&load.released, NULL);
+
+	int ok = LW_FAILURE;
+	long started = 0;
+	pthread_t *threads = (pthread_t *)lwmalloc(nthreads * sizeof(pthread_t));
+	load.slots = (lwbulk_slot *)lwmalloc0(load.nslots * sizeof(lwbulk_slot));
+	if (!threads || !load.slots)
+		goto cleanup;
+	for (size_t i = 0; i < load.nslots; ++i)
+	{
+		load.slots[i].arena = lwgeom_arena_new(0);
+		if (!load.slots[i].arena)
+			goto cleanup;
+	}
+	for (; started < nthreads; ++started)
+	{
+		if (pthread_create(&threads[started], NULL, lwbulk__worker, &load) != 0)
+			break;
+	}
+	if (started)
+		ok = lwbulk__emit(&load, callback, data);
+
+cleanup:
+	pthread_mutex_lock(&load.lock);
+	load.stop = LW_TRUE;
+	pthread_cond_broadcast(&load.released);
+	pthread_mutex_unlock(&load.lock);
+	for (long i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+	for (size_t i = 0; load.slots && i < load.nslots; ++i)
+	{
+		if (load.slots[i].arena)
+			lwgeom_arena_free(load.slots[i].arena);
+		lwfree(load.slots[i].geoms);
+		lwfree(load.slots[i].lines);
+	}
+	lwfree(load.slots);
+	lwfree(threads);
+	pthread_cond_destroy(&load.released);
+	pthread_cond_destroy(&load.parsed);
+	pthread_mutex_destroy(&load.lock);
+	munmap(map, load.size);
+	return ok;
+}
@@ -20,10 +20,25 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+
+/// @brief Write \a obj as little endian EWKB, dimensions in the high bits of
+/// the type as PostGIS does, into a new buffer. LWGEOM has no SRID to write.
+/// @param obj geometry
+/// @param ewkb receives the output to release with lwfree()
+/// @param len receives the length of \a ewkb
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
 int
-lwgeom_write_ewkb(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_ewkb(const LWGEOM *obj, char **ewkb, size_t *len)
 {
-	return 0;
+	assert(obj && ewkb && len);
+	*len = lwgeom_wkb_size(obj, LWGEOM_WKB_EXTENDED);
+	*ewkb = (char *)lwmalloc__cat(*len ? *len : 1, LWGEOM_MEM_OTHER);
+	if (!*ewkb)
+		return LW_FAILURE;
+	lwgeom_write_wkb_buf(obj, LWGEOM_WKB_EXTENDED, *ewkb, *len);
+	return LW_SUCCESS;
 }
@@ -0,0 +1,795 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "bytebuffer.h"
+#include "lwfgb.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Output is handed to the sink in chunks of this size */
+#define FGB_CHUNK_SIZE (64 * 1024)
+/* Hilbert grid of the index, 16 bits per axis */
+#define FGB_HILBERT_MAX 0xFFFF
+
+typedef struct {
+	char *name;
+	uint8_t type;
+} fgb_column;
+
+/// Feature buffered until the file is written in Hilbert order
+typedef struct {
+	double minx;
+	double miny;
+	double maxx;
+	double maxy;
+	size_t offset; ///< of its size prefix in lwgeom_fgb_writer.features
+	uint32_t hilbert;
+} fgb_item;
+
+struct lwgeom_fgb_writer {
+	bytebuffer_t features; ///< encoded features, in insertion order
+	bytebuffer_t props;    ///< properties of the feature being written
+	fgb_item *items;
+	size_t nitems;
+	size_t items_capacity;
+	fgb_column *columns;
+	uint16_t ncolumns;
+	uint16_t columns_capacity;
+	uint8_t type;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	uint16_t node_size;
+	int finished;
+};
+
+/* --------------------------- flatbuffer building -------------------------- */
+
+/// Flatbuffer written front to back into a growable buffer: vtables come
+/// before their table and offsets, written as 0, are patched once their
+/// target follows. Positions are relative to the size prefix at \a base.
+typedef struct {
+	bytebuffer_t *b;
+	size_t base;
+} fgb_builder;
+
+/// Field of a table being written, scalar or offset
+typedef struct {
+	uint8_t size;   ///< 1, 2, 4 or 8 bytes, 0 when absent
+	uint64_t value; ///< scalar value, offsets are patched later
+	size_t pos;     ///< position of the field once written
+} fgb_field;
+
+static inline void
+fgb_le(uint8_t *p, uint64_t v, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline size_t
+fgb_pos(const fgb_builder *fb)
+{
+	return bytebuffer_getlength(fb->b) - fb->base;
+}
+
+static inline void
+fgb_put_u32(fgb_builder *fb, uint32_t v)
+{
+	uint8_t p[4];
+	fgb_le(p, v, 4);
+	bytebuffer_append(fb->b, p, 4);
+}
+
+static inline void
+fgb_put_f64(uint8_t *p, double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	fgb_le(p, v, 8);
+}
+
+/// Zero padding so that the next \a extra bytes end \a align aligned
+static void
+fgb_pad(fgb_builder *fb, size_t align, size_t extra)
+{
+	static const uint8_t zeros[8] = {0};
+	size_t n = (align - (fgb_pos(fb) + extra) % align) % align;
+	bytebuffer_append(fb->b, zeros, n);
+}
+
+/// Point the offset at \a field to \a target
+static void
+fgb_patch(fgb_builder *fb, size_t field, size_t target)
+{
+	if (!fb->b->error)
+		fgb_le(fb->b->buf_start + fb->base + field, target - field, 4);
+}
+
+/// Write a table of \a n fields, indexed by id, and its vtable. Fields are
+/// laid out by decreasing size so that each is naturally aligned.
+static size_t
+fgb_table(fgb_builder *fb, fgb_field *fields, int n)
+{
+	uint16_t offsets[16] = {0};
+	uint16_t size = 4;
+	size_t align = 4;
+	int nslots = 0;
+	assert(n <= 16);
+	for (uint8_t s = 8; s; s >>= 1)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			if (fields[i].size != s)
+				continue;
+			size = (uint16_t)((size + s - 1) & ~(s - 1));
+			offsets[i] = size;
+			size += s;
+			align = LWMAX(align, s);
+			nslots = i + 1 > nslots ? i + 1 : nslots;
+		}
+	}
+
+	uint8_t vtable[4 + 2 * 16];
+	fgb_le(vtable, 4 + 2 * (uint64_t)nslots, 2);
+	fgb_le(vtable + 2, size, 2);
+	for (int i = 0; i < nslots; i++)
+		fgb_le(vtable + 4 + 2 * i, offsets[i], 2);
+	fgb_pad(fb, 2, 0);
+	size_t vpos = fgb_pos(fb);
+	bytebuffer_append(fb->b, vtable, 4 + 2 * (size_t)nslots);
+
+	fgb_pad(fb, align, 0);
+	size_t table = fgb_pos(fb);
+	uint8_t inline_[4 + 8 * 16] = {0};
+	fgb_le(inline_, table - vpos, 4);
+	for (int i = 0; i < n; i++)
+	{
+		if (!fields[i].size)
+			continue;
+		fgb_le(inline_ + offsets[i], fields[i].value, fields[i].size);
+		fields[i].pos = table + offsets[i];
+	}
+	bytebuffer_append(fb->b, inline_, size);
+	return table;
+}
+
+/// Write the vector of \a n \a elem bytes elements targeted by \a field
+static void
+fgb_vector(fgb_builder *fb, size_t field, const void *data, uint32_t n, size_t elem)
+{
+	fgb_pad(fb, LWMAX(elem, 4), 4);
+	fgb_patch(fb, field, fgb_pos(fb));
+	fgb_put_u32(fb, n);
+	bytebuffer_append(fb->b, data, (size_t)n * elem);
+}
+
+/// Write the NUL terminated string targeted by \a field
+static void
+fgb_string(fgb_builder *fb, size_t field, const char *s)
+{
+	size_t len = strlen(s);
+	fgb_vector(fb, field, s, (uint32_t)len, 1);
+	bytebuffer_append_byte(fb->b, 0);
+}
+
+/* -------------------------------- geometry -------------------------------- */
+
+/// Points and lines are their own single part, polygons have their rings,
+/// multi points and multi lines their children
+static void
+fgb_flat_parts(const LWGEOM *const *obj, const LWGEOM *const **parts, uint32_t *nparts)
+{
+	if ((*obj)->type == POINTTYPE || (*obj)->type == LINETYPE)
+	{
+		*parts = obj;
+		*nparts = 1;
+		return;
+	}
+	*parts = (const LWGEOM *const *)(*obj)->geoms;
+	*nparts = (*obj)->ngeoms;
+}
+
+/// Write the \a n ordinates from \a o of every point of \a parts, as the
+/// double vector targeted by \a field
+static void
+fgb_ordinates(fgb_builder *fb,
+	      size_t field,
+	      const LWGEOM *const *parts,
+	      uint32_t nparts,
+	      uint32_t npoints,
+	      int o,
+	      int n)
+{
+	fgb_pad(fb, 8, 4);
+	fgb_patch(fb, field, fgb_pos(fb));
+	fgb_put_u32(fb, npoints * (uint32_t)n);
+	if (!bytebuffer_reserve(fb->b, (size_t)npoints * n * sizeof(double)))
+		return;
+	uint8_t *w = fb->b->writecursor;
+	for (uint32_t i = 0; i < nparts; i++)
+	{
+		const LWGEOM *p = parts[i];
+		int cdim = lwgeom_dim_coordinate(p);
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (cdim == n && !LWFLAGS_GET_QUANT(p->flags) && !LWFLAGS_GET_SOA(p->flags))
+		{
+			memcpy(w, p->pp, (size_t)p->npoints * n * sizeof(double));
+			w += (size_t)p->npoints * n * sizeof(double);
+			continue;
+		}
+#endif
+		int from = o < 0 ? cdim - 1 : o;
+		for (uint32_t j = 0; j < p->npoints; j++)
+		{
+			for (int k = 0; k < n; k++, w += 8)
+			{
+				if (LWFLAGS_GET_QUANT(p->flags))
+					fgb_put_f64(w, lwgeom__quant_get(p, j, from + k));
+				else
+					fgb_put_f64(w, p->pp[LWGEOM_PP_INDEX(p, cdim, j, from + k)]);
+			}
+		}
+	}
+	fb->b->writecursor = w;
+}
+
+/// Write the Geometry table of \a obj, returns its position
+static size_t
+fgb_geometry(fgb_builder *fb, const LWGEOM *obj)
+{
+	fgb_field fields[LWFGB_GEOMETRY_PARTS + 1] = {{0}};
+	const LWGEOM *const *parts = NULL;
+	uint32_t nparts = 0;
+	uint32_t npoints = 0;
+	int flat = obj->type != MPOLYTYPE && obj->type != COLLECTIONTYPE;
+	if (flat)
+	{
+		fgb_flat_parts(&obj, &parts, &nparts);
+		for (uint32_t i = 0; i < nparts; i++)
+			npoints += parts[i]->npoints;
+	}
+	int ends = (obj->type == POLYTYPE || obj->type == MLINETYPE) && nparts > 1;
+	if (ends)
+		fields[LWFGB_GEOMETRY_ENDS].size = 4;
+	if (npoints)
+	{
+		fields[LWFGB_GEOMETRY_XY].size = 4;
+		fields[LWFGB_GEOMETRY_Z].size = LWFLAGS_GET_Z(obj->flags) ? 4 : 0;
+		fields[LWFGB_GEOMETRY_M].size = LWFLAGS_GET_M(obj->flags) ? 4 : 0;
+	}
+	fields[LWFGB_GEOMETRY_TYPE].size = 1;
+	fields[LWFGB_GEOMETRY_TYPE].value = obj->type;
+	if (!flat && obj->ngeoms)
+		fields[LWFGB_GEOMETRY_PARTS].size = 4;
+	size_t table = fgb_table(fb, fields, LWFGB_GEOMETRY_PARTS + 1);
+
+	if (ends)
+	{
+		fgb_pad(fb, 4, 4);
+		fgb_patch(fb, fields[LWFGB_GEOMETRY_ENDS].pos, fgb_pos(fb));
+		fgb_put_u32(fb, nparts);
+		uint32_t end = 0;
+		for (uint32_t i = 0; i < nparts; i++)
+		{
+			end += parts[i]->npoints;
+			fgb_put_u32(fb, end);
+		}
+	}
+	if (npoints)
+	{
+		fgb_ordinates(fb, fields[LWFGB_GEOMETRY_XY].pos, parts, nparts, npoints, 0, 2);
+		if (LWFLAGS_GET_Z(obj->flags))
+			fgb_ordinates(fb, fields[LWFGB_GEOMETRY_Z].pos, parts, nparts, npoints, 2, 1);
+		if (LWFLAGS_GET_M(obj->flags))
+			fgb_ordinates(fb, fields[LWFGB_GEOMETRY_M].pos, parts, nparts, npoints, -1, 1);
+	}
+	if (fields[LWFGB_GEOMETRY_PARTS].size)
+	{
+		fgb_pad(fb, 4, 4);
+		size_t vec = fgb_pos(fb);
+		fgb_patch(fb, fields[LWFGB_GEOMETRY_PARTS].pos, vec);
+		fgb_put_u32(fb, obj->ngeoms);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			fgb_put_u32(fb, 0);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			size_t part = fgb_geometry(fb, obj->geoms[i]);
+			fgb_patch(fb, vec + 4 + 4 * (size_t)i, part);
+		}
+	}
+	return table;
+}
+
+/* ------------------------------- properties ------------------------------- */
+
+/// Integer text of [s, s + len), as its sign and magnitude
+static int
+fgb_parse_integer(const char *s, size_t len, int *negative, uint64_t *value)
+{
+	size_t i = 0;
+	*negative = LW_FALSE;
+	*value = 0;
+	if (i < len && (s[i] == '-' || s[i] == '+'))
+		*negative = s[i++] == '-';
+	if (i == len)
+		return LW_FAILURE;
+	for (; i < len; i++)
+	{
+		if (s[i] < '0' || s[i] > '9' || *value > (UINT64_MAX - (uint64_t)(s[i] - '0')) / 10)
+			return LW_FAILURE;
+		*value = *value * 10 + (uint64_t)(s[i] - '0');
+	}
+	return LW_SUCCESS;
+}
+
+/// Append column \a index and the value of text [s, s + len) as \a type
+static int
+fgb_property(bytebuffer_t *b, uint16_t index, uint8_t type, const char *s, size_t len)
+{
+	uint8_t p[8];
+	fgb_le(p, index, 2);
+	bytebuffer_append(b, p, 2);
+
+	int negative;
+	uint64_t value;
+	double d;
+	switch (type)
+	{
+	case LWGEOM_FGB_BOOL:
+		if ((len == 4 && !memcmp(s, "true", 4)) || (len == 1 && s[0] == '1'))
+			bytebuffer_append_byte(b, 1);
+		else if ((len == 5 && !memcmp(s, "false", 5)) || (len == 1 && s[0] == '0'))
+			bytebuffer_append_byte(b, 0);
+		else
+			return LW_FAILURE;
+		return LW_SUCCESS;
+	case LWGEOM_FGB_FLOAT:
+	case LWGEOM_FGB_DOUBLE:
+		if (lwgeom__parse_double(s, s + len, &d) != s + len)
+			return LW_FAILURE;
+		if (type == LWGEOM_FGB_FLOAT)
+		{
+			float f = (float)d;
+			uint32_t v;
+			memcpy(&v, &f, sizeof(v));
+			fgb_le(p, v, 4);
+			bytebuffer_append(b, p, 4);
+		}
+		else
+		{
+			fgb_put_f64(p, d);
+			bytebuffer_append(b, p, 8);
+		}
+		return LW_SUCCESS;
+	case LWGEOM_FGB_STRING:
+	case LWGEOM_FGB_JSON:
+	case LWGEOM_FGB_DATETIME:
+	case LWGEOM_FGB_BINARY:
+		if (len > UINT32_MAX)
+			return LW_FAILURE;
+		fgb_le(p, len, 4);
+		bytebuffer_append(b, p, 4);
+		bytebuffer_append(b, s, len);
+		return LW_SUCCESS;
+	}
+
+	/* Integers, [min, max] of each type as a sign and magnitude */
+	static const struct {
+		uint8_t size;
+		uint64_t min; ///< magnitude of the most negative value
+		uint64_t max;
+	} ranges[] = {{1, 128, INT8_MAX},
+		      {1, 0, UINT8_MAX},
+		      {1, 0, 1},
+		      {2, 32768, INT16_MAX},
+		      {2, 0, UINT16_MAX},
+		      {4, 2147483648u, INT32_MAX},
+		      {4, 0, UINT32_MAX},
+		      {8, (uint64_t)INT64_MAX + 1, INT64_MAX},
+		      {8, 0, UINT64_MAX}};
+	if (type > LWGEOM_FGB_ULONG || !fgb_parse_integer(s, len, &negative, &value) ||
+	    (negative ? value > ranges[type].min : value > ranges[type].max))
+		return LW_FAILURE;
+	fgb_le(p, negative ? (uint64_t)0 - value : value, ranges[type].size);
+	bytebuffer_append(b, p, ranges[type].size);
+	return LW_SUCCESS;
+}
+
+/* ---------------------------------- writer -------------------------------- */
+
+/// @brief Start a FlatGeobuf file. Features are buffered encoded and written
+/// by lwgeom_fgb_writer_finish(), in Hilbert order of their box center when
+/// the file is indexed.
+/// @param type geometry type of every feature, 0 when they are mixed
+/// @param hasz Z of every feature
+/// @param hasm M of every feature
+/// @param node_size children of each node of the packed R-tree, 0 for no index
+/// @return the writer to release with lwgeom_fgb_writer_free()
+lwgeom_fgb_writer *
+lwgeom_fgb_writer_new(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm, uint16_t node_size)
+{
+	if (type > COLLECTIONTYPE || node_size == 1)
+		return NULL;
+	lwgeom_fgb_writer *w = (lwgeom_fgb_writer *)lwmalloc__cat(sizeof(lwgeom_fgb_writer), LWGEOM_MEM_OTHER);
+	if (!w)
+		return NULL;
+	memset(w, 0, sizeof(lwgeom_fgb_writer));
+	bytebuffer_init_with_size(&w->features, FGB_CHUNK_SIZE);
+	bytebuffer_init(&w->props);
+	if (w->features.error)
+	{
+		lwgeom_fgb_writer_free(w);
+		return NULL;
+	}
+	w->type = type;
+	w->hasz = hasz ? LW_TRUE : LW_FALSE;
+	w->hasm = hasm ? LW_TRUE : LW_FALSE;
+	w->node_size = node_size;
+	return w;
+}
+
+/// @brief Declare the next property column, before the first feature
+/// @param writer writer
+/// @param name column name
+/// @param type column type
+/// @return LW_SUCCESS or LW_FAILURE
+int
+lwgeom_fgb_writer_column(lwgeom_fgb_writer *writer, const char *name, lwgeom_fgb_column_type type)
+{
+	assert(writer && name);
+	if (writer->nitems || writer->finished || (unsigned)type > LWGEOM_FGB_BINARY || writer->ncolumns == UINT16_MAX)
+		return LW_FAILURE;
+	if (writer->ncolumns == writer->columns_capacity)
+	{
+		uint16_t capacity = 8;
+		if (writer->columns_capacity)
+			capacity = (uint16_t)LWMIN(writer->columns_capacity * 2, UINT16_MAX);
+		fgb_column *columns =
+		    (fgb_column *)lwrealloc__cat(writer->columns, capacity * sizeof(fgb_column), LWGEOM_MEM_OTHER);
+		if (!columns)
+			return LW_FAILURE;
+		writer->columns = columns;
+		writer->columns_capacity = capacity;
+	}
+	size_t len = strlen(name);
+	char *copy = (char *)lwmalloc__cat(len + 1, LWGEOM_MEM_OTHER);
+	if (!copy)
+		return LW_FAILURE;
+	memcpy(copy, name, len + 1);
+	writer->columns[writer->ncolumns].name = copy;
+	writer->columns[writer->ncolumns].type = (uint8_t)type;
+	writer->ncolumns++;
+	return LW_SUCCESS;
+}
+
+/// @brief Encode a feature
+/// @param writer writer
+/// @param obj geometry of the writer type and dimensions, NULL for a null geometry,
+/// empty geometries are stored as null ones
+/// @param values text of each column value, converted to the column type,
+/// NULL or a NULL entry for a null value
+/// @param lens length of each value, NULL when they are NUL terminated
+/// @return LW_SUCCESS or LW_FAILURE for a mismatched geometry, a value
+/// that does not convert, or out of memory
+int
+lwgeom_fgb_writer_feature(lwgeom_fgb_writer *writer,
+			  const LWGEOM *obj,
+			  const char *const *values,
+			  const size_t *lens)
+{
+	assert(writer && !writer->finished);
+	if (obj && ((writer->type && obj->type != writer->type) || !LWFLAGS_GET_Z(obj->flags) != !writer->hasz ||
+		    !LWFLAGS_GET_M(obj->flags) != !writer->hasm))
+		return LW_FAILURE;
+
+	bytebuffer_t *props = &writer->props;
+	props->writecursor = props->buf_start;
+	for (uint16_t i = 0; values && i < writer->ncolumns; i++)
+	{
+		if (!values[i])
+			continue;
+		size_t len = lens ? lens[i] : strlen(values[i]);
+		if (!fgb_property(props, i, writer->columns[i].type, values[i], len))
+			return LW_FAILURE;
+	}
+	if (props->error)
+		return LW_FAILURE;
+
+	if (writer->nitems == writer->items_capacity)
+	{
+		size_t capacity = writer->items_capacity ? writer->items_capacity * 2 : 1024;
+		fgb_item *items =
+		    (fgb_item *)lwrealloc__cat(writer->items, capacity * sizeof(fgb_item), LWGEOM_MEM_INDEX);
+		if (!items)
+			return LW_FAILURE;
+		writer->items = items;
+		writer->items_capacity = capacity;
+	}
+
+	/* Feature table, geometry and properties. Readers expect coordinates in
+	 * every Geometry table, empty geometries are written as null ones. */
+	if (obj && lwgeom_points_count(obj) == 0)
+		obj = NULL;
+	fgb_builder fb = {&writer->features, bytebuffer_getlength(&writer->features)};
+	fgb_field fields[LWFGB_FEATURE_PROPERTIES + 1] = {{0}};
+	size_t nprops = bytebuffer_getlength(props);
+	fields[LWFGB_FEATURE_GEOMETRY].size = obj ? 4 : 0;
+	fields[LWFGB_FEATURE_PROPERTIES].size = nprops ? 4 : 0;
+	fgb_put_u32(&fb, 0);
+	fgb_put_u32(&fb, 0);
+	size_t table = fgb_table(&fb, fields, LWFGB_FEATURE_PROPERTIES + 1);
+	fgb_patch(&fb, 4, table);
+	if (obj)
+		fgb_patch(&fb, fields[LWFGB_FEATURE_GEOMETRY].pos, fgb_geometry(&fb, obj));
+	if (nprops)
+		fgb_vector(&fb, fields[LWFGB_FEATURE_PROPERTIES].pos, props->buf_start, (uint32_t)nprops, 1);
+	fgb_pad(&fb, 8, 0);
+	if (writer->features.error || fgb_pos(&fb) - 4 > UINT32_MAX)
+		return LW_FAILURE;
+	fgb_le(writer->features.buf_start + fb.base, fgb_pos(&fb) - 4, 4);
+
+	fgb_item *item = &writer->items[writer->nitems++];
+	item->offset = fb.base;
+	item->hilbert = 0;
+	if (obj)
+	{
+		const LWBOX *box = lwgeom_get_bbox(obj);
+		item->minx = box->xmin;
+		item->miny = box->ymin;
+		item->maxx = box->xmax;
+		item->maxy = box->ymax;
+	}
+	else
+	{
+		item->minx = item->miny = DBL_MAX;
+		item->maxx = item->maxy = -DBL_MAX;
+	}
+	return LW_SUCCESS;
+}
+
+/// Descending Hilbert values, ties in insertion order
+static int
+fgb_item_cmp(const void *a, const void *b)
+{
+	const fgb_item *ia = (const fgb_item *)a;
+	const fgb_item *ib = (const fgb_item *)b;
+	if (ia->hilbert != ib->hilbert)
+		return ia->hilbert < ib->hilbert ? 1 : -1;
+	return ia->offset < ib->offset ? -1 : ia->offset > ib->offset;
+}
+
+/// Sort the items along the Hilbert curve through the extent
+static void
+fgb_hilbert_sort(lwgeom_fgb_writer *w, LWBOX *extent)
+{
+	for (size_t i = 0; i < w->nitems; i++)
+	{
+		const fgb_item *item = &w->items[i];
+		if (item->minx > item->maxx)
+			continue;
+		extent->xmin = LWMIN(extent->xmin, item->minx);
+		extent->ymin = LWMIN(extent->ymin, item->miny);
+		extent->xmax = LWMAX(extent->xmax, item->maxx);
+		extent->ymax = LWMAX(extent->ymax, item->maxy);
+	}
+	if (!w->node_size || extent->xmin > extent->xmax)
+		return;
+	double width = extent->xmax - extent->xmin;
+	double height = extent->ymax - extent->ymin;
+	for (size_t i = 0; i < w->nitems; i++)
+	{
+		fgb_item *item = &w->items[i];
+		if (item->minx > item->maxx)
+			continue;
+		uint32_t x = 0;
+		uint32_t y = 0;
+		if (width > 0)
+			x = (uint32_t)(FGB_HILBERT_MAX * ((item->minx + item->maxx) / 2 - extent->xmin) / width);
+		if (height > 0)
+			y = (uint32_t)(FGB_HILBERT_MAX * ((item->miny + item->maxy) / 2 - extent->ymin) / height);
+		item->hilbert = lwfgb_hilbert(x, y);
+	}
+	qsort(w->items, w->nitems, sizeof(fgb_item), fgb_item_cmp);
+}
+
+/// Header table, size prefixed and padded so that the index and the
+/// features that follow the magic bytes stay 8 bytes aligned
+static void
+fgb_header(const lwgeom_fgb_writer *w, const LWBOX *extent, bytebuffer_t *b)
+{
+	fgb_builder fb = {b, 0};
+	fgb_field fields[LWFGB_HEADER_INDEX_NODE_SIZE + 1] = {{0}};
+	int envelope = extent->xmin <= extent->xmax;
+	fields[LWFGB_HEADER_ENVELOPE].size = envelope ? 4 : 0;
+	fields[LWFGB_HEADER_GEOMETRY_TYPE].size = 1;
+	fields[LWFGB_HEADER_GEOMETRY_TYPE].value = w->type;
+	fields[LWFGB_HEADER_HAS_Z].size = w->hasz ? 1 : 0;
+	fields[LWFGB_HEADER_HAS_Z].value = 1;
+	fields[LWFGB_HEADER_HAS_M].size = w->hasm ? 1 : 0;
+	fields[LWFGB_HEADER_HAS_M].value = 1;
+	fields[LWFGB_HEADER_COLUMNS].size = w->ncolumns ? 4 : 0;
+	fields[LWFGB_HEADER_FEATURES_COUNT].size = 8;
+	fields[LWFGB_HEADER_FEATURES_COUNT].value = w->nitems;
+	fields[LWFGB_HEADER_INDEX_NODE_SIZE].size = 2;
+	fields[LWFGB_HEADER_INDEX_NODE_SIZE].value = w->nitems ? w->node_size : 0;
+
+	fgb_put_u32(&fb, 0);
+	fgb_put_u32(&fb, 0);
+	size_t table = fgb_table(&fb, fields, LWFGB_HEADER_INDEX_NODE_SIZE + 1);
+	fgb_patch(&fb, 4, table);
+	if (envelope)
+	{
+		uint8_t box[32];
+		fgb_put_f64(box, extent->xmin);
+		fgb_put_f64(box + 8, extent->ymin);
+		fgb_put_f64(box + 16, extent->xmax);
+		fgb_put_f64(box + 24, extent->ymax);
+		fgb_vector(&fb, fields[LWFGB_HEADER_ENVELOPE].pos, box, 4, 8);
+	}
+	if (w->ncolumns)
+	{
+		fgb_pad(&fb, 4, 4);
+		size_t vec = fgb_pos(&fb);
+		fgb_patch(&fb, fields[LWFGB_HEADER_COLUMNS].pos, vec);
+		fgb_put_u32(&fb, w->ncolumns);
+		for (uint16_t i = 0; i < w->ncolumns; i++)
+			fgb_put_u32(&fb, 0);
+		for (uint16_t i = 0; i < w->ncolumns; i++)
+		{
+			fgb_field column[LWFGB_COLUMN_TYPE + 1] = {{4, 0, 0}, {1, w->columns[i].type, 0}};
+			fgb_patch(&fb, vec + 4 + 4 * (size_t)i, fgb_table(&fb, column, LWFGB_COLUMN_TYPE + 1));
+			fgb_string(&fb, column[LWFGB_COLUMN_NAME].pos, w->columns[i].name);
+		}
+	}
+	/* The magic bytes before the header are 8 bytes long */
+	fgb_pad(&fb, 8, 0);
+	if (!b->error)
+		fgb_le(b->buf_start, fgb_pos(&fb) - 4, 4);
+}
+
+/// Append the packed R-tree over the sorted items, whose features follow
+/// back to back. Parents are the union of up to node_size consecutive nodes.
+static int
+fgb_index(const lwgeom_fgb_writer *w, bytebuffer_t *out)
+{
+	lwfgb_levels levels;
+	if (!lwfgb_levels_init(&levels, w->nitems, w->node_size))
+		return LW_FAILURE;
+	if (levels.nnodes > SIZE_MAX / sizeof(lwfgb_node))
+		return LW_FAILURE;
+	lwfgb_node *nodes = (lwfgb_node *)lwmalloc__cat(levels.nnodes * sizeof(lwfgb_node), LWGEOM_MEM_INDEX);
+	if (!nodes)
+		return LW_FAILURE;
+
+	uint64_t offset = 0;
+	for (size_t i = 0; i < w->nitems; i++)
+	{
+		const fgb_item *item = &w->items[i];
+		lwfgb_node *node = &nodes[levels.start[0] + i];
+		node->minx = item->minx;
+		node->miny = item->miny;
+		node->maxx = item->maxx;
+		node->maxy = item->maxy;
+		node->offset = offset;
+		offset += 4 + (uint64_t)lwfgb_u32(w->features.buf_start + item->offset);
+	}
+	for (int l = 1; l < levels.nlevels; l++)
+	{
+		uint64_t child = levels.start[l - 1];
+		for (uint64_t p = levels.start[l]; p < levels.end[l]; p++)
+		{
+			uint64_t end = LWMIN(child + w->node_size, levels.end[l - 1]);
+			lwfgb_node *node = &nodes[p];
+			node->minx = node->miny = DBL_MAX;
+			node->maxx = node->maxy = -DBL_MAX;
+			node->offset = child;
+			for (; child < end; child++)
+			{
+				node->minx = LWMIN(node->minx, nodes[child].minx);
+				node->miny = LWMIN(node->miny, nodes[child].miny);
+				node->maxx = LWMAX(node->maxx, nodes[child].maxx);
+				node->maxy = LWMAX(node->maxy, nodes[child].maxy);
+			}
+		}
+	}
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	bytebuffer_append(out, nodes, levels.nnodes * sizeof(lwfgb_node));
+#else
+	lwgeom__bswap64_copy(nodes, nodes, levels.nnodes * sizeof(lwfgb_node) / 8);
+	bytebuffer_append(out, nodes, levels.nnodes * sizeof(lwfgb_node));
+#endif
+	lwfree(nodes);
+	return LW_SUCCESS;
+}
+
+/// @brief Write the file to \a sink: magic bytes, header, index and the
+/// features, no feature can follow
+/// @return LW_SUCCESS or LW_FAILURE when the sink failed
+int
+lwgeom_fgb_writer_finish(lwgeom_fgb_writer *writer, lwgeom_sink sink, void *arg)
+{
+	assert(writer && !writer->finished && sink);
+	writer->finished = LW_TRUE;
+	LWBOX extent = {.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX};
+	fgb_hilbert_sort(writer, &extent);
+
+	bytebuffer_t out;
+	bytebuffer_init_sink_with_size(&out, FGB_CHUNK_SIZE, sink, arg);
+	bytebuffer_append(&out, lwfgb_magic, LWFGB_MAGIC_SIZE);
+	bytebuffer_t header;
+	bytebuffer_init(&header);
+	fgb_header(writer, &extent, &header);
+	int ok = !header.error;
+	bytebuffer_append(&out, header.buf_start, bytebuffer_getlength(&header));
+	bytebuffer_destroy_buffer(&header);
+
+	if (ok && writer->node_size && writer->nitems)
+		ok = fgb_index(writer, &out);
+	for (size_t i = 0; ok && i < writer->nitems; i++)
+	{
+		const uint8_t *feature = writer->features.buf_start + writer->items[i].offset;
+		bytebuffer_append(&out, feature, 4 + (size_t)lwfgb_u32(feature));
+	}
+	ok = ok && bytebuffer_flush(&out);
+	bytebuffer_destroy_buffer(&out);
+	return ok ? LW_SUCCESS : LW_FAILURE;
+}
+
+static int
+fgb_write_file(const char *data, size_t len, void *arg)
+{
+	return fwrite(data, 1, len, (FILE *)arg) == len ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief lwgeom_fgb_writer_finish() to the file at \a path
+int
+lwgeom_fgb_writer_save(lwgeom_fgb_writer *writer, const char *path)
+{
+	assert(writer && path);
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return LW_FAILURE;
+	int ok = lwgeom_fgb_writer_finish(writer, fgb_write_file, file);
+	if (fclose(file) != 0)
+		ok = LW_FAILURE;
+	return ok;
+}
+
+void
+lwgeom_fgb_writer_free(lwgeom_fgb_writer *writer)
+{
+	if (!writer)
+		return;
+	for (uint16_t i = 0; i < writer->ncolumns; i++)
+		lwfree(writer->columns[i].name);
+	lwfree(writer->columns);
+	lwfree(writer->items);
+	bytebuffer_destroy_buffer(&writer->features);
+	bytebuffer_destroy_buffer(&writer->props);
+	lwfree(writer);
+}
@@ -20,10 +20,317 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
+#include "bytebuffer.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/* Default size of the chunks handed to the sink of a writer */
+#define GEOJSON_CHUNK_SIZE (64 * 1024)
+
+struct lwgeom_geojson_writer {
+	bytebuffer_t b; ///< chunk reused for every feature
+	int precision;
+	int flags;
+	uint32_t nfeatures;
+	int finished;
+};
+
+/* -------------------------------- inner json ------------------------------ */
+
+static const char *geojson_type_names[] = {"",
+					   "Point",
+					   "LineString",
+					   "Polygon",
+					   "MultiPoint",
+					   "MultiLineString",
+					   "MultiPolygon",
+					   "GeometryCollection"};
+
+/// "[x,y]" or "[x,y,z]", GeoJSON has no M. JSON has no NaN nor infinity,
+/// such an ordinate fails the whole write.
+static void
+geojson_write_position(bytebuffer_t *b, const double *pp, int dims, int precision)
+{
+	bytebuffer_append_byte(b, '[');
+	for (int o = 0; o < dims; ++o)
+	{
+		if (o)
+			bytebuffer_append_byte(b, ',');
+		lwprint_double_append(b, pp[o], precision, LW_TRUE);
+	}
+	bytebuffer_append_byte(b, ']');
+}
+
+/// Position of a point, array of positions of a line or a ring
+static void
+geojson_write_points(bytebuffer_t *b, const LWGEOM *obj, int precision, int array)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	int dims = LWFLAGS_GET_Z(obj->flags) ? 3 : 2;
+	int direct = !LWFLAGS_GET_SOA(obj->flags) && !LWFLAGS_GET_QUANT(obj->flags);
+	if (array)
+		bytebuffer_append_byte(b, '[');
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		const double *pp = point;
+		if (direct)
+			pp = obj->pp + (size_t)i * cdim;
+		else
+			lwgeom_point_at(obj, (int)i, point);
+		if (i)
+			bytebuffer_append_byte(b, ',');
+		geojson_write_position(b, pp, dims, precision);
+	}
+	if (array)
+		bytebuffer_append_byte(b, ']');
+}
+
+/// "coordinates" value of any geometry but a collection
+static void
+geojson_write_coordinates(bytebuffer_t *b, const LWGEOM *obj, int precision)
+{
+	if (obj->type == POINTTYPE || obj->type == LINETYPE)
+	{
+		if (obj->npoints == 0)
+			bytebuffer_append(b, "[]", 2);
+		else
+			geojson_write_points(b, obj, precision, obj->type == LINETYPE);
+		return;
+	}
+	bytebuffer_append_byte(b, '[');
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (i)
+			bytebuffer_append_byte(b, ',');
+		geojson_write_coordinates(b, obj->geoms[i], precision);
+	}
+	bytebuffer_append_byte(b, ']');
+}
+
+/// Expand [zmin, zmax] of \a box with the Z of every point of \a obj
+static void
+geojson_z_range(const LWGEOM *obj, LWBOX *box)
+{
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		geojson_z_range(obj->geoms[i], box);
+	if (!LWFLAGS_GET_Z(obj->flags))
+		return;
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		lwgeom_point_at(obj, (int)i, point);
+		box->zmin = LWMIN(box->zmin, point[2]);
+		box->zmax = LWMAX(box->zmax, point[2]);
+	}
+}
+
+/// \a d rounded down, or up when \a up, to \a precision decimals
+static double
+geojson_bound(double d, int precision, int up)
+{
+	if (precision < 0 || !isfinite(d))
+		return d;
+	double scale = pow(10.0, precision);
+	double n = up ? ceil(d * scale) : floor(d * scale);
+	double r = n / scale;
+	// The scaling rounds too, one more step when it went past d
+	if (up ? r < d : r > d)
+		r = (up ? n + 1 : n - 1) / scale;
+	return isfinite(r) ? r : d;
+}
+
+/// "bbox" member, [xmin,ymin,xmax,ymax] or [xmin,ymin,zmin,xmax,ymax,zmax]
+/// with Z, rounded outwards so that it holds the rounded positions. The
+/// cached envelope is 2D, its Z range is gathered here.
+static void
+geojson_write_bbox(bytebuffer_t *b, const LWGEOM *obj, int precision)
+{
+	LWBOX box = *lwgeom_get_bbox(obj);
+	// An empty geometry has the inverted null box and no "bbox"
+	if (box.xmin > box.xmax)
+		return;
+	int dims = LWFLAGS_GET_Z(obj->flags) ? 3 : 2;
+	if (dims == 3)
+	{
+		box.zmin = DBL_MAX;
+		box.zmax = -DBL_MAX;
+		geojson_z_range(obj, &box);
+	}
+	const double lo[3] = {box.xmin, box.ymin, box.zmin};
+	const double hi[3] = {box.xmax, box.ymax, box.zmax};
+	double v[6];
+	for (int o = 0; o < dims; ++o)
+	{
+		v[o] = geojson_bound(lo[o], precision, LW_FALSE);
+		v[dims + o] = geojson_bound(hi[o], precision, LW_TRUE);
+	}
+	bytebuffer_append(b, ",\"bbox\":", 8);
+	geojson_write_position(b, v, 2 * dims, precision);
+}
+
+/// Geometry object, with a "bbox" on request
+static void
+geojson_write_geom(bytebuffer_t *b, const LWGEOM *obj, int precision, int bbox)
+{
+	bytebuffer_append(b, "{\"type\":\"", 9);
+	bytebuffer_append_string(b, obj->type <= COLLECTIONTYPE ? geojson_type_names[obj->type] : "");
+	bytebuffer_append_byte(b, '"');
+	if (bbox)
+		geojson_write_bbox(b, obj, precision);
+	if (obj->type == COLLECTIONTYPE)
+	{
+		bytebuffer_append(b, ",\"geometries\":[", 15);
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		{
+			if (i)
+				bytebuffer_append_byte(b, ',');
+			geojson_write_geom(b, obj->geoms[i], precision, LW_FALSE);
+		}
+		bytebuffer_append(b, "]}", 2);
+		return;
+	}
+	bytebuffer_append(b, ",\"coordinates\":", 15);
+	geojson_write_coordinates(b, obj, precision);
+	bytebuffer_append_byte(b, '}');
+}
+
+/* ------------------------------- output json ------------------------------ */
+
+/// @brief Write \a obj as a GeoJSON geometry, numbers with the shortest
+/// digits reading back to the same double. M ordinates are dropped.
+/// @param obj geometry
+/// @param json receives a NUL terminated string to release with lwfree()
+/// @param len receives the length of \a json, may be NULL
+/// @return LW_SUCCESS or LW_FAILURE when out of memory or when an ordinate
+/// is NaN or infinite
+int
+lwgeom_write_geojson(const LWGEOM *obj, char **json, size_t *len)
+{
+	assert(obj && json);
+	bytebuffer_t b;
+	bytebuffer_init(&b);
+	geojson_write_geom(&b, obj, -1, LW_FALSE);
+	*json = (char *)bytebuffer_release_buffer(&b, len);
+	bytebuffer_destroy_buffer(&b);
+	return *json ? LW_SUCCESS : LW_FAILURE;
+}
 
+/// @brief Stream \a obj as a GeoJSON geometry to \a sink through a small
+/// fixed buffer
+/// @param obj geometry
+/// @param precision maximum number of decimals, negative for round trip
+/// @param flags LWGEOM_GEOJSON_BBOX to add a "bbox" member
+/// @param sink receives the text in order, returns LW_FAILURE to stop
+/// @param arg passed to \a sink
+/// @return LW_SUCCESS or LW_FAILURE when \a sink failed or when an ordinate
+/// is NaN or infinite, the text after it is then not handed to \a sink
 int
-lwgeom_write_geojson(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_geojson_sink(const LWGEOM *obj, int precision, int flags, lwgeom_sink sink, void *arg)
+{
+	assert(obj && sink);
+	bytebuffer_t b;
+	bytebuffer_init_sink(&b, sink, arg);
+	geojson_write_geom(&b, obj, precision, (flags & LWGEOM_GEOJSON_BBOX) != 0);
+	return bytebuffer_flush(&b);
+}
+
+/// @brief FeatureCollection writer handing its output to \a sink in chunks
+/// of \a chunk bytes, so that a response starts before it is complete. The
+/// same chunk is reused by every feature.
+/// @param precision maximum number of decimals, negative for round trip
+/// @param flags LWGEOM_GEOJSON_BBOX to add a "bbox" to the geometries,
+/// LWGEOM_GEOJSON_FLUSH to hand every feature to the sink once written
+/// @param chunk size of the chunks, 0 for a default of 64 KB, 1 KB at least
+/// @param sink receives the text in order, returns LW_FAILURE to stop
+/// @param arg passed to \a sink
+/// @return the writer to release with lwgeom_geojson_writer_free()
+lwgeom_geojson_writer *
+lwgeom_geojson_writer_new(int precision, int flags, size_t chunk, lwgeom_sink sink, void *arg)
+{
+	assert(sink);
+	lwgeom_geojson_writer *w =
+	    (lwgeom_geojson_writer *)lwmalloc__cat(sizeof(lwgeom_geojson_writer), LWGEOM_MEM_OTHER);
+	if (!w)
+		return NULL;
+	bytebuffer_init_sink_with_size(&w->b, chunk ? chunk : GEOJSON_CHUNK_SIZE, sink, arg);
+	if (w->b.error)
+	{
+		lwfree(w);
+		return NULL;
+	}
+	w->precision = precision;
+	w->flags = flags;
+	w->nfeatures = 0;
+	w->finished = LW_FALSE;
+	return w;
+}
+
+/// @brief Write a feature of the collection
+/// @param writer writer
+/// @param obj geometry, NULL for a null geometry
+/// @param properties JSON object written as is, NULL for null properties
+/// @param len length of \a properties
+/// @return LW_SUCCESS or LW_FAILURE when the sink failed or when an ordinate
+/// is NaN or infinite, which stops the writer as a sink failure does
+int
+lwgeom_geojson_writer_feature(lwgeom_geojson_writer *writer, const LWGEOM *obj, const char *properties, size_t len)
+{
+	assert(writer && !writer->finished);
+	bytebuffer_t *b = &writer->b;
+	if (writer->nfeatures++)
+		bytebuffer_append_byte(b, ',');
+	else
+		bytebuffer_append_string(b, "{\"type\":\"FeatureCollection\",\"features\":[");
+	bytebuffer_append(b, "{\"type\":\"Feature\",\"geometry\":", 29);
+	if (obj)
+		geojson_write_geom(b, obj, writer->precision, (writer->flags & LWGEOM_GEOJSON_BBOX) != 0);
+	else
+		bytebuffer_append(b, "null", 4);
+	bytebuffer_append(b, ",\"properties\":", 14);
+	if (properties)
+		bytebuffer_append(b, properties, len);
+	else
+		bytebuffer_append(b, "null", 4);
+	bytebuffer_append_byte(b, '}');
+	if (writer->flags & LWGEOM_GEOJSON_FLUSH)
+		return bytebuffer_flush(b);
+	return b->error ? LW_FAILURE : LW_SUCCESS;
+}
+
+/// @brief Hand what was written so far to the sink
+/// @return LW_SUCCESS or LW_FAILURE when the sink failed
+int
+lwgeom_geojson_writer_flush(lwgeom_geojson_writer *writer)
+{
+	assert(writer);
+	return bytebuffer_flush(&writer->b);
+}
+
+/// @brief Close the collection and flush it, no feature can follow
+/// @return LW_SUCCESS or LW_FAILURE when the sink failed
+int
+lwgeom_geojson_writer_finish(lwgeom_geojson_writer *writer)
+{
+	assert(writer && !writer->finished);
+	writer->finished = LW_TRUE;
+	if (writer->nfeatures)
+		bytebuffer_append(&writer->b, "]}", 2);
+	else
+		bytebuffer_append_string(&writer->b, "{\"type\":\"FeatureCollection\",\"features\":[]}");
+	return bytebuffer_flush(&writer->b);
+}
+
+void
+lwgeom_geojson_writer_free(lwgeom_geojson_writer *writer)
 {
-	return 0;
+	if (!writer)
+		return;
+	bytebuffer_destroy_buffer(&writer->b);
+	lwfree(writer);
 }
@@ -0,0 +1,891 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+#include "bytebuffer.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+/* Geometry commands */
+#define MVT_MOVETO 1
+#define MVT_LINETO 2
+#define MVT_CLOSEPATH 7
+
+/* Feature types, a collection gives one feature per type */
+#define MVT_POINT 1
+#define MVT_LINESTRING 2
+#define MVT_POLYGON 3
+
+/* Protobuf wire types */
+#define MVT_VARINT 0
+#define MVT_BYTES 2
+
+/* Fields of the Tile, Layer, Feature and Value messages */
+#define MVT_TILE_LAYERS 3
+#define MVT_LAYER_NAME 1
+#define MVT_LAYER_FEATURES 2
+#define MVT_LAYER_KEYS 3
+#define MVT_LAYER_VALUES 4
+#define MVT_LAYER_EXTENT 5
+#define MVT_LAYER_VERSION 15
+#define MVT_FEATURE_ID 1
+#define MVT_FEATURE_TAGS 2
+#define MVT_FEATURE_TYPE 3
+#define MVT_FEATURE_GEOMETRY 4
+#define MVT_VALUE_STRING 1
+
+/// Keys or values of a layer, deduplicated by an open addressing table
+typedef struct {
+	struct {
+		uint32_t offset; ///< of the text in lwgeom_mvt_encoder.strings
+		uint32_t len;
+		uint32_t hash;
+	} *entries;
+	uint32_t n;
+	uint32_t capacity;
+	uint32_t *slots; ///< entry index + 1, 0 when free
+	uint32_t nslots; ///< a power of two
+} mvt_table;
+
+struct lwgeom_mvt_encoder {
+	mapsettings_t settings;
+	double x0, y0;         ///< world coordinates of the top left tile corner
+	double sx, sy;         ///< tile units per world unit
+	double lo, hi;         ///< buffered tile in tile units
+	LWBOX bounds;          ///< buffered tile in world units
+	bytebuffer_t tile;     ///< finished layers
+	bytebuffer_t features; ///< features of the open layer
+	bytebuffer_t name;     ///< of the open layer
+	bytebuffer_t strings;  ///< text of its keys and values
+	mvt_table keys;
+	mvt_table values;
+	int layer_open;
+	int error;             ///< out of memory, the tile is lost
+
+	/* Scratch of the feature being encoded, kept from feature to feature */
+	uint32_t *cmds;        ///< geometry command stream
+	size_t ncmds;
+	size_t cmds_capacity;
+	uint32_t *tags;
+	size_t ntags;
+	size_t tags_capacity;
+	double *pts[2];        ///< x, y pairs in tile units, clipped back and forth
+	size_t pts_capacity;
+	int32_t *q;            ///< x, y pairs quantized
+	size_t nq;
+	size_t q_capacity;
+	int32_t cx, cy;        ///< cursor of the command stream
+};
+
+/* -------------------------------- protobuf -------------------------------- */
+
+static inline size_t
+mvt_varint_size(uint64_t v)
+{
+	size_t n = 1;
+	for (; v >= 0x80; v >>= 7)
+		n++;
+	return n;
+}
+
+/// Varint at \a w, which has room for it
+static inline uint8_t *
+mvt_put_varint(uint8_t *w, uint64_t v)
+{
+	for (; v >= 0x80; v >>= 7)
+		*w++ = (uint8_t)(v | 0x80);
+	*w++ = (uint8_t)v;
+	return w;
+}
+
+static inline void
+mvt_varint(bytebuffer_t *b, uint64_t v)
+{
+	uint8_t buf[10];
+	size_t n = 0;
+	for (; v >= 0x80; v >>= 7)
+		buf[n++] = (uint8_t)(v | 0x80);
+	buf[n++] = (uint8_t)v;
+	bytebuffer_append(b, buf, n);
+}
+
+static inline void
+mvt_key(bytebuffer_t *b, uint32_t field, uint32_t wire)
+{
+	mvt_varint(b, field << 3 | wire);
+}
+
+/// Bytes of a length delimited field of \a len bytes, with its one byte key
+static inline size_t
+mvt_bytes_size(size_t len)
+{
+	return 1 + mvt_varint_size(len) + len;
+}
+
+static inline void
+mvt_bytes(bytebuffer_t *b, uint32_t field, const void *data, size_t len)
+{
+	mvt_key(b, field, MVT_BYTES);
+	mvt_varint(b, len);
+	bytebuffer_append(b, data, len);
+}
+
+/* ------------------------------ keys and values --------------------------- */
+
+static void
+mvt_table_clear(mvt_table *t)
+{
+	t->n = 0;
+	if (t->slots)
+		memset(t->slots, 0, t->nslots * sizeof(uint32_t));
+}
+
+static void
+mvt_table_free(mvt_table *t)
+{
+	lwfree(t->entries);
+	lwfree(t->slots);
+}
+
+/// Index of \a text in \a t, added when it is new
+static int
+mvt_table_index(lwgeom_mvt_encoder *enc, mvt_table *t, const char *text, uint32_t *index)
+{
+	size_t len = strlen(text);
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+
+	if ((size_t)(t->n + 1) * 2 > t->nslots)
+	{
+		// Twice as many slots as entries at least, rehashed
+		uint32_t nslots = t->nslots ? t->nslots * 2 : 64;
+		uint32_t *slots = (uint32_t *)lwmalloc0(nslots * sizeof(uint32_t));
+		if (!slots)
+			return LW_FAILURE;
+		for (uint32_t i = 0; i < t->n; i++)
+		{
+			uint32_t s = t->entries[i].hash & (nslots - 1);
+			while (slots[s])
+				s = (s + 1) & (nslots - 1);
+			slots[s] = i + 1;
+		}
+		lwfree(t->slots);
+		t->slots = slots;
+		t->nslots = nslots;
+	}
+
+	const uint8_t *strings = enc->strings.buf_start;
+	uint32_t s = hash & (t->nslots - 1);
+	for (; t->slots[s]; s = (s + 1) & (t->nslots - 1))
+	{
+		uint32_t i = t->slots[s] - 1;
+		if (t->entries[i].hash == hash && t->entries[i].len == len &&
+		    memcmp(strings + t->entries[i].offset, text, len) == 0)
+		{
+			*index = i;
+			return LW_SUCCESS;
+		}
+	}
+
+	size_t offset = bytebuffer_getlength(&enc->strings);
+	size_t capacity = t->capacity;
+	if (len > UINT32_MAX || offset > UINT32_MAX - len ||
+	    !lwgeom__reserve((void **)&t->entries, &capacity, (size_t)t->n + 1, sizeof(*t->entries), LWGEOM_MEM_OTHER))
+		return LW_FAILURE;
+	t->capacity = (uint32_t)capacity;
+	bytebuffer_append(&enc->strings, text, len);
+	if (enc->strings.error)
+		return LW_FAILURE;
+	t->entries[t->n].offset = (uint32_t)offset;
+	t->entries[t->n].len = (uint32_t)len;
+	t->entries[t->n].hash = hash;
+	t->slots[s] = t->n + 1;
+	*index = t->n++;
+	return LW_SUCCESS;
+}
+
+/* -------------------------------- geometry -------------------------------- */
+
+static inline int
+mvt_cmd_reserve(lwgeom_mvt_encoder *enc, size_t n)
+{
+	return lwgeom__reserve(
+	    (void **)&enc->cmds, &enc->cmds_capacity, enc->ncmds + n, sizeof(uint32_t), LWGEOM_MEM_OTHER);
+}
+
+static inline void
+mvt_cmd(lwgeom_mvt_encoder *enc, uint32_t id, uint32_t count)
+{
+	enc->cmds[enc->ncmds++] = id | count << 3;
+}
+
+/// Zigzag encoded move of the cursor to (x, y)
+static inline void
+mvt_param(lwgeom_mvt_encoder *enc, int32_t x, int32_t y)
+{
+	int32_t dx = (int32_t)((uint32_t)x - (uint32_t)enc->cx);
+	int32_t dy = (int32_t)((uint32_t)y - (uint32_t)enc->cy);
+	enc->cmds[enc->ncmds++] = (uint32_t)dx << 1 ^ (uint32_t)(dx >> 31);
+	enc->cmds[enc->ncmds++] = (uint32_t)dy << 1 ^ (uint32_t)(dy >> 31);
+	enc->cx = x;
+	enc->cy = y;
+}
+
+static inline int32_t
+mvt_round(double v)
+{
+	// Clipped ordinates are in range, this only guards against NaN
+	v = floor(v + 0.5);
+	if (!(v >= -(double)(1 << 30)))
+		return -(1 << 30);
+	return v > (double)(1 << 30) ? 1 << 30 : (int32_t)v;
+}
+
+/// Grow both clipping buffers to \a n doubles
+static int
+mvt_pts_reserve(lwgeom_mvt_encoder *enc, size_t n)
+{
+	size_t capacity[2] = {enc->pts_capacity, enc->pts_capacity};
+	for (int i = 0; i < 2; i++)
+	{
+		if (!lwgeom__reserve((void **)&enc->pts[i], &capacity[i], n, sizeof(double), LWGEOM_MEM_OTHER))
+			return LW_FAILURE;
+	}
+	enc->pts_capacity = capacity[0];
+	return LW_SUCCESS;
+}
+
+/// Points of \a obj in tile units into pts[0]
+/// @param[out] inside LW_TRUE when they are all in the buffered tile
+/// @return LW_FAILURE when out of memory
+static int
+mvt_transform(lwgeom_mvt_encoder *enc, const LWGEOM *obj, int *inside)
+{
+	uint32_t n = obj->npoints;
+	if (!mvt_pts_reserve(enc, 2 * (size_t)n + 8))
+		return LW_FAILURE;
+
+	double *p = enc->pts[0];
+	double lo = enc->lo, hi = enc->hi;
+	int in = LW_TRUE;
+	if (LWFLAGS_GET_QUANT(obj->flags))
+	{
+		for (uint32_t i = 0; i < n; i++, p += 2)
+		{
+			p[0] = (lwgeom__quant_get(obj, i, 0) - enc->x0) * enc->sx;
+			p[1] = (enc->y0 - lwgeom__quant_get(obj, i, 1)) * enc->sy;
+			in &= p[0] >= lo && p[0] <= hi && p[1] >= lo && p[1] <= hi;
+		}
+	}
+	else
+	{
+		const double *xs = LWGEOM_PP_XS(obj);
+		const double *ys = LWGEOM_PP_YS(obj);
+		size_t stride = LWGEOM_PP_STRIDE(obj);
+		for (uint32_t i = 0; i < n; i++, p += 2)
+		{
+			p[0] = (xs[i * stride] - enc->x0) * enc->sx;
+			p[1] = (enc->y0 - ys[i * stride]) * enc->sy;
+			in &= p[0] >= lo && p[0] <= hi && p[1] >= lo && p[1] <= hi;
+		}
+	}
+	*inside = in;
+	return LW_SUCCESS;
+}
+
+/// Quantize the \a n points at \a p into q, without repeated points
+static void
+mvt_quantize(lwgeom_mvt_encoder *enc, const double *p, size_t n)
+{
+	int32_t *q = enc->q;
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++, p += 2)
+	{
+		int32_t x = mvt_round(p[0]);
+		int32_t y = mvt_round(p[1]);
+		if (m && q[2 * m - 2] == x && q[2 * m - 1] == y)
+			continue;
+		q[2 * m] = x;
+		q[2 * m + 1] = y;
+		m++;
+	}
+	enc->nq = m;
+}
+
+static int
+mvt_point(lwgeom_mvt_encoder *enc, const LWGEOM *obj)
+{
+	int inside;
+	if (obj->npoints == 0 || !mvt_transform(enc, obj, &inside))
+		return obj->npoints == 0;
+	if (!inside)
+		return LW_SUCCESS;
+	if (!lwgeom__reserve((void **)&enc->q, &enc->q_capacity, 2 * (enc->nq + 1), sizeof(int32_t), LWGEOM_MEM_OTHER))
+		return LW_FAILURE;
+	// Gathered until the whole feature was walked, for one MoveTo
+	enc->q[2 * enc->nq] = mvt_round(enc->pts[0][0]);
+	enc->q[2 * enc->nq + 1] = mvt_round(enc->pts[0][1]);
+	enc->nq++;
+	return LW_SUCCESS;
+}
+
+/// Emit the line at \a p quantized, when it keeps two points
+static int
+mvt_line_part(lwgeom_mvt_encoder *enc, const double *p, size_t n)
+{
+	if (!lwgeom__reserve((void **)&enc->q, &enc->q_capacity, 2 * n, sizeof(int32_t), LWGEOM_MEM_OTHER))
+		return LW_FAILURE;
+	mvt_quantize(enc, p, n);
+	if (enc->nq < 2)
+		return LW_SUCCESS;
+	if (!mvt_cmd_reserve(enc, 2 * enc->nq + 2))
+		return LW_FAILURE;
+	mvt_cmd(enc, MVT_MOVETO, 1);
+	mvt_param(enc, enc->q[0], enc->q[1]);
+	mvt_cmd(enc, MVT_LINETO, (uint32_t)(enc->nq - 1));
+	for (size_t i = 1; i < enc->nq; i++)
+		mvt_param(enc, enc->q[2 * i], enc->q[2 * i + 1]);
+	return LW_SUCCESS;
+}
+
+/// Liang-Barsky clip of the segment \a a, \a b to the buffered tile
+/// @return LW_FALSE when it is outside
+static int
+mvt_clip_segment(double lo, double hi, double *a, double *b)
+{
+	double t0 = 0.0, t1 = 1.0;
+	double d[2] = {b[0] - a[0], b[1] - a[1]};
+	for (int o = 0; o < 2; o++)
+	{
+		double p[2] = {-d[o], d[o]};
+		double q[2] = {a[o] - lo, hi - a[o]};
+		for (int k = 0; k < 2; k++)
+		{
+			if (p[k] == 0.0)
+			{
+				if (q[k] < 0.0)
+					return LW_FALSE;
+				continue;
+			}
+			double t = q[k] / p[k];
+			if (p[k] < 0.0 && t > t0)
+				t0 = t;
+			else if (p[k] > 0.0 && t < t1)
+				t1 = t;
+		}
+	}
+	if (t0 > t1)
+		return LW_FALSE;
+	double a0 = a[0], a1 = a[1];
+	if (t1 < 1.0)
+	{
+		b[0] = a0 + t1 * d[0];
+		b[1] = a1 + t1 * d[1];
+	}
+	if (t0 > 0.0)
+	{
+		a[0] = a0 + t0 * d[0];
+		a[1] = a1 + t0 * d[1];
+	}
+	return LW_TRUE;
+}
+
+/// Line cut in the parts inside the buffered tile
+static int
+mvt_line(lwgeom_mvt_encoder *enc, const LWGEOM *obj)
+{
+	int inside;
+	if (obj->npoints < 2)
+		return LW_SUCCESS;
+	if (!mvt_transform(enc, obj, &inside))
+		return LW_FAILURE;
+	const double *p = enc->pts[0];
+	if (inside)
+		return mvt_line_part(enc, p, obj->npoints);
+
+	// Runs of clipped segments go to pts[1], a run ends where the line leaves
+	double *run = enc->pts[1];
+	size_t n = 0;
+	for (uint32_t i = 1; i < obj->npoints; i++)
+	{
+		double a[2] = {p[2 * i - 2], p[2 * i - 1]};
+		double b[2] = {p[2 * i], p[2 * i + 1]};
+		if (!mvt_clip_segment(enc->lo, enc->hi, a, b))
+			continue;
+		if (n && (run[2 * n - 2] != a[0] || run[2 * n - 1] != a[1]))
+		{
+			if (!mvt_line_part(enc, run, n))
+				return LW_FAILURE;
+			n = 0;
+		}
+		if (n == 0)
+		{
+			run[0] = a[0];
+			run[1] = a[1];
+			n = 1;
+		}
+		run[2 * n] = b[0];
+		run[2 * n + 1] = b[1];
+		n++;
+	}
+	return n ? mvt_line_part(enc, run, n) : LW_SUCCESS;
+}
+
+/// Sutherland-Hodgman pass of the \a n vertices at \a in against the edge
+/// \a o >= \a v (\a sign 1) or \a o <= \a v (\a sign -1), into \a out
+static size_t
+mvt_clip_ring_edge(const double *in, size_t n, double *out, int o, double v, double sign)
+{
+	size_t m = 0;
+	const double *prev = in + 2 * (n - 1);
+	int prev_in = (prev[o] - v) * sign >= 0.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const double *cur = in + 2 * i;
+		int cur_in = (cur[o] - v) * sign >= 0.0;
+		if (cur_in != prev_in)
+		{
+			double t = (v - prev[o]) / (cur[o] - prev[o]);
+			out[2 * m + o] = v;
+			out[2 * m + 1 - o] = prev[1 - o] + t * (cur[1 - o] - prev[1 - o]);
+			m++;
+		}
+		if (cur_in)
+		{
+			out[2 * m] = cur[0];
+			out[2 * m + 1] = cur[1];
+			m++;
+		}
+		prev = cur;
+		prev_in = cur_in;
+	}
+	return m;
+}
+
+/// Emit the ring clipped to the buffered tile, shells with a positive
+/// area in tile units (clockwise on screen) and holes with a negative one.
+/// Rings are clipped one by one, a hole crossing the buffer edge shares an
+/// edge with its shell there, out of the visible tile.
+/// @param[out] kept LW_FALSE when the ring collapsed
+static int
+mvt_ring(lwgeom_mvt_encoder *enc, const LWGEOM *ring, int shell, int *kept)
+{
+	*kept = LW_FALSE;
+	int inside;
+	if (ring->npoints < 4)
+		return LW_SUCCESS;
+	if (!mvt_transform(enc, ring, &inside))
+		return LW_FAILURE;
+
+	// The closing point is left out while clipping
+	size_t n = ring->npoints - 1;
+	double *p = enc->pts[0];
+	if (!inside)
+	{
+		static const struct {
+			int o;
+			double sign;
+		} edges[4] = {{0, 1.0}, {0, -1.0}, {1, 1.0}, {1, -1.0}};
+		for (int e = 0; e < 4 && n; e++)
+		{
+			// Each pass adds at most one vertex per vertex
+			if (!mvt_pts_reserve(enc, 4 * n + 8))
+				return LW_FAILURE;
+			p = enc->pts[e & 1];
+			n = mvt_clip_ring_edge(p, n, enc->pts[!(e & 1)], edges[e].o,
+					       edges[e].sign > 0 ? enc->lo : enc->hi, edges[e].sign);
+		}
+		p = enc->pts[0];
+	}
+	if (!lwgeom__reserve((void **)&enc->q, &enc->q_capacity, 2 * n + 2, sizeof(int32_t), LWGEOM_MEM_OTHER))
+		return LW_FAILURE;
+	mvt_quantize(enc, p, n);
+	int32_t *q = enc->q;
+	size_t m = enc->nq;
+	while (m > 1 && q[2 * m - 2] == q[0] && q[2 * m - 1] == q[1])
+		m--;
+	if (m < 3)
+		return LW_SUCCESS;
+	int64_t area = 0;
+	for (size_t i = 0; i < m; i++)
+	{
+		size_t j = i + 1 < m ? i + 1 : 0;
+		area += (int64_t)q[2 * i] * q[2 * j + 1] - (int64_t)q[2 * j] * q[2 * i + 1];
+	}
+	if (area == 0)
+		return LW_SUCCESS;
+	if ((area > 0) != shell)
+	{
+		for (size_t i = 0, j = m - 1; i < j; i++, j--)
+		{
+			int32_t x = q[2 * i], y = q[2 * i + 1];
+			q[2 * i] = q[2 * j];
+			q[2 * i + 1] = q[2 * j + 1];
+			q[2 * j] = x;
+			q[2 * j + 1] = y;
+		}
+	}
+	if (!mvt_cmd_reserve(enc, 2 * m + 3))
+		return LW_FAILURE;
+	mvt_cmd(enc, MVT_MOVETO, 1);
+	mvt_param(enc, q[0], q[1]);
+	mvt_cmd(enc, MVT_LINETO, (uint32_t)(m - 1));
+	for (size_t i = 1; i < m; i++)
+		mvt_param(enc, q[2 * i], q[2 * i + 1]);
+	mvt_cmd(enc, MVT_CLOSEPATH, 1);
+	*kept = LW_TRUE;
+	return LW_SUCCESS;
+}
+
+/// Polygon without the holes of a collapsed shell
+static int
+mvt_polygon(lwgeom_mvt_encoder *enc, const LWGEOM *obj)
+{
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		int kept;
+		if (!mvt_ring(enc, obj->geoms[i], i == 0, &kept))
+			return LW_FAILURE;
+		if (i == 0 && !kept)
+			return LW_SUCCESS;
+	}
+	return LW_SUCCESS;
+}
+
+/// Parts of \a obj of the feature type \a type
+static int
+mvt_geometry(lwgeom_mvt_encoder *enc, const LWGEOM *obj, int type)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		return type == MVT_POINT ? mvt_point(enc, obj) : LW_SUCCESS;
+	case LINETYPE:
+		return type == MVT_LINESTRING ? mvt_line(enc, obj) : LW_SUCCESS;
+	case POLYTYPE:
+		return type == MVT_POLYGON ? mvt_polygon(enc, obj) : LW_SUCCESS;
+	default:
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (!mvt_geometry(enc, obj->geoms[i], type))
+				return LW_FAILURE;
+		}
+		return LW_SUCCESS;
+	}
+}
+
+/// Key and value indices of the properties with a value
+static int
+mvt_tags(lwgeom_mvt_encoder *enc, const char *const *keys, const char *const *values, uint32_t nprops)
+{
+	enc->ntags = 0;
+	if (!lwgeom__reserve(
+		(void **)&enc->tags, &enc->tags_capacity, 2 * (size_t)nprops, sizeof(uint32_t), LWGEOM_MEM_OTHER))
+		return LW_FAILURE;
+	for (uint32_t i = 0; i < nprops; i++)
+	{
+		if (!values[i])
+			continue;
+		uint32_t k, v;
+		if (!mvt_table_index(enc, &enc->keys, keys[i], &k))
+			return LW_FAILURE;
+		if (!mvt_table_index(enc, &enc->values, values[i], &v))
+			return LW_FAILURE;
+		enc->tags[enc->ntags++] = k;
+		enc->tags[enc->ntags++] = v;
+	}
+	return LW_SUCCESS;
+}
+
+/// Append the feature of type \a type made of the command stream
+static void
+mvt_feature(lwgeom_mvt_encoder *enc, uint64_t id, int type)
+{
+	size_t tags = 0, cmds = 0;
+	for (size_t i = 0; i < enc->ntags; i++)
+		tags += mvt_varint_size(enc->tags[i]);
+	for (size_t i = 0; i < enc->ncmds; i++)
+		cmds += mvt_varint_size(enc->cmds[i]);
+	size_t len = (id ? 1 + mvt_varint_size(id) : 0) + (enc->ntags ? mvt_bytes_size(tags) : 0) + 2 +
+		     mvt_bytes_size(cmds);
+
+	// Written in place, the command stream makes most of the tile
+	bytebuffer_t *b = &enc->features;
+	if (!bytebuffer_reserve(b, 1 + mvt_varint_size(len) + len))
+		return;
+	uint8_t *w = b->writecursor;
+	*w++ = MVT_LAYER_FEATURES << 3 | MVT_BYTES;
+	w = mvt_put_varint(w, len);
+	if (id)
+	{
+		*w++ = MVT_FEATURE_ID << 3 | MVT_VARINT;
+		w = mvt_put_varint(w, id);
+	}
+	if (enc->ntags)
+	{
+		*w++ = MVT_FEATURE_TAGS << 3 | MVT_BYTES;
+		w = mvt_put_varint(w, tags);
+		for (size_t i = 0; i < enc->ntags; i++)
+			w = mvt_put_varint(w, enc->tags[i]);
+	}
+	*w++ = MVT_FEATURE_TYPE << 3 | MVT_VARINT;
+	*w++ = (uint8_t)type;
+	*w++ = MVT_FEATURE_GEOMETRY << 3 | MVT_BYTES;
+	w = mvt_put_varint(w, cmds);
+	for (size_t i = 0; i < enc->ncmds; i++)
+		w = mvt_put_varint(w, enc->cmds[i]);
+	b->writecursor = w;
+}
+
+/* --------------------------------- layers --------------------------------- */
+
+/// Write the open layer into the tile, unless it has no feature
+static void
+mvt_layer_end(lwgeom_mvt_encoder *enc)
+{
+	if (!enc->layer_open)
+		return;
+	enc->layer_open = LW_FALSE;
+	size_t nfeatures = bytebuffer_getlength(&enc->features);
+	if (nfeatures == 0)
+		return;
+
+	const uint8_t *strings = enc->strings.buf_start;
+	size_t name = bytebuffer_getlength(&enc->name);
+	size_t len = 2 + mvt_bytes_size(name) + nfeatures + 1 + mvt_varint_size(enc->settings.extent);
+	for (uint32_t i = 0; i < enc->keys.n; i++)
+		len += mvt_bytes_size(enc->keys.entries[i].len);
+	for (uint32_t i = 0; i < enc->values.n; i++)
+		len += mvt_bytes_size(mvt_bytes_size(enc->values.entries[i].len));
+
+	bytebuffer_t *b = &enc->tile;
+	mvt_key(b, MVT_TILE_LAYERS, MVT_BYTES);
+	mvt_varint(b, len);
+	mvt_key(b, MVT_LAYER_VERSION, MVT_VARINT);
+	mvt_varint(b, 2);
+	mvt_bytes(b, MVT_LAYER_NAME, enc->name.buf_start, name);
+	bytebuffer_append(b, enc->features.buf_start, nfeatures);
+	for (uint32_t i = 0; i < enc->keys.n; i++)
+		mvt_bytes(b, MVT_LAYER_KEYS, strings + enc->keys.entries[i].offset, enc->keys.entries[i].len);
+	for (uint32_t i = 0; i < enc->values.n; i++)
+	{
+		uint32_t vlen = enc->values.entries[i].len;
+		mvt_key(b, MVT_LAYER_VALUES, MVT_BYTES);
+		mvt_varint(b, mvt_bytes_size(vlen));
+		mvt_bytes(b, MVT_VALUE_STRING, strings + enc->values.entries[i].offset, vlen);
+	}
+	mvt_key(b, MVT_LAYER_EXTENT, MVT_VARINT);
+	mvt_varint(b, enc->settings.extent);
+}
+
+/* ----------------------------------- API ---------------------------------- */
+
+/// @brief Vector tile encoder, its buffers are kept from tile to tile
+/// @param settings tile grid, NULL for the mapsettings_init() defaults
+/// @return the encoder to release with lwgeom_mvt_encoder_free(), NULL when
+/// out of memory or for an invalid grid
+lwgeom_mvt_encoder *
+lwgeom_mvt_encoder_new(const mapsettings_t *settings)
+{
+	lwgeom_mvt_encoder *enc = (lwgeom_mvt_encoder *)lwmalloc0(sizeof(lwgeom_mvt_encoder));
+	if (!enc)
+		return NULL;
+	if (settings)
+		enc->settings = *settings;
+	else
+		mapsettings_init(&enc->settings);
+	if (!(enc->settings.xmax > enc->settings.xmin) || !(enc->settings.ymax > enc->settings.ymin) ||
+	    enc->settings.extent == 0 || enc->settings.extent > (1u << 24) || enc->settings.buffer > (1u << 24))
+	{
+		lwfree(enc);
+		return NULL;
+	}
+	bytebuffer_init(&enc->tile);
+	bytebuffer_init(&enc->features);
+	bytebuffer_init(&enc->name);
+	bytebuffer_init(&enc->strings);
+	return enc;
+}
+
+/// @brief Start tile \a z / \a x / \a y, dropping the previous one
+/// @return LW_FAILURE when the tile is not in the grid
+int
+lwgeom_mvt_encoder_tile(lwgeom_mvt_encoder *enc, uint32_t z, uint32_t x, uint32_t y)
+{
+	assert(enc);
+	if (z > 30 || x >= (1u << z) || y >= (1u << z))
+		return LW_FAILURE;
+	const mapsettings_t *s = &enc->settings;
+	double w = ldexp(s->xmax - s->xmin, -(int)z);
+	double h = ldexp(s->ymax - s->ymin, -(int)z);
+	enc->x0 = s->xmin + x * w;
+	enc->y0 = s->ymax - y * h;
+	enc->sx = s->extent / w;
+	enc->sy = s->extent / h;
+	enc->lo = -(double)s->buffer;
+	enc->hi = (double)s->extent + s->buffer;
+	enc->bounds.xmin = enc->x0 - s->buffer / enc->sx;
+	enc->bounds.xmax = enc->x0 + w + s->buffer / enc->sx;
+	enc->bounds.ymin = enc->y0 - h - s->buffer / enc->sy;
+	enc->bounds.ymax = enc->y0 + s->buffer / enc->sy;
+
+	enc->tile.writecursor = enc->tile.buf_start;
+	enc->tile.error = LW_FALSE;
+	enc->layer_open = LW_FALSE;
+	enc->error = LW_FALSE;
+	return LW_SUCCESS;
+}
+
+/// @brief Start a layer, closing the previous one. Layers without any
+/// feature are left out of the tile.
+/// @return LW_FAILURE when out of memory
+int
+lwgeom_mvt_encoder_layer(lwgeom_mvt_encoder *enc, const char *name)
+{
+	assert(enc && name);
+	mvt_layer_end(enc);
+	enc->features.writecursor = enc->features.buf_start;
+	enc->name.writecursor = enc->name.buf_start;
+	enc->strings.writecursor = enc->strings.buf_start;
+	mvt_table_clear(&enc->keys);
+	mvt_table_clear(&enc->values);
+	bytebuffer_append_string(&enc->name, name);
+	enc->layer_open = LW_TRUE;
+	if (enc->name.error || enc->tile.error)
+		enc->error = LW_TRUE;
+	return enc->error ? LW_FAILURE : LW_SUCCESS;
+}
+
+/// @brief Add a feature to the open layer: clipped to the buffered tile,
+/// quantized to tile units, without the parts that collapse. A collection
+/// gives a feature for each of its point, line and polygon parts.
+/// @param enc encoder with an open layer
+/// @param obj geometry in the coordinates of the grid
+/// @param id feature id, 0 for none
+/// @param keys property names
+/// @param values property values written as strings, NULL ones are left out
+/// @param nprops number of properties
+/// @return LW_SUCCESS, also when nothing of \a obj is left in the tile,
+/// LW_FAILURE when out of memory or without an open layer
+int
+lwgeom_mvt_encoder_feature(lwgeom_mvt_encoder *enc,
+			   const LWGEOM *obj,
+			   uint64_t id,
+			   const char *const *keys,
+			   const char *const *values,
+			   uint32_t nprops)
+{
+	assert(enc && obj);
+	if (!enc->layer_open || enc->error)
+		return LW_FAILURE;
+	const LWBOX *box = lwgeom_get_bbox(obj);
+	if (box->xmin > enc->bounds.xmax || box->xmax < enc->bounds.xmin || box->ymin > enc->bounds.ymax ||
+	    box->ymax < enc->bounds.ymin)
+		return LW_SUCCESS;
+
+	int first = MVT_POLYGON;
+	if (obj->type == POINTTYPE || obj->type == MPOINTTYPE || obj->type == COLLECTIONTYPE)
+		first = MVT_POINT;
+	else if (obj->type == LINETYPE || obj->type == MLINETYPE)
+		first = MVT_LINESTRING;
+	int last = obj->type == COLLECTIONTYPE ? MVT_POLYGON : first;
+	int tagged = LW_FALSE;
+	for (int type = first; type <= last; type++)
+	{
+		enc->ncmds = 0;
+		enc->nq = 0;
+		enc->cx = enc->cy = 0;
+		if (!mvt_geometry(enc, obj, type))
+		{
+			enc->error = LW_TRUE;
+			return LW_FAILURE;
+		}
+		if (type == MVT_POINT && enc->nq)
+		{
+			if (!mvt_cmd_reserve(enc, 2 * enc->nq + 1))
+			{
+				enc->error = LW_TRUE;
+				return LW_FAILURE;
+			}
+			mvt_cmd(enc, MVT_MOVETO, (uint32_t)enc->nq);
+			for (size_t i = 0; i < enc->nq; i++)
+				mvt_param(enc, enc->q[2 * i], enc->q[2 * i + 1]);
+		}
+		if (enc->ncmds == 0)
+			continue;
+
+		// Properties once the feature is known to be kept
+		if (!tagged && !mvt_tags(enc, keys, values, nprops))
+		{
+			enc->error = LW_TRUE;
+			return LW_FAILURE;
+		}
+		tagged = LW_TRUE;
+		mvt_feature(enc, id, type);
+	}
+	if (enc->features.error)
+		enc->error = LW_TRUE;
+	return enc->error ? LW_FAILURE : LW_SUCCESS;
+}
+
+/// @brief Close the open layer and return the tile
+/// @param enc encoder
+/// @param[out] tile the encoded tile, owned by the encoder and valid until
+/// the next lwgeom_mvt_encoder_tile()
+/// @param[out] len bytes of \a tile, 0 when no feature was kept
+/// @return LW_FAILURE when out of memory at some point of the tile
+int
+lwgeom_mvt_encoder_finish(lwgeom_mvt_encoder *enc, const uint8_t **tile, size_t *len)
+{
+	assert(enc && tile && len);
+	mvt_layer_end(enc);
+	*tile = NULL;
+	*len = 0;
+	if (enc->error || enc->tile.error)
+		return LW_FAILURE;
+	*tile = enc->tile.buf_start;
+	*len = bytebuffer_getlength(&enc->tile);
+	return LW_SUCCESS;
+}
+
+void
+lwgeom_mvt_encoder_free(lwgeom_mvt_encoder *enc)
+{
+	if (enc == NULL)
+		return;
+	bytebuffer_destroy_buffer(&enc->tile);
+	bytebuffer_destroy_buffer(&enc->features);
+	bytebuffer_destroy_buffer(&enc->name);
+	bytebuffer_destroy_buffer(&enc->strings);
+	mvt_table_free(&enc->keys);
+	mvt_table_free(&enc->values);
+	lwfree(enc->cmds);
+	lwfree(enc->tags);
+	lwfree(enc->pts[0]);
+	lwfree(enc->pts[1]);
+	lwfree(enc->q);
+	lwfree(enc);
+}
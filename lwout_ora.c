@@ -20,11 +20,218 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom.h"
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+/// Element info and ordinates output, only counted while info is NULL
+typedef struct {
+	int *info;
+	size_t ninfo;
+	double *ord;
+	size_t nord;
+} ora_writer;
+
+static void
+ora_put_elem(ora_writer *w, int etype, int interpretation)
+{
+	if (w->info)
+	{
+		w->info[w->ninfo] = (int)(w->nord + 1);
+		w->info[w->ninfo + 1] = etype;
+		w->info[w->ninfo + 2] = interpretation;
+	}
+	w->ninfo += 3;
+}
+
+/// Ordinates of \a obj, last point first when \a reverse is set
+static void
+ora_put_points(ora_writer *w, const LWGEOM *obj, int reverse)
+{
+	size_t cdim = (size_t)lwgeom_dim_coordinate(obj);
+	if (w->ord && obj->npoints)
+	{
+		if (!reverse && !LWFLAGS_GET_SOA(obj->flags) && !LWFLAGS_GET_QUANT(obj->flags))
+			memcpy(w->ord + w->nord, obj->pp, obj->npoints * cdim * sizeof(double));
+		else
+		{
+			for (uint32_t i = 0; i < obj->npoints; ++i)
+			{
+				uint32_t k = reverse ? obj->npoints - 1 - i : i;
+				lwgeom_point_at(obj, (int)k, w->ord + w->nord + i * cdim);
+			}
+		}
+	}
+	w->nord += obj->npoints * cdim;
+}
+
+/// Ring of a polygon, the exterior one counterclockwise and the interior
+/// ones clockwise as Oracle requires, reversed when they are not
+static void
+ora_put_ring(ora_writer *w, const LWGEOM *ring, int exterior)
+{
+	ora_put_elem(w, exterior ? 1003 : 2003, 1);
+	// The shoelace area is positive for clockwise rings, only needed when writing
+	int reverse = 0;
+	if (w->ord)
+	{
+		double area = lwgeom_prop_area(ring);
+		reverse = exterior ? area > 0.0 : area < 0.0;
+	}
+	ora_put_points(w, ring, reverse);
+}
+
+/// Elements of \a obj, collections nested in collections are flattened
+static void
+ora_put_geom(ora_writer *w, const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		if (obj->npoints)
+		{
+			ora_put_elem(w, 1, 1);
+			ora_put_points(w, obj, 0);
+		}
+		return;
+	case LINETYPE:
+		if (obj->npoints)
+		{
+			ora_put_elem(w, 2, 1);
+			ora_put_points(w, obj, 0);
+		}
+		return;
+	case POLYTYPE:
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		{
+			if (obj->geoms[i]->npoints == 0)
+				continue;
+			ora_put_ring(w, obj->geoms[i], i == 0);
+		}
+		return;
+	case MPOINTTYPE:
+	{
+		// A point cluster, the empty points left out
+		int n = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+			n += obj->geoms[i]->npoints != 0;
+		if (n)
+			ora_put_elem(w, 1, n);
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+			ora_put_points(w, obj->geoms[i], 0);
+		return;
+	}
+	default:
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+			ora_put_geom(w, obj->geoms[i]);
+		return;
+	}
+}
+
+/// sdo_gtype DLTT: dimension, position of the measure and geometry type
+static int
+ora_gtype(const LWGEOM *obj)
+{
+	static const int tt[8] = {0, 1, 2, 3, 5, 6, 7, 4};
+	int dims = lwgeom_dim_coordinate(obj);
+	return dims * 1000 + (LWFLAGS_GET_M(obj->flags) ? dims * 100 : 0) + tt[obj->type];
+}
+
+/// @brief Size of the SDO_GEOMETRY of \a obj
+/// @param[out] elem_count ints of its element info
+/// @param[out] ord_count doubles of its ordinates
+/// @return LW_FAILURE when its ordinates are too many for the int offsets
+int
+lwgeom_ora_size(const LWGEOM *obj, size_t *elem_count, size_t *ord_count)
+{
+	assert(obj && elem_count && ord_count);
+	ora_writer w = {NULL, 0, NULL, 0};
+	ora_put_geom(&w, obj);
+	*elem_count = w.ninfo;
+	*ord_count = w.nord;
+	return w.nord < INT_MAX ? LW_SUCCESS : LW_FAILURE;
+}
+
+static void
+ora_write(const LWGEOM *obj, LWGEOM_SDO *sdo, int *elem_info, double *ordinates)
+{
+	ora_writer w = {elem_info, 0, ordinates, 0};
+	ora_put_geom(&w, obj);
+	sdo->sdo_gtype = ora_gtype(obj);
+	sdo->sdo_srid = 0;
+	sdo->sdo_elem_count = w.ninfo;
+	sdo->sdo_elem_info = elem_info;
+	sdo->sdo_ord_count = w.nord;
+	sdo->sdo_ordinates = ordinates;
+}
+
+/// @brief Write \a obj as an Oracle SDO_GEOMETRY, with straight lines and
+/// point clusters for multi points. Exterior rings are written counterclockwise
+/// and interior rings clockwise. Empty geometries have no element.
+/// @param[out] sdo the geometry, its SRID 0, lwgeom_ora_free() releases its arrays
 int
 lwgeom_write_ora(const LWGEOM *obj, LWGEOM_SDO *sdo)
 {
-	return 0;
-}
\ No newline at end of file
+	assert(obj && sdo);
+	size_t elem_count, ord_count;
+	if (!lwgeom_ora_size(obj, &elem_count, &ord_count))
+		return LW_FAILURE;
+	int *elem_info = elem_count ? (int *)lwmalloc__cat(elem_count * sizeof(int), LWGEOM_MEM_OTHER) : NULL;
+	double *ordinates = ord_count ? (double *)lwmalloc__cat(ord_count * sizeof(double), LWGEOM_MEM_COORDS) : NULL;
+	if ((elem_count && !elem_info) || (ord_count && !ordinates))
+	{
+		lwfree(elem_info);
+		lwfree(ordinates);
+		return LW_FAILURE;
+	}
+	ora_write(obj, sdo, elem_info, ordinates);
+	return LW_SUCCESS;
+}
+
+/// @brief Write \a n geometries back to back into the caller's arrays,
+/// each SDO_GEOMETRY pointing into them
+/// @param elem_size ints available in \a elem_info
+/// @param ord_size doubles available in \a ordinates
+/// @return LW_FAILURE when the arrays are too small, see lwgeom_ora_size()
+int
+lwgeom_write_ora_batch(const LWGEOM *const *objs,
+		       uint32_t n,
+		       LWGEOM_SDO *sdos,
+		       int *elem_info,
+		       size_t elem_size,
+		       double *ordinates,
+		       size_t ord_size)
+{
+	assert((objs && sdos) || n == 0);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		size_t elem_count, ord_count;
+		if (!lwgeom_ora_size(objs[i], &elem_count, &ord_count) || elem_count > elem_size ||
+		    ord_count > ord_size)
+			return LW_FAILURE;
+		ora_write(objs[i], &sdos[i], elem_info, ordinates);
+		elem_info += elem_count;
+		elem_size -= elem_count;
+		ordinates += ord_count;
+		ord_size -= ord_count;
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief Release the arrays of an SDO_GEOMETRY written by lwgeom_write_ora()
+void
+lwgeom_ora_free(LWGEOM_SDO *sdo)
+{
+	if (sdo == NULL)
+		return;
+	lwfree(sdo->sdo_elem_info);
+	lwfree(sdo->sdo_ordinates);
+	sdo->sdo_elem_info = NULL;
+	sdo->sdo_ordinates = NULL;
+	sdo->sdo_elem_count = 0;
+	sdo->sdo_ord_count = 0;
+}
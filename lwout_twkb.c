@@ -0,0 +1,335 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "bytebuffer.h"
+#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+/* Metadata header bits */
+#define TWKB_BBOX     0x01
+#define TWKB_SIZE     0x02
+#define TWKB_IDLIST   0x04
+#define TWKB_EXTENDED 0x08
+#define TWKB_EMPTY    0x10
+
+/* Longest varint, 64 bits in 7 bit groups */
+#define TWKB_VARINT_MAX 10
+
+typedef struct {
+	bytebuffer_t *b;
+	const lwgeom_twkb_options *options;
+	int ndims;
+	double scale[4]; ///< 10^precision of each ordinate
+	int64_t last[4]; ///< previous point, the next one is written as a delta
+	int error;       ///< ordinate out of the int64 range once scaled
+} twkb_writer;
+
+static inline size_t
+twkb_encode_uvarint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80)
+	{
+		p[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+/// Varint straight into the buffer when it has room
+static inline void
+twkb_put_uvarint(bytebuffer_t *b, uint64_t v)
+{
+	if (b->buf_end - b->writecursor >= TWKB_VARINT_MAX || bytebuffer_reserve(b, TWKB_VARINT_MAX))
+		b->writecursor += twkb_encode_uvarint(b->writecursor, v);
+	else
+	{
+		uint8_t tmp[TWKB_VARINT_MAX];
+		bytebuffer_append(b, tmp, twkb_encode_uvarint(tmp, v));
+	}
+}
+
+static inline uint64_t
+twkb_zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+twkb_quantize(twkb_writer *w, double v, int o)
+{
+	double s = v * w->scale[o];
+	// Beyond 2^62 the deltas could overflow
+	if (!(fabs(s) < 4.6e18))
+	{
+		w->error = LW_TRUE;
+		return 0;
+	}
+	return llround(s);
+}
+
+static void
+twkb_put_points(twkb_writer *w, const LWGEOM *obj)
+{
+	int fast = !LWFLAGS_GET_SOA(obj->flags) && !LWFLAGS_GET_QUANT(obj->flags);
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		const double *pp = fast ? obj->pp + (size_t)i * (size_t)w->ndims : point;
+		if (!fast)
+			lwgeom_point_at(obj, (int)i, point);
+		for (int o = 0; o < w->ndims; ++o)
+		{
+			int64_t q = twkb_quantize(w, pp[o], o);
+			twkb_put_uvarint(w->b, twkb_zigzag(q - w->last[o]));
+			w->last[o] = q;
+		}
+	}
+}
+
+static void
+twkb_extent(const twkb_writer *w, const LWGEOM *obj, double *min, double *max)
+{
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		lwgeom_point_at(obj, (int)i, point);
+		for (int o = 0; o < w->ndims; ++o)
+		{
+			min[o] = LWMIN(min[o], point[o]);
+			max[o] = LWMAX(max[o], point[o]);
+		}
+	}
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		twkb_extent(w, obj->geoms[i], min, max);
+}
+
+/// Minimum and extent of each ordinate, rounding being monotonic those of
+/// the rounded points are the rounded extremes
+static void
+twkb_put_bbox(twkb_writer *w, const LWGEOM *obj)
+{
+	double min[4] = {INFINITY, INFINITY, INFINITY, INFINITY};
+	double max[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+	twkb_extent(w, obj, min, max);
+	for (int o = 0; o < w->ndims; ++o)
+	{
+		// Parts without points leave infinite extremes
+		int64_t lo = twkb_quantize(w, isfinite(min[o]) ? min[o] : 0.0, o);
+		int64_t hi = twkb_quantize(w, isfinite(max[o]) ? max[o] : 0.0, o);
+		twkb_put_uvarint(w->b, twkb_zigzag(lo));
+		twkb_put_uvarint(w->b, twkb_zigzag(hi - lo));
+	}
+}
+
+/// Prefix the bytes written from \a at with their count. What a fixed
+/// buffer dropped is counted only, the output is not usable anyway.
+static void
+twkb_insert_size(bytebuffer_t *b, size_t at)
+{
+	size_t size = bytebuffer_getlength(b) - at;
+	uint8_t tmp[TWKB_VARINT_MAX];
+	size_t n = twkb_encode_uvarint(tmp, size);
+	bytebuffer_append(b, tmp, n);
+	if (b->error || b->flushed)
+		return;
+	memmove(b->buf_start + at + n, b->buf_start + at, size);
+	memcpy(b->buf_start + at, tmp, n);
+}
+
+static int
+twkb_is_empty(const LWGEOM *obj)
+{
+	return obj->type <= LINETYPE ? obj->npoints == 0 : obj->ngeoms == 0;
+}
+
+static void twkb_put_geom(twkb_writer *w, const LWGEOM *obj, const int64_t *ids);
+
+static void
+twkb_put_line(twkb_writer *w, const LWGEOM *obj)
+{
+	twkb_put_uvarint(w->b, obj->npoints);
+	twkb_put_points(w, obj);
+}
+
+static void
+twkb_put_poly(twkb_writer *w, const LWGEOM *obj)
+{
+	twkb_put_uvarint(w->b, obj->ngeoms);
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		twkb_put_line(w, obj->geoms[i]);
+}
+
+static void
+twkb_put_members(twkb_writer *w, const LWGEOM *obj, const int64_t *ids)
+{
+	// Empty points can not be written in a multi point, they are left out
+	uint32_t n = obj->ngeoms;
+	if (obj->type == MPOINTTYPE)
+	{
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+			n -= obj->geoms[i]->npoints == 0;
+	}
+	twkb_put_uvarint(w->b, n);
+	if (ids)
+	{
+		for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		{
+			if (obj->type != MPOINTTYPE || obj->geoms[i]->npoints)
+				twkb_put_uvarint(w->b, twkb_zigzag(ids[i]));
+		}
+	}
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		const LWGEOM *part = obj->geoms[i];
+		switch (obj->type)
+		{
+		case MPOINTTYPE:
+			twkb_put_points(w, part);
+			break;
+		case MLINETYPE:
+			twkb_put_line(w, part);
+			break;
+		case MPOLYTYPE:
+			twkb_put_poly(w, part);
+			break;
+		default:
+			twkb_put_geom(w, part, NULL);
+			break;
+		}
+	}
+}
+
+static void
+twkb_put_geom(twkb_writer *w, const LWGEOM *obj, const int64_t *ids)
+{
+	const lwgeom_twkb_options *opts = w->options;
+	int hasz = LWFLAGS_GET_Z(obj->flags) != 0;
+	int hasm = LWFLAGS_GET_M(obj->flags) != 0;
+	int empty = twkb_is_empty(obj);
+	uint8_t meta = empty ? TWKB_EMPTY : 0;
+	if (opts->variant & LWGEOM_TWKB_BBOX && !empty)
+		meta |= TWKB_BBOX;
+	if (opts->variant & LWGEOM_TWKB_SIZE)
+		meta |= TWKB_SIZE;
+	if (ids && obj->type >= MPOINTTYPE && !empty)
+		meta |= TWKB_IDLIST;
+	if (hasz || hasm)
+		meta |= TWKB_EXTENDED;
+
+	bytebuffer_append_byte(w->b, (uint8_t)(obj->type | (twkb_zigzag(opts->precision_xy) << 4)));
+	bytebuffer_append_byte(w->b, meta);
+	if (meta & TWKB_EXTENDED)
+	{
+		int pz = hasz ? opts->precision_z : 0;
+		int pm = hasm ? opts->precision_m : 0;
+		bytebuffer_append_byte(w->b, (uint8_t)(hasz | hasm << 1 | pz << 2 | pm << 5));
+	}
+	size_t at = bytebuffer_getlength(w->b);
+
+	// Each geometry of a collection has its own dimensions
+	w->ndims = 2 + hasz + hasm;
+	w->scale[0] = w->scale[1] = pow(10.0, opts->precision_xy);
+	w->scale[2] = pow(10.0, hasz ? opts->precision_z : opts->precision_m);
+	w->scale[3] = pow(10.0, opts->precision_m);
+	memset(w->last, 0, sizeof(w->last));
+
+	if (!empty)
+	{
+		if (meta & TWKB_BBOX)
+			twkb_put_bbox(w, obj);
+		switch (obj->type)
+		{
+		case POINTTYPE:
+			twkb_put_points(w, obj);
+			break;
+		case LINETYPE:
+			twkb_put_line(w, obj);
+			break;
+		case POLYTYPE:
+			twkb_put_poly(w, obj);
+			break;
+		default:
+			twkb_put_members(w, obj, meta & TWKB_IDLIST ? ids : NULL);
+			break;
+		}
+	}
+	if (meta & TWKB_SIZE)
+		twkb_insert_size(w->b, at);
+}
+
+static int
+twkb_write(const LWGEOM *obj, const lwgeom_twkb_options *options, bytebuffer_t *b)
+{
+	static const lwgeom_twkb_options defaults = {0, 0, 0, 0, NULL};
+	if (!options)
+		options = &defaults;
+	if (options->precision_xy < -8 || options->precision_xy > 7 || options->precision_z < 0 ||
+	    options->precision_z > 7 || options->precision_m < 0 || options->precision_m > 7)
+		return LW_FAILURE;
+	twkb_writer w;
+	memset(&w, 0, sizeof(w));
+	w.b = b;
+	w.options = options;
+	twkb_put_geom(&w, obj, options->ids);
+	return !w.error && !b->error;
+}
+
+/// @brief Write \a obj as TWKB, ordinates rounded to the precisions of
+/// \a options and written as zigzag varint deltas
+/// @param options precisions, variant and ids, NULL for whole units alone
+/// @param[out] twkb heap buffer owned by the caller
+/// @return LW_FAILURE for precisions out of range and ordinates too large
+/// for them, or when out of memory
+int
+lwgeom_write_twkb(const LWGEOM *obj, const lwgeom_twkb_options *options, char **twkb, size_t *len)
+{
+	assert(obj && twkb);
+	bytebuffer_t b;
+	bytebuffer_init(&b);
+	*twkb = NULL;
+	if (twkb_write(obj, options, &b))
+		*twkb = (char *)bytebuffer_release_buffer(&b, len);
+	bytebuffer_destroy_buffer(&b);
+	return *twkb ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief Write \a obj as TWKB into the caller's \a buf, nothing usable is
+/// written when it is too small
+/// @return the length of the TWKB, larger than \a size when it did not fit,
+/// 0 on failure, see lwgeom_write_twkb()
+size_t
+lwgeom_write_twkb_buf(const LWGEOM *obj, const lwgeom_twkb_options *options, char *buf, size_t size)
+{
+	assert(obj && (buf || size == 0));
+	bytebuffer_t b;
+	bytebuffer_init_fixed(&b, buf, size);
+	if (!twkb_write(obj, options, &b))
+		return 0;
+	return bytebuffer_getlength(&b);
+}
@@ -20,10 +20,268 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
 
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WKB_HOST_XDR 1
+#else
+#define WKB_HOST_XDR 0
+#endif
+
+typedef struct {
+	uint8_t *pos;
+	uint8_t variant;
+	int swap; ///< output byte order differs from the host
+} wkb_writer;
+
+/// Binary size of \a obj, walks the parts but never the coordinates
+static size_t
+wkb_size(const LWGEOM *obj)
+{
+	size_t psize = (size_t)lwgeom_dim_coordinate(obj) * sizeof(double);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		return 5 + psize;
+	case LINETYPE:
+		return 9 + obj->npoints * psize;
+	default:
+		break;
+	}
+	size_t size = 9;
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+		size += obj->type == POLYTYPE ? 4 + obj->geoms[i]->npoints * psize : wkb_size(obj->geoms[i]);
+	return size;
+}
+
+static inline void
+wkb_put_uint32(wkb_writer *w, uint32_t v)
+{
+	if (w->swap)
+		v = __builtin_bswap32(v);
+	memcpy(w->pos, &v, sizeof(v));
+	w->pos += sizeof(v);
+}
+
+static inline void
+wkb_put_doubles(wkb_writer *w, const double *pp, size_t n)
+{
+	if (w->swap)
+		lwgeom__bswap64_copy(w->pos, pp, n);
+	else
+		memcpy(w->pos, pp, n * sizeof(double));
+	w->pos += n * sizeof(double);
+}
+
+static void
+wkb_put_points(wkb_writer *w, const LWGEOM *obj)
+{
+	size_t cdim = (size_t)lwgeom_dim_coordinate(obj);
+	if (obj->npoints == 0)
+		return;
+	if (!LWFLAGS_GET_SOA(obj->flags) && !LWFLAGS_GET_QUANT(obj->flags))
+	{
+		wkb_put_doubles(w, obj->pp, obj->npoints * cdim);
+		return;
+	}
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		lwgeom_point_at(obj, (int)i, point);
+		wkb_put_doubles(w, point, cdim);
+	}
+}
+
+static void
+wkb_put_geom(wkb_writer *w, const LWGEOM *obj)
+{
+	int hasz = LWFLAGS_GET_Z(obj->flags);
+	int hasm = LWFLAGS_GET_M(obj->flags);
+	uint32_t type = obj->type;
+	if (w->variant & LWGEOM_WKB_EXTENDED)
+		type |= (hasz ? 0x80000000u : 0) | (hasm ? 0x40000000u : 0);
+	else
+		type += (hasz ? 1000 : 0) + (hasm ? 2000 : 0);
+	*w->pos++ = (w->variant & LWGEOM_WKB_XDR) ? 0 : 1;
+	wkb_put_uint32(w, type);
+
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		if (obj->npoints)
+			wkb_put_points(w, obj);
+		else
+		{
+			// POINT EMPTY is written with NaN ordinates
+			const double empty[4] = {NAN, NAN, NAN, NAN};
+			wkb_put_doubles(w, empty, (size_t)lwgeom_dim_coordinate(obj));
+		}
+		return;
+	case LINETYPE:
+		wkb_put_uint32(w, obj->npoints);
+		wkb_put_points(w, obj);
+		return;
+	default:
+		break;
+	}
+	wkb_put_uint32(w, obj->ngeoms);
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (obj->type == POLYTYPE)
+		{
+			wkb_put_uint32(w, obj->geoms[i]->npoints);
+			wkb_put_points(w, obj->geoms[i]);
+		}
+		else
+			wkb_put_geom(w, obj->geoms[i]);
+	}
+}
+
+/// Upper case hex of \a n bytes, 16 per iteration with SSE2. \a bin may be
+/// the second half of \a hex: every byte is read before being overwritten.
+static void
+wkb_hex_encode(const uint8_t *bin, size_t n, char *hex)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i alpha = _mm_set1_epi8('A' - '0' - 10);
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(bin + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+		__m128i a = _mm_unpacklo_epi8(hi, lo);
+		__m128i b = _mm_unpackhi_epi8(hi, lo);
+		a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+		b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+		_mm_storeu_si128((__m128i *)(hex + 2 * i), a);
+		_mm_storeu_si128((__m128i *)(hex + 2 * i + 16), b);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		uint8_t c = bin[i];
+		hex[2 * i] = digits[c >> 4];
+		hex[2 * i + 1] = digits[c & 0x0F];
+	}
+}
+
+/// Write \a obj of binary size \a size at \a out, which has room for the
+/// variant. Hex is staged in binary in the second half and encoded in place.
+static size_t
+wkb_write(const LWGEOM *obj, uint8_t variant, uint8_t *out, size_t size)
+{
+	int hex = (variant & LWGEOM_WKB_HEX) != 0;
+	wkb_writer w = {hex ? out + size : out, variant, ((variant & LWGEOM_WKB_XDR) != 0) != WKB_HOST_XDR};
+	wkb_put_geom(&w, obj);
+	assert(w.pos == (hex ? out + 2 * size : out + size));
+	if (!hex)
+		return size;
+	wkb_hex_encode(out + size, size, (char *)out);
+	return 2 * size;
+}
+
+/// @brief Exact length of \a obj written as WKB, computed from the part
+/// counts without allocating or touching the coordinates
+/// @param obj geometry
+/// @param variant LWGEOM_WKB_* flags
+/// @return the length in bytes, or in characters for hex without the NUL
+size_t
+lwgeom_wkb_size(const LWGEOM *obj, uint8_t variant)
+{
+	assert(obj);
+	size_t size = wkb_size(obj);
+	return (variant & LWGEOM_WKB_HEX) ? 2 * size : size;
+}
+
+/// @brief Write \a obj as WKB into caller memory, such as a network send
+/// buffer or a mapped file. Nothing is written when \a size is too small, a
+/// first call with a NULL buffer gives the exact size, as lwgeom_wkb_size().
+/// @param obj geometry
+/// @param variant LWGEOM_WKB_* flags, ISO little endian binary when 0
+/// @param buf output, may be NULL when \a size is 0
+/// @param size size of \a buf
+/// @return the length of the WKB, hex is not NUL terminated
+size_t
+lwgeom_write_wkb_buf(const LWGEOM *obj, uint8_t variant, char *buf, size_t size)
+{
+	assert(obj && (buf || size == 0));
+	size_t bsize = wkb_size(obj);
+	size_t len = (variant & LWGEOM_WKB_HEX) ? 2 * bsize : bsize;
+	if (len <= size)
+		wkb_write(obj, variant, (uint8_t *)buf, bsize);
+	return len;
+}
+
+/// @brief Write \a n geometries back to back as with lwgeom_write_wkb_buf(),
+/// all of them or none when \a size is too small
+/// @param objs geometries
+/// @param n number of geometries
+/// @param variant LWGEOM_WKB_* flags
+/// @param buf output, may be NULL when \a size is 0
+/// @param size size of \a buf
+/// @param offsets receives the n + 1 offsets of the geometries in \a buf,
+/// may be NULL
+/// @return the length of the whole output
+size_t
+lwgeom_write_wkb_batch(const LWGEOM *const *objs,
+		       uint32_t n,
+		       uint8_t variant,
+		       char *buf,
+		       size_t size,
+		       size_t *offsets)
+{
+	assert(objs && (buf || size == 0));
+	int hex = (variant & LWGEOM_WKB_HEX) != 0;
+	size_t len = 0;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (offsets)
+			offsets[i] = len;
+		len += hex ? 2 * wkb_size(objs[i]) : wkb_size(objs[i]);
+	}
+	if (offsets)
+		offsets[n] = len;
+	if (len > size)
+		return len;
+
+	uint8_t *out = (uint8_t *)buf;
+	for (uint32_t i = 0; i < n; ++i)
+		out += wkb_write(objs[i], variant, out, wkb_size(objs[i]));
+	return len;
+}
+
+/// @brief Write \a obj as ISO little endian WKB into a new buffer
+/// @param obj geometry
+/// @param hex write upper case hex instead of bytes
+/// @param wkb receives the output to release with lwfree(), NUL terminated
+/// @param len receives the length of \a wkb, may be NULL
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
 int
-lwgeom_write_wkb(const LWGEOM *g, int hex, char **data, size_t *len)
+lwgeom_write_wkb(const LWGEOM *obj, int hex, char **wkb, size_t *len)
 {
-	return 0;
+	assert(obj && wkb);
+	uint8_t variant = LWGEOM_WKB_ISO | (hex ? LWGEOM_WKB_HEX : 0);
+	size_t size = lwgeom_wkb_size(obj, variant);
+	*wkb = (char *)lwmalloc__cat(size + 1, LWGEOM_MEM_OTHER);
+	if (!*wkb)
+		return LW_FAILURE;
+	lwgeom_write_wkb_buf(obj, variant, *wkb, size);
+	(*wkb)[size] = '\0';
+	if (len)
+		*len = size;
+	return LW_SUCCESS;
 }
@@ -20,18 +20,139 @@
  * IN THE SOFTWARE.
  */
 
+
 #include "liblwgeom_internel.h"
+#include "bytebuffer.h"
 
 #include <string.h>
-#include <locale.h>
-
 #include <assert.h>
-#include <ctype.h>
 
 /* -------------------------------- inner wkt ------------------------------- */
 
+static const char *wkt_type_names[] = {
+    "", "POINT", "LINESTRING", "POLYGON", "MULTIPOINT", "MULTILINESTRING", "MULTIPOLYGON", "GEOMETRYCOLLECTION"};
+
+/// "(x y, x y)" of a point or line
+static void
+wkt_write_points(bytebuffer_t *b, const LWGEOM *obj, int precision)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	int direct = !LWFLAGS_GET_SOA(obj->flags) && !LWFLAGS_GET_QUANT(obj->flags);
+	bytebuffer_append_byte(b, '(');
+	for (uint32_t i = 0; i < obj->npoints; ++i)
+	{
+		double point[4];
+		const double *pp = point;
+		if (direct)
+			pp = obj->pp + (size_t)i * cdim;
+		else
+			lwgeom_point_at(obj, (int)i, point);
+		if (i)
+			bytebuffer_append_byte(b, ',');
+		for (int o = 0; o < cdim; ++o)
+		{
+			if (o)
+				bytebuffer_append_byte(b, ' ');
+			lwprint_double_append(b, pp[o], precision, LW_FALSE);
+		}
+	}
+	bytebuffer_append_byte(b, ')');
+}
+
+/// Body of \a obj, without its type when \a tagged is false
+static void
+wkt_write_geom(bytebuffer_t *b, const LWGEOM *obj, int precision, int tagged)
+{
+	if (tagged)
+	{
+		bytebuffer_append_string(b, obj->type <= COLLECTIONTYPE ? wkt_type_names[obj->type] : "");
+		if (LWFLAGS_GET_Z(obj->flags) && LWFLAGS_GET_M(obj->flags))
+			bytebuffer_append(b, " ZM", 3);
+		else if (LWFLAGS_GET_Z(obj->flags))
+			bytebuffer_append(b, " Z", 2);
+		else if (LWFLAGS_GET_M(obj->flags))
+			bytebuffer_append(b, " M", 2);
+		bytebuffer_append_byte(b, ' ');
+	}
+	if (obj->type == POINTTYPE || obj->type == LINETYPE)
+	{
+		if (obj->npoints == 0)
+			bytebuffer_append(b, "EMPTY", 5);
+		else
+			wkt_write_points(b, obj, precision);
+		return;
+	}
+	if (obj->ngeoms == 0)
+	{
+		bytebuffer_append(b, "EMPTY", 5);
+		return;
+	}
+	// Rings and the children of multi geometries go untagged
+	int tag_children = obj->type == COLLECTIONTYPE;
+	bytebuffer_append_byte(b, '(');
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
+	{
+		if (i)
+			bytebuffer_append_byte(b, ',');
+		wkt_write_geom(b, obj->geoms[i], precision, tag_children);
+	}
+	bytebuffer_append_byte(b, ')');
+}
+
+/* -------------------------------- output wkt ------------------------------ */
+
+/// @brief Write \a obj as ISO WKT, numbers with the shortest digits reading
+/// back to the same double
+/// @param obj geometry
+/// @param wkt receives a NUL terminated string to release with lwfree()
+/// @param len receives the length of \a wkt, may be NULL
+/// @return LW_SUCCESS or LW_FAILURE when out of memory
+int
+lwgeom_write_wkt(const LWGEOM *obj, char **wkt, size_t *len)
+{
+	assert(obj && wkt);
+	bytebuffer_t b;
+	bytebuffer_init(&b);
+	wkt_write_geom(&b, obj, -1, LW_TRUE);
+	*wkt = (char *)bytebuffer_release_buffer(&b, len);
+	bytebuffer_destroy_buffer(&b);
+	return *wkt ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief Write \a obj as WKT into caller memory, with the semantics of
+/// snprintf(): the output is truncated to \a size - 1 characters and NUL
+/// terminated, and the full length is returned. A first call with a NULL
+/// buffer gives the exact size to allocate.
+/// @param obj geometry
+/// @param precision maximum number of decimals, negative for round trip
+/// @param buf output, may be NULL when \a size is 0
+/// @param size size of \a buf
+/// @return the length of the WKT, without the NUL
+size_t
+lwgeom_write_wkt_buf(const LWGEOM *obj, int precision, char *buf, size_t size)
+{
+	assert(obj && (buf || size == 0));
+	bytebuffer_t b;
+	bytebuffer_init_fixed(&b, buf, size ? size - 1 : 0);
+	wkt_write_geom(&b, obj, precision, LW_TRUE);
+	if (size)
+		*b.writecursor = '\0';
+	return bytebuffer_getlength(&b);
+}
+
+/// @brief Stream \a obj as WKT to \a sink through a small fixed buffer, so
+/// that no string of the whole geometry is ever built
+/// @param obj geometry
+/// @param precision maximum number of decimals, negative for round trip
+/// @param sink receives the text in order, returns LW_FAILURE to stop
+/// @param arg passed to \a sink
+/// @return LW_SUCCESS or LW_FAILURE when \a sink failed
 int
-lwgeom_write_wkt(const LWGEOM *obj, char **data, size_t *len)
+lwgeom_write_wkt_sink(const LWGEOM *obj, int precision, lwgeom_sink sink, void *arg)
 {
-	return 0;
-}
\ No newline at end of file
+	assert(obj && sink);
+	bytebuffer_t b;
+	bytebuffer_init_sink(&b, sink, arg);
+	wkt_write_geom(&b, obj, precision, LW_TRUE);
+	return bytebuffer_flush(&b);
+}
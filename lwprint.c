@@ -0,0 +1,360 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "liblwgeom_internel.h"
+#include "bytebuffer.h"
+
+#include <math.h>
+#include <string.h>
+
+/*
+ * Shortest round trip formatting of doubles with Grisu2 (Florian Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * PLDI 2010). The digits always read back to the same double and are the
+ * shortest ones but in rare cases, without any big integer arithmetic.
+ */
+
+typedef struct {
+	uint64_t f;
+	int e;
+} lwprint_diyfp;
+
+typedef struct {
+	uint64_t f;
+	int e;
+	int k;
+} lwprint_cached_power;
+
+/* Normalized 10^k for k = -300, -292, ..., 324, rounded to 64 bits */
+static const lwprint_cached_power lwprint_cached_powers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300}, {0xFF77B1FCBEBCDC4F, -1034, -292}, {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},  {0xD3515C2831559A83, -954, -268},  {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},  {0xAECC49914078536D, -874, -244},  {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},  {0x9096EA6F3848984F, -794, -220},  {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},  {0xEF340A98172AACE5, -715, -196},  {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},  {0xC5DD44271AD3CDBA, -635, -172},  {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},  {0xA3AB66580D5FDAF6, -555, -148},  {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},  {0x87625F056C7C4A8B, -475, -124},  {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},  {0xDFF9772470297EBD, -396, -100},  {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},   {0xB94470938FA89BCF, -316, -76},   {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},   {0x993FE2C6D07B7FAC, -236, -52},   {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},   {0xFD87B5F28300CA0E, -157, -28},   {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},   {0xD1B71758E219652C, -77, -4},     {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},     {0xAD78EBC5AC620000, 3, 20},       {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},      {0x8F7E32CE7BEA5C70, 83, 44},      {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},     {0xED63A231D4C4FB27, 162, 68},     {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},     {0xC45D1DF942711D9A, 242, 92},     {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},    {0xA26DA3999AEF774A, 322, 116},    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},    {0x865B86925B9BC5C2, 402, 140},    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},    {0xDE469FBD99A05FE3, 481, 164},    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},    {0xB7DCBF5354E9BECE, 561, 188},    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},    {0x98165AF37B2153DF, 641, 212},    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},    {0xFB9B7CD9A4A7443C, 720, 236},    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},    {0xD01FEF10A657842C, 800, 260},    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},    {0xAC2820D9623BF429, 880, 284},    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},    {0x8E679C2F5E44FF8F, 960, 308},    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+};
+
+/* Binary exponent range of the scaled boundaries */
+#define LWPRINT_ALPHA -60
+#define LWPRINT_GAMMA -32
+
+static inline lwprint_diyfp
+lwprint__mul(lwprint_diyfp x, lwprint_diyfp y)
+{
+	uint64_t u_lo = x.f & 0xFFFFFFFFu, u_hi = x.f >> 32;
+	uint64_t v_lo = y.f & 0xFFFFFFFFu, v_hi = y.f >> 32;
+	uint64_t p0 = u_lo * v_lo, p1 = u_lo * v_hi, p2 = u_hi * v_lo, p3 = u_hi * v_hi;
+	uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu) + (UINT64_C(1) << 31);
+	lwprint_diyfp r = {p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64};
+	return r;
+}
+
+static inline lwprint_diyfp
+lwprint__normalize(lwprint_diyfp x)
+{
+	while (!(x.f >> 63))
+	{
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+/// Largest power of ten not above \a n, returns its number of digits
+static inline int
+lwprint__largest_pow10(uint32_t n, uint32_t *pow10)
+{
+	static const uint32_t pows[] = {
+	    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+	int k = 9;
+	while (k > 0 && n < pows[k])
+		k--;
+	*pow10 = pows[k];
+	return k + 1;
+}
+
+/// Move the last digit towards the value while it stays in the interval
+static inline void
+lwprint__round(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+{
+	while (rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+	{
+		buf[len - 1]--;
+		rest += ten_k;
+	}
+}
+
+/// Digits of the shortest decimal in (m_minus, m_plus), closest to w
+static void
+lwprint__digit_gen(char *buf, int *len, int *exp10, lwprint_diyfp m_minus, lwprint_diyfp w, lwprint_diyfp m_plus)
+{
+	uint64_t delta = m_plus.f - m_minus.f;
+	uint64_t dist = m_plus.f - w.f;
+	lwprint_diyfp one = {UINT64_C(1) << -m_plus.e, m_plus.e};
+	uint32_t p1 = (uint32_t)(m_plus.f >> -one.e);
+	uint64_t p2 = m_plus.f & (one.f - 1);
+
+	uint32_t pow10;
+	int n = lwprint__largest_pow10(p1, &pow10);
+	while (n > 0)
+	{
+		uint32_t d = p1 / pow10;
+		p1 %= pow10;
+		buf[(*len)++] = (char)('0' + d);
+		n--;
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta)
+		{
+			*exp10 += n;
+			lwprint__round(buf, *len, dist, delta, rest, (uint64_t)pow10 << -one.e);
+			return;
+		}
+		pow10 /= 10;
+	}
+	int m = 0;
+	for (;;)
+	{
+		p2 *= 10;
+		buf[(*len)++] = (char)('0' + (p2 >> -one.e));
+		p2 &= one.f - 1;
+		m++;
+		delta *= 10;
+		dist *= 10;
+		if (p2 <= delta)
+			break;
+	}
+	*exp10 -= m;
+	lwprint__round(buf, *len, dist, delta, p2, one.f);
+}
+
+/// Shortest digits of a finite positive \a v, v = digits * 10^exp10
+static int
+lwprint__grisu2(double v, char *buf, int *exp10)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	uint64_t F = bits & ((UINT64_C(1) << 52) - 1);
+	int E = (int)(bits >> 52);
+	lwprint_diyfp w = E ? (lwprint_diyfp){F + (UINT64_C(1) << 52), E - 1075} : (lwprint_diyfp){F, -1074};
+
+	// Boundaries of the values rounding to v, the lower one is closer at a
+	// power of two
+	lwprint_diyfp m_plus = lwprint__normalize((lwprint_diyfp){2 * w.f + 1, w.e - 1});
+	lwprint_diyfp m_minus =
+	    (F == 0 && E > 1) ? (lwprint_diyfp){4 * w.f - 1, w.e - 2} : (lwprint_diyfp){2 * w.f - 1, w.e - 1};
+	m_minus.f <<= m_minus.e - m_plus.e;
+	m_minus.e = m_plus.e;
+	w = lwprint__normalize(w);
+
+	// Scale by a cached power of ten into [alpha, gamma]
+	int f = LWPRINT_ALPHA - m_plus.e - 1;
+	int k = (f * 78913) / (1 << 18) + (f > 0);
+	const lwprint_cached_power *c = &lwprint_cached_powers[(300 + k + 7) / 8];
+	lwprint_diyfp ck = {c->f, c->e};
+	lwprint_diyfp sw = lwprint__mul(w, ck);
+	lwprint_diyfp sminus = lwprint__mul(m_minus, ck);
+	lwprint_diyfp splus = lwprint__mul(m_plus, ck);
+	sminus.f++;
+	splus.f--;
+
+	int len = 0;
+	*exp10 = -c->k;
+	lwprint__digit_gen(buf, &len, exp10, sminus, sw, splus);
+	return len;
+}
+
+/// Round the digits to \a precision decimals, half up, and drop trailing zeros
+static int
+lwprint__round_digits(char *digits, int len, int *exp10, int precision)
+{
+	if (precision >= 0 && -*exp10 > precision)
+	{
+		int keep = len + *exp10 + precision;
+		if (keep < 0 || (keep == 0 && digits[0] < '5'))
+			return 0;
+		if (keep == 0)
+		{
+			digits[0] = '1';
+			*exp10 = -precision;
+			return 1;
+		}
+		int up = digits[keep] >= '5';
+		*exp10 = -precision;
+		len = keep;
+		for (int i = len - 1; up && i >= 0; --i)
+		{
+			up = digits[i] == '9';
+			digits[i] = up ? '0' : (char)(digits[i] + 1);
+		}
+		if (up)
+		{
+			// 99.9 became 100
+			digits[0] = '1';
+			len = 1;
+			*exp10 += keep;
+		}
+	}
+	while (len > 1 && digits[len - 1] == '0')
+	{
+		len--;
+		(*exp10)++;
+	}
+	return digits[0] == '0' ? 0 : len;
+}
+
+/// @brief Format \a d with the shortest digits reading back to it, or
+/// rounded to \a precision decimals, trailing zeros removed. Locale
+/// independent: the decimal point is always '.'. Exponent notation is used
+/// below 1e-4 and from 1e17.
+/// @param d value
+/// @param precision maximum number of decimals, negative for round trip
+/// @param buf output, LWPRINT_BUFSIZE bytes, not NUL terminated
+/// @return the number of characters written
+int
+lwprint_double(double d, int precision, char *buf)
+{
+	char *p = buf;
+	if (isnan(d))
+	{
+		memcpy(buf, "NaN", 3);
+		return 3;
+	}
+	if (signbit(d))
+	{
+		*p++ = '-';
+		d = -d;
+	}
+	if (isinf(d))
+	{
+		memcpy(p, "Infinity", 8);
+		return (int)(p - buf) + 8;
+	}
+	char digits[20];
+	int exp10 = 0;
+	int len = d == 0.0 ? 0 : lwprint__grisu2(d, digits, &exp10);
+	len = len ? lwprint__round_digits(digits, len, &exp10, precision) : 0;
+	if (!len)
+	{
+		// Zero keeps its sign only when it is a true -0
+		if (d != 0.0)
+			p = buf;
+		*p++ = '0';
+		return (int)(p - buf);
+	}
+
+	// Position of the decimal point relative to the first digit
+	int k = len + exp10;
+	if (k > 0 && k <= 17)
+	{
+		if (exp10 >= 0)
+		{
+			memcpy(p, digits, (size_t)len);
+			memset(p + len, '0', (size_t)exp10);
+			p += k;
+		}
+		else
+		{
+			memcpy(p, digits, (size_t)k);
+			p[k] = '.';
+			memcpy(p + k + 1, digits + k, (size_t)(len - k));
+			p += len + 1;
+		}
+	}
+	else if (k <= 0 && k > -4)
+	{
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', (size_t)-k);
+		memcpy(p - k, digits, (size_t)len);
+		p += len - k;
+	}
+	else
+	{
+		*p++ = digits[0];
+		if (len > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, (size_t)(len - 1));
+			p += len - 1;
+		}
+		int x = k - 1;
+		*p++ = 'e';
+		if (x < 0)
+		{
+			*p++ = '-';
+			x = -x;
+		}
+		if (x >= 100)
+			*p++ = (char)('0' + x / 100);
+		if (x >= 10)
+			*p++ = (char)('0' + x / 10 % 10);
+		*p++ = (char)('0' + x % 10);
+	}
+	return (int)(p - buf);
+}
+
+/// @brief Append \a d as lwprint_double() formats it
+/// @param b output buffer
+/// @param d value
+/// @param precision maximum number of decimals, negative for round trip
+/// @param finite for formats without NaN nor infinity, such a \a d then
+/// sets the error of \a b rather than producing text no parser reads back
+void
+lwprint_double_append(bytebuffer_t *b, double d, int precision, int finite)
+{
+	if (finite && !isfinite(d))
+	{
+		b->error = LW_TRUE;
+		return;
+	}
+	// Format in place when there is room, through a copy otherwise
+	if (bytebuffer_reserve(b, LWPRINT_BUFSIZE))
+		b->writecursor += lwprint_double(d, precision, (char *)b->writecursor);
+	else
+	{
+		char buf[LWPRINT_BUFSIZE];
+		bytebuffer_append(b, buf, (size_t)lwprint_double(d, precision, buf));
+	}
+}
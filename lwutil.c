@@ -20,14 +20,25 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
-
-#include "lwgeom_log.h"
+#include <assert.h>
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #define LWGEOM_DEBUG_LEVEL 1
 
@@ -49,6 +60,12 @@ lwreporter lwerror_var = default_errorreporter;
 static void default_debuglogger(int level, const char *fmt, va_list ap) __attribute__((format(printf, 2, 0)));
 lwdebuglogger lwdebug_var = default_debuglogger;
 
+/* Default tolerance */
+static double lwtolerance_var = 0.0001;
+
+/* Context of the calling thread, NULL uses the globals above */
+static LW_THREAD_LOCAL lwgeom_ctx *lwctx_var = NULL;
+
 #define LW_MSG_MAXLEN 256
 
 static char *lwgeomTypeName[] = {"Unknown",
@@ -174,6 +191,58 @@ lwgeom_set_debuglogger(lwdebuglogger debuglogger)
 		lwdebug_var = debuglogger;
 }
 
+/**
+ * Fill \a ctx with the global handlers and tolerance, so that callers only
+ * override what they need before installing it with lwgeom_ctx_set().
+ */
+void
+lwgeom_ctx_init(lwgeom_ctx *ctx)
+{
+	ctx->allocator = lwalloc_var;
+	ctx->reallocator = lwrealloc_var;
+	ctx->freeor = lwfree_var;
+	ctx->errorreporter = lwerror_var;
+	ctx->noticereporter = lwnotice_var;
+	ctx->tolerance = lwtolerance_var;
+}
+
+/**
+ * Install \a ctx for the calling thread and return the previous one, so it
+ * can be restored once the work done under \a ctx is over. NULL goes back to
+ * the global handlers. The context is not copied and has to stay alive
+ * while installed.
+ */
+lwgeom_ctx *
+lwgeom_ctx_set(lwgeom_ctx *ctx)
+{
+	lwgeom_ctx *prev = lwctx_var;
+	lwctx_var = ctx;
+	return prev;
+}
+
+lwgeom_ctx *
+lwgeom_ctx_get(void)
+{
+	return lwctx_var;
+}
+
+/// Set the tolerance used in geometric operations. This interface returns the
+/// tolerance currently in use.
+double
+lwtolerance(double tol)
+{
+	double *var = lwctx_var ? &lwctx_var->tolerance : &lwtolerance_var;
+	double tmp = *var;
+	*var = tol;
+	return tmp;
+}
+
+double
+lwtolerance2()
+{
+	return lwctx_var ? lwctx_var->tolerance : lwtolerance_var;
+}
+
 void
 lwnotice(const char *fmt, ...)
 {
@@ -182,7 +251,10 @@ lwnotice(const char *fmt, ...)
 	va_start(ap, fmt);
 
 	/* Call the supplied function */
-	(*lwnotice_var)(fmt, ap);
+	if (lwctx_var && lwctx_var->noticereporter)
+		(*lwctx_var->noticereporter)(fmt, ap);
+	else
+		(*lwnotice_var)(fmt, ap);
 
 	va_end(ap);
 }
@@ -195,7 +267,10 @@ lwerror(const char *fmt, ...)
 	va_start(ap, fmt);
 
 	/* Call the supplied function */
-	(*lwerror_var)(fmt, ap);
+	if (lwctx_var && lwctx_var->errorreporter)
+		(*lwctx_var->errorreporter)(fmt, ap);
+	else
+		(*lwerror_var)(fmt, ap);
 
 	va_end(ap);
 }
@@ -224,31 +299,510 @@ lwtype_name(uint8_t type)
 	return lwgeomTypeName[(int)type];
 }
 
+static inline void *
+lwmalloc__raw(size_t size)
+{
+	lwgeom_ctx *ctx = lwctx_var;
+	return (ctx && ctx->allocator) ? ctx->allocator(size) : lwalloc_var(size);
+}
+
+static inline void *
+lwrealloc__raw(void *mem, size_t size)
+{
+	lwgeom_ctx *ctx = lwctx_var;
+	if (ctx && ctx->reallocator)
+		return ctx->reallocator(mem, size);
+	return lwrealloc_var(mem, size);
+}
+
+static inline void
+lwfree__raw(void *mem)
+{
+	lwgeom_ctx *ctx = lwctx_var;
+	if (ctx && ctx->freeor)
+		ctx->freeor(mem);
+	else
+		lwfree_var(mem);
+}
+
+#ifdef LWGEOM_MEMORY_ACCOUNTING
+
+/// Every accounted block is prefixed with its size and category, the 16
+/// bytes keep the payload aligned like malloc does.
+typedef struct {
+	size_t size;
+	uint32_t cat;
+	uint32_t magic;
+} lwmem_hdr;
+
+#define LWMEM_MAGIC 0x4c574d4du
+
+static size_t lwmem_live = 0;
+static size_t lwmem_peak = 0;
+static uint64_t lwmem_allocs = 0;
+static uint64_t lwmem_frees = 0;
+static lwgeom_mem_category_stats lwmem_categories[LWGEOM_MEM_NCATEGORIES];
+
+static void
+lwmem__account(uint32_t cat, size_t size)
+{
+	size_t live = __atomic_add_fetch(&lwmem_live, size, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&lwmem_peak, __ATOMIC_RELAXED);
+	while (live > peak &&
+	       !__atomic_compare_exchange_n(&lwmem_peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	__atomic_add_fetch(&lwmem_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lwmem_categories[cat].live_bytes, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lwmem_categories[cat].live_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lwmem_categories[cat].allocs, 1, __ATOMIC_RELAXED);
+}
+
+static void
+lwmem__unaccount(uint32_t cat, size_t size)
+{
+	__atomic_sub_fetch(&lwmem_live, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lwmem_frees, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&lwmem_categories[cat].live_bytes, size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&lwmem_categories[cat].live_count, 1, __ATOMIC_RELAXED);
+}
+
+void *
+lwmalloc__cat(size_t size, lwgeom_mem_category cat)
+{
+	lwmem_hdr *hdr = (lwmem_hdr *)lwmalloc__raw(sizeof(lwmem_hdr) + size);
+	if (!hdr)
+		return NULL;
+	hdr->size = size;
+	hdr->cat = (uint32_t)cat;
+	hdr->magic = LWMEM_MAGIC;
+	lwmem__account(hdr->cat, size);
+	return hdr + 1;
+}
+
+void *
+lwrealloc__cat(void *mem, size_t size, lwgeom_mem_category cat)
+{
+	if (!mem)
+		return lwmalloc__cat(size, cat);
+	lwmem_hdr *hdr = (lwmem_hdr *)mem - 1;
+	assert(hdr->magic == LWMEM_MAGIC);
+	size_t oldsize = hdr->size;
+	uint32_t oldcat = hdr->cat;
+	hdr = (lwmem_hdr *)lwrealloc__raw(hdr, sizeof(lwmem_hdr) + size);
+	if (!hdr)
+		return NULL;
+	lwmem__unaccount(oldcat, oldsize);
+	hdr->size = size;
+	hdr->cat = (uint32_t)cat;
+	lwmem__account(hdr->cat, size);
+	return hdr + 1;
+}
+
+void
+lwfree(void *mem)
+{
+	if (!mem)
+		return;
+	lwmem_hdr *hdr = (lwmem_hdr *)mem - 1;
+	assert(hdr->magic == LWMEM_MAGIC);
+	hdr->magic = 0;
+	lwmem__unaccount(hdr->cat, hdr->size);
+	lwfree__raw(hdr);
+}
+
+/// @brief Take a snapshot of the allocation counters
+/// @param stats filled with the counters
+/// @return LW_SUCCESS, LW_FAILURE when built without LWGEOM_MEMORY_ACCOUNTING
+int
+lwgeom_mem_stats_get(lwgeom_mem_stats *stats)
+{
+	stats->live_bytes = __atomic_load_n(&lwmem_live, __ATOMIC_RELAXED);
+	stats->peak_bytes = __atomic_load_n(&lwmem_peak, __ATOMIC_RELAXED);
+	stats->allocs = __atomic_load_n(&lwmem_allocs, __ATOMIC_RELAXED);
+	stats->frees = __atomic_load_n(&lwmem_frees, __ATOMIC_RELAXED);
+	for (int i = 0; i < LWGEOM_MEM_NCATEGORIES; i++)
+	{
+		stats->categories[i].live_bytes = __atomic_load_n(&lwmem_categories[i].live_bytes, __ATOMIC_RELAXED);
+		stats->categories[i].live_count = __atomic_load_n(&lwmem_categories[i].live_count, __ATOMIC_RELAXED);
+		stats->categories[i].allocs = __atomic_load_n(&lwmem_categories[i].allocs, __ATOMIC_RELAXED);
+	}
+	return LW_SUCCESS;
+}
+
+/// Restart the peak from the live bytes and zero the allocation counts.
+/// Live bytes and counts describe memory still held and are kept.
+void
+lwgeom_mem_stats_reset(void)
+{
+	__atomic_store_n(&lwmem_peak, __atomic_load_n(&lwmem_live, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_store_n(&lwmem_allocs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&lwmem_frees, 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < LWGEOM_MEM_NCATEGORIES; i++)
+		__atomic_store_n(&lwmem_categories[i].allocs, 0, __ATOMIC_RELAXED);
+}
+
+#else
+
+void *
+lwmalloc__cat(size_t size, lwgeom_mem_category cat)
+{
+	(void)cat;
+	return lwmalloc__raw(size);
+}
+
+void *
+lwrealloc__cat(void *mem, size_t size, lwgeom_mem_category cat)
+{
+	(void)cat;
+	return lwrealloc__raw(mem, size);
+}
+
+void
+lwfree(void *mem)
+{
+	if (mem)
+		lwfree__raw(mem);
+}
+
+int
+lwgeom_mem_stats_get(lwgeom_mem_stats *stats)
+{
+	memset(stats, 0, sizeof(lwgeom_mem_stats));
+	return LW_FAILURE;
+}
+
+void
+lwgeom_mem_stats_reset(void)
+{
+}
+
+#endif /* LWGEOM_MEMORY_ACCOUNTING */
+
+const char *
+lwgeom_mem_category_name(lwgeom_mem_category cat)
+{
+	static const char *names[LWGEOM_MEM_NCATEGORIES] = {
+	    "other", "geometry", "coordinates", "index", "parser", "arena"};
+	if ((int)cat < 0 || cat >= LWGEOM_MEM_NCATEGORIES)
+		return "invalid";
+	return names[cat];
+}
+
 void *
 lwmalloc(size_t size)
 {
-	void *mem = lwalloc_var(size);
-	return mem;
+	return lwmalloc__cat(size, LWGEOM_MEM_OTHER);
 }
 
 void *
 lwmalloc0(size_t size)
 {
-	void *mem = lwalloc_var(size);
-	memset(mem, 0, size);
+	void *mem = lwmalloc(size);
+	if (mem)
+		memset(mem, 0, size);
 	return mem;
 }
 
+void *
+lwcalloc(size_t count, size_t size)
+{
+	return lwmalloc0(count * size);
+}
+
+/// Resize \a mem, a block allocated with lwmalloc keeps its category
 void *
 lwrealloc(void *mem, size_t size)
 {
-	return lwrealloc_var(mem, size);
+#ifdef LWGEOM_MEMORY_ACCOUNTING
+	if (mem)
+		return lwrealloc__cat(mem, size, (lwgeom_mem_category)((lwmem_hdr *)mem - 1)->cat);
+#endif
+	return lwrealloc__cat(mem, size, LWGEOM_MEM_OTHER);
+}
+
+/// Smallest power of two not less than \a v, 1 for 0
+size_t
+lw_nearest_pow(size_t v)
+{
+	size_t p = 1;
+	while (p < v)
+		p <<= 1;
+	return p;
+}
+
+/// @brief Grow \a *mem of \a *capacity elements of \a size bytes to hold
+/// \a need, doubling the capacity from 64 elements
+/// @return LW_SUCCESS or LW_FAILURE when out of memory, \a *mem is kept then
+int
+lwgeom__reserve(void **mem, size_t *capacity, size_t need, size_t size, lwgeom_mem_category cat)
+{
+	if (need <= *capacity)
+		return LW_SUCCESS;
+	if (need > SIZE_MAX / 2 / size)
+		return LW_FAILURE;
+	size_t grow = *capacity ? *capacity : 64;
+	while (grow < need)
+		grow *= 2;
+	void *p = lwrealloc__cat(*mem, grow * size, cat);
+	if (!p)
+		return LW_FAILURE;
+	*mem = p;
+	*capacity = grow;
+	return LW_SUCCESS;
 }
 
+/* ------------------------------ reader input ------------------------------ */
+
+/// @brief Input pulled from \a source in blocks of \a block bytes
+/// @return LW_FAILURE when out of memory
+int
+lwgeom__input_init(lwgeom_input *in, lwgeom_source source, void *arg, size_t block)
+{
+	memset(in, 0, sizeof(*in));
+	in->source = source;
+	in->arg = arg;
+	in->buf = (char *)lwmalloc__cat(block, LWGEOM_MEM_PARSER);
+	in->capacity = block;
+	return in->buf ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief Input over \a data, which must outlive it and is read in place
 void
-lwfree(void *mem)
+lwgeom__input_init_mem(lwgeom_input *in, const char *data, size_t len)
 {
-	lwfree_var(mem);
+	memset(in, 0, sizeof(*in));
+	in->buf = (char *)data;
+	in->len = in->capacity = len;
+	in->borrowed = LW_TRUE;
+	in->eof = LW_TRUE;
+}
+
+static size_t
+lwgeom__read_file(char *buf, size_t size, void *arg)
+{
+	return fread(buf, 1, size, (FILE *)arg);
+}
+
+/// @brief Input read from the file at \a path, see lwgeom__input_init()
+/// @return LW_FAILURE when the file can not be opened or out of memory
+int
+lwgeom__input_open(lwgeom_input *in, const char *path, size_t block)
+{
+	memset(in, 0, sizeof(*in));
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return LW_FAILURE;
+	if (!lwgeom__input_init(in, lwgeom__read_file, file, block))
+	{
+		fclose(file);
+		return LW_FAILURE;
+	}
+	in->file = file;
+	return LW_SUCCESS;
+}
+
+/// @brief Pull more input behind the bytes in use, moved to the front
+/// first, so that begin is 0 once it returns
+/// @return LW_FAILURE at the end of the input or out of memory
+int
+lwgeom__input_fill(lwgeom_input *in)
+{
+	if (in->eof)
+		return LW_FAILURE;
+	if (in->begin)
+	{
+		memmove(in->buf, in->buf + in->begin, in->len - in->begin);
+		in->len -= in->begin;
+		in->begin = 0;
+	}
+	if (in->len == in->capacity)
+	{
+		size_t capacity = in->capacity * 2;
+		char *buf = (char *)lwrealloc__cat(in->buf, capacity, LWGEOM_MEM_PARSER);
+		if (!buf)
+			return LW_FAILURE;
+		in->buf = buf;
+		in->capacity = capacity;
+	}
+	size_t n = in->source(in->buf + in->len, in->capacity - in->len, in->arg);
+	in->len += n;
+	in->eof = n == 0;
+	return n > 0;
+}
+
+void
+lwgeom__input_destroy(lwgeom_input *in)
+{
+	if (in->file)
+		fclose(in->file);
+	if (!in->borrowed)
+		lwfree(in->buf);
+	in->buf = NULL;
+	in->file = NULL;
+}
+
+/* Powers of ten exactly representable as a double */
+static const double lw__pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+				   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static int
+lw__is_digit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+/// Case insensitive match of the lower case \a word at \a s
+static int
+lw__match_nocase(const char *s, const char *end, const char *word)
+{
+	for (; *word; ++s, ++word)
+	{
+		if (s == end || (*s | 0x20) != *word)
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+/// strtod() of [s, end) with a '.' decimal point whatever the locale
+static const char *
+lw__parse_double_slow(const char *s, const char *end, double *out)
+{
+	const char *point = localeconv()->decimal_point;
+	size_t plen = strlen(point);
+	size_t len = (size_t)(end - s);
+	char local[64];
+	char *buf = len + plen < sizeof(local) ? local : (char *)lwmalloc__cat(len + plen + 1, LWGEOM_MEM_PARSER);
+	if (!buf)
+		return NULL;
+	size_t n = 0;
+	for (const char *p = s; p < end; ++p)
+	{
+		if (*p == '.')
+		{
+			memcpy(buf + n, point, plen);
+			n += plen;
+		}
+		else
+			buf[n++] = *p;
+	}
+	buf[n] = '\0';
+	char *stop;
+	*out = strtod(buf, &stop);
+	int ok = stop == buf + n;
+	if (buf != local)
+		lwfree(buf);
+	return ok ? end : NULL;
+}
+
+/// @brief Parse a decimal number, [+-]digits[.digits][(e|E)[+-]digits],
+/// inf, infinity or nan, correctly rounded and whatever the locale.
+/// Up to 19 significant digits are gathered in an integer, which converts
+/// exactly with one rounding when it fits a double mantissa and the power of
+/// ten is exact (Clinger's fast path). Other numbers go through strtod().
+/// @param s first character
+/// @param end end of the input
+/// @param out receives the value
+/// @return the first character after the number, NULL when there is none
+const char *
+lwgeom__parse_double(const char *s, const char *end, double *out)
+{
+	const char *p = s;
+	int neg = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+'))
+		++p;
+
+	uint64_t mant = 0;
+	int ndigits = 0;
+	int exp10 = 0;
+	int truncated = LW_FALSE;
+	const char *digits = p;
+	for (; p < end && lw__is_digit(*p); ++p)
+	{
+		if (ndigits < 19)
+		{
+			mant = mant * 10 + (uint64_t)(*p - '0');
+			ndigits += mant != 0;
+		}
+		else
+		{
+			++exp10;
+			truncated |= *p != '0';
+		}
+	}
+	size_t ndigit_chars = (size_t)(p - digits);
+	if (p < end && *p == '.')
+	{
+		const char *frac = ++p;
+		for (; p < end && lw__is_digit(*p); ++p)
+		{
+			if (ndigits < 19)
+			{
+				mant = mant * 10 + (uint64_t)(*p - '0');
+				ndigits += mant != 0;
+				--exp10;
+			}
+			else
+				truncated |= *p != '0';
+		}
+		ndigit_chars += (size_t)(p - frac);
+	}
+	if (!ndigit_chars)
+	{
+		if (lw__match_nocase(digits, end, "infinity") || lw__match_nocase(digits, end, "inf"))
+		{
+			*out = neg ? -HUGE_VAL : HUGE_VAL;
+			return digits + (lw__match_nocase(digits, end, "infinity") ? 8 : 3);
+		}
+		if (lw__match_nocase(digits, end, "nan"))
+		{
+			*out = neg ? -NAN : NAN;
+			return digits + 3;
+		}
+		return NULL;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *e = p + 1;
+		int eneg = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+'))
+			++e;
+		if (e < end && lw__is_digit(*e))
+		{
+			int ev = 0;
+			for (; e < end && lw__is_digit(*e); ++e)
+			{
+				if (ev < 100000)
+					ev = ev * 10 + (*e - '0');
+			}
+			exp10 += eneg ? -ev : ev;
+			p = e;
+		}
+	}
+
+	if (!mant)
+	{
+		*out = neg ? -0.0 : 0.0;
+		return p;
+	}
+#if FLT_EVAL_METHOD == 0
+	if (!truncated && mant <= (UINT64_C(1) << 53))
+	{
+		// A large power of ten may be split, moving digits into the mantissa
+		while (exp10 > 22 && mant * 10 <= (UINT64_C(1) << 53))
+		{
+			mant *= 10;
+			--exp10;
+		}
+		if (exp10 >= -22 && exp10 <= 22)
+		{
+			double v = (double)mant;
+			v = exp10 < 0 ? v / lw__pow10[-exp10] : v * lw__pow10[exp10];
+			*out = neg ? -v : v;
+			return p;
+		}
+	}
+#endif
+	return lw__parse_double_slow(s, p, out);
 }
 
 char *
@@ -336,3 +890,43 @@ lwmessage_truncate(char *str, int startpos, int endpos, int maxlength, int trunc
 
 	return output;
 }
+
+/// @brief Copy \a n 8 bytes words from \a src to \a dst reversing their
+/// bytes, for WKB in the other byte order. Neither pointer needs alignment.
+/// @param dst output, does not overlap \a src
+/// @param src input
+/// @param n number of words
+void
+lwgeom__bswap64_copy(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const __m128i rev = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 8));
+		_mm_storeu_si128((__m128i *)(d + i * 8), _mm_shuffle_epi8(v, rev));
+	}
+#elif defined(__SSE2__)
+	// Swap the bytes of each 16-bit word, then reverse the words of each half
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 8));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+		_mm_storeu_si128((__m128i *)(d + i * 8), v);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 2 <= n; i += 2)
+		vst1q_u8(d + i * 8, vrev64q_u8(vld1q_u8(s + i * 8)));
+#endif
+	for (; i < n; ++i)
+	{
+		uint64_t v;
+		memcpy(&v, s + i * 8, sizeof(v));
+		v = __builtin_bswap64(v);
+		memcpy(d + i * 8, &v, sizeof(v));
+	}
+}
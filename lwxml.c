@@ -0,0 +1,995 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwxml.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+/* Input is pulled in blocks of this size, the buffer grows past it only for larger tokens */
+#define LWXML_BLOCK_SIZE (64 * 1024)
+/* Nesting of geometries in collections */
+#define LWXML_MAX_DEPTH 32
+
+/* ------------------------------- tokenizer -------------------------------- */
+
+/// Pull more input behind the current token, moved to the front first
+static int
+xml_fill(lwxml_reader *x)
+{
+	size_t shift = x->in.begin;
+	int ok = lwgeom__input_fill(&x->in);
+	x->next -= shift - x->in.begin;
+	return ok;
+}
+
+/// At least \a n bytes from begin
+static int
+xml_have(lwxml_reader *x, size_t n)
+{
+	while (x->in.len - x->in.begin < n)
+	{
+		if (!xml_fill(x))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+/// Offset from begin of \a pat at or after \a from, pulling input as needed
+static int
+xml_find(lwxml_reader *x, size_t from, const char *pat, size_t *at)
+{
+	size_t n = strlen(pat);
+	for (;;)
+	{
+		const char *base = x->in.buf + x->in.begin;
+		size_t avail = x->in.len - x->in.begin;
+		while (from + n <= avail)
+		{
+			const char *p = (const char *)memchr(base + from, pat[0], avail - from - n + 1);
+			if (!p)
+			{
+				from = avail - n + 1;
+				break;
+			}
+			if (memcmp(p, pat, n) == 0)
+			{
+				*at = (size_t)(p - base);
+				return LW_SUCCESS;
+			}
+			from = (size_t)(p - base) + 1;
+		}
+		if (!xml_fill(x))
+			return LW_FAILURE;
+	}
+}
+
+/// Offset from begin of the '>' closing the tag at begin, quoted values may hold one
+static int
+xml_find_tag_end(lwxml_reader *x, size_t *at)
+{
+	size_t i = 1;
+	char quote = 0;
+	for (;;)
+	{
+		const char *base = x->in.buf + x->in.begin;
+		size_t avail = x->in.len - x->in.begin;
+		for (; i < avail; ++i)
+		{
+			char c = base[i];
+			if (quote)
+			{
+				if (c == quote)
+					quote = 0;
+			}
+			else if (c == '"' || c == '\'')
+				quote = c;
+			else if (c == '>')
+			{
+				*at = i;
+				return LW_SUCCESS;
+			}
+		}
+		if (!xml_fill(x))
+			return LW_FAILURE;
+	}
+}
+
+static inline int
+xml_is_blank(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/// Local name, without its prefix, at the start of [s, end)
+static void
+xml_set_name(lwxml_reader *x, const char *s, const char *end)
+{
+	const char *e = s;
+	while (e < end && !xml_is_blank(*e) && *e != '/')
+		e++;
+	const char *colon = (const char *)memchr(s, ':', (size_t)(e - s));
+	x->name = colon ? colon + 1 : s;
+	x->name_len = (size_t)(e - x->name);
+	x->attrs = e;
+	x->attrs_len = (size_t)(end - e);
+}
+
+static lwxml_token
+xml_error(lwxml_reader *x)
+{
+	return x->token = LWXML_ERROR;
+}
+
+/// @brief Next token of the input
+/// @return the token, LWXML_ERROR for malformed or truncated input, which
+/// every later call returns as well
+lwxml_token
+lwxml_next(lwxml_reader *x)
+{
+	if (x->token == LWXML_ERROR || x->token == LWXML_EOF)
+		return x->token;
+	if (x->pending_end)
+	{
+		x->pending_end = LW_FALSE;
+		x->depth--;
+		return x->token = LWXML_END;
+	}
+	x->in.begin = x->next;
+	for (;;)
+	{
+		if (x->in.begin == x->in.len && !xml_fill(x))
+			return x->token = x->in.eof && x->depth == 0 ? LWXML_EOF : LWXML_ERROR;
+		size_t at;
+		if (x->in.buf[x->in.begin] != '<')
+		{
+			// Character data up to the next tag, or to the end of the input
+			if (!xml_find(x, 0, "<", &at))
+			{
+				if (!x->in.eof)
+					return xml_error(x);
+				at = x->in.len - x->in.begin;
+			}
+			const char *p = x->in.buf + x->in.begin;
+			x->next = x->in.begin + at;
+			size_t i = 0;
+			while (i < at && xml_is_blank(p[i]))
+				i++;
+			if (i == at)
+			{
+				x->in.begin = x->next;
+				continue;
+			}
+			x->text = p;
+			x->text_len = at;
+			return x->token = LWXML_TEXT;
+		}
+
+		if (!xml_have(x, 2))
+			return xml_error(x);
+		char kind = x->in.buf[x->in.begin + 1];
+		if (kind == '?')
+		{
+			if (!xml_find(x, 2, "?>", &at))
+				return xml_error(x);
+			x->in.begin = x->next = x->in.begin + at + 2;
+			continue;
+		}
+		if (kind == '!')
+		{
+			if (xml_have(x, 4) && memcmp(x->in.buf + x->in.begin, "<!--", 4) == 0)
+			{
+				if (!xml_find(x, 4, "-->", &at))
+					return xml_error(x);
+				x->in.begin = x->next = x->in.begin + at + 3;
+				continue;
+			}
+			if (xml_have(x, 9) && memcmp(x->in.buf + x->in.begin, "<![CDATA[", 9) == 0)
+			{
+				if (!xml_find(x, 9, "]]>", &at))
+					return xml_error(x);
+				x->text = x->in.buf + x->in.begin + 9;
+				x->text_len = at - 9;
+				x->next = x->in.begin + at + 3;
+				return x->token = LWXML_TEXT;
+			}
+			// DOCTYPE and the other declarations
+			if (!xml_find_tag_end(x, &at))
+				return xml_error(x);
+			x->in.begin = x->next = x->in.begin + at + 1;
+			continue;
+		}
+
+		if (!xml_find_tag_end(x, &at))
+			return xml_error(x);
+		const char *p = x->in.buf + x->in.begin;
+		x->next = x->in.begin + at + 1;
+		if (kind == '/')
+		{
+			xml_set_name(x, p + 2, p + at);
+			if (--x->depth < 0)
+				return xml_error(x);
+			return x->token = LWXML_END;
+		}
+		int empty = p[at - 1] == '/';
+		xml_set_name(x, p + 1, p + at - (empty ? 1 : 0));
+		x->depth++;
+		x->pending_end = empty;
+		return x->token = LWXML_START;
+	}
+}
+
+/// @brief Consume the rest of the current element, from its start tag or
+/// from within it, up to its end tag included
+int
+lwxml_skip(lwxml_reader *x)
+{
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief Whether the current tag has the local name \a name
+int
+lwxml_is(const lwxml_reader *x, const char *name)
+{
+	return strlen(name) == x->name_len && memcmp(x->name, name, x->name_len) == 0;
+}
+
+/// @brief Value of the attribute of local name \a name of the current start tag
+/// @return LW_FALSE when the tag has no such attribute
+int
+lwxml_attr(const lwxml_reader *x, const char *name, const char **value, size_t *len)
+{
+	const char *p = x->attrs;
+	const char *end = x->attrs + x->attrs_len;
+	size_t n = strlen(name);
+	while (p < end)
+	{
+		while (p < end && xml_is_blank(*p))
+			p++;
+		const char *key = p;
+		while (p < end && *p != '=' && !xml_is_blank(*p))
+			p++;
+		const char *key_end = p;
+		while (p < end && (*p == '=' || xml_is_blank(*p)))
+			p++;
+		if (p == end || (*p != '"' && *p != '\''))
+			return LW_FALSE;
+		const char *v = p + 1;
+		const char *v_end = (const char *)memchr(v, *p, (size_t)(end - v));
+		if (!v_end)
+			return LW_FALSE;
+		const char *colon = (const char *)memchr(key, ':', (size_t)(key_end - key));
+		if (colon)
+			key = colon + 1;
+		if ((size_t)(key_end - key) == n && memcmp(key, name, n) == 0)
+		{
+			*value = v;
+			*len = (size_t)(v_end - v);
+			return LW_TRUE;
+		}
+		p = v_end + 1;
+	}
+	return LW_FALSE;
+}
+
+static lwxml_reader *
+xml_init(lwxml_reader *x)
+{
+	memset(x, 0, sizeof(*x));
+	x->token = LWXML_START;
+	return x;
+}
+
+/// @brief Tokenizer over the input pulled from \a source
+/// @return LW_FAILURE when out of memory
+int
+lwxml_init(lwxml_reader *x, lwgeom_source source, void *arg)
+{
+	return lwgeom__input_init(&xml_init(x)->in, source, arg, LWXML_BLOCK_SIZE);
+}
+
+/// @brief Tokenizer over \a data, tokenized in place
+void
+lwxml_init_mem(lwxml_reader *x, const char *data, size_t len)
+{
+	lwgeom__input_init_mem(&xml_init(x)->in, data, len);
+}
+
+/// @brief Tokenizer over the file at \a path
+/// @return LW_FAILURE when the file can not be opened
+int
+lwxml_open(lwxml_reader *x, const char *path)
+{
+	return lwgeom__input_open(&xml_init(x)->in, path, LWXML_BLOCK_SIZE);
+}
+
+void
+lwxml_destroy(lwxml_reader *x)
+{
+	lwgeom__input_destroy(&x->in);
+	lwfree(x->coords);
+	lwfree(x->props);
+	lwfree(x->spans);
+}
+
+/* ------------------------------- positions -------------------------------- */
+
+static int
+xml_push_position(lwxml_reader *x, const double *pp, int dims)
+{
+	if (dims < 2 || dims > 4 || (x->cdim && x->cdim != dims))
+		return LW_FAILURE;
+	if (!lwgeom__reserve(
+		(void **)&x->coords, &x->coords_capacity, x->ncoords + (size_t)dims, sizeof(double), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	memcpy(x->coords + x->ncoords, pp, (size_t)dims * sizeof(double));
+	x->ncoords += (size_t)dims;
+	x->cdim = dims;
+	return LW_SUCCESS;
+}
+
+static inline const char *
+xml_skip_blanks(const char *s, const char *end)
+{
+	while (s < end && xml_is_blank(*s))
+		s++;
+	return s;
+}
+
+/// Blank separated numbers of a pos, a single position, or of a posList,
+/// positions of \a dims numbers
+static int
+xml_parse_list(lwxml_reader *x, const char *s, size_t len, int dims)
+{
+	const char *end = s + len;
+	double pp[4];
+	int n = 0;
+	for (s = xml_skip_blanks(s, end); s < end; s = xml_skip_blanks(s, end))
+	{
+		if (n == 4 || !(s = lwgeom__parse_double(s, end, &pp[n++])))
+			return LW_FAILURE;
+		if (n == dims)
+		{
+			if (!xml_push_position(x, pp, n))
+				return LW_FAILURE;
+			n = 0;
+		}
+	}
+	if (dims)
+		return n == 0;
+	return n == 0 || xml_push_position(x, pp, n);
+}
+
+/// Tuples of KML and GML2 coordinates: ordinates separated by \a cs, tuples
+/// by \a ts or blanks
+static int
+xml_parse_tuples(lwxml_reader *x, const char *s, size_t len, char cs, char ts)
+{
+	const char *end = s + len;
+	for (;;)
+	{
+		while (s < end && (xml_is_blank(*s) || *s == ts))
+			s++;
+		if (s == end)
+			return LW_SUCCESS;
+		double pp[4];
+		int n = 0;
+		for (;;)
+		{
+			if (n == 4 || !(s = lwgeom__parse_double(s, end, &pp[n++])))
+				return LW_FAILURE;
+			const char *next = xml_skip_blanks(s, end);
+			if (next == end || *next != cs)
+				break;
+			s = xml_skip_blanks(next + 1, end);
+		}
+		if (!xml_push_position(x, pp, n))
+			return LW_FAILURE;
+	}
+}
+
+/// Dimension given by a srsDimension attribute, \a dims otherwise
+static int
+xml_dims(const lwxml_reader *x, int dims)
+{
+	const char *v;
+	size_t n;
+	if (lwxml_attr(x, "srsDimension", &v, &n) || lwxml_attr(x, "dimension", &v, &n))
+	{
+		if (n == 1 && v[0] >= '2' && v[0] <= '4')
+			return v[0] - '0';
+	}
+	return dims;
+}
+
+/// Single character attribute, \a def when absent
+static char
+xml_char_attr(const lwxml_reader *x, const char *name, char def)
+{
+	const char *v;
+	size_t n;
+	return lwxml_attr(x, name, &v, &n) && n == 1 ? v[0] : def;
+}
+
+/// GML2 <coord><X/><Y/><Z/></coord>
+static int
+xml_read_coord(lwxml_reader *x)
+{
+	double pp[3] = {0.0, 0.0, 0.0};
+	int dims = 0;
+	int depth = x->depth;
+	int o = -1;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			return LW_FAILURE;
+		if (t == LWXML_START)
+			o = lwxml_is(x, "X") ? 0 : lwxml_is(x, "Y") ? 1 : lwxml_is(x, "Z") ? 2 : -1;
+		else if (t == LWXML_TEXT && o >= 0)
+		{
+			const char *s = xml_skip_blanks(x->text, x->text + x->text_len);
+			if (!lwgeom__parse_double(s, x->text + x->text_len, &pp[o]))
+				return LW_FAILURE;
+			dims = LWMAX(dims, o + 1);
+			o = -1;
+		}
+	}
+	return xml_push_position(x, pp, dims);
+}
+
+/// Positions of the current element and of its descendants, up to its end.
+/// Elements other than positions are walked through, so that the rings of
+/// a boundary or the segments of a Curve are read the same way.
+static int
+xml_read_points(lwxml_reader *x, int dims)
+{
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			return LW_FAILURE;
+		if (t != LWXML_START)
+			continue;
+
+		int list = lwxml_is(x, "posList");
+		if (list || lwxml_is(x, "pos"))
+		{
+			int d = list ? xml_dims(x, dims ? dims : 2) : 0;
+			if (lwxml_next(x) == LWXML_TEXT && !xml_parse_list(x, x->text, x->text_len, d))
+				return LW_FAILURE;
+		}
+		else if (lwxml_is(x, "coordinates"))
+		{
+			char cs = xml_char_attr(x, "cs", ',');
+			char ts = xml_char_attr(x, "ts", ' ');
+			if (xml_char_attr(x, "decimal", '.') != '.')
+				return LW_FAILURE;
+			if (lwxml_next(x) == LWXML_TEXT && !xml_parse_tuples(x, x->text, x->text_len, cs, ts))
+				return LW_FAILURE;
+		}
+		else if (lwxml_is(x, "coord"))
+		{
+			if (!xml_read_coord(x))
+				return LW_FAILURE;
+		}
+	}
+	return x->token == LWXML_END ? LW_SUCCESS : LW_FAILURE;
+}
+
+/* ------------------------------- geometries ------------------------------- */
+
+#define XML_HASZ(x) ((x)->cdim >= 3)
+#define XML_HASM(x) ((x)->cdim == 4)
+
+/// Point or line of the positions read, which are then cleared
+static LWGEOM *
+xml_take_points(lwxml_reader *x, uint8_t type, uint32_t min)
+{
+	uint32_t n = x->cdim ? (uint32_t)(x->ncoords / (size_t)x->cdim) : 0;
+	LWGEOM *obj = NULL;
+	if (type == POINTTYPE && n <= 1)
+		obj = n ? lwgeom_point_arena(NULL, x->coords, XML_HASZ(x), XML_HASM(x))
+			: lwgeom__new(NULL, POINTTYPE, LW_FALSE, LW_FALSE);
+	else if (type == LINETYPE && (n == 0 || n >= min))
+		obj = lwgeom_line_arena(NULL, n, x->coords, XML_HASZ(x), XML_HASM(x));
+	x->ncoords = 0;
+	x->cdim = 0;
+	return obj;
+}
+
+typedef struct {
+	LWGEOM **v;
+	uint32_t n;
+	size_t capacity;
+} xml_list;
+
+static int
+xml_push(xml_list *l, LWGEOM *obj)
+{
+	if (!obj || !lwgeom__reserve(
+		(void **)&l->v, &l->capacity, (size_t)l->n + 1, sizeof(LWGEOM *), LWGEOM_MEM_PARSER))
+	{
+		lwgeom_free(obj);
+		return LW_FAILURE;
+	}
+	l->v[l->n++] = obj;
+	return LW_SUCCESS;
+}
+
+static void
+xml_list_free(xml_list *l)
+{
+	for (uint32_t i = 0; i < l->n; ++i)
+		lwgeom_free(l->v[i]);
+	lwfree(l->v);
+}
+
+/// Collection of \a type taking over the geometries of \a l, with \a type 0
+/// a multi geometry when they all are of the same type
+static LWGEOM *
+xml_collect(xml_list *l, uint8_t type)
+{
+	if (type == 0)
+	{
+		type = l->n && l->v[0]->type <= POLYTYPE ? l->v[0]->type + (MPOINTTYPE - POINTTYPE) : COLLECTIONTYPE;
+		for (uint32_t i = 1; i < l->n && type != COLLECTIONTYPE; ++i)
+		{
+			if (l->v[i]->type != l->v[0]->type)
+				type = COLLECTIONTYPE;
+		}
+	}
+	LWBOOLEAN hasz = l->n ? lwgeom_has_z(l->v[0]) : LW_FALSE;
+	LWBOOLEAN hasm = l->n ? lwgeom_has_m(l->v[0]) : LW_FALSE;
+	LWGEOM *mobj = lwgeom_create_empty_collection_arena(NULL, type, hasz, hasm);
+	uint32_t i = 0;
+	for (; mobj && i < l->n; ++i)
+	{
+		if (!lwgeom__add_child(mobj, l->v[i]))
+			break;
+	}
+	if (!mobj || i < l->n)
+	{
+		// The children added so far go with the collection
+		lwgeom_free(mobj);
+		l->n = mobj ? l->n - i : l->n;
+		memmove(l->v, l->v + i, l->n * sizeof(LWGEOM *));
+		xml_list_free(l);
+		return NULL;
+	}
+	lwfree(l->v);
+	return mobj;
+}
+
+/// Polygon or PolygonPatch: a ring from each exterior or interior boundary
+static LWGEOM *
+xml_read_polygon(lwxml_reader *x, int dims)
+{
+	xml_list rings = {NULL, 0, 0};
+	LWGEOM *shell = NULL;
+	LWGEOM *obj;
+	int depth = x->depth;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			goto fail;
+		if (t != LWXML_START)
+			continue;
+		int exterior = lwxml_is(x, "exterior") || lwxml_is(x, "outerBoundaryIs");
+		if (exterior || lwxml_is(x, "interior") || lwxml_is(x, "innerBoundaryIs"))
+		{
+			x->ncoords = 0;
+			x->cdim = 0;
+			if (!xml_read_points(x, dims))
+				goto fail;
+			LWGEOM *ring = xml_take_points(x, LINETYPE, 4);
+			if (!ring || ring->npoints == 0 || (exterior && shell))
+			{
+				lwgeom_free(ring);
+				goto fail;
+			}
+			if (exterior)
+				shell = ring;
+			else if (!xml_push(&rings, ring))
+				goto fail;
+		}
+		else if (!lwxml_skip(x))
+			goto fail;
+	}
+	if (!shell)
+	{
+		if (rings.n)
+			goto fail;
+		return lwgeom__new(NULL, POLYTYPE, LW_FALSE, LW_FALSE);
+	}
+	// The shell goes first, whatever the order of the boundaries
+	if (!xml_push(&rings, shell))
+	{
+		shell = NULL;
+		goto fail;
+	}
+	memmove(rings.v + 1, rings.v, (rings.n - 1) * sizeof(LWGEOM *));
+	rings.v[0] = shell;
+	shell = NULL;
+	for (uint32_t i = 1; i < rings.n; ++i)
+	{
+		if (lwgeom_has_z(rings.v[i]) != lwgeom_has_z(rings.v[0]) ||
+		    lwgeom_has_m(rings.v[i]) != lwgeom_has_m(rings.v[0]))
+			goto fail;
+	}
+	obj = lwgeom__poly_from_rings(NULL, rings.n, rings.v);
+	if (!obj)
+		goto fail;
+	lwfree(rings.v);
+	return obj;
+
+fail:
+	lwgeom_free(shell);
+	xml_list_free(&rings);
+	return NULL;
+}
+
+typedef enum {
+	XML_POINTS = 0, ///< positions of the element and its descendants
+	XML_POLYGON,    ///< rings of the boundaries
+	XML_SURFACE,    ///< polygon patches, a multi polygon when there are several
+	XML_MEMBERS     ///< geometries among the descendants
+} xml_shape;
+
+typedef struct {
+	const char *name;
+	xml_shape shape;
+	uint8_t type; ///< 0 for a multi geometry inferred from the members
+} xml_kind;
+
+static const xml_kind xml_kinds[] = {
+    {"Point", XML_POINTS, POINTTYPE},
+    {"LineString", XML_POINTS, LINETYPE},
+    {"LinearRing", XML_POINTS, LINETYPE},
+    {"Curve", XML_POINTS, LINETYPE},
+    {"Polygon", XML_POLYGON, POLYTYPE},
+    {"PolygonPatch", XML_POLYGON, POLYTYPE},
+    {"Surface", XML_SURFACE, MPOLYTYPE},
+    {"MultiPoint", XML_MEMBERS, MPOINTTYPE},
+    {"MultiLineString", XML_MEMBERS, MLINETYPE},
+    {"MultiCurve", XML_MEMBERS, MLINETYPE},
+    {"MultiPolygon", XML_MEMBERS, MPOLYTYPE},
+    {"MultiSurface", XML_MEMBERS, MPOLYTYPE},
+    {"MultiGeometry", XML_MEMBERS, 0},
+};
+
+static const xml_kind *
+xml_kind_of(const lwxml_reader *x)
+{
+	for (size_t i = 0; i < sizeof(xml_kinds) / sizeof(xml_kinds[0]); ++i)
+	{
+		if (lwxml_is(x, xml_kinds[i].name))
+			return &xml_kinds[i];
+	}
+	return NULL;
+}
+
+/// @brief Whether the current start tag is one of a geometry
+int
+lwxml_is_geometry(const lwxml_reader *x)
+{
+	return xml_kind_of(x) != NULL;
+}
+
+static LWGEOM *xml_read_geometry(lwxml_reader *x, int dims, int depth);
+
+/// Geometries among the descendants, the member elements around them are walked through
+static LWGEOM *
+xml_read_members(lwxml_reader *x, const xml_kind *kind, int dims, int depth)
+{
+	xml_list l = {NULL, 0, 0};
+	int top = x->depth;
+	while (x->depth >= top)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+		{
+			xml_list_free(&l);
+			return NULL;
+		}
+		if (t == LWXML_START && lwxml_is_geometry(x) && !xml_push(&l, xml_read_geometry(x, dims, depth + 1)))
+		{
+			xml_list_free(&l);
+			return NULL;
+		}
+	}
+	if (kind->shape == XML_SURFACE && l.n == 1)
+	{
+		LWGEOM *obj = l.v[0];
+		lwfree(l.v);
+		return obj;
+	}
+	for (uint32_t i = 0; i < l.n && kind->type; ++i)
+	{
+		if (l.v[i]->type != kind->type - (MPOINTTYPE - POINTTYPE))
+		{
+			xml_list_free(&l);
+			return NULL;
+		}
+	}
+	return xml_collect(&l, kind->type);
+}
+
+static LWGEOM *
+xml_read_geometry(lwxml_reader *x, int dims, int depth)
+{
+	const xml_kind *kind = xml_kind_of(x);
+	if (!kind || depth > LWXML_MAX_DEPTH)
+		return NULL;
+	dims = xml_dims(x, dims);
+	switch (kind->shape)
+	{
+	case XML_POINTS:
+		x->ncoords = 0;
+		x->cdim = 0;
+		if (!xml_read_points(x, dims))
+			return NULL;
+		return xml_take_points(x, kind->type, 2);
+	case XML_POLYGON:
+		return xml_read_polygon(x, dims);
+	default:
+		return xml_read_members(x, kind, dims, depth);
+	}
+}
+
+/// @brief Geometry of the element whose start tag is current, consumed up
+/// to its end tag
+/// @param depth nesting of the geometry in collections, 0 at the top
+/// @return NULL for a malformed geometry
+LWGEOM *
+lwxml_read_geometry(lwxml_reader *x, int depth)
+{
+	return xml_read_geometry(x, 0, depth);
+}
+
+/// @brief First geometry of the document \a data, whatever the elements around it
+LWGEOM *
+lwxml_read_first_geometry(const char *data, size_t len)
+{
+	lwxml_reader x;
+	LWGEOM *obj = NULL;
+	lwxml_init_mem(&x, data, len);
+	for (;;)
+	{
+		lwxml_token t = lwxml_next(&x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			break;
+		if (t == LWXML_START && lwxml_is_geometry(&x))
+		{
+			obj = lwxml_read_geometry(&x, 0);
+			break;
+		}
+	}
+	lwxml_destroy(&x);
+	return obj;
+}
+
+/* ------------------------------- properties ------------------------------- */
+
+static int
+xml_append(lwxml_reader *x, const char *s, size_t len)
+{
+	if (len == 0)
+		return LW_SUCCESS;
+	if (x->nprops + len > INT_MAX ||
+	    !lwgeom__reserve((void **)&x->props, &x->props_capacity, x->nprops + len, sizeof(char), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	memcpy(x->props + x->nprops, s, len);
+	x->nprops += len;
+	return LW_SUCCESS;
+}
+
+/// @brief Start a property of the feature being read, with an empty value
+/// until lwxml_property_value()
+int
+lwxml_property_key(lwxml_reader *x, const char *key, size_t key_len)
+{
+	if (!lwgeom__reserve((void **)&x->spans, &x->spans_capacity, x->nspans + 4, sizeof(int), LWGEOM_MEM_PARSER))
+		return LW_FAILURE;
+	int offset = (int)x->nprops;
+	if (!xml_append(x, key, key_len))
+		return LW_FAILURE;
+	int *span = x->spans + x->nspans;
+	span[0] = offset;
+	span[1] = (int)key_len;
+	span[2] = (int)x->nprops;
+	span[3] = 0;
+	x->nspans += 4;
+	return LW_SUCCESS;
+}
+
+/// @brief Text of the element whose start tag is current, consumed up to its
+/// end tag, as the value of the last property started. The text of its
+/// child elements is left out.
+/// @param[in,out] geom when not NULL, the first geometry among the
+/// descendants goes there if it is NULL, and the property is dropped
+int
+lwxml_property_value(lwxml_reader *x, LWGEOM **geom)
+{
+	assert(x->nspans >= 4);
+	int depth = x->depth;
+	int keep = LW_TRUE;
+	while (x->depth >= depth)
+	{
+		lwxml_token t = lwxml_next(x);
+		if (t == LWXML_EOF || t == LWXML_ERROR)
+			return LW_FAILURE;
+		if (t == LWXML_TEXT && x->depth == depth)
+		{
+			if (!xml_append(x, x->text, x->text_len))
+				return LW_FAILURE;
+			x->spans[x->nspans - 1] += (int)x->text_len;
+		}
+		else if (t == LWXML_START && geom && lwxml_is_geometry(x))
+		{
+			LWGEOM *obj = lwxml_read_geometry(x, 0);
+			if (!obj)
+				return LW_FAILURE;
+			if (*geom)
+				lwgeom_free(obj);
+			else
+				*geom = obj;
+			keep = LW_FALSE;
+		}
+	}
+	if (!keep)
+	{
+		x->nspans -= 4;
+		x->nprops = (size_t)x->spans[x->nspans];
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief Feature of \a geom and of the properties read since the last one,
+/// which are then cleared
+/// @return NULL when out of memory, \a geom is freed then
+LW_SGO *
+lwxml_take_feature(lwxml_reader *x, LWGEOM *geom)
+{
+	LW_SGO *sgo = lwgeom__sgo_new(geom, x->spans, x->nspans, x->props, x->nprops);
+	if (!sgo)
+		lwgeom_free(geom);
+	x->nspans = 0;
+	x->nprops = 0;
+	return sgo;
+}
+
+/* ----------------------------- feature reader ----------------------------- */
+
+struct lwgeom_xml_reader {
+	lwxml_reader x;
+	lwgeom_xml_dialect dialect;
+};
+
+static lwgeom_xml_reader *
+xml_reader_alloc(lwgeom_xml_dialect dialect)
+{
+	lwgeom_xml_reader *r = (lwgeom_xml_reader *)lwmalloc__cat(sizeof(lwgeom_xml_reader), LWGEOM_MEM_PARSER);
+	if (r)
+		r->dialect = dialect;
+	return r;
+}
+
+/// @brief Read the features of a KML or GML document pulled from \a source:
+/// the placemarks of KML, the feature members of GML, and the geometries
+/// outside of them. Memory is bounded by the largest feature, not by the
+/// document.
+/// @param source fills a buffer with the next input, returns 0 at its end
+/// @param arg passed to \a source
+/// @return NULL when out of memory
+lwgeom_xml_reader *
+lwgeom_xml_reader_new(lwgeom_xml_dialect dialect, lwgeom_source source, void *arg)
+{
+	assert(source);
+	lwgeom_xml_reader *r = xml_reader_alloc(dialect);
+	if (r && !lwxml_init(&r->x, source, arg))
+	{
+		lwgeom_xml_reader_free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/// @brief Read the features of the KML or GML file at \a path
+/// @return NULL when the file can not be opened
+lwgeom_xml_reader *
+lwgeom_xml_reader_open(lwgeom_xml_dialect dialect, const char *path)
+{
+	assert(path);
+	lwgeom_xml_reader *r = xml_reader_alloc(dialect);
+	if (r && !lwxml_open(&r->x, path))
+	{
+		lwgeom_xml_reader_free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/// @brief Read the features of \a data, which has to outlive the reader
+lwgeom_xml_reader *
+lwgeom_xml_reader_mem(lwgeom_xml_dialect dialect, const char *data, size_t len)
+{
+	assert(data || len == 0);
+	lwgeom_xml_reader *r = xml_reader_alloc(dialect);
+	if (r)
+		lwxml_init_mem(&r->x, data, len);
+	return r;
+}
+
+/// @brief Next feature of \a reader, owned by the caller
+/// @param[out] sgo the feature, NULL at the end of the input
+/// @return LW_FAILURE for malformed input
+int
+lwgeom_xml_reader_next(lwgeom_xml_reader *reader, LW_SGO **sgo)
+{
+	assert(reader && sgo);
+	*sgo = NULL;
+	if (reader->dialect == LWGEOM_XML_KML)
+		return lwkml_next_feature(&reader->x, sgo);
+	return lwgml_next_feature(&reader->x, sgo);
+}
+
+/// @brief Append at most \a max features of \a reader to \a out
+/// @return LW_FAILURE for malformed input, the features read before are kept
+int
+lwgeom_xml_reader_read(lwgeom_xml_reader *reader, LWGEOMREADER2 *out, size_t max)
+{
+	assert(reader && out);
+	for (size_t i = 0; i < max; ++i)
+	{
+		if (!lwgeom__reserve(
+			(void **)&out->sgos, &out->nsgo_max, out->nsgo + 1, sizeof(LW_SGO *), LWGEOM_MEM_PARSER))
+			return LW_FAILURE;
+		LW_SGO *sgo;
+		if (!lwgeom_xml_reader_next(reader, &sgo))
+			return LW_FAILURE;
+		if (!sgo)
+			break;
+		out->sgos[out->nsgo++] = sgo;
+	}
+	return LW_SUCCESS;
+}
+
+void
+lwgeom_xml_reader_free(lwgeom_xml_reader *reader)
+{
+	if (reader == NULL)
+		return;
+	lwxml_destroy(&reader->x);
+	lwfree(reader);
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LWXML_H
+#define LWXML_H
+
+#include "liblwgeom_internel.h"
+
+typedef enum {
+	LWXML_START = 0, ///< start tag, self closing ones are followed by their end
+	LWXML_END,       ///< end tag
+	LWXML_TEXT,      ///< character data or CDATA content, blank runs are skipped
+	LWXML_EOF,
+	LWXML_ERROR
+} lwxml_token;
+
+/// Pull tokenizer for the XML of KML and GML. The input is read in blocks
+/// and only the current token is kept, comments, processing instructions
+/// and declarations are skipped, and entities are left as they are. Names
+/// are local, without their namespace prefix. The name, attributes and
+/// text point in the buffer and are valid until the next lwxml_next().
+typedef struct {
+	lwgeom_input in; ///< in.begin is the start of the current token
+	size_t next;     ///< end of the current token
+
+	lwxml_token token;
+	int depth;       ///< open elements, the current one included
+	int pending_end; ///< the start tag was self closing
+	int feature_depth; ///< depth of the features in a GML collection, 0 outside
+	const char *name;
+	size_t name_len;
+	const char *attrs;
+	size_t attrs_len;
+	const char *text;
+	size_t text_len;
+
+	/* Scratch of the readers, as large as the largest feature */
+	double *coords;
+	size_t ncoords;
+	size_t coords_capacity;
+	int cdim;        ///< ordinates of the positions read, 0 before the first one
+	char *props;     ///< keys and values of the properties, back to back
+	size_t nprops;
+	size_t props_capacity;
+	int *spans;
+	size_t nspans;
+	size_t spans_capacity;
+} lwxml_reader;
+
+int lwxml_init(lwxml_reader *x, lwgeom_source source, void *arg);
+void lwxml_init_mem(lwxml_reader *x, const char *data, size_t len);
+int lwxml_open(lwxml_reader *x, const char *path);
+void lwxml_destroy(lwxml_reader *x);
+
+lwxml_token lwxml_next(lwxml_reader *x);
+int lwxml_skip(lwxml_reader *x);
+int lwxml_is(const lwxml_reader *x, const char *name);
+int lwxml_attr(const lwxml_reader *x, const char *name, const char **value, size_t *len);
+
+int lwxml_is_geometry(const lwxml_reader *x);
+LWGEOM *lwxml_read_geometry(lwxml_reader *x, int depth);
+LWGEOM *lwxml_read_first_geometry(const char *data, size_t len);
+int lwxml_property_key(lwxml_reader *x, const char *key, size_t key_len);
+int lwxml_property_value(lwxml_reader *x, LWGEOM **geom);
+LW_SGO *lwxml_take_feature(lwxml_reader *x, LWGEOM *geom);
+
+/* Next feature of each dialect, *sgo is NULL at the end of the input */
+int lwkml_next_feature(lwxml_reader *x, LW_SGO **sgo);
+int lwgml_next_feature(lwxml_reader *x, LW_SGO **sgo);
+
+#endif /* LWXML_H */
@@ -20,4 +20,19 @@
  * IN THE SOFTWARE.
  */
 
-#include "mapsettings.h"
\ No newline at end of file
+#include "mapsettings.h"
+
+/* Half the side of the web mercator square, in meters */
+#define MAPSETTINGS_MERCATOR_HALF 20037508.342789244
+
+/// @brief Web mercator grid of 4096 units tiles with a 64 units buffer
+void
+mapsettings_init(mapsettings_t *settings)
+{
+	settings->xmin = -MAPSETTINGS_MERCATOR_HALF;
+	settings->ymin = -MAPSETTINGS_MERCATOR_HALF;
+	settings->xmax = MAPSETTINGS_MERCATOR_HALF;
+	settings->ymax = MAPSETTINGS_MERCATOR_HALF;
+	settings->extent = 4096;
+	settings->buffer = 64;
+}
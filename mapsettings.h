@@ -23,8 +23,20 @@
 #ifndef MAPSETTINGS_H
 #define MAPSETTINGS_H
 
-typedef struct {
+#include <stdint.h>
 
+/// Tile grid of the vector tile encoder. Tile 0/0/0 covers the square
+/// bounds, each zoom level splits the tiles of the previous one in four, and
+/// tile rows are counted from the top.
+typedef struct {
+	double xmin;     ///< bounds of tile 0/0/0, web mercator by default
+	double ymin;
+	double xmax;
+	double ymax;
+	uint32_t extent; ///< tile side in integer units, 4096 by default
+	uint32_t buffer; ///< units kept around the tile when clipping, 64 by default
 } mapsettings_t;
 
-#endif /* MAPSETTINGS_H */
\ No newline at end of file
+void mapsettings_init(mapsettings_t *settings);
+
+#endif /* MAPSETTINGS_H */
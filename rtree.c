@@ -22,7 +22,8 @@
 
 #include <string.h>
 #include <math.h>
-#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
+#include "rtree.h"
 
 #define DIMS 2
 #define MAXITEMS 64
@@ -130,10 +131,16 @@ nv_rtree_set_udata(struct nv_rtree *tr, void *udata)
 	tr->udata = udata;
 }
 
+size_t
+lwgeom__rtree_node_size(void)
+{
+	return sizeof(struct node);
+}
+
 static struct node *
-node_new(struct nv_rtree *tr, enum kind kind)
+node_new(enum kind kind)
 {
-	struct node *node = (struct node *)lwmalloc(sizeof(struct node));
+	struct node *node = (struct node *)lwmalloc__cat(sizeof(struct node), LWGEOM_MEM_INDEX);
 	if (!node)
 		return NULL;
 	memset(node, 0, sizeof(struct node));
@@ -144,7 +151,7 @@ node_new(struct nv_rtree *tr, enum kind kind)
 static struct node *
 node_copy(struct nv_rtree *tr, struct node *node)
 {
-	struct node *node2 = (struct node *)lwmalloc(sizeof(struct node));
+	struct node *node2 = (struct node *)lwmalloc__cat(sizeof(struct node), LWGEOM_MEM_INDEX);
 	if (!node2)
 		return NULL;
 	memcpy(node2, node, sizeof(struct node));
@@ -419,10 +426,10 @@ node_move_rect_at_index_into(struct node *from, int index, struct node *into)
 }
 
 static int
-node_split_largest_axis_edge_snap(struct nv_rtree *tr, struct rect *rect, struct node *node, struct node **right_out)
+node_split_largest_axis_edge_snap(struct rect *rect, struct node *node, struct node **right_out)
 {
 	int axis = rect_largest_axis(rect);
-	struct node *right = node_new(tr, node->kind);
+	struct node *right = node_new(node->kind);
 	if (!right)
 	{
 		return LW_FALSE;
@@ -468,9 +475,9 @@ node_split_largest_axis_edge_snap(struct nv_rtree *tr, struct rect *rect, struct
 }
 
 static int
-node_split(struct nv_rtree *tr, struct rect *rect, struct node *node, struct node **right)
+node_split(struct rect *rect, struct node *node, struct node **right)
 {
-	return node_split_largest_axis_edge_snap(tr, rect, node, right);
+	return node_split_largest_axis_edge_snap(rect, node, right);
 }
 
 static int
@@ -580,7 +587,7 @@ node_insert(struct nv_rtree *tr,
 		return LW_TRUE;
 	}
 	struct node *right;
-	if (!node_split(tr, &node->rects[i], node->nodes[i], &right))
+	if (!node_split(&node->rects[i], node->nodes[i], &right))
 	{
 		return LW_FALSE;
 	}
@@ -597,7 +604,7 @@ node_insert(struct nv_rtree *tr,
 struct nv_rtree *
 nv_rtree_new(void)
 {
-	struct nv_rtree *tr = (struct nv_rtree *)lwmalloc(sizeof(struct nv_rtree));
+	struct nv_rtree *tr = (struct nv_rtree *)lwmalloc__cat(sizeof(struct nv_rtree), LWGEOM_MEM_INDEX);
 	if (!tr)
 		return NULL;
 	memset(tr, 0, sizeof(struct nv_rtree));
@@ -658,7 +665,7 @@ nv_rtree_insert(struct nv_rtree *tr, const double *min, const double *max, const
 	{
 		if (!tr->root)
 		{
-			struct node *new_root = node_new(tr, LEAF);
+			struct node *new_root = node_new(LEAF);
 			if (!new_root)
 			{
 				break;
@@ -679,13 +686,13 @@ nv_rtree_insert(struct nv_rtree *tr, const double *min, const double *max, const
 			tr->count++;
 			return LW_TRUE;
 		}
-		struct node *new_root = node_new(tr, BRANCH);
+		struct node *new_root = node_new(BRANCH);
 		if (!new_root)
 		{
 			break;
 		}
 		struct node *right;
-		if (!node_split(tr, &tr->rect, tr->root, &right))
+		if (!node_split(&tr->rect, tr->root, &right))
 		{
 			lwfree(new_root);
 			break;
@@ -1040,7 +1047,7 @@ nv_rtree_clone(struct nv_rtree *tr)
 {
 	if (!tr)
 		return NULL;
-	struct nv_rtree *tr2 = (struct nv_rtree *)lwmalloc(sizeof(struct nv_rtree));
+	struct nv_rtree *tr2 = (struct nv_rtree *)lwmalloc__cat(sizeof(struct nv_rtree), LWGEOM_MEM_INDEX);
 	if (!tr2)
 		return NULL;
 	memcpy(tr2, tr, sizeof(struct nv_rtree));
@@ -1057,3 +1064,42 @@ nv_rtree_opt_relaxed_atomics(struct nv_rtree *tr)
 {
 	tr->relaxed = LW_TRUE;
 }
+
+static void
+node_memreport(const struct node *node, struct nv_rtree_memreport *report)
+{
+	report->nodes++;
+	if (node->rc > 0)
+		report->shared++;
+	if (node->kind == LEAF)
+	{
+		report->leaves++;
+		report->items += node->count;
+		return;
+	}
+	report->branches++;
+	for (int i = 0; i < node->count; i++)
+	{
+		node_memreport(node->nodes[i], report);
+	}
+}
+
+// nv_rtree_memreport walks the tree and reports the nodes it holds and how
+// full they are.
+//
+// Nodes shared with a clone by copy-on-write are reported by each tree.
+void
+nv_rtree_memreport(const struct nv_rtree *tr, struct nv_rtree_memreport *report)
+{
+	memset(report, 0, sizeof(struct nv_rtree_memreport));
+	if (tr->root)
+	{
+		node_memreport(tr->root, report);
+	}
+	report->bytes = sizeof(struct nv_rtree) + report->nodes * sizeof(struct node);
+	if (report->nodes)
+	{
+		size_t used = report->items + report->nodes - 1;
+		report->fill = (double)used / (double)(report->nodes * MAXITEMS);
+	}
+}
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RTREE_H
+#define RTREE_H
+
+#include "liblwgeom.h"
+
+struct nv_rtree;
+
+struct nv_rtree *nv_rtree_new(void);
+void nv_rtree_free(struct nv_rtree *tr);
+struct nv_rtree *nv_rtree_clone(struct nv_rtree *tr);
+void nv_rtree_set_udata(struct nv_rtree *tr, void *udata);
+void nv_rtree_set_item_callbacks(struct nv_rtree *tr,
+				 int (*clone)(const void *item, void **into, void *udata),
+				 void (*free)(const void *item, void *udata));
+void nv_rtree_opt_relaxed_atomics(struct nv_rtree *tr);
+int nv_rtree_insert(struct nv_rtree *tr, const double *min, const double *max, const void *data);
+int nv_rtree_delete(struct nv_rtree *tr, const double *min, const double *max, const void *data);
+int nv_rtree_delete_with_comparator(struct nv_rtree *tr,
+				    const double *min,
+				    const double *max,
+				    const void *data,
+				    int (*compare)(const void *a, const void *b, void *udata),
+				    void *udata);
+void nv_rtree_search(const struct nv_rtree *tr,
+		     const double min[],
+		     const double max[],
+		     int (*iter)(const double min[], const double max[], const void *data, void *udata),
+		     void *udata);
+void nv_rtree_scan(const struct nv_rtree *tr,
+		   int (*iter)(const double *min, const double *max, const void *data, void *udata),
+		   void *udata);
+size_t nv_rtree_count(const struct nv_rtree *tr);
+
+/// Memory held by an rtree, see nv_rtree_memreport()
+struct nv_rtree_memreport {
+	size_t nodes;    ///< reachable nodes
+	size_t branches; ///< inner nodes
+	size_t leaves;   ///< leaf nodes
+	size_t shared;   ///< nodes shared with a clone, counted in every tree
+	size_t items;    ///< stored items
+	size_t bytes;    ///< tree header plus nodes
+	double fill;     ///< used slots over available slots
+};
+
+void nv_rtree_memreport(const struct nv_rtree *tr, struct nv_rtree_memreport *report);
+
+#endif /* RTREE_H */
@@ -100,10 +100,13 @@ stok_next_token(stok_t *tok)
 	}
 
 	char *brk = strpbrk(tok->pos, "\n\r\t() ,");
+	if (brk == NULL)
+		brk = tok->end;
 	if (brk == tok->end)
 	{
 		if (tok->pos != tok->end)
 		{
+			memset(tok->stok, 0, strlen(tok->stok));
 			memcpy(tok->stok, tok->pos, strlen(tok->pos));
 			tok->pos = tok->end;
 		}
@@ -144,25 +147,22 @@ stok_peek_next_token(stok_t *tok)
 	if (_pos == strlen(tok->pos))
 		return STOK_EOF;
 
-	switch (*tok->pos)
+	char *pos = tok->pos + _pos;
+	switch (*pos)
+	{
 	case '(':
 	case ')':
 	case ',':
-		return *tok->pos;
-
-	char *brk = strpbrk(tok->pos + 1, "\n\r\t() ,");
-	if (brk == tok->end)
-	{
-		if (tok->pos != tok->end)
-			memcpy(stok, tok->pos, strlen(tok->pos));
-		else
-			return STOK_EOF;
-	}
-	else
-	{
-		memcpy(stok, tok->pos, brk - tok->pos);
+		return *pos;
 	}
 
+	char *brk = strpbrk(pos + 1, "\n\r\t() ,");
+	if (brk == NULL)
+		brk = tok->end;
+	if ((size_t)(brk - pos) >= UCHAR_MAX)
+		return STOK_WORD;
+	memcpy(stok, pos, brk - pos);
+
 	char *stopstring;
 	double dbl = stok__strtod_with_vc_fix(stok, &stopstring);
 	if (*stopstring == '\0')
@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* FlatGeobuf writer and reader: round trips through the index and the
+ * sequential scan, and headers the reader has to reject. */
+
+#include "test_util.h"
+#include "lwfgb.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static void
+put_u16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void
+put_u32(uint8_t *p, uint32_t v)
+{
+	put_u16(p, (uint16_t)v);
+	put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void
+put_u64(uint8_t *p, uint64_t v)
+{
+	put_u32(p, (uint32_t)v);
+	put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+/* Features of the round trip, on a 100 wide grid: points, lines and
+ * multi polygons in turn, and one null geometry */
+#define NFEATURES 5001
+#define NULL_FEATURE 777
+
+/// WKT of feature \a i, NULL for the null geometry
+static const char *
+feature_wkt(int i, char *buf, size_t size)
+{
+	int x = i % 100;
+	int y = i / 100;
+	if (i == NULL_FEATURE)
+		return NULL;
+	if (i % 3 == 0)
+		snprintf(buf, size, "POINT (%d %d)", x, y);
+	else if (i % 3 == 1)
+		snprintf(buf, size, "LINESTRING (%d %d,%d.5 %d.5)", x, y, x, y);
+	else
+		snprintf(buf,
+			 size,
+			 "MULTIPOLYGON (((%d %d,%d.5 %d,%d.5 %d.5,%d %d)),"
+			 "((%d.5 %d.5,%d.75 %d.5,%d.75 %d.75,%d.5 %d.5)))",
+			 x, y, x, y, x, y, x, y, x, y, x, y, x, y, x, y);
+	return buf;
+}
+
+/// Box of feature \a i, as feature_wkt() lays it out
+static int
+feature_intersects(int i, const LWBOX *box)
+{
+	double x = i % 100;
+	double y = i / 100;
+	double size = i % 3 == 0 ? 0 : i % 3 == 1 ? 0.5 : 0.75;
+	return i != NULL_FEATURE && x <= box->xmax && y <= box->ymax && x + size >= box->xmin && y + size >= box->ymin;
+}
+
+/// Property text of feature \a i as the reader renders it
+static void
+feature_props(int i, char *buf, size_t size)
+{
+	snprintf(buf, size, "id=%d;name=f%d;w=%d.5;ok=%s;", i, i, i, i % 2 ? "true" : "false");
+}
+
+/// "key=value;" for each property of \a sgo
+static void
+sgo_props(const LW_SGO *sgo, char *buf, size_t size)
+{
+	const char *text = lwgeom_sgo_text(sgo);
+	size_t n = 0;
+	buf[0] = '\0';
+	for (size_t k = 0; k + 3 < sgo->prop_size && n < size; k += 4)
+	{
+		const int *p = sgo->properties + k;
+		n += (size_t)snprintf(buf + n, size - n, "%.*s=%.*s;", p[1], text + p[0], p[3], text + p[2]);
+	}
+}
+
+/// Id of a feature from its property text
+static int
+sgo_id(const LW_SGO *sgo)
+{
+	const char *text = lwgeom_sgo_text(sgo);
+	return sgo->prop_size >= 4 ? atoi(text + sgo->properties[2]) : -1;
+}
+
+/// FlatGeobuf file of the NFEATURES features
+static int
+write_file(uint16_t node_size, test_buffer *file)
+{
+	static const char *names[] = {"id", "name", "w", "ok"};
+	static const lwgeom_fgb_column_type types[] = {
+	    LWGEOM_FGB_INT, LWGEOM_FGB_STRING, LWGEOM_FGB_DOUBLE, LWGEOM_FGB_BOOL};
+	lwgeom_fgb_writer *w = lwgeom_fgb_writer_new(0, LW_FALSE, LW_FALSE, node_size);
+	int ok = w != NULL;
+	for (int c = 0; ok && c < 4; ++c)
+		ok = lwgeom_fgb_writer_column(w, names[c], types[c]);
+	for (int i = 0; ok && i < NFEATURES; ++i)
+	{
+		char wkt[256], id[16], name[16], weight[32];
+		const char *text = feature_wkt(i, wkt, sizeof(wkt));
+		LWGEOM *obj = text ? read_wkt(text) : NULL;
+		snprintf(id, sizeof(id), "%d", i);
+		snprintf(name, sizeof(name), "f%d", i);
+		snprintf(weight, sizeof(weight), "%d.5", i);
+		const char *values[] = {id, name, weight, i % 2 ? "true" : "false"};
+		ok = (obj || !text) && lwgeom_fgb_writer_feature(w, obj, values, NULL);
+		lwgeom_free(obj);
+	}
+	ok = ok && lwgeom_fgb_writer_finish(w, test_sink, file);
+	lwgeom_fgb_writer_free(w);
+	return ok;
+}
+
+/// Check a feature read back against the one written
+static void
+check_feature(LW_SGO *sgo)
+{
+	char expected[256], got[256];
+	int i = sgo_id(sgo);
+	if (i < 0 || i >= NFEATURES)
+	{
+		check(0, "fgb id", "a feature id", NULL);
+		return;
+	}
+	const char *wkt = feature_wkt(i, expected, sizeof(expected));
+	if (wkt)
+	{
+		check_wkt(sgo->geom, wkt, "fgb geometry");
+		sgo->geom = NULL;
+	}
+	else
+		check(sgo->geom == NULL, "fgb null geometry", "NULL", "a geometry");
+	feature_props(i, expected, sizeof(expected));
+	sgo_props(sgo, got, sizeof(got));
+	check(strcmp(expected, got) == 0, "fgb properties", expected, got);
+}
+
+/// Features of a query of \a r, each checked, their number returned
+static int
+read_query(lwgeom_fgb_reader *r, const LWBOX *box)
+{
+	int n = 0;
+	if (!lwgeom_fgb_reader_query(r, box))
+	{
+		check(0, "fgb query", "LW_SUCCESS", "LW_FAILURE");
+		return -1;
+	}
+	for (;;)
+	{
+		LW_SGO *sgo;
+		if (!lwgeom_fgb_reader_next(r, &sgo))
+		{
+			check(0, "fgb next", "LW_SUCCESS", "LW_FAILURE");
+			return -1;
+		}
+		if (!sgo)
+			return n;
+		if (box && !(sgo->geom && feature_intersects(sgo_id(sgo), box)))
+			check(0, "fgb query", "features in the box", "a feature outside");
+		check_feature(sgo);
+		lwgeom_sgo_free(sgo);
+		n++;
+	}
+}
+
+/// Write with or without an index, query a box and scan every feature
+static void
+test_roundtrip(uint16_t node_size)
+{
+	test_buffer file = {NULL, 0, 0};
+	lwgeom_fgb_reader *r = NULL;
+	if (!write_file(node_size, &file) || !(r = lwgeom_fgb_reader_mem(file.data, file.len)))
+	{
+		check(0, "fgb file", "written and opened", NULL);
+		free(file.data);
+		return;
+	}
+	char expected[32], got[32];
+
+	// The 6 cells of x 77 to 78 and y 5 to 7 but the null geometry, and
+	// the multi polygon of cell (76, 7) reaching 76.75
+	LWBOX box = {.xmin = 76.7, .xmax = 78, .ymin = 5, .ymax = 7};
+	int hits = 0;
+	for (int i = 0; i < NFEATURES; ++i)
+		hits += feature_intersects(i, &box);
+	snprintf(expected, sizeof(expected), "%d", hits);
+	snprintf(got, sizeof(got), "%d", read_query(r, &box));
+	check(hits == 6 && strcmp(expected, got) == 0, node_size ? "fgb index query" : "fgb scan query", expected, got);
+
+	// A box around nothing
+	LWBOX empty = {.xmin = 200, .xmax = 300, .ymin = 200, .ymax = 300};
+	snprintf(got, sizeof(got), "%d", read_query(r, &empty));
+	check(strcmp(got, "0") == 0, "fgb empty query", "0", got);
+
+	// Every feature, the null geometry included
+	snprintf(expected, sizeof(expected), "%d", NFEATURES);
+	snprintf(got, sizeof(got), "%d", read_query(r, NULL));
+	check(strcmp(expected, got) == 0, "fgb full scan", expected, got);
+
+	lwgeom_fgb_reader_free(r);
+	free(file.data);
+}
+
+/// File of \a len bytes, the magic bytes and a header of \a count features
+/// and an index of \a node_size, zeros after it
+static void
+make_header(uint8_t *file, size_t len, uint64_t count, uint16_t node_size)
+{
+	memset(file, 0, len);
+	memcpy(file, lwfgb_magic, LWFGB_MAGIC_SIZE);
+	put_u32(file + 8, 44);
+	uint8_t *h = file + 12;
+	put_u32(h, 28);      // root table
+	put_u16(h + 4, 24);  // vtable of the 10 header fields
+	put_u16(h + 6, 16);  // table size
+	put_u16(h + 8 + 2 * LWFGB_HEADER_GEOMETRY_TYPE, 14);
+	put_u16(h + 8 + 2 * LWFGB_HEADER_FEATURES_COUNT, 4);
+	put_u16(h + 8 + 2 * LWFGB_HEADER_INDEX_NODE_SIZE, 12);
+	put_u32(h + 28, 24); // table to vtable
+	put_u64(h + 32, count);
+	put_u16(h + 40, node_size);
+	h[42] = POINTTYPE;
+}
+
+/// Headers whose feature count does not fit the file, the index levels
+/// must not wrap around and send the search past the end of the file
+static void
+test_bad_headers(void)
+{
+	lwfgb_levels levels;
+	check(!lwfgb_levels_init(&levels, UINT64_C(1) << 63 | 1, 2), "levels", "LW_FAILURE", "LW_SUCCESS");
+	check(lwfgb_levels_init(&levels, 5, 2) && levels.nnodes == 11, "levels", "11 nodes", NULL);
+
+	// The file ends on a page boundary followed by a page that faults
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len = 2700;
+	uint8_t *map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED || len > page || mprotect(map + page, page, PROT_NONE) != 0)
+	{
+		check(0, "guard page", "mapped", NULL);
+		return;
+	}
+	uint8_t *file = map + page - len;
+
+	static const uint64_t counts[] = {UINT64_C(1) << 63 | 1, UINT64_MAX, 64, 61};
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	{
+		make_header(file, len, counts[i], 2);
+		lwgeom_fgb_reader *r = lwgeom_fgb_reader_mem((const char *)file, len);
+		check(r == NULL, "oversized count", "NULL reader", "reader");
+		if (r)
+		{
+			LWBOX box = {.xmin = 0, .xmax = 1, .ymin = 0, .ymax = 1};
+			lwgeom_fgb_reader_query(r, &box);
+			lwgeom_fgb_reader_free(r);
+		}
+	}
+
+	// A count whose index fits the file is accepted
+	make_header(file, len, 30, 2);
+	lwgeom_fgb_reader *r = lwgeom_fgb_reader_mem((const char *)file, len);
+	check(r != NULL, "fitting count", "reader", NULL);
+	lwgeom_fgb_reader_free(r);
+	munmap(map, 2 * page);
+}
+
+int
+main(void)
+{
+	test_roundtrip(16);
+	test_roundtrip(0);
+	test_bad_headers();
+	return test_summary();
+}
@@ -0,0 +1,493 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* GeoPackage and SpatiaLite geometry blobs: GeoPackage envelopes of every
+ * kind in both byte orders, SpatiaLite TinyPoints, compressed lines and
+ * polygons and nested collections, and borrowed against copied coordinates.
+ * The blobs are written by the test. */
+
+#include "test_util.h"
+
+#include <stdint.h>
+
+/// Blob being written, numbers in big endian when \a xdr
+typedef struct {
+	test_buffer b;
+	int xdr;
+} blob;
+
+/// Append the \a n low bytes of \a v
+static void
+put_bytes(blob *w, uint64_t v, size_t n)
+{
+	uint8_t bytes[8];
+	for (size_t i = 0; i < n; ++i)
+		bytes[i] = (uint8_t)(v >> 8 * (w->xdr ? n - 1 - i : i));
+	test_sink((const char *)bytes, n, &w->b);
+}
+
+static void
+put_u8(blob *w, uint8_t v)
+{
+	put_bytes(w, v, 1);
+}
+
+static void
+put_u32(blob *w, uint32_t v)
+{
+	put_bytes(w, v, 4);
+}
+
+static void
+put_double(blob *w, double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	put_bytes(w, v, 8);
+}
+
+static void
+put_float(blob *w, float f)
+{
+	uint32_t v;
+	memcpy(&v, &f, sizeof(v));
+	put_bytes(w, v, 4);
+}
+
+/// Whether numbers are big endian on this host, only native ones are borrowed
+static int
+host_xdr(void)
+{
+	uint16_t v = 1;
+	uint8_t first;
+	memcpy(&first, &v, 1);
+	return first == 0;
+}
+
+/// Copy of the \a w blob at \a shift bytes into an 8 bytes aligned buffer,
+/// so that tests choose whether its coordinates are aligned
+static char *
+blob_place(blob *w, size_t shift, double **buf)
+{
+	*buf = (double *)calloc(w->b.len / sizeof(double) + 2, sizeof(double));
+	if (*buf)
+		memcpy((char *)*buf + shift, w->b.data, w->b.len);
+	free(w->b.data);
+	w->b.data = NULL;
+	return *buf ? (char *)*buf + shift : NULL;
+}
+
+/* -------------------------------- GeoPackage ------------------------------- */
+
+/// GeoPackage blob of \a wkt with an envelope of kind \a envelope, the
+/// header in big endian when \a xdr
+static void
+gpkg_blob(blob *w, const char *wkt, int envelope, int xdr, int empty)
+{
+	static const int nvalues[] = {0, 4, 6, 6, 8};
+	static const double values[] = {1, 5, 2, 6, 3, 7, 4, 8};
+	memset(w, 0, sizeof(*w));
+	w->xdr = xdr;
+	put_u8(w, 'G');
+	put_u8(w, 'P');
+	put_u8(w, 0);
+	put_u8(w, (uint8_t)((xdr ? 0 : 0x01) | envelope << 1 | (empty ? 0x10 : 0)));
+	put_u32(w, 4326);
+	// minx, maxx, miny, maxy then z or m, then m
+	for (int i = 0; i < nvalues[envelope]; ++i)
+		put_double(w, envelope == 3 && i >= 4 ? values[i + 2] : values[i]);
+	LWGEOM *obj = read_wkt(wkt);
+	char *wkb = NULL;
+	size_t len = 0;
+	if (obj && lwgeom_write_wkb(obj, LW_FALSE, &wkb, &len))
+		test_sink(wkb, len, &w->b);
+	lwfree(wkb);
+	lwgeom_free(obj);
+}
+
+static void
+test_gpkg_envelopes(void)
+{
+	const char *wkt = "LINESTRING ZM (1 2 3 4,5 6 7 8)";
+	for (int xdr = 0; xdr < 2; ++xdr)
+	{
+		for (int envelope = 0; envelope <= 4; ++envelope)
+		{
+			char what[64];
+			snprintf(what, sizeof(what), "gpkg envelope %d%s", envelope, xdr ? " xdr" : "");
+			blob w;
+			gpkg_blob(&w, wkt, envelope, xdr, LW_FALSE);
+			LWBOX box;
+			int32_t srid = 0;
+			int ok = lwgeom_gpkg_envelope(w.b.data, w.b.len, &srid, &box);
+			// Only a full decode gives the extent of a line without envelope
+			check(ok == (envelope != 0), what, envelope ? "envelope" : "failure", NULL);
+			if (envelope)
+			{
+				int hasz = envelope == 2 || envelope == 4;
+				check(srid == 4326 && box.xmin == 1 && box.xmax == 5 && box.ymin == 2 && box.ymax == 6,
+				      what,
+				      "1 2 5 6",
+				      NULL);
+				check(box.zmin == (hasz ? 3 : 0) && box.zmax == (hasz ? 7 : 0), what, "z range", NULL);
+			}
+			srid = 0;
+			check_wkt(lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, &srid), wkt, what);
+			check(srid == 4326, what, "srid 4326", NULL);
+			free(w.b.data);
+		}
+	}
+
+	/* Envelope kinds above 4 and truncated headers are invalid */
+	blob w;
+	gpkg_blob(&w, wkt, 1, LW_FALSE, LW_FALSE);
+	LWBOX box;
+	w.b.data[3] = 0x01 | 5 << 1;
+	check(!lwgeom_gpkg_envelope(w.b.data, w.b.len, NULL, &box), "gpkg envelope 5", "failure", "success");
+	check(!lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, NULL), "gpkg envelope 5", "NULL", "geometry");
+	w.b.data[3] = 0x01 | 1 << 1;
+	check(!lwgeom_read_gpkg(NULL, w.b.data, 39, LW_FALSE, NULL), "gpkg truncated", "NULL", "geometry");
+	w.b.data[1] = 'X';
+	check(!lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, NULL), "gpkg magic", "NULL", "geometry");
+	free(w.b.data);
+}
+
+static void
+test_gpkg_points(void)
+{
+	/* Without an envelope, the box of a point comes from its WKB */
+	LWBOX box;
+	blob w;
+	gpkg_blob(&w, "POINT (3 4)", 0, LW_FALSE, LW_FALSE);
+	check(lwgeom_gpkg_envelope(w.b.data, w.b.len, NULL, &box) && box.xmin == 3 && box.xmax == 3 &&
+		  box.ymin == 4 && box.ymax == 4,
+	      "gpkg point envelope",
+	      "3 4 3 4",
+	      NULL);
+	check_wkt(lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, NULL), "POINT (3 4)", "gpkg point");
+	free(w.b.data);
+
+	/* Big endian header and WKB */
+	gpkg_blob(&w, "POINT EMPTY", 0, LW_TRUE, LW_FALSE);
+	w.b.len = 8;
+	put_u8(&w, 0);
+	put_u32(&w, 1);
+	put_double(&w, 3);
+	put_double(&w, 4);
+	int32_t srid = 0;
+	check(lwgeom_gpkg_envelope(w.b.data, w.b.len, &srid, &box) && srid == 4326 && box.xmin == 3 &&
+		  box.ymax == 4,
+	      "gpkg xdr point envelope",
+	      "3 4 3 4",
+	      NULL);
+	check_wkt(lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, NULL), "POINT (3 4)", "gpkg xdr point");
+	free(w.b.data);
+
+	/* The empty flag gives the inverted box, POINT EMPTY as well */
+	const char *empties[] = {"POLYGON EMPTY", "POINT EMPTY"};
+	for (int i = 0; i < 2; ++i)
+	{
+		gpkg_blob(&w, empties[i], 0, LW_FALSE, i == 0);
+		check(lwgeom_gpkg_envelope(w.b.data, w.b.len, NULL, &box) && box.xmin > box.xmax &&
+			  box.ymin > box.ymax,
+		      "gpkg empty envelope",
+		      empties[i],
+		      NULL);
+		check_wkt(lwgeom_read_gpkg(NULL, w.b.data, w.b.len, LW_FALSE, NULL), empties[i], "gpkg empty");
+		free(w.b.data);
+	}
+}
+
+static void
+test_gpkg_borrow(void)
+{
+	/* 40 bytes of header, 9 of WKB header: the points are aligned at 7 */
+	const char *wkt = "LINESTRING (0 0,1.5 2.25,-3 4)";
+	for (int borrow = 0; borrow < 2; ++borrow)
+	{
+		for (size_t shift = 6; shift < 8; ++shift)
+		{
+			blob w;
+			double *buf;
+			gpkg_blob(&w, wkt, 1, LW_FALSE, LW_FALSE);
+			size_t len = w.b.len;
+			char *data = blob_place(&w, shift, &buf);
+			LWGEOM *obj = data ? lwgeom_read_gpkg(NULL, data, len, borrow, NULL) : NULL;
+			int borrowed = obj && LWFLAGS_GET_BORROWED(obj->flags);
+			check(borrowed == (borrow && shift == 7 && !host_xdr()),
+			      "gpkg borrow",
+			      borrow ? "aligned" : "copy",
+			      NULL);
+			check(!borrowed || lwgeom_points(obj) == (double *)(data + 49), "gpkg borrow", "aliased", NULL);
+			check_wkt(obj, wkt, "gpkg borrow");
+			free(buf);
+		}
+	}
+}
+
+/* -------------------------------- SpatiaLite ------------------------------- */
+
+/// Start a SpatiaLite blob of class \a code, its MBR from \a box
+static void
+spl_begin(blob *w, int xdr, uint32_t code, const LWBOX *box)
+{
+	memset(w, 0, sizeof(*w));
+	w->xdr = xdr;
+	put_u8(w, 0x00);
+	put_u8(w, xdr ? 0x00 : 0x01);
+	put_u32(w, 4326);
+	put_double(w, box->xmin);
+	put_double(w, box->ymin);
+	put_double(w, box->xmax);
+	put_double(w, box->ymax);
+	put_u8(w, 0x7C);
+	put_u32(w, code);
+}
+
+static void
+spl_end(blob *w)
+{
+	put_u8(w, 0xFE);
+}
+
+/// Points, the inner ones as float deltas when \a compressed
+static void
+spl_points(blob *w, uint32_t n, int cdim, const double *pp, int compressed)
+{
+	put_u32(w, n);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		for (int o = 0; o < cdim; ++o)
+		{
+			double v = pp[i * cdim + o];
+			if (compressed && i > 0 && i + 1 < n)
+				put_float(w, (float)(v - pp[(i - 1) * cdim + o]));
+			else
+				put_double(w, v);
+		}
+	}
+}
+
+static const LWBOX spl_box = {.xmin = 0, .xmax = 10, .ymin = 0, .ymax = 10};
+
+static void
+test_spl_tiny(void)
+{
+	for (int xdr = 0; xdr < 2; ++xdr)
+	{
+		blob w = {{NULL, 0, 0}, xdr};
+		put_u8(&w, 0x00);
+		put_u8(&w, xdr ? 0x80 : 0x81);
+		put_u32(&w, 3857);
+		put_u8(&w, 2); // xyz
+		put_double(&w, 1);
+		put_double(&w, 2);
+		put_double(&w, 3);
+		spl_end(&w);
+		LWBOX box;
+		int32_t srid = 0;
+		check(lwgeom_spatialite_envelope(w.b.data, w.b.len, &srid, &box) && srid == 3857 && box.xmin == 1 &&
+			  box.xmax == 1 && box.ymin == 2 && box.ymax == 2,
+		      "spatialite tiny envelope",
+		      "1 2 1 2",
+		      NULL);
+		check_wkt(lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+			  "POINT Z (1 2 3)",
+			  xdr ? "spatialite tiny xdr" : "spatialite tiny");
+		w.b.data[6] = 5;
+		check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+		      "spatialite tiny dims",
+		      "NULL",
+		      "geometry");
+		free(w.b.data);
+	}
+}
+
+static void
+test_spl_compressed(void)
+{
+	static const double line[] = {0, 0, 1.5, 2.25, 3, 4.5, 10, 10};
+	static const double shell[] = {0, 0, 0, 0, 10, 1, 10, 10, 2, 10, 0, 3, 0, 0, 0};
+	static const double hole[] = {2, 2, 5, 4, 2, 5, 4, 4, 5, 2, 4, 5, 2, 2, 5};
+	for (int xdr = 0; xdr < 2; ++xdr)
+	{
+		blob w;
+		spl_begin(&w, xdr, 1000000 + LINETYPE, &spl_box);
+		spl_points(&w, 4, 2, line, LW_TRUE);
+		spl_end(&w);
+		LWBOX box;
+		check(lwgeom_spatialite_envelope(w.b.data, w.b.len, NULL, &box) && box.xmax == 10 && box.ymax == 10,
+		      "spatialite mbr",
+		      "0 0 10 10",
+		      NULL);
+		check_wkt(lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+			  "LINESTRING (0 0,1.5 2.25,3 4.5,10 10)",
+			  "spatialite compressed line");
+		free(w.b.data);
+
+		spl_begin(&w, xdr, 1000000 + 1000 + POLYTYPE, &spl_box);
+		put_u32(&w, 2);
+		spl_points(&w, 5, 3, shell, LW_TRUE);
+		spl_points(&w, 5, 3, hole, LW_TRUE);
+		spl_end(&w);
+		check_wkt(lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+			  "POLYGON Z ((0 0 0,0 10 1,10 10 2,10 0 3,0 0 0),(2 2 5,4 2 5,4 4 5,2 4 5,2 2 5))",
+			  "spatialite compressed polygon");
+		free(w.b.data);
+	}
+
+	/* Only lines and polygons are compressed */
+	blob w;
+	spl_begin(&w, LW_FALSE, 1000000 + POINTTYPE, &spl_box);
+	put_double(&w, 1);
+	put_double(&w, 2);
+	spl_end(&w);
+	check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+	      "spatialite compressed point",
+	      "NULL",
+	      "geometry");
+	free(w.b.data);
+}
+
+/// GEOMETRYCOLLECTION (POINT (1 2),GEOMETRYCOLLECTION (LINESTRING (0 0,1 1),MULTIPOINT ((3 4))))
+static void
+spl_nested(blob *w, int xdr)
+{
+	static const double line[] = {0, 0, 1, 1};
+	spl_begin(w, xdr, COLLECTIONTYPE, &spl_box);
+	put_u32(w, 2);
+	put_u8(w, 0x69);
+	put_u32(w, POINTTYPE);
+	put_double(w, 1);
+	put_double(w, 2);
+	put_u8(w, 0x69);
+	put_u32(w, COLLECTIONTYPE);
+	put_u32(w, 2);
+	put_u8(w, 0x69);
+	put_u32(w, LINETYPE);
+	spl_points(w, 2, 2, line, LW_FALSE);
+	put_u8(w, 0x69);
+	put_u32(w, MPOINTTYPE);
+	put_u32(w, 1);
+	put_u8(w, 0x69);
+	put_u32(w, POINTTYPE);
+	put_double(w, 3);
+	put_double(w, 4);
+	spl_end(w);
+}
+
+static void
+test_spl_nested(void)
+{
+	const char *wkt =
+	    "GEOMETRYCOLLECTION (POINT (1 2),GEOMETRYCOLLECTION (LINESTRING (0 0,1 1),MULTIPOINT ((3 4))))";
+	for (int xdr = 0; xdr < 2; ++xdr)
+	{
+		blob w;
+		spl_nested(&w, xdr);
+		int32_t srid = 0;
+		check_wkt(lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, &srid), wkt, "spatialite nested");
+		check(srid == 4326, "spatialite srid", "4326", NULL);
+		lwgeom_arena *arena = lwgeom_arena_new(0);
+		LWGEOM *obj = lwgeom_read_spatialite(arena, w.b.data, w.b.len, LW_FALSE, NULL);
+		check(obj && obj->arena == arena, "spatialite arena", "arena geometry", NULL);
+		check_wkt(obj, wkt, "spatialite arena");
+		lwgeom_arena_free(arena);
+
+		/* Truncated bodies, a missing end marker and trailing bytes */
+		check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len - 9, LW_FALSE, NULL),
+		      "spatialite truncated",
+		      "NULL",
+		      "geometry");
+		w.b.data[w.b.len - 1] = 0;
+		check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+		      "spatialite end marker",
+		      "NULL",
+		      "geometry");
+		w.b.data[w.b.len - 1] = (char)0xFE;
+		spl_end(&w);
+		check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL),
+		      "spatialite trailing bytes",
+		      "NULL",
+		      "geometry");
+		free(w.b.data);
+	}
+
+	/* Collections nested too deep are refused */
+	blob w;
+	spl_begin(&w, LW_FALSE, COLLECTIONTYPE, &spl_box);
+	for (int i = 0; i < 40; ++i)
+	{
+		put_u32(&w, 1);
+		put_u8(&w, 0x69);
+		put_u32(&w, COLLECTIONTYPE);
+	}
+	put_u32(&w, 0);
+	spl_end(&w);
+	check(!lwgeom_read_spatialite(NULL, w.b.data, w.b.len, LW_FALSE, NULL), "spatialite depth", "NULL", "geometry");
+	free(w.b.data);
+}
+
+static void
+test_spl_borrow(void)
+{
+	/* 43 bytes of header and the count: the points are aligned at 1 */
+	static const double line[] = {0, 0, 1.5, 2.25, -3, 4};
+	const char *wkt = "LINESTRING (0 0,1.5 2.25,-3 4)";
+	// Copied, borrowed, borrowed in the foreign byte order, borrowed compressed
+	for (int variant = 0; variant < 4; ++variant)
+	{
+		int borrow = variant != 0;
+		int xdr = (variant == 2) != host_xdr();
+		int compressed = variant == 3;
+		blob w;
+		double *buf;
+		spl_begin(&w, xdr, (compressed ? 1000000 : 0) + LINETYPE, &spl_box);
+		spl_points(&w, 3, 2, line, compressed);
+		spl_end(&w);
+		size_t len = w.b.len;
+		char *data = blob_place(&w, 1, &buf);
+		LWGEOM *obj = data ? lwgeom_read_spatialite(NULL, data, len, borrow, NULL) : NULL;
+		// Only native uncompressed points can be aliased
+		int borrowed = obj && LWFLAGS_GET_BORROWED(obj->flags);
+		check(borrowed == (borrow && xdr == host_xdr() && !compressed),
+		      "spatialite borrow",
+		      borrow ? "borrow" : "copy",
+		      NULL);
+		check(!borrowed || lwgeom_points(obj) == (double *)(data + 47), "spatialite borrow", "aliased", NULL);
+		check_wkt(obj, wkt, "spatialite borrow");
+		free(buf);
+	}
+}
+
+int
+main(void)
+{
+	test_gpkg_envelopes();
+	test_gpkg_points();
+	test_gpkg_borrow();
+	test_spl_tiny();
+	test_spl_compressed();
+	test_spl_nested();
+	test_spl_borrow();
+	return test_summary();
+}
@@ -0,0 +1,362 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Vector tile encoder: a tile of a point, a line crossing the buffer edge
+ * and a polygon whose small hole collapses, decoded back from protobuf to
+ * check the command streams, the ring winding, the shared keys and values
+ * and the layer fields. */
+
+#include "test_util.h"
+
+#include <stdint.h>
+
+#define MAX_ITEMS 16
+
+typedef struct {
+	uint64_t id;
+	uint64_t type;
+	uint32_t tags[MAX_ITEMS];
+	size_t ntags;
+	uint32_t cmds[MAX_ITEMS * 4];
+	size_t ncmds;
+} mvt_feature;
+
+typedef struct {
+	char name[32];
+	uint64_t version;
+	uint64_t extent;
+	char keys[MAX_ITEMS][16];
+	size_t nkeys;
+	char values[MAX_ITEMS][16];
+	size_t nvalues;
+	mvt_feature features[MAX_ITEMS];
+	size_t nfeatures;
+} mvt_layer;
+
+/// Protobuf message being read, \a ok is cleared by malformed input
+typedef struct {
+	const uint8_t *pos;
+	const uint8_t *end;
+	int ok;
+} pb_reader;
+
+static uint64_t
+pb_varint(pb_reader *r)
+{
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (r->pos == r->end)
+			break;
+		uint8_t b = *r->pos++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+	r->ok = LW_FALSE;
+	return 0;
+}
+
+/// Length delimited field as a message of its own
+static pb_reader
+pb_bytes(pb_reader *r)
+{
+	uint64_t len = pb_varint(r);
+	pb_reader sub = {r->pos, r->pos, r->ok};
+	if (len > (uint64_t)(r->end - r->pos))
+	{
+		r->ok = sub.ok = LW_FALSE;
+		return sub;
+	}
+	sub.end = r->pos + len;
+	r->pos += len;
+	return sub;
+}
+
+static void
+pb_string(pb_reader *r, char *text, size_t size)
+{
+	pb_reader s = pb_bytes(r);
+	size_t len = (size_t)(s.end - s.pos);
+	if (len >= size)
+	{
+		r->ok = LW_FALSE;
+		len = 0;
+	}
+	memcpy(text, s.pos, len);
+	text[len] = '\0';
+}
+
+/// Packed varints into \a out, \a max at most
+static size_t
+pb_packed(pb_reader *r, uint32_t *out, size_t max)
+{
+	pb_reader s = pb_bytes(r);
+	size_t n = 0;
+	while (s.ok && s.pos < s.end && n < max)
+		out[n++] = (uint32_t)pb_varint(&s);
+	r->ok &= s.ok && s.pos == s.end;
+	return n;
+}
+
+static void
+pb_feature(pb_reader *r, mvt_feature *f)
+{
+	while (r->ok && r->pos < r->end)
+	{
+		uint64_t key = pb_varint(r);
+		if (key == (1 << 3 | 0))
+			f->id = pb_varint(r);
+		else if (key == (2 << 3 | 2))
+			f->ntags = pb_packed(r, f->tags, MAX_ITEMS);
+		else if (key == (3 << 3 | 0))
+			f->type = pb_varint(r);
+		else if (key == (4 << 3 | 2))
+			f->ncmds = pb_packed(r, f->cmds, MAX_ITEMS * 4);
+		else
+			r->ok = LW_FALSE;
+	}
+}
+
+static void
+pb_layer(pb_reader *r, mvt_layer *l)
+{
+	while (r->ok && r->pos < r->end)
+	{
+		uint64_t key = pb_varint(r);
+		if (key == (15 << 3 | 0))
+			l->version = pb_varint(r);
+		else if (key == (1 << 3 | 2))
+			pb_string(r, l->name, sizeof(l->name));
+		else if (key == (2 << 3 | 2) && l->nfeatures < MAX_ITEMS)
+		{
+			pb_reader s = pb_bytes(r);
+			pb_feature(&s, &l->features[l->nfeatures++]);
+			r->ok &= s.ok;
+		}
+		else if (key == (3 << 3 | 2) && l->nkeys < MAX_ITEMS)
+			pb_string(r, l->keys[l->nkeys++], sizeof(l->keys[0]));
+		else if (key == (4 << 3 | 2) && l->nvalues < MAX_ITEMS)
+		{
+			// A Value message holding its string_value
+			pb_reader s = pb_bytes(r);
+			if (pb_varint(&s) != (1 << 3 | 2))
+				r->ok = LW_FALSE;
+			pb_string(&s, l->values[l->nvalues++], sizeof(l->values[0]));
+			r->ok &= s.ok && s.pos == s.end;
+		}
+		else if (key == (5 << 3 | 0))
+			l->extent = pb_varint(r);
+		else
+			r->ok = LW_FALSE;
+	}
+}
+
+/// Layers of \a tile, \a max at most
+static size_t
+pb_tile(const uint8_t *tile, size_t len, mvt_layer *layers, size_t max)
+{
+	pb_reader r = {tile, tile + len, LW_TRUE};
+	size_t n = 0;
+	while (r.ok && r.pos < r.end && n < max)
+	{
+		if (pb_varint(&r) != (3 << 3 | 2))
+			return 0;
+		pb_reader s = pb_bytes(&r);
+		memset(&layers[n], 0, sizeof(layers[n]));
+		pb_layer(&s, &layers[n++]);
+		r.ok &= s.ok;
+	}
+	return r.ok && r.pos == r.end ? n : 0;
+}
+
+/// Rings of a polygon command stream in tile units, \a max points each
+/// @return the number of rings, 0 for a malformed stream
+static size_t
+decode_rings(const mvt_feature *f, int32_t rings[][MAX_ITEMS][2], size_t *sizes, size_t max)
+{
+	int32_t x = 0, y = 0;
+	size_t nrings = 0;
+	for (size_t i = 0; i < f->ncmds;)
+	{
+		uint32_t id = f->cmds[i] & 7, count = f->cmds[i] >> 3;
+		i++;
+		if (id == 7)
+			continue;
+		if (id == 1 && (count != 1 || nrings == max))
+			return 0;
+		if (id == 1)
+			sizes[nrings++] = 0;
+		if ((id != 1 && id != 2) || nrings == 0 || i + 2 * count > f->ncmds ||
+		    sizes[nrings - 1] + count > MAX_ITEMS)
+			return 0;
+		for (uint32_t k = 0; k < count; ++k, i += 2)
+		{
+			x += (int32_t)(f->cmds[i] >> 1) ^ -(int32_t)(f->cmds[i] & 1);
+			y += (int32_t)(f->cmds[i + 1] >> 1) ^ -(int32_t)(f->cmds[i + 1] & 1);
+			rings[nrings - 1][sizes[nrings - 1]][0] = x;
+			rings[nrings - 1][sizes[nrings - 1]][1] = y;
+			sizes[nrings - 1]++;
+		}
+	}
+	return nrings;
+}
+
+/// Twice the area of a ring in tile units, positive when clockwise on screen
+static int64_t
+ring_area(int32_t ring[][2], size_t n)
+{
+	int64_t area = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		size_t j = (i + 1) % n;
+		area += (int64_t)ring[i][0] * ring[j][1] - (int64_t)ring[j][0] * ring[i][1];
+	}
+	return area;
+}
+
+static int
+same_cmds(const mvt_feature *f, const uint32_t *cmds, size_t n)
+{
+	return f->ncmds == n && memcmp(f->cmds, cmds, n * sizeof(uint32_t)) == 0;
+}
+
+static int
+same_tags(const mvt_feature *f, const uint32_t *tags, size_t n)
+{
+	return f->ntags == n && memcmp(f->tags, tags, n * sizeof(uint32_t)) == 0;
+}
+
+static void
+test_tile(void)
+{
+	/* World and tile units match on tile 0/0/0, with y pointing down */
+	mapsettings_t settings = {0, 0, 4096, 4096, 4096, 64};
+	lwgeom_mvt_encoder *enc = lwgeom_mvt_encoder_new(&settings);
+	check(enc != NULL, "mvt encoder", "encoder", NULL);
+	if (!enc)
+		return;
+	const char *keys[] = {"kind", "name"};
+	const char *point_values[] = {"a", "p"};
+	const char *line_values[] = {"a", NULL};
+	const char *poly_values[] = {"b", "p"};
+	LWGEOM *point = read_wkt("POINT (100 200)");
+	// Leaves the buffered tile at x = 4160
+	LWGEOM *line = read_wkt("LINESTRING (4000 100,4200 100)");
+	LWGEOM *poly = read_wkt("POLYGON ((1000 1000,2000 1000,2000 2000,1000 2000,1000 1000),"
+				"(1200 1200,1200 1400,1400 1400,1400 1200,1200 1200),"
+				"(1500 1500,1500.2 1500,1500.2 1500.2,1500 1500.2,1500 1500))");
+	LWGEOM *outside = read_wkt("POINT (5000 5000)");
+	int ok = point && line && poly && outside && lwgeom_mvt_encoder_tile(enc, 0, 0, 0) &&
+		 lwgeom_mvt_encoder_layer(enc, "test") &&
+		 lwgeom_mvt_encoder_feature(enc, point, 1, keys, point_values, 2) &&
+		 lwgeom_mvt_encoder_feature(enc, line, 2, keys, line_values, 2) &&
+		 lwgeom_mvt_encoder_feature(enc, poly, 3, keys, poly_values, 2) &&
+		 lwgeom_mvt_encoder_feature(enc, outside, 4, keys, poly_values, 2) &&
+		 lwgeom_mvt_encoder_layer(enc, "nothing") &&
+		 lwgeom_mvt_encoder_feature(enc, outside, 5, keys, poly_values, 2);
+	const uint8_t *tile = NULL;
+	size_t len = 0;
+	ok = ok && lwgeom_mvt_encoder_finish(enc, &tile, &len);
+	check(ok, "mvt encode", "tile", NULL);
+
+	/* The layer without a feature in the tile is left out */
+	mvt_layer layers[2];
+	size_t nlayers = ok ? pb_tile(tile, len, layers, 2) : 0;
+	check(nlayers == 1, "mvt layers", "1 layer", NULL);
+	if (nlayers == 1)
+	{
+		mvt_layer *l = &layers[0];
+		check(strcmp(l->name, "test") == 0 && l->version == 2 && l->extent == 4096,
+		      "mvt layer",
+		      "test, version 2, extent 4096",
+		      l->name);
+		check(l->nkeys == 2 && strcmp(l->keys[0], "kind") == 0 && strcmp(l->keys[1], "name") == 0,
+		      "mvt keys",
+		      "kind, name",
+		      NULL);
+		check(l->nvalues == 3 && strcmp(l->values[0], "a") == 0 && strcmp(l->values[1], "p") == 0 &&
+			  strcmp(l->values[2], "b") == 0,
+		      "mvt values",
+		      "a, p, b",
+		      NULL);
+		check(l->nfeatures == 3, "mvt features", "3", NULL);
+	}
+	if (nlayers == 1 && layers[0].nfeatures == 3)
+	{
+		mvt_feature *f = layers[0].features;
+
+		// MoveTo(1) to (100, 3896), zigzag encoded
+		static const uint32_t point_cmds[] = {9, 200, 7792};
+		static const uint32_t point_tags[] = {0, 0, 1, 1};
+		check(f[0].id == 1 && f[0].type == 1, "mvt point", "id 1, type 1", NULL);
+		check(same_cmds(&f[0], point_cmds, 3), "mvt point", "MoveTo (100 3896)", NULL);
+		check(same_tags(&f[0], point_tags, 4), "mvt point", "kind=a, name=p", NULL);
+
+		// MoveTo(1) to (4000, 3996) then LineTo(1) by (160, 0) up to the buffer edge
+		static const uint32_t line_cmds[] = {9, 8000, 7992, 10, 320, 0};
+		static const uint32_t line_tags[] = {0, 0};
+		check(f[1].id == 2 && f[1].type == 2, "mvt line", "id 2, type 2", NULL);
+		check(same_cmds(&f[1], line_cmds, 6), "mvt line", "clipped at x = 4160", NULL);
+		check(same_tags(&f[1], line_tags, 2), "mvt line", "kind=a", NULL);
+
+		/* The shell is clockwise on screen, the hole counterclockwise and
+		 * the hole smaller than a tile unit is gone */
+		static const uint32_t poly_tags[] = {0, 2, 1, 1};
+		int32_t rings[3][MAX_ITEMS][2];
+		size_t sizes[3];
+		size_t nrings = decode_rings(&f[2], rings, sizes, 3);
+		check(f[2].id == 3 && f[2].type == 3, "mvt polygon", "id 3, type 3", NULL);
+		check(same_tags(&f[2], poly_tags, 4), "mvt polygon", "kind=b, name=p", NULL);
+		check(nrings == 2 && sizes[0] == 4 && sizes[1] == 4, "mvt polygon", "2 rings of 4 points", NULL);
+		if (nrings == 2)
+		{
+			check(ring_area(rings[0], sizes[0]) == 2 * 1000 * 1000, "mvt shell", "clockwise", NULL);
+			check(ring_area(rings[1], sizes[1]) == -2 * 200 * 200, "mvt hole", "counterclockwise", NULL);
+			// MoveTo(1), LineTo(3) and ClosePath(1) for each ring
+			check(f[2].ncmds == 2 * 11 && f[2].cmds[10] == 15 && f[2].cmds[21] == 15,
+			      "mvt polygon",
+			      "ClosePath after each ring",
+			      NULL);
+		}
+	}
+
+	/* An encoder is reused from tile to tile, an empty tile has no layer */
+	ok = lwgeom_mvt_encoder_tile(enc, 1, 1, 1) && lwgeom_mvt_encoder_layer(enc, "test") &&
+	     lwgeom_mvt_encoder_feature(enc, point, 1, keys, point_values, 2) &&
+	     lwgeom_mvt_encoder_finish(enc, &tile, &len);
+	check(ok && len == 0, "mvt empty tile", "0 bytes", NULL);
+	check(!lwgeom_mvt_encoder_tile(enc, 1, 2, 0), "mvt tile range", "failure", "success");
+
+	lwgeom_free(point);
+	lwgeom_free(line);
+	lwgeom_free(poly);
+	lwgeom_free(outside);
+	lwgeom_mvt_encoder_free(enc);
+}
+
+int
+main(void)
+{
+	test_tile();
+	return test_summary();
+}
@@ -0,0 +1,1051 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Round trips of the readers and writers. Every geometry is read from WKT,
+ * encoded, decoded and written back to WKT, which has to give the text it
+ * started from. */
+
+#include "test_util.h"
+
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+
+/* Canonical WKT, as lwgeom_write_wkt() writes it */
+static const char *wkt_cases[] = {
+    "POINT (1 2)",
+    "POINT Z (1 2 3)",
+    "POINT M (1 2 4)",
+    "POINT ZM (1 2 3 4)",
+    "LINESTRING (0 0,1.5 2.25,-3 4)",
+    "POLYGON ((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))",
+    "MULTIPOINT ((1 2),(3 4))",
+    "MULTILINESTRING ((0 0,1 1),(2 2,3 3,4 5))",
+    "MULTIPOLYGON (((0 0,1 0,1 1,0 0)),((5 5,6 5,6 6,5 5)))",
+    "GEOMETRYCOLLECTION (POINT (1 2),LINESTRING (0 0,1 1))",
+    "GEOMETRYCOLLECTION Z (POINT Z (1 2 3),LINESTRING Z (0 0 1,1 1 2))",
+};
+
+/* EMPTY geometries and EMPTY members, not kept by Oracle SDO. TWKB has
+ * no empty point in a multi point, MULTIPOINT ((1 2),EMPTY) is only read
+ * back from WKT and from the serialized format. */
+static const char *empty_cases[] = {
+    "POINT EMPTY",
+    "POINT Z EMPTY",
+    "LINESTRING EMPTY",
+    "POLYGON EMPTY",
+    "POLYGON ZM EMPTY",
+    "MULTIPOINT EMPTY",
+    "MULTIPOLYGON (EMPTY,((0 0,1 0,1 1,0 0)))",
+    "GEOMETRYCOLLECTION EMPTY",
+    "GEOMETRYCOLLECTION (POLYGON EMPTY,POINT (1 2))",
+};
+
+static void
+test_wkt(const char *wkt)
+{
+	check_wkt(read_wkt(wkt), wkt, "wkt");
+}
+
+static void
+test_twkb(const char *wkt)
+{
+	LWGEOM *obj = read_wkt(wkt);
+	lwgeom_twkb_options options = {2, 2, 2, LWGEOM_TWKB_BBOX | LWGEOM_TWKB_SIZE, NULL};
+	char *twkb = NULL;
+	size_t len = 0;
+	LWGEOM *back = NULL;
+	if (obj && lwgeom_write_twkb(obj, &options, &twkb, &len))
+		back = lwgeom_read_twkb(twkb, len);
+	lwfree(twkb);
+	lwgeom_free(obj);
+	check_wkt(back, wkt, "twkb");
+}
+
+static void
+test_serialized(const char *wkt)
+{
+	for (int bbox = 0; bbox < 2; ++bbox)
+	{
+		LWGEOM *obj = read_wkt(wkt);
+		size_t size = 0;
+		LWSERIALIZED *s = obj ? lwgeom_serialize(obj, bbox, &size) : NULL;
+		LWGEOM *back = s ? lwgeom_deserialize(s) : NULL;
+		check(!s || lwserialized_size(s) == size, "serialized size", wkt, NULL);
+		lwfree(s);
+		lwgeom_free(obj);
+		check_wkt(back, wkt, bbox ? "serialized with bbox" : "serialized");
+	}
+}
+
+static void
+test_ora(const char *wkt, const char *expected)
+{
+	LWGEOM *obj = read_wkt(wkt);
+	LWGEOM_SDO sdo;
+	LWGEOM *back = NULL;
+	if (obj && lwgeom_write_ora(obj, &sdo))
+	{
+		back = lwgeom_read_ora(sdo, 0);
+		lwgeom_ora_free(&sdo);
+	}
+	lwgeom_free(obj);
+	check_wkt(back, expected, "ora");
+}
+
+static void
+test_ora_sdo(int gtype, int *info, size_t ninfo, double *ord, size_t nord, const char *expected)
+{
+	LWGEOM_SDO sdo = {gtype, 0, ninfo, info, nord, ord};
+	check_wkt(lwgeom_read_ora(sdo, 0), expected, "ora sdo");
+}
+
+/// Read \a wkt back from WKB and EWKB in both byte orders, binary and hex,
+/// and from every truncation of its WKB, which has to fail
+static void
+test_wkb(const char *wkt)
+{
+	static const uint8_t variants[] = {LWGEOM_WKB_ISO,
+					   LWGEOM_WKB_ISO | LWGEOM_WKB_XDR,
+					   LWGEOM_WKB_EXTENDED,
+					   LWGEOM_WKB_EXTENDED | LWGEOM_WKB_XDR};
+	LWGEOM *obj = read_wkt(wkt);
+	if (!obj)
+	{
+		check(0, "wkb", wkt, NULL);
+		return;
+	}
+	for (size_t v = 0; v < sizeof(variants); ++v)
+	{
+		for (int hex = 0; hex < 2; ++hex)
+		{
+			uint8_t variant = variants[v] | (hex ? LWGEOM_WKB_HEX : 0);
+			size_t len = lwgeom_wkb_size(obj, variant);
+			char *wkb = (char *)malloc(len);
+			if (!wkb || lwgeom_write_wkb_buf(obj, variant, wkb, len) != len)
+			{
+				check(0, "wkb write", wkt, NULL);
+				free(wkb);
+				continue;
+			}
+			char what[32];
+			snprintf(what,
+				 sizeof(what),
+				 "wkb %s %s%s",
+				 variant & LWGEOM_WKB_EXTENDED ? "ewkb" : "iso",
+				 variant & LWGEOM_WKB_XDR ? "xdr" : "ndr",
+				 hex ? " hex" : "");
+			check_wkt(lwgeom_read_wkb(wkb, len, hex), wkt, what);
+			if (variant == LWGEOM_WKB_EXTENDED)
+				check_wkt(lwgeom_read_ewkb(wkb, len), wkt, "ewkb");
+			if (hex)
+			{
+				// Hex digits in lower case read the same
+				for (size_t i = 0; i < len; ++i)
+					wkb[i] = (char)(wkb[i] >= 'A' && wkb[i] <= 'F' ? wkb[i] - 'A' + 'a' : wkb[i]);
+				check_wkt(lwgeom_read_wkb(wkb, len, hex), wkt, "wkb lower case hex");
+				check(!lwgeom_read_wkb(wkb, len - 1, hex), "wkb odd hex", wkt, "geometry");
+			}
+			else if (variant == LWGEOM_WKB_ISO)
+			{
+				for (size_t n = 0; n < len; ++n)
+				{
+					LWGEOM *cut = lwgeom_read_wkb(wkb, n, LW_FALSE);
+					check(!cut, "wkb truncated", wkt, "geometry");
+					lwgeom_free(cut);
+				}
+			}
+			free(wkb);
+		}
+	}
+	lwgeom_free(obj);
+}
+
+/// Write \a wkt as WKB into caller buffers: a size query, a buffer one byte
+/// short that is left untouched, and one of the exact size
+static void
+test_wkb_buf(const char *wkt)
+{
+	static const uint8_t variants[] = {LWGEOM_WKB_ISO,
+					   LWGEOM_WKB_ISO | LWGEOM_WKB_XDR | LWGEOM_WKB_HEX,
+					   LWGEOM_WKB_EXTENDED,
+					   LWGEOM_WKB_EXTENDED | LWGEOM_WKB_XDR};
+	LWGEOM *obj = read_wkt(wkt);
+	for (size_t v = 0; obj && v < sizeof(variants); ++v)
+	{
+		uint8_t variant = variants[v];
+		int hex = (variant & LWGEOM_WKB_HEX) != 0;
+		size_t len = lwgeom_write_wkb_buf(obj, variant, NULL, 0);
+		char *buf = (char *)malloc(len + 1);
+		if (!buf || len != lwgeom_wkb_size(obj, variant))
+		{
+			check(0, "wkb size", wkt, NULL);
+			free(buf);
+			continue;
+		}
+		memset(buf, '#', len + 1);
+		size_t short_len = lwgeom_write_wkb_buf(obj, variant, buf, len - 1);
+		int untouched = 1;
+		for (size_t i = 0; i <= len; ++i)
+			untouched &= buf[i] == '#';
+		check(short_len == len && untouched, "wkb short buffer", wkt, "written");
+		check(lwgeom_write_wkb_buf(obj, variant, buf, len) == len && buf[len] == '#',
+		      "wkb exact buffer",
+		      wkt,
+		      "overrun");
+		check_wkt(lwgeom_read_wkb(buf, len, hex), wkt, "wkb exact buffer");
+
+		/* The allocating writers give the same bytes */
+		char *out = NULL;
+		size_t out_len = 0;
+		if (variant == LWGEOM_WKB_ISO && lwgeom_write_wkb(obj, LW_FALSE, &out, &out_len))
+			check(out_len == len && memcmp(out, buf, len) == 0, "wkb", wkt, "other bytes");
+		if (variant == LWGEOM_WKB_EXTENDED && lwgeom_write_ewkb(obj, &out, &out_len))
+			check(out_len == len && memcmp(out, buf, len) == 0, "ewkb", wkt, "other bytes");
+		lwfree(out);
+		free(buf);
+	}
+	lwgeom_free(obj);
+}
+
+/// Write all \a n cases back to back, all of them or none
+static void
+test_wkb_batch(const char *const *wkts, uint32_t n)
+{
+	LWGEOM *objs[16];
+	size_t offsets[17];
+	assert(n <= 16);
+	uint32_t nobjs = 0;
+	while (nobjs < n && (objs[nobjs] = read_wkt(wkts[nobjs])))
+		++nobjs;
+	check(nobjs == n, "wkb batch", "every case", NULL);
+	const LWGEOM *const *all = (const LWGEOM *const *)objs;
+	size_t len = lwgeom_write_wkb_batch(all, nobjs, LWGEOM_WKB_ISO, NULL, 0, offsets);
+	char *buf = (char *)malloc(len + 1);
+	if (buf)
+	{
+		memset(buf, '#', len + 1);
+		size_t short_len = lwgeom_write_wkb_batch(all, nobjs, LWGEOM_WKB_ISO, buf, len - 1, NULL);
+		check(short_len == len && buf[0] == '#', "wkb batch short buffer", "nothing written", NULL);
+		size_t exact_len = lwgeom_write_wkb_batch(all, nobjs, LWGEOM_WKB_ISO, buf, len, NULL);
+		check(exact_len == len && buf[len] == '#' && offsets[nobjs] == len, "wkb batch", "exact buffer", NULL);
+		for (uint32_t i = 0; i < nobjs; ++i)
+			check_wkt(lwgeom_read_wkb(buf + offsets[i], offsets[i + 1] - offsets[i], LW_FALSE),
+				  wkts[i],
+				  "wkb batch");
+	}
+	free(buf);
+	for (uint32_t i = 0; i < nobjs; ++i)
+		lwgeom_free(objs[i]);
+}
+
+/// Read \a wkt from little and big endian WKB at each alignment: only
+/// native, 8 bytes aligned coordinates are aliased by the borrowing reader
+static void
+test_wkb_borrow(const char *wkt, size_t aligned)
+{
+	LWGEOM *obj = read_wkt(wkt);
+	size_t len = obj ? lwgeom_wkb_size(obj, LWGEOM_WKB_ISO) : 0;
+	double *buf = (double *)calloc(len / sizeof(double) + 2, sizeof(double));
+	for (int xdr = 0; obj && buf && xdr < 2; ++xdr)
+	{
+		for (size_t shift = 0; shift < 8; ++shift)
+		{
+			char *wkb = (char *)buf + shift;
+			lwgeom_write_wkb_buf(obj, LWGEOM_WKB_ISO | (xdr ? LWGEOM_WKB_XDR : 0), wkb, len);
+			LWGEOM *back = lwgeom_read_wkb_borrow(NULL, wkb, len);
+			int borrowed = back && LWFLAGS_GET_BORROWED(back->flags);
+			check(borrowed == (!xdr && shift == aligned),
+			      "wkb borrow",
+			      wkt,
+			      borrowed ? "borrowed" : "copied");
+			check(!borrowed || (const char *)lwgeom_points(back) == wkb + len - 16 * back->npoints,
+			      "wkb borrow",
+			      "aliased",
+			      NULL);
+			check_wkt(back, wkt, "wkb borrow");
+		}
+	}
+	lwgeom_free(obj);
+	free(buf);
+}
+
+/* Batches of one GeoArrow type each */
+static const char *arrow_cases[][3] = {
+    {"POINT (1 2)", "POINT (3 4)", "POINT (-5 6.5)"},
+    {"LINESTRING Z (0 0 1,1 1 2)", "LINESTRING Z (2 2 3,3 3 4,4 5 6)", "LINESTRING Z EMPTY"},
+    {"POLYGON ((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))", "POLYGON EMPTY", "POLYGON ((0 0,1 0,1 1,0 0))"},
+    {"MULTIPOINT M ((1 2 3),(3 4 5))", "MULTIPOINT M ((5 6 7))", "MULTIPOINT M EMPTY"},
+    {"MULTILINESTRING ((0 0,1 1),(2 2,3 3,4 5))", "MULTILINESTRING EMPTY", "MULTILINESTRING ((1 1,2 2))"},
+    {"MULTIPOLYGON (((0 0,1 0,1 1,0 0)),((5 5,6 5,6 6,5 5)))",
+     "MULTIPOLYGON EMPTY",
+     "MULTIPOLYGON (((0 0,1 0,1 1,0 0),(0.2 0.1,0.8 0.1,0.8 0.7,0.2 0.1)))"},
+};
+
+/// Export a batch of \a n geometries to Arrow and import it back, the
+/// coordinates are moved both ways without a copy
+static void
+test_arrow(const char *const *wkts, size_t n)
+{
+	LWGEOM *first = read_wkt(wkts[0]);
+	LWGEOM_BATCH *batch =
+	    first ? lwgeom_batch_new(LWFLAGS_GET_Z(first->flags) != 0, LWFLAGS_GET_M(first->flags) != 0) : NULL;
+	lwgeom_free(first);
+	int ok = batch != NULL;
+	for (size_t i = 0; ok && i < n; ++i)
+		ok = lwgeom_batch_append_wkt(batch, wkts[i], strlen(wkts[i]));
+	check(ok, "arrow batch", wkts[0], NULL);
+	if (!ok)
+	{
+		lwgeom_batch_free(batch);
+		return;
+	}
+	const double *coords = batch->coords;
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+	if (!lwgeom_batch_to_arrow(batch, &schema, &array))
+	{
+		check(0, "arrow export", wkts[0], NULL);
+		lwgeom_batch_free(batch);
+		return;
+	}
+	LWGEOM_BATCH *back = lwgeom_batch_from_arrow(&schema, &array);
+	check(back && back->ngeoms == n, "arrow import", wkts[0], NULL);
+	check(!back || back->coords == coords, "arrow import", "coordinates moved", "copied");
+	for (uint32_t i = 0; back && i < back->ngeoms; ++i)
+		check_wkt(lwgeom_batch_get(back, i), wkts[i], "arrow");
+	if (back)
+		lwgeom_batch_free(back);
+	else
+		array.release(&array);
+	schema.release(&schema);
+}
+
+/// lwgeom_source handing out \a text at most \a step bytes at a time
+typedef struct {
+	const char *text;
+	size_t len;
+	size_t pos;
+	size_t step;
+} chunked_source;
+
+static size_t
+chunked_read(char *buf, size_t size, void *arg)
+{
+	chunked_source *src = (chunked_source *)arg;
+	size_t n = src->len - src->pos;
+	n = n < size ? n : size;
+	n = n < src->step ? n : src->step;
+	memcpy(buf, src->text + src->pos, n);
+	src->pos += n;
+	return n;
+}
+
+/// Write \a doc to a new file named from the mkstemp() template \a path
+/// @return whether the file was written, it is to be unlinked then
+static int
+write_temp_file(char *path, const test_buffer *doc)
+{
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return LW_FALSE;
+	FILE *file = fdopen(fd, "wb");
+	if (!file)
+	{
+		close(fd);
+		unlink(path);
+		return LW_FALSE;
+	}
+	int written = fwrite(doc->data, 1, doc->len, file) == doc->len;
+	written = fclose(file) == 0 && written;
+	if (!written)
+		unlink(path);
+	return written;
+}
+
+static void
+buffer_append(test_buffer *b, const char *text)
+{
+	test_sink(text, strlen(text), b);
+}
+
+/// Line of \a n points as WKT, longer than a block of the streaming readers
+static void
+long_line_wkt(test_buffer *b, int n)
+{
+	char point[32];
+	buffer_append(b, "LINESTRING (");
+	for (int i = 0; i < n; ++i)
+	{
+		snprintf(point, sizeof(point), "%s%d %d.5", i ? "," : "", i, i % 1000);
+		buffer_append(b, point);
+	}
+	test_sink(")", 2, b);
+}
+
+/// "key=value;" for each property of \a sgo, the values as JSON text
+static void
+sgo_props(const LW_SGO *sgo, char *buf, size_t size)
+{
+	const char *text = lwgeom_sgo_text(sgo);
+	size_t n = 0;
+	buf[0] = '\0';
+	for (size_t k = 0; k + 3 < sgo->prop_size && n < size; k += 4)
+	{
+		const int *p = sgo->properties + k;
+		n += (size_t)snprintf(buf + n, size - n, "%.*s=%.*s;", p[1], text + p[0], p[3], text + p[2]);
+	}
+}
+
+/// Read the \a n features of the \a wkts geometries with their properties,
+/// then one with a null geometry and the end of the collection
+static void
+check_geojson_features(lwgeom_geojson_reader *r, const char *const *wkts, size_t n, const char *what)
+{
+	char props[256], expected[256];
+	for (size_t i = 0; r && i < n + 1; ++i)
+	{
+		LW_SGO *sgo = NULL;
+		if (!lwgeom_geojson_reader_next(r, &sgo) || !sgo)
+		{
+			check(0, what, i < n ? wkts[i] : "null geometry", NULL);
+			return;
+		}
+		sgo_props(sgo, props, sizeof(props));
+		snprintf(expected, sizeof(expected), "i=%zu;s=\"a \\\"}] b\";o={\"k\": [1, 2]};", i);
+		if (i == n)
+			check(!sgo->geom && sgo->prop_size == 0, what, "null geometry and properties", NULL);
+		else
+			check(strcmp(props, expected) == 0, what, expected, props);
+		if (i < n)
+		{
+			check_wkt(sgo->geom, wkts[i], what);
+			sgo->geom = NULL;
+		}
+		lwgeom_sgo_free(sgo);
+	}
+	LW_SGO *sgo = NULL;
+	check(r && lwgeom_geojson_reader_next(r, &sgo) && !sgo, what, "end of the collection", NULL);
+	lwgeom_sgo_free(sgo);
+}
+
+/// The cases GeoJSON holds, it has no M, then a line longer than a block
+/// @return the number of \a wkts, 16 at most
+static size_t
+geojson_cases(const char *const *cases, size_t ncases, const char **wkts, test_buffer *line)
+{
+	long_line_wkt(line, 5000);
+	size_t n = 0;
+	for (size_t i = 0; i < ncases && n < 15; ++i)
+	{
+		if (!strstr(cases[i], " M ") && !strstr(cases[i], " ZM "))
+			wkts[n++] = cases[i];
+	}
+	wkts[n++] = line->data;
+	return n;
+}
+
+/// Read a FeatureCollection of the cases whole, from a file and through
+/// sources cutting it at every few bytes
+static void
+test_geojson_reader(const char *const *cases, size_t ncases)
+{
+	const char *wkts[16];
+	test_buffer line = {NULL, 0, 0};
+	size_t n = geojson_cases(cases, ncases, wkts, &line);
+
+	test_buffer doc = {NULL, 0, 0};
+	buffer_append(&doc, "{\"type\": \"FeatureCollection\", \"name\": \"cases\",\n\"features\": [\n");
+	for (size_t i = 0; i < n; ++i)
+	{
+		char head[64], *json = NULL;
+		LWGEOM *obj = read_wkt(wkts[i]);
+		if (!obj || !lwgeom_write_geojson(obj, &json, NULL))
+			check(0, "geojson write", wkts[i], NULL);
+		lwgeom_free(obj);
+		snprintf(head, sizeof(head), "{\"type\":\"Feature\", \"id\": %zu,\n \"geometry\": ", i);
+		buffer_append(&doc, head);
+		buffer_append(&doc, json ? json : "null");
+		lwfree(json);
+		snprintf(head, sizeof(head), ", \"properties\": {\"i\": %zu, ", i);
+		buffer_append(&doc, head);
+		buffer_append(&doc, "\"s\": \"a \\\"}] b\", \"o\": {\"k\": [1, 2]}}},\n");
+	}
+	buffer_append(&doc, "{\"type\": \"Feature\", \"geometry\": null, \"properties\": null}\n],\n");
+	buffer_append(&doc, "\"bbox\": [0, 0, 5000, 1000]}\n");
+
+	lwgeom_geojson_reader *r = lwgeom_geojson_reader_mem(doc.data, doc.len);
+	check_geojson_features(r, wkts, n, "geojson mem");
+	lwgeom_geojson_reader_free(r);
+
+	static const size_t steps[] = {1, 7, 4096};
+	for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); ++k)
+	{
+		chunked_source src = {doc.data, doc.len, 0, steps[k]};
+		r = lwgeom_geojson_reader_new(chunked_read, &src);
+		check_geojson_features(r, wkts, n, "geojson chunked");
+		lwgeom_geojson_reader_free(r);
+	}
+
+	char path[] = "/tmp/lwgeom_geojson_XXXXXX";
+	int written = write_temp_file(path, &doc);
+	r = written ? lwgeom_geojson_reader_open(path) : NULL;
+	check(r != NULL, "geojson file", path, NULL);
+	check_geojson_features(r, wkts, n, "geojson file");
+	lwgeom_geojson_reader_free(r);
+	if (written)
+		unlink(path);
+
+	/* A document cut short fails after the features it holds */
+	chunked_source src = {doc.data, doc.len - line.len, 0, 7};
+	r = lwgeom_geojson_reader_new(chunked_read, &src);
+	LW_SGO *sgo = NULL;
+	int ok = LW_TRUE;
+	while (r && (ok = lwgeom_geojson_reader_next(r, &sgo)) && sgo)
+		lwgeom_sgo_free(sgo);
+	check(r && !ok, "geojson truncated", "failure", "success");
+	lwgeom_geojson_reader_free(r);
+
+	/* A sequence of features and bare geometries */
+	const char *seq = "{\"type\":\"Point\",\"coordinates\":[1,2]}\n"
+			  "{\"type\":\"Feature\",\"properties\":{\"a\":\"b\"},"
+			  "\"geometry\":{\"type\":\"LineString\",\"coordinates\":[[0,0],[1,1]]}}\n";
+	chunked_source seq_src = {seq, strlen(seq), 0, 3};
+	r = lwgeom_geojson_reader_new(chunked_read, &seq_src);
+	const char *seq_wkts[] = {"POINT (1 2)", "LINESTRING (0 0,1 1)"};
+	for (int i = 0; r && i < 2; ++i)
+	{
+		sgo = NULL;
+		check(lwgeom_geojson_reader_next(r, &sgo) && sgo, "geojson sequence", seq_wkts[i], NULL);
+		if (!sgo)
+			break;
+		check_wkt(sgo->geom, seq_wkts[i], "geojson sequence");
+		sgo->geom = NULL;
+		lwgeom_sgo_free(sgo);
+	}
+	lwgeom_geojson_reader_free(r);
+	free(doc.data);
+	free(line.data);
+}
+
+/// lwgeom_sink keeping the text and the size of the chunks it is handed
+typedef struct {
+	test_buffer text;
+	size_t nchunks;
+	size_t largest;
+	int fail;
+} chunk_sink;
+
+static int
+chunk_record(const char *data, size_t len, void *arg)
+{
+	chunk_sink *s = (chunk_sink *)arg;
+	s->nchunks++;
+	s->largest = len > s->largest ? len : s->largest;
+	return !s->fail && test_sink(data, len, &s->text);
+}
+
+/// Write the features of check_geojson_features() in chunks of 1 KB and
+/// read them back, a feature at a time when flushing
+static void
+test_geojson_writer(const char *const *cases, size_t ncases)
+{
+	const char *wkts[16];
+	test_buffer line = {NULL, 0, 0};
+	size_t n = geojson_cases(cases, ncases, wkts, &line);
+
+	static const int flags[] = {0, LWGEOM_GEOJSON_FLUSH | LWGEOM_GEOJSON_BBOX};
+	for (size_t k = 0; k < sizeof(flags) / sizeof(flags[0]); ++k)
+	{
+		chunk_sink s = {{NULL, 0, 0}, 0, 0, LW_FALSE};
+		lwgeom_geojson_writer *w = lwgeom_geojson_writer_new(-1, flags[k], 1024, chunk_record, &s);
+		check(w != NULL, "geojson writer", "writer", NULL);
+		for (size_t i = 0; w && i <= n; ++i)
+		{
+			char props[64];
+			int len = snprintf(
+			    props, sizeof(props), "{\"i\": %zu, \"s\": \"a \\\"}] b\", \"o\": {\"k\": [1, 2]}}", i);
+			LWGEOM *obj = i < n ? read_wkt(wkts[i]) : NULL;
+			int ok = lwgeom_geojson_writer_feature(w, obj, i < n ? props : NULL, i < n ? (size_t)len : 0);
+			check(ok, "geojson writer", i < n ? wkts[i] : "null geometry", "failure");
+			lwgeom_free(obj);
+			// The sink holds every complete feature
+			if (flags[k] & LWGEOM_GEOJSON_FLUSH)
+				check(s.text.len && s.text.data[s.text.len - 1] == '}',
+				      "geojson flush",
+				      i < n ? wkts[i] : "null",
+				      NULL);
+		}
+		check(w && lwgeom_geojson_writer_finish(w), "geojson writer", "finish", "failure");
+		lwgeom_geojson_writer_free(w);
+		check(s.largest <= 1024 && s.nchunks > line.len / 1024, "geojson writer", "chunks of 1 KB", NULL);
+		lwgeom_geojson_reader *r = lwgeom_geojson_reader_mem(s.text.data, s.text.len);
+		check_geojson_features(r, wkts, n, "geojson writer");
+		lwgeom_geojson_reader_free(r);
+		free(s.text.data);
+	}
+
+	/* The single geometry writer streams the same text */
+	LWGEOM *obj = read_wkt(line.data);
+	char *json = NULL;
+	size_t len = 0;
+	chunk_sink s = {{NULL, 0, 0}, 0, 0, LW_FALSE};
+	int ok = obj && lwgeom_write_geojson(obj, &json, &len) &&
+		 lwgeom_write_geojson_sink(obj, -1, 0, chunk_record, &s);
+	check(ok && s.text.len == len && memcmp(s.text.data, json, len) == 0, "geojson sink", "same text", NULL);
+	check(s.largest <= 1024 && s.nchunks > 1, "geojson sink", "chunks", NULL);
+	lwfree(json);
+	free(s.text.data);
+
+	/* JSON has no NaN, nor does a failed sink take more text */
+	double *pp = obj ? lwgeom_points(obj) : NULL;
+	if (pp)
+		pp[3] = NAN;
+	s = (chunk_sink){{NULL, 0, 0}, 0, 0, LW_FALSE};
+	check(pp && !lwgeom_write_geojson(obj, &json, NULL) && !json, "geojson nan", "failure", "success");
+	check(pp && !lwgeom_write_geojson_sink(obj, -1, 0, chunk_record, &s), "geojson nan", "failure", "success");
+	lwgeom_geojson_writer *w = lwgeom_geojson_writer_new(-1, 0, 1024, chunk_record, &s);
+	check(w && !lwgeom_geojson_writer_feature(w, obj, NULL, 0) && !lwgeom_geojson_writer_finish(w),
+	      "geojson writer nan",
+	      "failure",
+	      "success");
+	lwgeom_geojson_writer_free(w);
+	lwgeom_free(obj);
+	free(s.text.data);
+
+	s = (chunk_sink){{NULL, 0, 0}, 0, 0, LW_TRUE};
+	w = lwgeom_geojson_writer_new(-1, LWGEOM_GEOJSON_FLUSH, 0, chunk_record, &s);
+	obj = read_wkt("POINT (1 2)");
+	check(w && !lwgeom_geojson_writer_feature(w, obj, NULL, 0) && s.nchunks == 1 &&
+		  !lwgeom_geojson_writer_feature(w, obj, NULL, 0) && s.nchunks == 1,
+	      "geojson writer sink failure",
+	      "stop",
+	      NULL);
+	lwgeom_geojson_writer_free(w);
+	lwgeom_free(obj);
+	free(line.data);
+}
+
+/// Geometry with its "bbox" written at \a precision
+static void
+test_geojson_bbox(const char *wkt, int precision, const char *expected)
+{
+	LWGEOM *obj = read_wkt(wkt);
+	test_buffer out = {NULL, 0, 0};
+	int ok = obj && lwgeom_write_geojson_sink(obj, precision, LWGEOM_GEOJSON_BBOX, test_sink, &out) &&
+		 test_sink("", 1, &out);
+	check(ok && strcmp(out.data, expected) == 0, "geojson bbox", expected, ok ? out.data : NULL);
+	lwgeom_free(obj);
+	free(out.data);
+}
+
+/* The same geometry in KML, GML2 and GML3, NULL where a dialect has no
+ * such spelling of it */
+typedef struct {
+	const char *wkt;
+	const char *kml;
+	const char *gml2;
+	const char *gml3;
+} xml_case;
+
+static const xml_case xml_cases[] = {
+    {"POINT (1 2)",
+     "<Point><coordinates>1,2</coordinates></Point>",
+     "<gml:Point><gml:coordinates>1,2</gml:coordinates></gml:Point>",
+     "<gml:Point><gml:pos>1 2</gml:pos></gml:Point>"},
+    {"POINT Z (1 2 3)",
+     "<Point><coordinates>1,2,3</coordinates></Point>",
+     "<gml:Point><gml:coord><gml:X>1</gml:X><gml:Y>2</gml:Y><gml:Z>3</gml:Z></gml:coord></gml:Point>",
+     "<gml:Point srsDimension=\"3\"><gml:pos>1 2 3</gml:pos></gml:Point>"},
+    {"LINESTRING (0 0,1.5 2.25,-3 4)",
+     "<LineString><coordinates>0,0 1.5,2.25\n\t-3,4</coordinates></LineString>",
+     "<gml:LineString><gml:coordinates cs=\";\" ts=\"|\">0;0|1.5;2.25|-3;4</gml:coordinates></gml:LineString>",
+     "<gml:LineString><gml:posList>0 0 1.5 2.25 -3 4</gml:posList></gml:LineString>"},
+    {"LINESTRING Z (0 0 1,2 2 3)",
+     "<LineString><coordinates>0,0,1 2,2,3</coordinates></LineString>",
+     "<gml:LineString><gml:coordinates>0,0,1 2,2,3</gml:coordinates></gml:LineString>",
+     "<gml:LineString><gml:posList srsDimension=\"3\">0 0 1 2 2 3</gml:posList></gml:LineString>"},
+    {"LINESTRING (0 0,1 1,2 0)",
+     NULL,
+     NULL,
+     "<gml:Curve><gml:segments><gml:LineStringSegment><gml:posList>0 0 1 1 2 0</gml:posList>"
+     "</gml:LineStringSegment></gml:segments></gml:Curve>"},
+    {"POLYGON ((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))",
+     "<Polygon><outerBoundaryIs><LinearRing><coordinates>0,0 10,0 10,10 0,10 0,0</coordinates></LinearRing>"
+     "</outerBoundaryIs><innerBoundaryIs><LinearRing><coordinates>2,2 2,4 4,4 4,2 2,2</coordinates>"
+     "</LinearRing></innerBoundaryIs></Polygon>",
+     "<gml:Polygon><gml:outerBoundaryIs><gml:LinearRing><gml:coordinates>0,0 10,0 10,10 0,10 0,0"
+     "</gml:coordinates></gml:LinearRing></gml:outerBoundaryIs><gml:innerBoundaryIs><gml:LinearRing>"
+     "<gml:coordinates>2,2 2,4 4,4 4,2 2,2</gml:coordinates></gml:LinearRing></gml:innerBoundaryIs></gml:Polygon>",
+     "<gml:Polygon><gml:interior><gml:LinearRing><gml:posList>2 2 2 4 4 4 4 2 2 2</gml:posList></gml:LinearRing>"
+     "</gml:interior><gml:exterior><gml:LinearRing><gml:posList>0 0 10 0 10 10 0 10 0 0</gml:posList>"
+     "</gml:LinearRing></gml:exterior></gml:Polygon>"},
+    {"POLYGON ((0 0,1 0,1 1,0 0))",
+     NULL,
+     NULL,
+     "<gml:Surface><gml:patches><gml:PolygonPatch><gml:exterior><gml:LinearRing><gml:posList>0 0 1 0 1 1 0 0"
+     "</gml:posList></gml:LinearRing></gml:exterior></gml:PolygonPatch></gml:patches></gml:Surface>"},
+    {"MULTIPOINT ((1 2),(3 4))",
+     "<MultiGeometry><Point><coordinates>1,2</coordinates></Point><Point><coordinates>3,4</coordinates></Point>"
+     "</MultiGeometry>",
+     "<gml:MultiPoint><gml:pointMember><gml:Point><gml:coordinates>1,2</gml:coordinates></gml:Point>"
+     "</gml:pointMember><gml:pointMember><gml:Point><gml:coordinates>3,4</gml:coordinates></gml:Point>"
+     "</gml:pointMember></gml:MultiPoint>",
+     "<gml:MultiPoint><gml:pointMembers><gml:Point><gml:pos>1 2</gml:pos></gml:Point><gml:Point><gml:pos>3 4"
+     "</gml:pos></gml:Point></gml:pointMembers></gml:MultiPoint>"},
+    {"MULTILINESTRING ((0 0,1 1),(2 2,3 3,4 5))",
+     "<MultiGeometry><LineString><coordinates>0,0 1,1</coordinates></LineString><LineString><coordinates>"
+     "2,2 3,3 4,5</coordinates></LineString></MultiGeometry>",
+     "<gml:MultiLineString><gml:lineStringMember><gml:LineString><gml:coordinates>0,0 1,1</gml:coordinates>"
+     "</gml:LineString></gml:lineStringMember><gml:lineStringMember><gml:LineString><gml:coordinates>"
+     "2,2 3,3 4,5</gml:coordinates></gml:LineString></gml:lineStringMember></gml:MultiLineString>",
+     "<gml:MultiCurve><gml:curveMember><gml:LineString><gml:posList>0 0 1 1</gml:posList></gml:LineString>"
+     "</gml:curveMember><gml:curveMember><gml:LineString><gml:posList>2 2 3 3 4 5</gml:posList></gml:LineString>"
+     "</gml:curveMember></gml:MultiCurve>"},
+    {"MULTIPOLYGON (((0 0,1 0,1 1,0 0)),((5 5,6 5,6 6,5 5)))",
+     "<MultiGeometry><Polygon><outerBoundaryIs><LinearRing><coordinates>0,0 1,0 1,1 0,0</coordinates>"
+     "</LinearRing></outerBoundaryIs></Polygon><Polygon><outerBoundaryIs><LinearRing><coordinates>"
+     "5,5 6,5 6,6 5,5</coordinates></LinearRing></outerBoundaryIs></Polygon></MultiGeometry>",
+     "<gml:MultiPolygon><gml:polygonMember><gml:Polygon><gml:outerBoundaryIs><gml:LinearRing><gml:coordinates>"
+     "0,0 1,0 1,1 0,0</gml:coordinates></gml:LinearRing></gml:outerBoundaryIs></gml:Polygon></gml:polygonMember>"
+     "<gml:polygonMember><gml:Polygon><gml:outerBoundaryIs><gml:LinearRing><gml:coordinates>5,5 6,5 6,6 5,5"
+     "</gml:coordinates></gml:LinearRing></gml:outerBoundaryIs></gml:Polygon></gml:polygonMember>"
+     "</gml:MultiPolygon>",
+     "<gml:MultiSurface><gml:surfaceMember><gml:Polygon><gml:exterior><gml:LinearRing><gml:posList>"
+     "0 0 1 0 1 1 0 0</gml:posList></gml:LinearRing></gml:exterior></gml:Polygon></gml:surfaceMember>"
+     "<gml:surfaceMember><gml:Polygon><gml:exterior><gml:LinearRing><gml:posList>5 5 6 5 6 6 5 5</gml:posList>"
+     "</gml:LinearRing></gml:exterior></gml:Polygon></gml:surfaceMember></gml:MultiSurface>"},
+    {"GEOMETRYCOLLECTION (POINT (1 2),LINESTRING (0 0,1 1))",
+     "<MultiGeometry><Point><coordinates>1,2</coordinates></Point><LineString><coordinates>0,0 1,1"
+     "</coordinates></LineString></MultiGeometry>",
+     "<gml:MultiGeometry><gml:geometryMember><gml:Point><gml:coordinates>1,2</gml:coordinates></gml:Point>"
+     "</gml:geometryMember><gml:geometryMember><gml:LineString><gml:coordinates>0,0 1,1</gml:coordinates>"
+     "</gml:LineString></gml:geometryMember></gml:MultiGeometry>",
+     "<gml:MultiGeometry><gml:geometryMember><gml:Point><gml:pos>1 2</gml:pos></gml:Point></gml:geometryMember>"
+     "<gml:geometryMember><gml:LineString><gml:posList>0 0 1 1</gml:posList></gml:LineString>"
+     "</gml:geometryMember></gml:MultiGeometry>"},
+};
+
+/// Read the \a n features of \a wkts with their properties, then the end
+/// of the document
+static void
+check_xml_features(lwgeom_xml_reader *r, const char *const *wkts, size_t n, int kml, const char *what)
+{
+	char props[256], expected[256];
+	for (size_t i = 0; r && i < n; ++i)
+	{
+		LW_SGO *sgo = NULL;
+		if (!lwgeom_xml_reader_next(r, &sgo) || !sgo)
+		{
+			check(0, what, wkts[i], NULL);
+			return;
+		}
+		sgo_props(sgo, props, sizeof(props));
+		if (kml)
+			snprintf(expected, sizeof(expected), "name=c%zu;i=%zu;", i, i);
+		else
+			snprintf(expected, sizeof(expected), "i=%zu;", i);
+		check(strcmp(props, expected) == 0, what, expected, props);
+		check_wkt(sgo->geom, wkts[i], what);
+		sgo->geom = NULL;
+		lwgeom_sgo_free(sgo);
+	}
+	LW_SGO *sgo = NULL;
+	check(r && lwgeom_xml_reader_next(r, &sgo) && !sgo, what, "end of the document", NULL);
+	lwgeom_sgo_free(sgo);
+}
+
+/// Read \a doc whole, from a file and through sources cutting it at every
+/// few bytes
+static void
+check_xml_document(lwgeom_xml_dialect dialect, const test_buffer *doc, const char *const *wkts, size_t n)
+{
+	int kml = dialect == LWGEOM_XML_KML;
+	lwgeom_xml_reader *r = lwgeom_xml_reader_mem(dialect, doc->data, doc->len);
+	check_xml_features(r, wkts, n, kml, kml ? "kml mem" : "gml mem");
+	lwgeom_xml_reader_free(r);
+
+	static const size_t steps[] = {1, 7, 4096};
+	for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); ++k)
+	{
+		chunked_source src = {doc->data, doc->len, 0, steps[k]};
+		r = lwgeom_xml_reader_new(dialect, chunked_read, &src);
+		check_xml_features(r, wkts, n, kml, kml ? "kml chunked" : "gml chunked");
+		lwgeom_xml_reader_free(r);
+	}
+
+	char path[] = "/tmp/lwgeom_xml_XXXXXX";
+	int written = write_temp_file(path, doc);
+	r = written ? lwgeom_xml_reader_open(dialect, path) : NULL;
+	check(r != NULL, kml ? "kml file" : "gml file", path, NULL);
+	check_xml_features(r, wkts, n, kml, kml ? "kml file" : "gml file");
+	lwgeom_xml_reader_free(r);
+	if (written)
+		unlink(path);
+
+	/* A document cut short fails after the features it holds */
+	chunked_source src = {doc->data, doc->len / 2, 0, 7};
+	r = lwgeom_xml_reader_new(dialect, chunked_read, &src);
+	LW_SGO *sgo = NULL;
+	int ok = LW_TRUE;
+	while (r && (ok = lwgeom_xml_reader_next(r, &sgo)) && sgo)
+		lwgeom_sgo_free(sgo);
+	check(r && !ok, kml ? "kml truncated" : "gml truncated", "failure", "success");
+	lwgeom_xml_reader_free(r);
+}
+
+/// Each geometry kind read from KML, GML2 and GML3 alone, then as the
+/// placemarks of a KML document and the features of a GML one, the last
+/// of them a line longer than a block of the reader
+static void
+test_xml(void)
+{
+	size_t ncases = sizeof(xml_cases) / sizeof(xml_cases[0]);
+	for (size_t i = 0; i < ncases; ++i)
+	{
+		const xml_case *c = &xml_cases[i];
+		if (c->kml)
+			check_wkt(lwgeom_read_kml(c->kml, strlen(c->kml)), c->wkt, "kml");
+		if (c->gml2)
+			check_wkt(lwgeom_read_gml2(c->gml2, strlen(c->gml2)), c->wkt, "gml2");
+		if (c->gml3)
+			check_wkt(lwgeom_read_gml3(c->gml3, strlen(c->gml3)), c->wkt, "gml3");
+	}
+
+	test_buffer line = {NULL, 0, 0}, kml_line = {NULL, 0, 0}, gml_line = {NULL, 0, 0};
+	long_line_wkt(&line, 5000);
+	buffer_append(&kml_line, "<LineString><coordinates>");
+	buffer_append(&gml_line, "<gml:LineString><gml:posList>");
+	for (int i = 0; i < 5000; ++i)
+	{
+		char point[32];
+		snprintf(point, sizeof(point), "%d,%d.5 ", i, i % 1000);
+		buffer_append(&kml_line, point);
+		snprintf(point, sizeof(point), "%d %d.5\n", i, i % 1000);
+		buffer_append(&gml_line, point);
+	}
+	test_sink("</coordinates></LineString>", 28, &kml_line);
+	test_sink("</gml:posList></gml:LineString>", 32, &gml_line);
+
+	const char *wkts[16];
+	size_t n = 0;
+	test_buffer kml = {NULL, 0, 0};
+	buffer_append(&kml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	buffer_append(&kml, "<kml xmlns=\"http://www.opengis.net/kml/2.2\"><Document><name>cases</name><Folder>\n");
+	for (size_t i = 0; i <= ncases; ++i)
+	{
+		if (i < ncases && !xml_cases[i].kml)
+			continue;
+		char head[128];
+		snprintf(head,
+			 sizeof(head),
+			 "<Placemark><name>c%zu</name><ExtendedData><Data name=\"i\"><value>%zu</value></Data>"
+			 "</ExtendedData>\n",
+			 n,
+			 n);
+		buffer_append(&kml, head);
+		buffer_append(&kml, i < ncases ? xml_cases[i].kml : kml_line.data);
+		buffer_append(&kml, "</Placemark>\n");
+		wkts[n++] = i < ncases ? xml_cases[i].wkt : line.data;
+	}
+	buffer_append(&kml, "</Folder></Document></kml>\n");
+	check_xml_document(LWGEOM_XML_KML, &kml, wkts, n);
+
+	/* GML2 and GML3 geometries in turn */
+	n = 0;
+	test_buffer gml = {NULL, 0, 0};
+	buffer_append(&gml, "<?xml version=\"1.0\"?>\n<ogr:FeatureCollection xmlns:ogr=\"http://ogr.maptools.org/\"");
+	buffer_append(&gml, " xmlns:gml=\"http://www.opengis.net/gml\">\n<gml:boundedBy><gml:Box><gml:coordinates>");
+	buffer_append(&gml, "-3,0 5000,1000</gml:coordinates></gml:Box></gml:boundedBy>\n");
+	for (size_t i = 0; i <= ncases; ++i)
+	{
+		const char *geom = gml_line.data;
+		if (i < ncases)
+			geom = i % 2 || !xml_cases[i].gml2 ? xml_cases[i].gml3 : xml_cases[i].gml2;
+		char head[128];
+		snprintf(head, sizeof(head), "<gml:featureMember><ogr:cases fid=\"c%zu\"><ogr:i>%zu</ogr:i>", n, n);
+		buffer_append(&gml, head);
+		buffer_append(&gml, "<ogr:geometryProperty>");
+		buffer_append(&gml, geom);
+		buffer_append(&gml, "</ogr:geometryProperty></ogr:cases></gml:featureMember>\n");
+		wkts[n++] = i < ncases ? xml_cases[i].wkt : line.data;
+	}
+	buffer_append(&gml, "</ogr:FeatureCollection>\n");
+	check_xml_document(LWGEOM_XML_GML, &gml, wkts, n);
+
+	free(kml.data);
+	free(gml.data);
+	free(line.data);
+	free(kml_line.data);
+	free(gml_line.data);
+}
+
+/// Copy \a src, release it and check that the copy still reads \a wkt
+static void
+test_clone_of(LWGEOM *src, lwgeom_arena *arena, const char *wkt, const char *what)
+{
+	LWGEOM *clone = src ? lwgeom_clone(src) : NULL;
+	check(clone && !clone->arena && !LWFLAGS_GET_BORROWED(clone->flags), what, wkt, "not owned");
+	check(!clone || lwgeom_is_soa(clone) == lwgeom_is_soa(src), what, wkt, "layout lost");
+	check(!clone || lwgeom_is_quantized(clone) == lwgeom_is_quantized(src), what, wkt, "layout lost");
+	lwgeom_free(src);
+	if (arena)
+		lwgeom_arena_free(arena);
+	check_wkt(clone, wkt, what);
+}
+
+static void
+test_clone(const char *wkt)
+{
+	test_clone_of(read_wkt(wkt), NULL, wkt, "clone");
+
+	LWGEOM *soa = read_wkt(wkt);
+	if (soa && !lwgeom_to_soa(soa))
+		check(0, "clone soa", wkt, "to soa");
+	test_clone_of(soa, NULL, wkt, "clone soa");
+
+	// Every ordinate of the cases is a multiple of 0.25
+	LWBOX extent = {.xmin = -10, .xmax = 10, .ymin = -10, .ymax = 10};
+	LWQUANT quant;
+	lwquant_init(&quant, &extent, 0.25);
+	LWGEOM *quantized = read_wkt(wkt);
+	if (quantized && !lwgeom_quantize(quantized, &quant))
+		check(0, "clone quantized", wkt, "quantize");
+	test_clone_of(quantized, NULL, wkt, "clone quantized");
+
+	lwgeom_arena *arena = lwgeom_arena_new(0);
+	test_clone_of(lwgeom_read_wkt_arena(arena, wkt, strlen(wkt)), arena, wkt, "clone arena");
+}
+
+/// The coordinates of a borrowed point or line live in the WKB, which is
+/// released before the copy is written
+static void
+test_clone_borrowed(const char *wkt, size_t shift)
+{
+	LWGEOM *obj = read_wkt(wkt);
+	char *wkb = NULL;
+	size_t len = 0;
+	if (!obj || !lwgeom_write_wkb(obj, 0, &wkb, &len))
+		len = 0;
+	lwgeom_free(obj);
+	// Shifted so that the ordinates are 8 bytes aligned and aliased
+	double *buf = (double *)calloc(len / sizeof(double) + 2, sizeof(double));
+	if (buf && wkb)
+		memcpy((char *)buf + shift, wkb, len);
+	lwfree(wkb);
+	LWGEOM *borrowed = buf ? lwgeom_read_wkb_borrow(NULL, (char *)buf + shift, len) : NULL;
+	check(borrowed && LWFLAGS_GET_BORROWED(borrowed->flags), "clone borrowed", wkt, "copied");
+	LWGEOM *clone = borrowed ? lwgeom_clone(borrowed) : NULL;
+	lwgeom_free(borrowed);
+	if (buf)
+		memset(buf, 0, len / sizeof(double) * sizeof(double));
+	free(buf);
+	check_wkt(clone, wkt, "clone borrowed");
+}
+
+int
+main(void)
+{
+	for (size_t i = 0; i < sizeof(wkt_cases) / sizeof(wkt_cases[0]); ++i)
+	{
+		test_wkt(wkt_cases[i]);
+		test_twkb(wkt_cases[i]);
+		test_serialized(wkt_cases[i]);
+		test_ora(wkt_cases[i], wkt_cases[i]);
+		test_clone(wkt_cases[i]);
+		test_wkb(wkt_cases[i]);
+		test_wkb_buf(wkt_cases[i]);
+	}
+	for (size_t i = 0; i < sizeof(empty_cases) / sizeof(empty_cases[0]); ++i)
+	{
+		test_wkt(empty_cases[i]);
+		test_twkb(empty_cases[i]);
+		test_serialized(empty_cases[i]);
+		test_clone(empty_cases[i]);
+		test_wkb(empty_cases[i]);
+		test_wkb_buf(empty_cases[i]);
+	}
+	test_wkt("MULTIPOINT ((1 2),EMPTY)");
+	test_serialized("MULTIPOINT ((1 2),EMPTY)");
+
+	// Oracle SDO flattens nested collections
+	const char *nested = "GEOMETRYCOLLECTION (POLYGON ((0 0,1 0,1 1,0 0)),GEOMETRYCOLLECTION (POINT (5 6)))";
+	test_wkt(nested);
+	test_twkb(nested);
+	test_serialized(nested);
+	test_ora(nested, "GEOMETRYCOLLECTION (POLYGON ((0 0,1 0,1 1,0 0)),POINT (5 6))");
+	test_clone(nested);
+	test_clone_borrowed("POINT (1 2)", 3);
+	test_clone_borrowed("LINESTRING (0 0,1.5 2.25,-3 4)", 7);
+	test_wkb("MULTIPOINT ((1 2),EMPTY)");
+	test_wkb(nested);
+	test_wkb_buf(nested);
+	test_wkb_batch(wkt_cases, sizeof(wkt_cases) / sizeof(wkt_cases[0]));
+	// Byte order, type and count come before the points
+	test_wkb_borrow("POINT (1 2)", 3);
+	test_wkb_borrow("LINESTRING (0 0,1.5 2.25,-3 4)", 7);
+	test_geojson_reader(wkt_cases, sizeof(wkt_cases) / sizeof(wkt_cases[0]));
+	test_geojson_writer(wkt_cases, sizeof(wkt_cases) / sizeof(wkt_cases[0]));
+	test_xml();
+	// With Z the box has 6 values, bounds are rounded outwards, positions to the nearest
+	test_geojson_bbox("POINT Z (1 2 3)", -1, "{\"type\":\"Point\",\"bbox\":[1,2,3,1,2,3],\"coordinates\":[1,2,3]}");
+	test_geojson_bbox("LINESTRING (0.123 -0.456,1.001 2.999)",
+			  2,
+			  "{\"type\":\"LineString\",\"bbox\":[0.12,-0.46,1.01,3],"
+			  "\"coordinates\":[[0.12,-0.46],[1,3]]}");
+	test_geojson_bbox("POLYGON Z ((0 0 -1.21,1.04 0 2.01,1 1 0.5,0 0 -1.21))",
+			  1,
+			  "{\"type\":\"Polygon\",\"bbox\":[0,0,-1.3,1.1,1,2.1],"
+			  "\"coordinates\":[[[0,0,-1.2],[1,0,2],[1,1,0.5],[0,0,-1.2]]]}");
+	test_geojson_bbox("MULTIPOINT Z ((1 2 3),(4 5 -6))",
+			  -1,
+			  "{\"type\":\"MultiPoint\",\"bbox\":[1,2,-6,4,5,3],\"coordinates\":[[1,2,3],[4,5,-6]]}");
+	test_geojson_bbox("POINT EMPTY", -1, "{\"type\":\"Point\",\"coordinates\":[]}");
+
+	for (size_t i = 0; i < sizeof(arrow_cases) / sizeof(arrow_cases[0]); ++i)
+		test_arrow(arrow_cases[i], 3);
+	// GeoArrow has no mixed arrays, the batch stays with the caller
+	LWGEOM_BATCH *mixed = lwgeom_batch_new(LW_FALSE, LW_FALSE);
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+	check(mixed && lwgeom_batch_append_wkt(mixed, "POINT (1 2)", 11) &&
+		  lwgeom_batch_append_wkt(mixed, "LINESTRING (0 0,1 1)", 20) &&
+		  !lwgeom_batch_to_arrow(mixed, &schema, &array),
+	      "arrow mixed",
+	      "failure",
+	      "success");
+	lwgeom_batch_free(mixed);
+
+	// Exterior rings are written counterclockwise, interior ones clockwise
+	test_ora("POLYGON ((0 0,0 10,10 10,10 0,0 0),(2 2,4 2,4 4,2 4,2 2))",
+		 "POLYGON ((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))");
+
+	// The orientation of an oriented point is not a point
+	int point_info[] = {1, 1, 1, 3, 1, 0};
+	double point_ord[] = {10, 20, 0.6, 0.8};
+	test_ora_sdo(2001, point_info, 6, point_ord, 4, "POINT (10 20)");
+	int mpoint_info[] = {1, 1, 1, 3, 1, 0, 5, 1, 1, 7, 1, 0};
+	double mpoint_ord[] = {1, 2, 1, 0, 3, 4, 0, 1};
+	test_ora_sdo(2005, mpoint_info, 12, mpoint_ord, 8, "MULTIPOINT ((1 2),(3 4))");
+
+	return test_summary();
+}
@@ -0,0 +1,347 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Shapefile reader: records by index through the .shx and by walking the
+ * .shp, the box prefilter, polygon ring grouping, borrowed coordinates and
+ * the threaded scan. The files are written by the test. */
+
+#include "test_util.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+static void
+put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void
+put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static void
+put_double(uint8_t *p, double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	put_le32(p, (uint32_t)v);
+	put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+/// .shp and .shx being written, both start with room for their header
+typedef struct {
+	test_buffer shp;
+	test_buffer shx;
+	uint32_t count;
+	int ok;
+} shp_file;
+
+static void
+shp_file_init(shp_file *f)
+{
+	uint8_t header[100] = {0};
+	memset(f, 0, sizeof(*f));
+	f->ok = test_sink((const char *)header, sizeof(header), &f->shp) &&
+		test_sink((const char *)header, sizeof(header), &f->shx);
+}
+
+/// Append a record, \a content of \a len bytes
+static void
+shp_file_record(shp_file *f, const uint8_t *content, size_t len)
+{
+	uint8_t head[8], index[8];
+	put_be32(head, ++f->count);
+	put_be32(head + 4, (uint32_t)(len / 2));
+	put_be32(index, (uint32_t)(f->shp.len / 2));
+	put_be32(index + 4, (uint32_t)(len / 2));
+	f->ok = f->ok && test_sink((const char *)head, 8, &f->shp) &&
+		test_sink((const char *)content, len, &f->shp) && test_sink((const char *)index, 8, &f->shx);
+}
+
+/// Fill both headers and write \a base.shp and, when \a with_shx, \a base.shx
+static int
+shp_file_write(shp_file *f, const char *base, int type, const LWBOX *extent, int with_shx)
+{
+	test_buffer *files[] = {&f->shp, &f->shx};
+	const char *suffixes[] = {".shp", ".shx"};
+	for (int k = 0; f->ok && k < 1 + with_shx; ++k)
+	{
+		uint8_t *h = (uint8_t *)files[k]->data;
+		put_be32(h, 9994);
+		put_be32(h + 24, (uint32_t)(files[k]->len / 2));
+		put_le32(h + 28, 1000);
+		put_le32(h + 32, (uint32_t)type);
+		put_double(h + 36, extent->xmin);
+		put_double(h + 44, extent->ymin);
+		put_double(h + 52, extent->xmax);
+		put_double(h + 60, extent->ymax);
+		char path[512];
+		snprintf(path, sizeof(path), "%s%s", base, suffixes[k]);
+		FILE *out = fopen(path, "wb");
+		f->ok = out && fwrite(files[k]->data, 1, files[k]->len, out) == files[k]->len;
+		if (out)
+			f->ok = fclose(out) == 0 && f->ok;
+	}
+	free(f->shp.data);
+	free(f->shx.data);
+	return f->ok;
+}
+
+/// Polygon record of \a nrings closed rings of \a sizes[r] points each
+static void
+shp_file_polygon(shp_file *f, uint32_t nrings, const uint32_t *sizes, const double *xy)
+{
+	uint8_t rec[1024];
+	uint32_t npoints = 0;
+	for (uint32_t r = 0; r < nrings; ++r)
+		npoints += sizes[r];
+	LWBOX box = {.xmin = xy[0], .xmax = xy[0], .ymin = xy[1], .ymax = xy[1]};
+	for (uint32_t i = 0; i < npoints; ++i)
+	{
+		box.xmin = xy[2 * i] < box.xmin ? xy[2 * i] : box.xmin;
+		box.xmax = xy[2 * i] > box.xmax ? xy[2 * i] : box.xmax;
+		box.ymin = xy[2 * i + 1] < box.ymin ? xy[2 * i + 1] : box.ymin;
+		box.ymax = xy[2 * i + 1] > box.ymax ? xy[2 * i + 1] : box.ymax;
+	}
+	put_le32(rec, 5);
+	put_double(rec + 4, box.xmin);
+	put_double(rec + 12, box.ymin);
+	put_double(rec + 20, box.xmax);
+	put_double(rec + 28, box.ymax);
+	put_le32(rec + 36, nrings);
+	put_le32(rec + 40, npoints);
+	uint8_t *p = rec + 44;
+	for (uint32_t r = 0, start = 0; r < nrings; start += sizes[r++], p += 4)
+		put_le32(p, start);
+	for (uint32_t i = 0; i < 2 * npoints; ++i, p += 8)
+		put_double(p, xy[i]);
+	shp_file_record(f, rec, (size_t)(p - rec));
+}
+
+static void
+shp_file_null(shp_file *f)
+{
+	uint8_t rec[4];
+	put_le32(rec, 0);
+	shp_file_record(f, rec, sizeof(rec));
+}
+
+static void
+shp_file_point(shp_file *f, double x, double y)
+{
+	uint8_t rec[20];
+	put_le32(rec, 1);
+	put_double(rec + 4, x);
+	put_double(rec + 12, y);
+	shp_file_record(f, rec, sizeof(rec));
+}
+
+/* Polygons: shells are clockwise and holes counterclockwise. The shell of
+ * record 0 has a hole holding a smaller shell with a hole of its own, the
+ * inner hole lies in both shells and belongs to the smaller one. */
+static const uint32_t nested_sizes[] = {5, 5, 5, 5};
+static const double nested_xy[] = {
+    0, 0, 0, 10, 10, 10, 10, 0, 0, 0, // shell
+    3, 3, 3, 7, 7, 7, 7, 3, 3, 3,     // inner shell
+    1, 1, 9, 1, 9, 9, 1, 9, 1, 1,     // hole of the shell
+    4, 4, 6, 4, 6, 6, 4, 6, 4, 4,     // hole of the inner shell
+};
+static const char *nested_wkt = "MULTIPOLYGON (((0 0,0 10,10 10,10 0,0 0),(1 1,9 1,9 9,1 9,1 1)),"
+				"((3 3,3 7,7 7,7 3,3 3),(4 4,6 4,6 6,4 6,4 4)))";
+static const uint32_t square_sizes[] = {5};
+static const double square_xy[] = {100, 100, 100, 101, 101, 101, 101, 100, 100, 100};
+static const char *square_wkt = "POLYGON ((100 100,100 101,101 101,101 100,100 100))";
+
+static void
+test_polygons(const char *base)
+{
+	shp_file f;
+	shp_file_init(&f);
+	shp_file_polygon(&f, 4, nested_sizes, nested_xy);
+	shp_file_null(&f);
+	shp_file_polygon(&f, 1, square_sizes, square_xy);
+	LWBOX extent = {.xmin = 0, .xmax = 101, .ymin = 0, .ymax = 101};
+	char path[512], shx[512];
+	snprintf(path, sizeof(path), "%s.shp", base);
+	snprintf(shx, sizeof(shx), "%s.shx", base);
+	lwgeom_shp_reader *r = shp_file_write(&f, base, 5, &extent, LW_TRUE) ? lwgeom_shp_reader_open(path) : NULL;
+	check(r != NULL, "shp open", path, NULL);
+	if (!r)
+		return;
+	check(lwgeom_shp_reader_count(r) == 3, "shp count", "3", NULL);
+	LWBOX box;
+	lwgeom_shp_reader_extent(r, &box);
+	check(box.xmax == 101 && box.ymax == 101, "shp extent", "0 0 101 101", NULL);
+
+	/* Records by index, in any order */
+	LWGEOM *obj = NULL;
+	check(lwgeom_shp_reader_get(r, NULL, 2, NULL, 0, &obj), "shp get", square_wkt, NULL);
+	check_wkt(obj, square_wkt, "shp get");
+	check(lwgeom_shp_reader_get(r, NULL, 0, NULL, 0, &obj), "shp get", nested_wkt, NULL);
+	check_wkt(obj, nested_wkt, "shp ring grouping");
+	check(lwgeom_shp_reader_get(r, NULL, 1, NULL, 0, &obj) && !obj, "shp null shape", "NULL", "geometry");
+	check(!lwgeom_shp_reader_get(r, NULL, 3, NULL, 0, &obj) && !obj, "shp out of range", "failure", "success");
+	check(!lwgeom_shp_reader_bbox(r, 1, &box), "shp null bbox", "failure", "success");
+	check(lwgeom_shp_reader_bbox(r, 2, &box) && box.xmin == 100 && box.ymax == 101, "shp bbox", "square", NULL);
+
+	/* The box prefilter skips records without decoding them */
+	LWBOX filter = {.xmin = 50, .xmax = 150, .ymin = 50, .ymax = 150};
+	check(lwgeom_shp_reader_get(r, NULL, 0, &filter, 0, &obj) && !obj, "shp filter", "NULL", "geometry");
+	check(lwgeom_shp_reader_get(r, NULL, 2, &filter, 0, &obj), "shp filter", square_wkt, NULL);
+	check_wkt(obj, square_wkt, "shp filter");
+
+	/* Aligned XY rings are borrowed from the mapping, with or without an
+	 * arena. The points of record 2 are 4 bytes off and get copied. */
+	check(lwgeom_shp_reader_get(r, NULL, 0, NULL, LWGEOM_SHP_BORROW, &obj), "shp borrow", nested_wkt, NULL);
+	check(obj && LWFLAGS_GET_BORROWED(obj->geoms[1]->geoms[1]->flags), "shp borrow", "borrowed", "copied");
+	check_wkt(obj, nested_wkt, "shp borrow");
+	check(lwgeom_shp_reader_get(r, NULL, 0, NULL, 0, &obj), "shp copy", nested_wkt, NULL);
+	check(obj && !LWFLAGS_GET_BORROWED(obj->geoms[1]->geoms[1]->flags), "shp copy", "copied", "borrowed");
+	check_wkt(obj, nested_wkt, "shp copy");
+	check(lwgeom_shp_reader_get(r, NULL, 2, NULL, LWGEOM_SHP_BORROW, &obj), "shp unaligned", square_wkt, NULL);
+	check(obj && !LWFLAGS_GET_BORROWED(obj->geoms[0]->flags), "shp unaligned", "copied", "borrowed");
+	check_wkt(obj, square_wkt, "shp unaligned");
+	lwgeom_arena *arena = lwgeom_arena_new(0);
+	check(lwgeom_shp_reader_get(r, arena, 0, NULL, LWGEOM_SHP_BORROW, &obj), "shp borrow arena", nested_wkt, NULL);
+	check(obj && obj->arena == arena && LWFLAGS_GET_BORROWED(obj->geoms[0]->geoms[0]->flags),
+	      "shp borrow arena",
+	      "borrowed",
+	      "copied");
+	check_wkt(obj, nested_wkt, "shp borrow arena");
+	lwgeom_arena_free(arena);
+	lwgeom_shp_reader_free(r);
+	unlink(path);
+	unlink(shx);
+}
+
+/* Points: enough records for several scanning threads */
+#define NPOINTS 10000
+
+typedef struct {
+	int records;
+	int wrong;
+	uint64_t index_sum;
+} scan_result;
+
+static int
+scan_point(const LWGEOM *obj, uint32_t index, void *data)
+{
+	scan_result *s = (scan_result *)data;
+	int wrong = obj->type != POINTTYPE || lwgeom_get_x(obj, 0) != index % 100 ||
+		    lwgeom_get_y(obj, 0) != index / 100;
+	__atomic_fetch_add(&s->records, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->wrong, wrong, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->index_sum, index, __ATOMIC_RELAXED);
+	return LW_SUCCESS;
+}
+
+static int
+scan_stop(const LWGEOM *obj, uint32_t index, void *data)
+{
+	(void)obj;
+	(void)data;
+	return index != 5000;
+}
+
+static void
+test_scan(lwgeom_shp_reader *r, const char *what)
+{
+	char expected[32];
+	for (int nthreads = 1; nthreads <= 4; nthreads += 3)
+	{
+		scan_result s = {0, 0, 0};
+		check(lwgeom_shp_reader_scan(r, NULL, 0, nthreads, scan_point, &s), what, "scan", NULL);
+		snprintf(expected, sizeof(expected), "%d records", NPOINTS);
+		check(s.records == NPOINTS && !s.wrong, what, expected, NULL);
+		check(s.index_sum == (uint64_t)NPOINTS * (NPOINTS - 1) / 2, what, "every index once", NULL);
+
+		// Rows 10 to 19, columns 20 to 29
+		LWBOX filter = {.xmin = 19.5, .xmax = 29.5, .ymin = 9.5, .ymax = 19.5};
+		memset(&s, 0, sizeof(s));
+		check(lwgeom_shp_reader_scan(r, &filter, 0, nthreads, scan_point, &s), what, "filtered scan", NULL);
+		check(s.records == 100 && !s.wrong, what, "100 records", NULL);
+	}
+	check(!lwgeom_shp_reader_scan(r, NULL, 0, 4, scan_stop, NULL), what, "stopped scan fails", "success");
+}
+
+static void
+test_points(const char *base)
+{
+	shp_file f;
+	shp_file_init(&f);
+	for (int i = 0; i < NPOINTS; ++i)
+		shp_file_point(&f, i % 100, i / 100);
+	LWBOX extent = {.xmin = 0, .xmax = 99, .ymin = 0, .ymax = NPOINTS / 100 - 1};
+	char path[512], shx[512];
+	snprintf(path, sizeof(path), "%s.shp", base);
+	snprintf(shx, sizeof(shx), "%s.shx", base);
+	if (!shp_file_write(&f, base, 1, &extent, LW_TRUE))
+	{
+		check(0, "shp write", path, NULL);
+		return;
+	}
+
+	// Through the .shx, then by walking the .shp once it is gone
+	for (int walk = 0; walk < 2; ++walk)
+	{
+		const char *what = walk ? "shp walk" : "shp index";
+		if (walk)
+			unlink(shx);
+		lwgeom_shp_reader *r = lwgeom_shp_reader_open(path);
+		check(r && lwgeom_shp_reader_count(r) == NPOINTS, what, "10000 records", NULL);
+		if (!r)
+			continue;
+		LWGEOM *obj = NULL;
+		check(lwgeom_shp_reader_get(r, NULL, 4321, NULL, 0, &obj), what, "POINT (21 43)", NULL);
+		check_wkt(obj, "POINT (21 43)", what);
+		test_scan(r, what);
+		lwgeom_shp_reader_free(r);
+	}
+	unlink(path);
+}
+
+int
+main(void)
+{
+	char dir[] = "/tmp/lwgeom_shp_XXXXXX";
+	if (!mkdtemp(dir))
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	char base[256];
+	snprintf(base, sizeof(base), "%s/polygons", dir);
+	test_polygons(base);
+	snprintf(base, sizeof(base), "%s/points", dir);
+	test_points(base);
+	rmdir(dir);
+	return test_summary();
+}
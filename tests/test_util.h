@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Checks shared by the tests, each test is a single translation unit */
+
+#ifndef LWGEOM_TEST_UTIL_H
+#define LWGEOM_TEST_UTIL_H
+
+#include "liblwgeom.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+/// Count a failure and report what was expected and what came instead
+static inline void
+check(int ok, const char *what, const char *expected, const char *got)
+{
+	if (ok)
+		return;
+	failures++;
+	fprintf(stderr, "FAIL %s: %s -> %s\n", what, expected, got ? got : "NULL");
+}
+
+static inline LWGEOM *
+read_wkt(const char *wkt)
+{
+	return lwgeom_read_wkt(wkt, strlen(wkt));
+}
+
+/// Compare the WKT of \a obj with \a expected and release \a obj
+static inline void
+check_wkt(LWGEOM *obj, const char *expected, const char *what)
+{
+	char *wkt = NULL;
+	size_t len;
+	if (obj && !lwgeom_write_wkt(obj, &wkt, &len))
+		wkt = NULL;
+	check(wkt && strcmp(wkt, expected) == 0, what, expected, wkt);
+	lwfree(wkt);
+	lwgeom_free(obj);
+}
+
+/// Growable buffer filled by test_sink()
+typedef struct {
+	char *data;
+	size_t len;
+	size_t capacity;
+} test_buffer;
+
+/// lwgeom_sink appending to the test_buffer \a arg
+static inline int
+test_sink(const char *data, size_t len, void *arg)
+{
+	test_buffer *b = (test_buffer *)arg;
+	if (b->len + len > b->capacity)
+	{
+		size_t capacity = b->capacity ? b->capacity : 4096;
+		while (capacity < b->len + len)
+			capacity *= 2;
+		char *mem = (char *)realloc(b->data, capacity);
+		if (!mem)
+			return LW_FAILURE;
+		b->data = mem;
+		b->capacity = capacity;
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return LW_SUCCESS;
+}
+
+/// Exit status of the test
+static inline int
+test_summary(void)
+{
+	if (failures)
+		fprintf(stderr, "%d failures\n", failures);
+	return failures ? 1 : 0;
+}
+
+#endif /* LWGEOM_TEST_UTIL_H */